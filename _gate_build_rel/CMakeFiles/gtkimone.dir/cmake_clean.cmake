@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/gtkimone.dir/main.c.o"
+  "CMakeFiles/gtkimone.dir/main.c.o.d"
+  "gtkimone"
+  "gtkimone.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/gtkimone.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/gtkimone_bench.dir/tools/bench.c.o"
+  "CMakeFiles/gtkimone_bench.dir/tools/bench.c.o.d"
+  "gtkimone_bench"
+  "gtkimone_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/gtkimone_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/gtkimone_headless.dir/tools/headless.c.o"
+  "CMakeFiles/gtkimone_headless.dir/tools/headless.c.o.d"
+  "gtkimone_headless"
+  "gtkimone_headless.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/gtkimone_headless.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
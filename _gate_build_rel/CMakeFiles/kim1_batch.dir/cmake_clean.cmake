@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kim1_batch.dir/tools/kim1_batch.c.o"
+  "CMakeFiles/kim1_batch.dir/tools/kim1_batch.c.o.d"
+  "kim1_batch"
+  "kim1_batch.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/kim1_batch.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/clk_test.dir/clk_test.c.o"
+  "CMakeFiles/clk_test.dir/clk_test.c.o.d"
+  "clk_test"
+  "clk_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/clk_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
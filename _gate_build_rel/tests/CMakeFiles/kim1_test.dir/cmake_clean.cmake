@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kim1_test.dir/kim1_test.c.o"
+  "CMakeFiles/kim1_test.dir/kim1_test.c.o.d"
+  "kim1_test"
+  "kim1_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/kim1_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
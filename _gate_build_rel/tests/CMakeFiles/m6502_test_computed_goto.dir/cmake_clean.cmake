@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/m6502_test_computed_goto.dir/m6502_test.c.o"
+  "CMakeFiles/m6502_test_computed_goto.dir/m6502_test.c.o.d"
+  "m6502_test_computed_goto"
+  "m6502_test_computed_goto.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/m6502_test_computed_goto.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
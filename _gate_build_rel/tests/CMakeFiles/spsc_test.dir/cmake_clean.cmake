@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/spsc_test.dir/spsc_test.c.o"
+  "CMakeFiles/spsc_test.dir/spsc_test.c.o.d"
+  "spsc_test"
+  "spsc_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/spsc_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
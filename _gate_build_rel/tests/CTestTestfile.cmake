@@ -0,0 +1,114 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_gate_build_rel/tests
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(m6502_decimal "/root/repo/_gate_build_rel/tests/m6502_test" "decimal")
+set_tests_properties(m6502_decimal PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;34;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_decimal_bcd_tables "/root/repo/_gate_build_rel/tests/m6502_test_bcd_tables" "decimal")
+set_tests_properties(m6502_decimal_bcd_tables PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;35;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_decimal_computed_goto "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "decimal")
+set_tests_properties(m6502_decimal_computed_goto PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;36;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_0 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "0" "8")
+set_tests_properties(m6502_opcodes_0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_0 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "0" "8")
+set_tests_properties(m6502_opcodes_computed_goto_0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_1 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "1" "8")
+set_tests_properties(m6502_opcodes_1 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_1 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "1" "8")
+set_tests_properties(m6502_opcodes_computed_goto_1 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_2 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "2" "8")
+set_tests_properties(m6502_opcodes_2 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_2 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "2" "8")
+set_tests_properties(m6502_opcodes_computed_goto_2 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_3 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "3" "8")
+set_tests_properties(m6502_opcodes_3 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_3 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "3" "8")
+set_tests_properties(m6502_opcodes_computed_goto_3 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_4 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "4" "8")
+set_tests_properties(m6502_opcodes_4 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_4 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "4" "8")
+set_tests_properties(m6502_opcodes_computed_goto_4 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_5 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "5" "8")
+set_tests_properties(m6502_opcodes_5 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_5 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "5" "8")
+set_tests_properties(m6502_opcodes_computed_goto_5 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_6 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "6" "8")
+set_tests_properties(m6502_opcodes_6 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_6 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "6" "8")
+set_tests_properties(m6502_opcodes_computed_goto_6 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_7 "/root/repo/_gate_build_rel/tests/m6502_test" "opcodes" "7" "8")
+set_tests_properties(m6502_opcodes_7 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_opcodes_computed_goto_7 "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "opcodes" "7" "8")
+set_tests_properties(m6502_opcodes_computed_goto_7 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;40;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_functional "/root/repo/_gate_build_rel/tests/m6502_test" "program" "/root/repo/tests/data/6502_functional_test.bin")
+set_tests_properties(m6502_functional PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;42;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(m6502_functional_computed_goto "/root/repo/_gate_build_rel/tests/m6502_test_computed_goto" "program" "/root/repo/tests/data/6502_functional_test.bin")
+set_tests_properties(m6502_functional_computed_goto PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;43;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_trace_scan "/root/repo/_gate_build_rel/tests/kim1_test" "trace" "scan")
+set_tests_properties(kim1_trace_scan PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;46;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_run_scan "/root/repo/_gate_build_rel/tests/kim1_test" "run" "scan")
+set_tests_properties(kim1_run_scan PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;47;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_lockstep_scan "/root/repo/_gate_build_rel/tests/kim1_test" "lockstep" "scan")
+set_tests_properties(kim1_lockstep_scan PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;48;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_trace_timer "/root/repo/_gate_build_rel/tests/kim1_test" "trace" "timer")
+set_tests_properties(kim1_trace_timer PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;46;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_run_timer "/root/repo/_gate_build_rel/tests/kim1_test" "run" "timer")
+set_tests_properties(kim1_run_timer PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;47;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_lockstep_timer "/root/repo/_gate_build_rel/tests/kim1_test" "lockstep" "timer")
+set_tests_properties(kim1_lockstep_timer PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;48;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_trace_tty "/root/repo/_gate_build_rel/tests/kim1_test" "trace" "tty")
+set_tests_properties(kim1_trace_tty PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;46;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_run_tty "/root/repo/_gate_build_rel/tests/kim1_test" "run" "tty")
+set_tests_properties(kim1_run_tty PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;47;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_lockstep_tty "/root/repo/_gate_build_rel/tests/kim1_test" "lockstep" "tty")
+set_tests_properties(kim1_lockstep_tty PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;48;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_trace_modes "/root/repo/_gate_build_rel/tests/kim1_test" "trace" "modes")
+set_tests_properties(kim1_trace_modes PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;46;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_run_modes "/root/repo/_gate_build_rel/tests/kim1_test" "run" "modes")
+set_tests_properties(kim1_run_modes PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;47;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_lockstep_modes "/root/repo/_gate_build_rel/tests/kim1_test" "lockstep" "modes")
+set_tests_properties(kim1_lockstep_modes PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;48;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_replay "/root/repo/_gate_build_rel/tests/kim1_test" "replay")
+set_tests_properties(kim1_replay PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;50;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_rewind "/root/repo/_gate_build_rel/tests/kim1_test" "rewind")
+set_tests_properties(kim1_rewind PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;51;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_snapshot "/root/repo/_gate_build_rel/tests/kim1_test" "snapshot")
+set_tests_properties(kim1_snapshot PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;52;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_fork "/root/repo/_gate_build_rel/tests/kim1_test" "fork")
+set_tests_properties(kim1_fork PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;53;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_teletype "/root/repo/_gate_build_rel/tests/kim1_test" "teletype")
+set_tests_properties(kim1_teletype PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;54;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_tape "/root/repo/_gate_build_rel/tests/kim1_test" "tape")
+set_tests_properties(kim1_tape PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;55;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_idle "/root/repo/_gate_build_rel/tests/kim1_test" "idle")
+set_tests_properties(kim1_idle PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;56;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_watch "/root/repo/_gate_build_rel/tests/kim1_test" "watch")
+set_tests_properties(kim1_watch PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;57;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_image "/root/repo/_gate_build_rel/tests/kim1_test" "image" "/root/repo/_gate_build_rel/tests")
+set_tests_properties(kim1_image PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;58;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_batch "/root/repo/_gate_build_rel/tests/kim1_test" "batch")
+set_tests_properties(kim1_batch PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;59;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_profile "/root/repo/_gate_build_rel/tests/kim1_test" "profile")
+set_tests_properties(kim1_profile PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;60;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(spsc_ring "/root/repo/_gate_build_rel/tests/spsc_test" "ring")
+set_tests_properties(spsc_ring PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;61;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(spsc_triple "/root/repo/_gate_build_rel/tests/spsc_test" "triple")
+set_tests_properties(spsc_triple PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;62;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(clk_pacer "/root/repo/_gate_build_rel/tests/clk_test" "pacer")
+set_tests_properties(clk_pacer PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;63;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(kim1_monitor "/root/repo/_gate_build_rel/tests/kim1_test" "monitor" "/root/repo/tests/data/6530-002.bin" "/root/repo/tests/data/6530-003.bin")
+set_tests_properties(kim1_monitor PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;64;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(headless_tty "/root/repo/_gate_build_rel/gtkimone_headless" "-tty" "-t" "1000000" "/root/repo/tests/headless_tty.ptp")
+set_tests_properties(headless_tty PROPERTIES  PASS_REGULAR_EXPRESSION "^KIM-1
+#[^
+]*
+trapped +[0-9]+ 0215 00 05 00 FD [0-9A-F][0-9A-F]
+\$" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;67;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(headless_tty_cycle "/root/repo/_gate_build_rel/gtkimone_headless" "-x" "-tty" "-t" "1000000" "/root/repo/tests/headless_tty.ptp")
+set_tests_properties(headless_tty_cycle PROPERTIES  PASS_REGULAR_EXPRESSION "^KIM-1
+#[^
+]*
+trapped +[0-9]+ 0215 00 05 00 FD [0-9A-F][0-9A-F]
+\$" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;68;add_test;/root/repo/tests/CMakeLists.txt;0;")
@@ -25,6 +25,57 @@
     ~~~
         Convert micro-seconds to system ticks.
 
+    ~~~C
+    uint64_t clk_now_ns(void)
+    ~~~
+        Return the host's monotonic clock in nanoseconds.
+
+    ## Pacing
+
+    A clk_pacer_t ties the emulated time to the host's wall clock:
+
+    ~~~C
+    clk_pacer_t pacer;
+    clk_pacer_init(&pacer, &(clk_pacer_desc_t){
+        .freq_hz = KIM1_FREQUENCY,
+        .mode = CLK_PACE_REALTIME,
+        .slice_us = 10000,      // optional, default: 10 ms
+    });
+    while (running) {
+        const uint32_t ticks = clk_pacer_next(&pacer);
+        clk_pacer_done(&pacer, kim1_exec(&sys, ticks));     // at 1 MHz, ticks are micro-seconds
+    }
+    ~~~
+
+    clk_pacer_next() sleeps until at least one slice of emulated time is
+    due, and returns the number of ticks due, clk_pacer_done() reports
+    the number of ticks which were actually run (which may be a few
+    more, when the emulator stops at instruction boundaries).
+
+    The due ticks are computed from the host time since the previous
+    call, and the fractional tick which is left over is carried into the
+    next call, so the emulated clock never drifts from the host clock,
+    no matter how long a session runs or how the slices are cut. If the
+    host falls behind by more than clk_pacer_desc_t.max_lag_us (for
+    instance while the process was suspended), the excess is dropped
+    instead of being caught up in one burst (the number of dropped ticks
+    is in clk_pacer_t.dropped). The sleep is a single timed wait until
+    the time the slice is due, not a busy wait.
+
+    The pacing modes are:
+
+    - **CLK_PACE_REALTIME**: run at the emulated system's real speed
+    - **CLK_PACE_MULTIPLE**: run at clk_pacer_desc_t.multiple times the real speed
+    - **CLK_PACE_TURBO**: don't throttle, clk_pacer_next() returns one slice
+      right away
+
+    The mode can be changed at any time with clk_pacer_set_mode(), which
+    restarts the pacing from the current host time.
+
+    Frontends which are driven by their own frame clock can use
+    clk_pacer_update() with their own timestamps, this returns the due
+    ticks without sleeping.
+
     ## zlib/libpng license
 
     Copyright (c) 2018 Andre Weissflog
@@ -49,8 +100,53 @@
 extern "C" {
 #endif
 
+#define CLK_PACER_DEFAULT_SLICE_US (10000)
+#define CLK_PACER_DEFAULT_MAX_LAG_US (100000)
+
+// pacing modes
+typedef enum {
+    CLK_PACE_REALTIME,
+    CLK_PACE_MULTIPLE,
+    CLK_PACE_TURBO,
+} clk_pace_mode_t;
+
+// clk_pacer_init() parameters
+typedef struct {
+    uint64_t freq_hz;           // emulated clock frequency
+    clk_pace_mode_t mode;
+    uint32_t multiple;          // speed factor in CLK_PACE_MULTIPLE mode
+    uint32_t slice_us;          // minimum emulated time per clk_pacer_next() (default: CLK_PACER_DEFAULT_SLICE_US)
+    uint32_t max_lag_us;        // max host lag which is caught up (default: CLK_PACER_DEFAULT_MAX_LAG_US)
+} clk_pacer_desc_t;
+
+// pacer state
+typedef struct {
+    uint64_t freq_hz;
+    clk_pace_mode_t mode;
+    uint32_t multiple;
+    uint32_t slice_ticks;
+    uint64_t max_lag_ticks;
+    uint64_t last_ns;           // host time of the last update
+    uint64_t residue;           // fractional due tick, in 1/1000000000 ticks
+    uint64_t due;               // ticks due since the start
+    uint64_t done;              // ticks run since the start
+    uint64_t dropped;           // due ticks which were dropped because the host fell behind
+} clk_pacer_t;
+
 // helper func to convert micro_seconds into ticks
 uint32_t clk_us_to_ticks(uint64_t freq_hz, uint32_t micro_seconds);
+// return the host's monotonic clock in nanoseconds
+uint64_t clk_now_ns(void);
+// initialize a pacer, the pacing starts at the current host time
+void clk_pacer_init(clk_pacer_t* pacer, const clk_pacer_desc_t* desc);
+// change the pacing mode (multiple is only used in CLK_PACE_MULTIPLE mode)
+void clk_pacer_set_mode(clk_pacer_t* pacer, clk_pace_mode_t mode, uint32_t multiple);
+// advance the pacer to a host time, returns the number of due ticks (doesn't sleep)
+uint32_t clk_pacer_update(clk_pacer_t* pacer, uint64_t now_ns);
+// sleep until at least one slice is due, returns the number of due ticks
+uint32_t clk_pacer_next(clk_pacer_t* pacer);
+// report the number of ticks which were actually run
+void clk_pacer_done(clk_pacer_t* pacer, uint32_t ticks);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -63,7 +159,119 @@ uint32_t clk_us_to_ticks(uint64_t freq_hz, uint32_t micro_seconds);
     #define CHIPS_ASSERT(c) assert(c)
 #endif
 
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
 uint32_t clk_us_to_ticks(uint64_t freq_hz, uint32_t micro_seconds) {
     return (uint32_t) ((freq_hz * micro_seconds) / 1000000);
 }
+
+uint64_t clk_now_ns(void) {
+    #if defined(_WIN32)
+        LARGE_INTEGER freq, count;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&count);
+        return (uint64_t) ((count.QuadPart / freq.QuadPart) * 1000000000 + ((count.QuadPart % freq.QuadPart) * 1000000000) / freq.QuadPart);
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+    #endif
+}
+
+static void _clk_sleep_ns(uint64_t ns) {
+    #if defined(_WIN32)
+        Sleep((DWORD)((ns + 999999) / 1000000));
+    #else
+        struct timespec ts = { .tv_sec = (time_t)(ns / 1000000000), .tv_nsec = (long)(ns % 1000000000) };
+        while ((0 != nanosleep(&ts, &ts)) && ((ts.tv_sec > 0) || (ts.tv_nsec > 0)));
+    #endif
+}
+
+// emulated ticks per host second
+static inline uint64_t _clk_pacer_rate(const clk_pacer_t* p) {
+    return p->freq_hz * ((p->mode == CLK_PACE_MULTIPLE) ? p->multiple : 1);
+}
+
+void clk_pacer_init(clk_pacer_t* p, const clk_pacer_desc_t* desc) {
+    CHIPS_ASSERT(p && desc && (desc->freq_hz > 0));
+    CHIPS_ASSERT((desc->mode != CLK_PACE_MULTIPLE) || (desc->multiple > 0));
+    p->freq_hz = desc->freq_hz;
+    p->slice_ticks = clk_us_to_ticks(desc->freq_hz, desc->slice_us ? desc->slice_us : CLK_PACER_DEFAULT_SLICE_US);
+    if (0 == p->slice_ticks) {
+        p->slice_ticks = 1;
+    }
+    p->max_lag_ticks = clk_us_to_ticks(desc->freq_hz, desc->max_lag_us ? desc->max_lag_us : CLK_PACER_DEFAULT_MAX_LAG_US);
+    if (p->max_lag_ticks < p->slice_ticks) {
+        p->max_lag_ticks = p->slice_ticks;
+    }
+    p->dropped = 0;
+    clk_pacer_set_mode(p, desc->mode, desc->multiple);
+}
+
+void clk_pacer_set_mode(clk_pacer_t* p, clk_pace_mode_t mode, uint32_t multiple) {
+    CHIPS_ASSERT(p && ((mode != CLK_PACE_MULTIPLE) || (multiple > 0)));
+    p->mode = mode;
+    p->multiple = multiple;
+    p->last_ns = clk_now_ns();
+    p->residue = 0;
+    p->due = 0;
+    p->done = 0;
+}
+
+uint32_t clk_pacer_update(clk_pacer_t* p, uint64_t now_ns) {
+    CHIPS_ASSERT(p);
+    if (p->mode == CLK_PACE_TURBO) {
+        p->last_ns = now_ns;
+        return p->slice_ticks;
+    }
+    uint64_t delta_ns = (now_ns > p->last_ns) ? (now_ns - p->last_ns) : 0;
+    p->last_ns = now_ns;
+    // anything beyond the max lag is dropped anyway, this also keeps the product below from overflowing
+    const uint64_t rate = _clk_pacer_rate(p);
+    const uint64_t max_delta_ns = ((p->max_lag_ticks + p->slice_ticks) * 1000000000) / rate + 1;
+    if (delta_ns > max_delta_ns) {
+        const uint64_t skipped_ns = delta_ns - max_delta_ns;
+        p->dropped += (skipped_ns / 1000000000) * rate + ((skipped_ns % 1000000000) * rate) / 1000000000;
+        delta_ns = max_delta_ns;
+    }
+    const uint64_t num = delta_ns * rate + p->residue;
+    p->due += num / 1000000000;
+    p->residue = num % 1000000000;
+    // the ticks which were run ahead (instruction overshoot) are subtracted from the next slice
+    if (p->done >= p->due) {
+        return 0;
+    }
+    if ((p->due - p->done) > p->max_lag_ticks) {
+        p->dropped += (p->due - p->done) - p->max_lag_ticks;
+        p->done = p->due - p->max_lag_ticks;
+    }
+    return (uint32_t)(p->due - p->done);
+}
+
+uint32_t clk_pacer_next(clk_pacer_t* p) {
+    CHIPS_ASSERT(p);
+    uint32_t ticks = clk_pacer_update(p, clk_now_ns());
+    const uint64_t target = p->done + p->slice_ticks;
+    if ((p->mode != CLK_PACE_TURBO) && (p->due < target)) {
+        // sleep until a whole slice is due, taking the fractional tick which is already due into account
+        const uint64_t rate = _clk_pacer_rate(p);
+        const uint64_t missing = (target - p->due) * 1000000000 - p->residue;
+        _clk_sleep_ns((missing + rate - 1) / rate);
+        ticks = clk_pacer_update(p, clk_now_ns());
+    }
+    return ticks;
+}
+
+void clk_pacer_done(clk_pacer_t* p, uint32_t ticks) {
+    CHIPS_ASSERT(p);
+    if (p->mode == CLK_PACE_TURBO) {
+        return;
+    }
+    p->done += ticks;
+}
 #endif
\ No newline at end of file
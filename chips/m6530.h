@@ -26,72 +26,109 @@
     *    A9 ---> |           | <--> PA7   *
     *            |           |            *
     *   RS0 ---> |           | <--> PB0   *
-    *            |           | ...        *
-    *            |           | <--> PB4   *
+    *   CS1 ---> |           | ...        *
+    *   CS2 ---> |           | <--> PB7   *
+    *            |   m6530   |            *
     *   DB0 <--> |           |            *
-    *        ... |   m6530   | <--- CS2 } *
-    *   DB7 <--> |           | <--> PB5 } *
+    *        ... |           |            *
+    *   DB7 <--> |           |            *
     *            |           |            *
-    *    RW ---> |           | <--- CS1 } *
-    *            |           | <--> PB6 } *
-    * (RES) ---> |           |            *
-    *            |           | ---> IRQ } *
-    *            |           | <--> PB7 } *
+    *    RW ---> |           |            *
+    *   RES ---> |           | ---> IRQ   *
     *            +-----------+            *
     ***************************************
 
+    On a real 6530, CS1, CS2 and IRQ are mask-programmable alternate
+    functions of PB5..PB7, and the ROM/RAM/IO chip select decoding is
+    part of the mask. The emulation has dedicated pins for those instead.
+
     ## How to use
 
-    Call m6522_init() to initialize a new m6522_t instance (note that
-    there is no m6522_desc_t struct:
+    Call m6530_init() to initialize a new m6530_t instance (note that
+    there is no m6530_desc_t struct):
 
     ~~~C
-    m6530_t rriot1;
-    m6530_init(&rriot1);
+    m6530_t rriot;
+    m6530_init(&rriot);
     ~~~
 
-    In each system tick, call the m6522_tick() function, this takes
+    In each system tick, call the m6530_tick() function, this takes
     an input pin mask, and returns a (potentially modified) output
     pin mask.
 
-    Depending on the emulated system, the I/O and control pins
-    PA0..PA7, PB0..PB7, CA1, CA2, CB1 and CB2 must be set as needed
-    in the input pin mask (these are often connected to the keyboard
-    matrix or peripheral devices).
-
-    If the CPU wants to read or write VIA registers, set the CS1 pin
-    to 1 (keep CS2 at 0), and set the RW pin depending on whether it's
-    a register read (RW=1 means read, RW=0 means write, just like
-    on the M6502 CPU), and the RS0..RS3 register select pins
-    (usually identical with the shared address bus pins A0..A4).
-
-    Note that the pin positions for RS0..RS3 and RW are shared with the
-    respective M6502 pins.
-
-    On return m6522_tick() returns a modified pin mask where the following
+    The port input pins PA0..PA7 and PB0..PB7 must be set as needed in
+    the input pin mask, they are only sampled when the CPU reads a port
+    data register.
+
+    If the CPU wants to access the RRIOT, set the CS1 pin to 1 (keep CS2
+    at 0), and set the RW pin depending on whether it's a read or write
+    access (RW=1 means read, RW=0 means write, just like on the M6502
+    CPU). The address bus pins select what's accessed:
+
+    - A7=1: the 64 bytes of RAM, addressed by A0..A5
+    - A7=0, A2=0: the I/O ports, A0..A1 select the register:
+        - 0: port A data register
+        - 1: port A data direction register
+        - 2: port B data register
+        - 3: port B data direction register
+    - A7=0, A2=1, write: start the interval timer, the data byte is the
+      initial timer value, A0..A1 select the prescaler (1, 8, 64, 1024 clock
+      cycles) and A3 enables the timer interrupt
+    - A7=0, A2=1, read: A0=0 reads the current timer value (and A3 enables
+      or disables the timer interrupt), A0=1 reads the interrupt flag in bit 7
+
+    The 1 KB ROM isn't emulated by the m6530, map it as regular memory
+    in the system emulation, the RS0 pin is ignored.
+
+    Note that the pin positions for A0..A9, D0..D7, RW, IRQ and RES are
+    shared with the respective M6502 pins.
+
+    On return m6530_tick() returns a modified pin mask where the following
     pins might have changed state:
 
     - the IRQ pin (same bit position as M6502_IRQ)
     - the port A I/O pins PA0..PA7
-    - the port A control pins CA1 and CA2
     - the port B I/O pins PB0..PB7
-    - the port B control pins CB1 and CB2
-    - data bus pins D0..D7 if this was a register read function.
+    - data bus pins D0..D7 if this was a read access
 
-    For an example VIA ticking code, checkout the _vic20_tick() function
-    in systems/vic20.h
+    For systems that don't tick the RRIOT each cycle (for instance when running
+    the CPU instruction-by-instruction), the m6530_read() and m6530_write()
+    functions access the registers directly (the port input pins are then taken
+    from m6530_t.pa.inpr and m6530_t.pb.inpr), and m6530_advance() moves the
+    RRIOT forward by a number of clock cycles. m6530_irq() returns the state
+    of the IRQ output, and m6530_irq_tick() the tick at which the IRQ output
+    will go active (this allows a system to schedule the timer interrupt
+    instead of polling m6530_irq() each tick).
 
-    To reset a m6522_t instance, call m6522_reset():
+    To reset a m6530_t instance, call m6530_reset():
 
     ~~~C
-    m6522_reset(&sys->via);
+    m6530_reset(&sys->rriot);
     ~~~
 
-    ## LINKS
+    ## The Interval Timer
+
+    The timer isn't decremented in each tick, instead the start cycle, the
+    initial value and the prescaler are stored when the timer is written,
+    and the current timer value and interrupt flag are computed from the
+    elapsed number of cycles when needed. This means that an idle RRIOT
+    costs next to nothing per tick.
 
-    On timer behaviour when hitting zero:
+    After the timer has counted down through zero, the interrupt flag is set
+    and the timer keeps counting down in each clock cycle (ignoring the
+    prescaler) until the timer is written again. Reading the timer value, or
+    writing a new timer value clears the interrupt flag.
 
-    http://forum.6502.org/viewtopic.php?f=4&t=2901
+    ## Memory Layout
+
+    A m6530_t is aligned to the host cache line size (M6530_CACHE_LINE_SIZE).
+    The port, timer and pin state fits into the first cache line, the 64
+    bytes of RAM are in a separate cache line, so that a system with many
+    RRIOT instances only pulls the RAM into the cache when it is accessed.
+
+    ## LINKS
+
+    http://www.zimmers.net/anonftp/pub/cbm/documents/chipdata/6530.zip
 
     ## zlib/libpng license
 
@@ -113,12 +150,13 @@
 #*/
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdalign.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// address bus pins
+// address bus pins shared with CPU
 #define M6530_PIN_A0    (0)
 #define M6530_PIN_A1    (1)
 #define M6530_PIN_A2    (2)
@@ -129,16 +167,8 @@ extern "C" {
 #define M6530_PIN_A7    (7)
 #define M6530_PIN_A8    (8)
 #define M6530_PIN_A9    (9)
-#define M6530_PIN_RS0   (10)      // RAM Select 
-#define M6530_PIN_CS1   (42)      // Chip Select 1 (same as PB6)
-#define M6530_PIN_CS2   (41)      // Chip Select 2 (same as PB5) 
-
-// control pins
-#define M6530_PIN_RW    (11)      // in: memory read or write access
-#define M6530_PIN_IRQ   (43)      // out: interrupt (same as PB7)
-#define M6530_PIN_RES   (12)      // request RESET
 
-// data bus pins
+// data bus pins shared with CPU
 #define M6530_PIN_D0    (16)
 #define M6530_PIN_D1    (17)
 #define M6530_PIN_D2    (18)
@@ -148,26 +178,35 @@ extern "C" {
 #define M6530_PIN_D6    (22)
 #define M6530_PIN_D7    (23)
 
+// control pins shared with CPU
+#define M6530_PIN_RW    (24)      // same as M6502_RW
+#define M6530_PIN_IRQ   (26)      // same as M6502_IRQ
+#define M6530_PIN_RES   (30)      // same as M6502_RES
+
+// control pins
+#define M6530_PIN_CS1   (40)      // chip-select 1, to select: CS1 high, CS2 low
+#define M6530_PIN_CS2   (41)      // chip-select 2
+#define M6530_PIN_RS0   (42)      // ROM select (ignored)
+
 // peripheral A port
-#define M6530_PIN_PA0       (24)
-#define M6530_PIN_PA1       (25)
-#define M6530_PIN_PA2       (26)
-#define M6530_PIN_PA3       (27)
-#define M6530_PIN_PA4       (28)
-#define M6530_PIN_PA5       (29)
-#define M6530_PIN_PA6       (30)
-#define M6530_PIN_PA7       (31)
+#define M6530_PIN_PA0       (48)
+#define M6530_PIN_PA1       (49)
+#define M6530_PIN_PA2       (50)
+#define M6530_PIN_PA3       (51)
+#define M6530_PIN_PA4       (52)
+#define M6530_PIN_PA5       (53)
+#define M6530_PIN_PA6       (54)
+#define M6530_PIN_PA7       (55)
 
 // peripheral B port
-#define M6530_PIN_PB0       (32)
-#define M6530_PIN_PB1       (33)
-#define M6530_PIN_PB2       (34)
-#define M6530_PIN_PB3       (35)
-#define M6530_PIN_PB4       (36)
-#define M6530_PIN_PB5       (37)
-#define M6530_PIN_PB6       (38)
-#define M6530_PIN_PB7       (39)
-
+#define M6530_PIN_PB0       (56)
+#define M6530_PIN_PB1       (57)
+#define M6530_PIN_PB2       (58)
+#define M6530_PIN_PB3       (59)
+#define M6530_PIN_PB4       (60)
+#define M6530_PIN_PB5       (61)
+#define M6530_PIN_PB6       (62)
+#define M6530_PIN_PB7       (63)
 
 // pin bit masks
 #define M6530_A0        (1ULL<<M6530_PIN_A0)
@@ -180,10 +219,7 @@ extern "C" {
 #define M6530_A7        (1ULL<<M6530_PIN_A7)
 #define M6530_A8        (1ULL<<M6530_PIN_A8)
 #define M6530_A9        (1ULL<<M6530_PIN_A9)
-#define M6530_RS0       (1ULL<<6530_PIN_RS0)
-#define M6530_CS1       (1ULL<<6530_PIN_CS1)
-#define M6530_CS2       (1ULL<<6530_PIN_CS2)
-#define M6530_RES       (1ULL<<M6530_PIN_RES)
+#define M6530_ADDR_PINS (0x3FFULL)
 #define M6530_D0        (1ULL<<M6530_PIN_D0)
 #define M6530_D1        (1ULL<<M6530_PIN_D1)
 #define M6530_D2        (1ULL<<M6530_PIN_D2)
@@ -195,6 +231,10 @@ extern "C" {
 #define M6530_DB_PINS   (0xFF0000ULL)
 #define M6530_RW        (1ULL<<M6530_PIN_RW)
 #define M6530_IRQ       (1ULL<<M6530_PIN_IRQ)
+#define M6530_RES       (1ULL<<M6530_PIN_RES)
+#define M6530_CS1       (1ULL<<M6530_PIN_CS1)
+#define M6530_CS2       (1ULL<<M6530_PIN_CS2)
+#define M6530_RS0       (1ULL<<M6530_PIN_RS0)
 #define M6530_PA0       (1ULL<<M6530_PIN_PA0)
 #define M6530_PA1       (1ULL<<M6530_PIN_PA1)
 #define M6530_PA2       (1ULL<<M6530_PIN_PA2)
@@ -214,50 +254,44 @@ extern "C" {
 #define M6530_PB7       (1ULL<<M6530_PIN_PB7)
 #define M6530_PB_PINS   (M6530_PB0|M6530_PB1|M6530_PB2|M6530_PB3|M6530_PB4|M6530_PB5|M6530_PB6|M6530_PB7)
 
+// register indices (A0..A1 with A2=0)
+#define M6530_REG_PAD       (0)     /* port A data register */
+#define M6530_REG_PADD      (1)     /* port A data direction register */
+#define M6530_REG_PBD       (2)     /* port B data register */
+#define M6530_REG_PBDD      (3)     /* port B data direction register */
+
+// size of the RRIOT RAM
+#define M6530_RAM_SIZE      (64)
+// host cache line size, the RAM is kept out of the cache line with the I/O and timer state
+#define M6530_CACHE_LINE_SIZE (64)
 
 // I/O port state
 typedef struct {
-    uint8_t inpr;
-    uint8_t outr;
-    uint8_t ddr;
-    uint8_t pins;
-    bool c1_in;
-    bool c1_out;
-    bool c1_triggered;
-    bool c2_in;
-    bool c2_out;
-    bool c2_triggered;
+    uint8_t inpr;       /* input pin state, sampled on data register reads */
+    uint8_t outr;       /* output register */
+    uint8_t ddr;        /* data direction register, bit set means output */
+    uint8_t pins;       /* last port pin state */
 } m6530_port_t;
 
-// timer state
+// interval timer state
 typedef struct {
-    uint16_t latch;     /* 16-bit initial value latch, NOTE: T2 only has an 8-bit latch */
-    uint16_t counter;   /* 16-bit counter */
-    bool t_bit;         /* toggles between true and false when counter underflows */
-    bool t_out;         /* true for 1 cycle when counter underflow */
-    /* merged delay-pipelines:
-        2-cycle 'counter active':   bits 0..7
-        1-cycle 'force load':       bits 8..16
-    */
-    uint16_t pip;
+    uint64_t start;     /* tick when the timer was written */
+    uint64_t irq_tick;  /* tick when the interrupt flag is set, UINT64_MAX if never */
+    uint8_t latch;      /* initial timer value */
+    uint8_t shift;      /* prescaler as shift count (0, 3, 6 or 10) */
+    bool irq_enable;    /* timer interrupt enabled */
 } m6530_timer_t;
 
-// interrupt state (same as m6522_int_t)
-typedef struct {
-    uint8_t ier;            /* interrupt enable register */
-    uint8_t ifr;            /* interrupt flag register */
-    uint16_t pip;
-} m6530_int_t;
-
 // m6530 state
 typedef struct {
-    m6530_port_t pa;
+    // hot: touched by each I/O access and each m6530_tick()
+    alignas(M6530_CACHE_LINE_SIZE) m6530_port_t pa;
     m6530_port_t pb;
-    m6530_timer_t t1;
-    m6530_int_t intr;
-    uint8_t acr;        /* auxilary control register */
-    uint8_t pcr;        /* peripheral control register */
+    m6530_timer_t timer;
+    uint64_t ticks;     /* clock cycle counter, the timer is evaluated relative to this */
     uint64_t pins;
+    // cold: only touched by RAM accesses
+    alignas(M6530_CACHE_LINE_SIZE) uint8_t ram[M6530_RAM_SIZE];
 } m6530_t;
 
 // extract 8-bit data bus from 64-bit pins
@@ -265,15 +299,32 @@ typedef struct {
 // merge 8-bit data bus value into 64-bit pins
 #define M6530_SET_DATA(p,d) {p=(((p)&~0xFF0000ULL)|(((d)<<16)&0xFF0000ULL));}
 // extract port A pins
-#define M6530_GET_PA(p) ((uint8_t)((p)>>24))
+#define M6530_GET_PA(p) ((uint8_t)((p)>>48))
 // extract port B pins
-#define M6530_GET_PB(p) ((uint8_t)((p)>>32))
+#define M6530_GET_PB(p) ((uint8_t)((p)>>56))
 // merge port A pins into pin mask
-#define M6530_SET_PA(p,a) {p=((p)&0xFFFFFFFF00FFFFFFULL)|(((a)&0xFFULL)<<24);}
+#define M6530_SET_PA(p,a) {p=((p)&0xFF00FFFFFFFFFFFFULL)|(((a)&0xFFULL)<<48);}
 // merge port B pins into pin mask
-#define M6530_SET_PB(p,b) {p=((p)&0xFFFFFF00FFFFFFFFULL)|(((b)&0xFFULL)<<32);}
+#define M6530_SET_PB(p,b) {p=((p)&0x00FFFFFFFFFFFFFFULL)|(((b)&0xFFULL)<<56);}
 // merge port A and B pins into pin mask
-#define M6530_SET_PAB(p,a,b) {p=((p)&0xFFFFFF0000FFFFFFULL)|(((a)&0xFFULL)<<24)|(((b)&0xFFULL)<<32);}
+#define M6530_SET_PAB(p,a,b) {p=((p)&0x0000FFFFFFFFFFFFULL)|(((a)&0xFFULL)<<48)|(((b)&0xFFULL)<<56);}
+
+// initialize a new 6530 instance
+void m6530_init(m6530_t* m6530);
+// reset an existing 6530 instance
+void m6530_reset(m6530_t* m6530);
+// tick the m6530
+uint64_t m6530_tick(m6530_t* m6530, uint64_t pins);
+// advance the m6530 by a number of ticks without register access
+void m6530_advance(m6530_t* m6530, uint32_t num_ticks);
+// read a register or RAM byte (addr is A0..A9)
+uint8_t m6530_read(m6530_t* m6530, uint16_t addr);
+// write a register or RAM byte (addr is A0..A9)
+void m6530_write(m6530_t* m6530, uint16_t addr, uint8_t data);
+// return true if the IRQ output is active
+bool m6530_irq(const m6530_t* m6530);
+// return the tick at which the IRQ output goes active, or UINT64_MAX if it won't
+uint64_t m6530_irq_tick(const m6530_t* m6530);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -287,4 +338,152 @@ typedef struct {
     #define CHIPS_ASSERT(c) assert(c)
 #endif
 
+#define _M6530_NO_IRQ (0xFFFFFFFFFFFFFFFFULL)
+
+static void _m6530_init_port(m6530_port_t* p) {
+    p->inpr = 0xFF;
+    p->outr = 0;
+    p->ddr = 0;
+    p->pins = 0xFF;
+}
+
+void m6530_init(m6530_t* c) {
+    CHIPS_ASSERT(c);
+    memset(c, 0, sizeof(*c));
+    m6530_reset(c);
+}
+
+/*
+    The RESET input clears the data and data direction registers (all
+    port pins are inputs) and disables the timer interrupt. The RAM
+    and the timer value are not affected.
+*/
+void m6530_reset(m6530_t* c) {
+    CHIPS_ASSERT(c);
+    _m6530_init_port(&c->pa);
+    _m6530_init_port(&c->pb);
+    c->timer.irq_enable = false;
+    c->timer.irq_tick = _M6530_NO_IRQ;
+    c->pins = 0;
+}
+
+void m6530_advance(m6530_t* c, uint32_t num_ticks) {
+    c->ticks += num_ticks;
+}
+
+bool m6530_irq(const m6530_t* c) {
+    return c->timer.irq_enable && (c->ticks >= c->timer.irq_tick);
+}
+
+uint64_t m6530_irq_tick(const m6530_t* c) {
+    return c->timer.irq_enable ? c->timer.irq_tick : _M6530_NO_IRQ;
+}
+
+/*--- interval timer ---*/
+static uint8_t _m6530_timer_value(const m6530_timer_t* t, uint64_t ticks) {
+    const uint64_t elapsed = ticks - t->start;
+    const uint64_t zero = ((uint64_t)t->latch + 1) << t->shift;
+    if (elapsed < zero) {
+        return t->latch - (uint8_t)(elapsed >> t->shift);
+    }
+    else {
+        // past zero, count down once per clock cycle
+        return (uint8_t)(0xFF - (elapsed - zero));
+    }
+}
+
+static void _m6530_timer_write(m6530_timer_t* t, uint64_t ticks, uint16_t addr, uint8_t data) {
+    static const uint8_t shifts[4] = { 0, 3, 6, 10 };
+    t->start = ticks;
+    t->latch = data;
+    t->shift = shifts[addr & 3];
+    t->irq_enable = 0 != (addr & (1<<3));
+    t->irq_tick = ticks + (((uint64_t)data + 1) << t->shift);
+}
+
+static uint8_t _m6530_timer_read(m6530_timer_t* t, uint64_t ticks, uint16_t addr) {
+    if (addr & 1) {
+        // interrupt flag in bit 7, reading the flag doesn't clear it
+        return (ticks >= t->irq_tick) ? 0x80 : 0x00;
+    }
+    else {
+        // reading the timer clears the interrupt flag, A3 enables/disables the interrupt
+        t->irq_enable = 0 != (addr & (1<<3));
+        if (ticks >= t->irq_tick) {
+            t->irq_tick = _M6530_NO_IRQ;
+        }
+        return _m6530_timer_value(t, ticks);
+    }
+}
+
+/*--- register access ---*/
+static inline uint8_t _m6530_port_pins(const m6530_port_t* p) {
+    return (p->inpr & ~p->ddr) | (p->outr & p->ddr);
+}
+
+uint8_t m6530_read(m6530_t* c, uint16_t addr) {
+    if (addr & (1<<7)) {
+        return c->ram[addr & (M6530_RAM_SIZE - 1)];
+    }
+    if (addr & (1<<2)) {
+        return _m6530_timer_read(&c->timer, c->ticks, addr);
+    }
+    switch (addr & 3) {
+        case M6530_REG_PAD:     return _m6530_port_pins(&c->pa);
+        case M6530_REG_PADD:    return c->pa.ddr;
+        case M6530_REG_PBD:     return _m6530_port_pins(&c->pb);
+        default:                return c->pb.ddr;
+    }
+}
+
+void m6530_write(m6530_t* c, uint16_t addr, uint8_t data) {
+    if (addr & (1<<7)) {
+        c->ram[addr & (M6530_RAM_SIZE - 1)] = data;
+        return;
+    }
+    if (addr & (1<<2)) {
+        _m6530_timer_write(&c->timer, c->ticks, addr, data);
+        return;
+    }
+    switch (addr & 3) {
+        case M6530_REG_PAD:     c->pa.outr = data; break;
+        case M6530_REG_PADD:    c->pa.ddr = data; break;
+        case M6530_REG_PBD:     c->pb.outr = data; break;
+        default:                c->pb.ddr = data; break;
+    }
+    c->pa.pins = _m6530_port_pins(&c->pa);
+    c->pb.pins = _m6530_port_pins(&c->pb);
+}
+
+uint64_t m6530_tick(m6530_t* c, uint64_t pins) {
+    if (pins & M6530_RES) {
+        m6530_reset(c);
+    }
+    if ((pins & (M6530_CS1|M6530_CS2)) == M6530_CS1) {
+        const uint16_t addr = pins & M6530_ADDR_PINS;
+        if (pins & M6530_RW) {
+            c->pa.inpr = M6530_GET_PA(pins);
+            c->pb.inpr = M6530_GET_PB(pins);
+            const uint8_t data = m6530_read(c, addr);
+            M6530_SET_DATA(pins, data);
+        }
+        else {
+            m6530_write(c, addr, M6530_GET_DATA(pins));
+        }
+    }
+    // output pins are driven from the output register, input pins pass through
+    const uint8_t pa = (M6530_GET_PA(pins) & ~c->pa.ddr) | (c->pa.outr & c->pa.ddr);
+    const uint8_t pb = (M6530_GET_PB(pins) & ~c->pb.ddr) | (c->pb.outr & c->pb.ddr);
+    M6530_SET_PAB(pins, pa, pb);
+    if (m6530_irq(c)) {
+        pins |= M6530_IRQ;
+    }
+    else {
+        pins &= ~M6530_IRQ;
+    }
+    c->ticks++;
+    c->pins = pins;
+    return pins;
+}
+
 #endif /* CHIPS_IMPL */
\ No newline at end of file
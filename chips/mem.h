@@ -67,10 +67,14 @@
     Each page item consists of two host system pointers, one for read access,
     and one for write access.
 
-    There are 2 internal special 'junk pages', one for write accesses to
+    There are 2 special 'junk pages', one for write accesses to
     read-only-memory or unmapped memory, and one for read-access from unmapped
     memory. A read access from unmapped memory always returns 0xFF.
 
+    The junk-read-page is a constant shared by all mem_t instances, and
+    the junk-write-page is part of each mem_t instance, so that multiple
+    mem_t instances can be used concurrently on different threads.
+
     The different page-mapping scenarios are then implemented as follows:
 
     - **RAM**: both read- and write-pointers point to the same host-memory
@@ -82,6 +86,141 @@
     - **unmapped page**: the read-pointer points to the internal junk-read-page, and
       the write-pointer to the internal junk-write-page
 
+    ## Flat Mode
+
+    For small systems where all RAM and ROM can live in a single contiguous
+    host memory block (and the address space is optionally mirrored), call
+    **mem_set_flat()** after mem_init() to switch the mem_t instance into flat
+    mode:
+
+    ~~~C
+    void mem_set_flat(mem_t* mem, uint8_t* ptr, uint32_t size)
+    ~~~
+
+    The size must be a power of two up to 64 KBytes, addresses are masked
+    with (size - 1) for mirroring. The page-mapping functions still need to
+    be called as usual (they update the page table and attributes), but all
+    read- and write-pointers must point into the flat memory block at the
+    location of their (masked) address, and RAM-behind-ROM mappings are not
+    supported. Unmapped pages must be filled with 0xFF in the flat memory
+    block.
+
+    By default mem_rd() and mem_wr() still go through the page table, which
+    points into the flat memory block, so flat and paged instances behave
+    exactly the same and can be mixed freely (mem_set_flat() only validates
+    the layout and records the flat memory block for snapshots and write
+    tracking).
+
+    To get rid of the page table lookup, compile with:
+
+    ~~~C
+    #define MEM_FLAT
+    ~~~
+
+    With MEM_FLAT, mem_rd() is a single masked load from the flat memory
+    block, and mem_wr() only checks a one-byte-per-page attribute table
+    before storing the byte (writes to pages with attribute bits, like
+    MEM_PAGEATTR_READONLY for pages mapped as ROM or unmapped, go through
+    mem_wr_attr()). All mem_t instances must then be switched to flat mode
+    with mem_set_flat() before the first access, and copy-on-write pages
+    can't be used. The define only changes the inline mem_rd() and mem_wr(),
+    the mem_t layout is the same.
+
+    ## Copy-on-write Pages
+
+    To share read-mostly memory between many emulator instances (for
+    instance forks of the same system snapshot), pages can be mapped
+    copy-on-write:
+
+    ~~~C
+    void mem_map_cow(mem_t* mem, size_t layer, uint16_t addr, uint32_t size, const uint8_t* shared_ptr, uint8_t* private_ptr)
+    ~~~
+
+    Reads go to the shared memory until the first write into a page, this
+    copies the page from shared_ptr to the same offset in private_ptr and
+    remaps the page as RAM at private_ptr (this also remaps all other pages
+    which share the same memory, for instance in mirrored address ranges).
+    The shared memory is never written, and must stay unchanged while
+    it's mapped. Pages which still share memory have MEM_PAGEATTR_COW set
+    in mem_t.page_attr, and their bits set in mem_t.cow_pages[layer].
+
+    Copy-on-write pages are not supported in flat mode, or when compiled
+    with MEM_FLAT.
+
+    ## Write Tracking
+
+    To find out which memory areas have been written since some point in
+    time (for instance to only copy changed memory into an incremental
+    snapshot, or to only repaint the changed parts of a memory viewer),
+    switch on write tracking:
+
+    ~~~C
+    void mem_set_write_tracking(mem_t* mem, bool enabled)
+    ~~~
+
+    While write tracking is enabled mem_wr() sets a bit in mem_t.dirty_lines
+    for each 64-byte line that's written to (writes to ROM or unmapped pages
+    are ignored and don't set a bit). This is implemented with the
+    MEM_PAGEATTR_TRACK page attribute, so that mem_wr() doesn't get any slower
+    while write tracking is disabled. Enabling or disabling write tracking clears
+    all dirty bits.
+
+    In paged mode the dirty bits are for the CPU-visible address that has been
+    written, in flat mode the address is first masked with the flat memory
+    size, so all writes into a mirrored address range show up in the first
+    mirror.
+
+    ~~~C
+    bool mem_is_dirty(mem_t* mem, uint16_t addr, uint32_t size)
+    ~~~
+        Returns true if any 64-byte line overlapping the address range
+        has been written.
+
+    ~~~C
+    uint64_t mem_dirty_pages(mem_t* mem)
+    ~~~
+        Returns one bit per 1 KByte page, set if any line in the page has
+        been written.
+
+    ~~~C
+    void mem_clear_dirty(mem_t* mem, uint16_t addr, uint32_t size)
+    ~~~
+        Clears the dirty bits of all lines overlapping the address range,
+        call mem_clear_dirty(mem, 0, MEM_ADDR_RANGE) to clear all dirty bits.
+
+    ## Write Watchpoints
+
+    A debugger can watch pages for writes without slowing down writes to
+    other pages:
+
+    ~~~C
+    void mem_set_watch(mem_t* mem, uint64_t pages, mem_watch_func_t func, void* user_data)
+    ~~~
+
+    This sets MEM_PAGEATTR_WATCH on the pages in the bit mask (one bit per
+    1 KByte page), and calls func(addr, data, user_data) for each write
+    into a watched page (including writes to ROM or unmapped pages, which
+    are still ignored, func is called before the byte is written). Call
+    mem_set_watch(mem, 0, 0, 0) to remove the watch, the callback isn't
+    preserved in snapshots.
+
+    mem_wr() only has a single attribute check in the regular case, all
+    pages with other attributes than MEM_PAGEATTR_READONLY (or any
+    attribute with MEM_FLAT) go through mem_wr_attr(). mem_rd() doesn't
+    look at page attributes at all, so read watchpoints must be checked
+    by the caller.
+
+    ## Memory Layout
+
+    A mem_t is aligned to the host cache line size (MEM_CACHE_LINE_SIZE),
+    and starts with the state which mem_rd() and mem_wr() access: the page
+    attributes fill the first cache line, followed by the flat mode pointer
+    and the CPU-visible page table. With MEM_FLAT, mem_rd() and mem_wr() only
+    touch the first two cache lines. The mapping layers (4 KByte), the
+    copy-on-write, tracking and watch state and the junk page are behind
+    the page table, and are only touched when the memory mapping changes
+    or a write goes through mem_wr_attr().
+
     ## zlib/libpng license
 
     Copyright (c) 2018 Andre Weissflog
@@ -103,6 +242,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdalign.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -120,6 +260,23 @@ extern "C" {
 #define MEM_NUM_PAGES (MEM_ADDR_RANGE / MEM_PAGE_SIZE)
 #define MEM_NUM_LAYERS (4U)
 
+/* host cache line size (see "Memory Layout") */
+#define MEM_CACHE_LINE_SIZE (64)
+
+/* page attribute bits (mem_t.page_attr) */
+#define MEM_PAGEATTR_READONLY (1<<0)   /* writes to this page are ignored */
+#define MEM_PAGEATTR_COW (1<<1)        /* page is shared, and copied on the first write */
+#define MEM_PAGEATTR_TRACK (1<<2)      /* writes to this page set a bit in mem_t.dirty_lines */
+#define MEM_PAGEATTR_WATCH (1<<3)      /* writes to this page call mem_t.watch_func */
+
+/* write tracking granularity (64 bytes) */
+#define MEM_DIRTY_LINE_SHIFT (6U)
+#define MEM_DIRTY_LINE_SIZE (1U<<MEM_DIRTY_LINE_SHIFT)
+#define MEM_NUM_DIRTY_LINES (MEM_ADDR_RANGE / MEM_DIRTY_LINE_SIZE)
+
+/* write watch callback (see mem_set_watch()) */
+typedef void (*mem_watch_func_t)(uint16_t addr, uint8_t data, void* user_data);
+
 /* a memory page item maps a chunk of emulator memory to host memory */
 typedef struct {
     uint8_t* read_ptr;
@@ -128,20 +285,44 @@ typedef struct {
 
 /* a memory instance is a 2-dimensional table of memory pages */
 typedef struct {
+    /* hot: everything mem_rd() and mem_wr() look at */
+    /* attribute bits of the CPU-visible pages */
+    alignas(MEM_CACHE_LINE_SIZE) uint8_t page_attr[MEM_NUM_PAGES];
+    /* optional flat memory mode (see mem_set_flat()) */
+    uint8_t* flat;
+    uint16_t flat_mask;
     /* the pages that are actually visible to the emulated CPU */
     mem_page_t page_table[MEM_NUM_PAGES];
+    /* cold: only touched when mapping memory and by mem_wr_attr() */
     /* memory-mapped layers, layer 0 is highest priority */
-    mem_page_t layers[MEM_NUM_LAYERS][MEM_NUM_PAGES];
+    alignas(MEM_CACHE_LINE_SIZE) mem_page_t layers[MEM_NUM_LAYERS][MEM_NUM_PAGES];
+    /* one bit per page which is mapped copy-on-write and not yet copied, per layer */
+    uint64_t cow_pages[MEM_NUM_LAYERS];
+    /* write tracking (see mem_set_write_tracking()), one bit per 64-byte line */
+    bool track_writes;
+    uint64_t dirty_lines[MEM_NUM_DIRTY_LINES / 64];
+    /* write watchpoints (see mem_set_watch()) */
+    uint64_t watch_pages;
+    mem_watch_func_t watch_func;
+    void* watch_user_data;
+    /* a write-only 'junk page' for writes to ROM areas */
+    uint8_t junk_page[MEM_PAGE_SIZE];
 } mem_t;
 
 /* initialize a new mem instance */
 void mem_init(mem_t* mem);
+/* switch to flat mode with all memory in a single (optionally mirrored) host memory block */
+void mem_set_flat(mem_t* mem, uint8_t* ptr, uint32_t size);
 /* map a range of RAM */
 void mem_map_ram(mem_t* mem, size_t layer, uint16_t addr, uint32_t size, uint8_t* ptr);
 /* map a range of ROM */
 void mem_map_rom(mem_t* mem, size_t layer, uint16_t addr, uint32_t size, const uint8_t* ptr);
 /* map a range of memory to different read/write pointers (e.g. for RAM behind ROM) */
 void mem_map_rw(mem_t* mem, size_t layer, uint16_t addr, uint32_t size, const uint8_t* read_ptr, uint8_t* write_ptr);
+/* map a range of shared memory which is copied to private_ptr on the first write into a page */
+void mem_map_cow(mem_t* mem, size_t layer, uint16_t addr, uint32_t size, const uint8_t* shared_ptr, uint8_t* private_ptr);
+/* copy a copy-on-write page into private memory (called by mem_wr()) */
+void mem_cow_copy(mem_t* mem, size_t page_index);
 /* unmap all memory pages in a layer, also updates the CPU-visible page-table */
 void mem_unmap_layer(mem_t* mem, size_t layer);
 /* unmap all memory pages in all layers, also updates the CPU-visible page-table */
@@ -150,14 +331,48 @@ void mem_unmap_all(mem_t* mem);
 uint8_t* mem_readptr(mem_t* mem, uint16_t addr);
 /* copy a range of bytes into memory via mem_wr() */
 void mem_write_range(mem_t* mem, uint16_t addr, const uint8_t* src, uint32_t num_bytes);
+/* enable or disable write tracking, also clears all dirty bits */
+void mem_set_write_tracking(mem_t* mem, bool enabled);
+/* return true if any 64-byte line in the address range has been written */
+bool mem_is_dirty(mem_t* mem, uint16_t addr, uint32_t size);
+/* return one bit per 1 KByte page which has been written */
+uint64_t mem_dirty_pages(mem_t* mem);
+/* clear the dirty bits of an address range */
+void mem_clear_dirty(mem_t* mem, uint16_t addr, uint32_t size);
+/* call a function for each write into the pages in a bit mask (one bit per 1 KByte page) */
+void mem_set_watch(mem_t* mem, uint64_t pages, mem_watch_func_t func, void* user_data);
+/* write a byte to a page with attribute bits (called by mem_wr()) */
+void mem_wr_attr(mem_t* mem, uint16_t addr, uint8_t data);
+
+/* set the dirty bit of the 64-byte line at an address (called by mem_wr()) */
+static inline void mem_mark_dirty(mem_t* mem, uint16_t addr) {
+    mem->dirty_lines[addr >> (MEM_DIRTY_LINE_SHIFT + 6)] |= 1ULL << ((addr >> MEM_DIRTY_LINE_SHIFT) & 63);
+}
 
 /* read a byte at 16-bit address */
 static inline uint8_t mem_rd(mem_t* mem, uint16_t addr) {
+    #if defined(MEM_FLAT)
+    return mem->flat[addr & mem->flat_mask];
+    #else
     return mem->page_table[addr>>MEM_PAGE_SHIFT].read_ptr[addr & MEM_PAGE_MASK];
+    #endif
 }
 /* write a byte to 16-bit address */
 static inline void mem_wr(mem_t* mem, uint16_t addr, uint8_t data) {
-    mem->page_table[addr>>MEM_PAGE_SHIFT].write_ptr[addr & MEM_PAGE_MASK] = data;
+    const uint8_t attr = mem->page_attr[addr>>MEM_PAGE_SHIFT];
+    #if defined(MEM_FLAT)
+    if (0 == attr) {
+        mem->flat[addr & mem->flat_mask] = data;
+    }
+    #else
+    /* read-only pages write into the junk page */
+    if (0 == (attr & ~MEM_PAGEATTR_READONLY)) {
+        mem->page_table[addr>>MEM_PAGE_SHIFT].write_ptr[addr & MEM_PAGE_MASK] = data;
+    }
+    #endif
+    else {
+        mem_wr_attr(mem, addr, data);
+    }
 }
 /* helper method to write a 16-bit value, does 2 mem_wr() */
 static inline void mem_wr16(mem_t* mem, uint16_t addr, uint16_t data) {
@@ -193,18 +408,43 @@ void mem_snapshot_onload(mem_t* snapshot, void* base);
     #define CHIPS_ASSERT(c) assert(c)
 #endif
 
-// a dummy page for currently unmapped memory
-static uint8_t _mem_unmapped_page[MEM_PAGE_SIZE];
-// a write-only 'junk table' for writes to ROM areas
-static uint8_t _mem_junk_page[MEM_PAGE_SIZE];
+// a dummy page for currently unmapped memory (constant, never written)
+#define _MEM_FF_16 0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF
+#define _MEM_FF_64 _MEM_FF_16,_MEM_FF_16,_MEM_FF_16,_MEM_FF_16
+#define _MEM_FF_256 _MEM_FF_64,_MEM_FF_64,_MEM_FF_64,_MEM_FF_64
+static const uint8_t _mem_unmapped_page[MEM_PAGE_SIZE] = { _MEM_FF_256, _MEM_FF_256, _MEM_FF_256, _MEM_FF_256 };
+#undef _MEM_FF_256
+#undef _MEM_FF_64
+#undef _MEM_FF_16
 
 void mem_init(mem_t* m) {
     CHIPS_ASSERT(m);
-    *m = (mem_t){0};
-    memset(_mem_unmapped_page, 0xFF, sizeof(_mem_unmapped_page));
+    memset(m, 0, sizeof(mem_t));
     mem_unmap_all(m);
 }
 
+/* in flat mode, check that a CPU-visible page points to its location in the flat memory block */
+static void _mem_check_flat_page(mem_t* m, size_t page_index) {
+    if (m->flat) {
+        const mem_page_t* page = &m->page_table[page_index];
+        const uint8_t* flat_ptr = m->flat + ((page_index<<MEM_PAGE_SHIFT) & m->flat_mask);
+        (void)page; (void)flat_ptr;
+        CHIPS_ASSERT(0 == (m->page_attr[page_index] & MEM_PAGEATTR_COW));
+        CHIPS_ASSERT((page->read_ptr == _mem_unmapped_page) || (page->read_ptr == flat_ptr));
+        CHIPS_ASSERT((page->write_ptr == m->junk_page) || (page->write_ptr == flat_ptr));
+    }
+}
+
+void mem_set_flat(mem_t* m, uint8_t* ptr, uint32_t size) {
+    CHIPS_ASSERT(m && ptr);
+    CHIPS_ASSERT((size >= MEM_PAGE_SIZE) && (size <= MEM_ADDR_RANGE) && (0 == (size & (size - 1))));
+    m->flat = ptr;
+    m->flat_mask = (uint16_t)(size - 1);
+    for (size_t page_index = 0; page_index < MEM_NUM_PAGES; page_index++) {
+        _mem_check_flat_page(m, page_index);
+    }
+}
+
 /* this sets the CPU-visible mapping of a page in the page-table */
 static void _mem_update_page_table(mem_t* m, size_t page_index) {
     /* find highest priority layer which maps this memory page */
@@ -250,9 +490,20 @@ static void _mem_update_page_table(mem_t* m, size_t page_index) {
     }
     else {
         /* no mapping exists for this page, set to special 'unmapped page' */
-        m->page_table[page_index].read_ptr = _mem_unmapped_page;
-        m->page_table[page_index].write_ptr = _mem_junk_page;
+        m->page_table[page_index].read_ptr = (uint8_t*)_mem_unmapped_page;
+        m->page_table[page_index].write_ptr = m->junk_page;
+    }
+    m->page_attr[page_index] = (m->page_table[page_index].write_ptr == m->junk_page) ? MEM_PAGEATTR_READONLY : 0;
+    if ((layer_index != MEM_NUM_LAYERS) && (m->cow_pages[layer_index] & (1ULL<<page_index))) {
+        m->page_attr[page_index] |= MEM_PAGEATTR_COW;
+    }
+    if (m->track_writes && (0 == (m->page_attr[page_index] & MEM_PAGEATTR_READONLY))) {
+        m->page_attr[page_index] |= MEM_PAGEATTR_TRACK;
+    }
+    if (m->watch_pages & (1ULL<<page_index)) {
+        m->page_attr[page_index] |= MEM_PAGEATTR_WATCH;
     }
+    _mem_check_flat_page(m, page_index);
 }
 
 static void _mem_map(mem_t* m, size_t layer, uint16_t addr, uint32_t size, const uint8_t* read_ptr, uint8_t* write_ptr) {
@@ -269,12 +520,13 @@ static void _mem_map(mem_t* m, size_t layer, uint16_t addr, uint32_t size, const
         const uint16_t page_index = ((addr+offset) & MEM_ADDR_MASK) >> MEM_PAGE_SHIFT;
         CHIPS_ASSERT(page_index <= MEM_NUM_PAGES);
         mem_page_t* page = &m->layers[layer][page_index];
+        m->cow_pages[layer] &= ~(1ULL<<page_index);
         page->read_ptr = (uint8_t*)read_ptr + offset;
         if (0 != write_ptr) {
             page->write_ptr = write_ptr + offset;
         }
         else {
-            page->write_ptr = _mem_junk_page;
+            page->write_ptr = m->junk_page;
         }
         _mem_update_page_table(m, page_index);
     }
@@ -295,9 +547,52 @@ void mem_map_rw(mem_t* m, size_t layer, uint16_t addr, uint32_t size, const uint
     _mem_map(m, layer, addr, size, read_ptr, write_ptr);
 }
 
+void mem_map_cow(mem_t* m, size_t layer, uint16_t addr, uint32_t size, const uint8_t* shared_ptr, uint8_t* private_ptr) {
+    CHIPS_ASSERT(shared_ptr && private_ptr && (0 == m->flat));
+    #if defined(MEM_FLAT)
+    CHIPS_ASSERT(false && "mem_map_cow() can't be used with MEM_FLAT");
+    #endif
+    _mem_map(m, layer, addr, size, shared_ptr, private_ptr);
+    const size_t num = size>>MEM_PAGE_SHIFT;
+    for (size_t i = 0; i < num; i++) {
+        const size_t page_index = ((addr + i * MEM_PAGE_SIZE) & MEM_ADDR_MASK) >> MEM_PAGE_SHIFT;
+        m->cow_pages[layer] |= 1ULL<<page_index;
+        _mem_update_page_table(m, page_index);
+    }
+}
+
+void mem_cow_copy(mem_t* m, size_t page_index) {
+    CHIPS_ASSERT(m && (page_index < MEM_NUM_PAGES));
+    CHIPS_ASSERT(m->page_attr[page_index] & MEM_PAGEATTR_COW);
+    // find the CPU-visible layer
+    size_t layer_index;
+    for (layer_index = 0; layer_index < MEM_NUM_LAYERS; layer_index++) {
+        if (m->layers[layer_index][page_index].read_ptr) {
+            break;
+        }
+    }
+    CHIPS_ASSERT(layer_index < MEM_NUM_LAYERS);
+    const uint8_t* shared_ptr = m->layers[layer_index][page_index].read_ptr;
+    uint8_t* private_ptr = m->layers[layer_index][page_index].write_ptr;
+    memcpy(private_ptr, shared_ptr, MEM_PAGE_SIZE);
+    // remap all pages which share the same memory (e.g. mirrors) to the private copy
+    for (layer_index = 0; layer_index < MEM_NUM_LAYERS; layer_index++) {
+        uint64_t cow = m->cow_pages[layer_index];
+        for (size_t i = 0; cow; i++, cow >>= 1) {
+            mem_page_t* page = &m->layers[layer_index][i];
+            if ((cow & 1) && (page->read_ptr == shared_ptr) && (page->write_ptr == private_ptr)) {
+                page->read_ptr = private_ptr;
+                m->cow_pages[layer_index] &= ~(1ULL<<i);
+                _mem_update_page_table(m, i);
+            }
+        }
+    }
+}
+
 void mem_unmap_layer(mem_t* m, size_t layer) {
     CHIPS_ASSERT(m);
     CHIPS_ASSERT(layer < MEM_NUM_LAYERS);
+    m->cow_pages[layer] = 0;
     for (size_t page_index = 0; page_index < MEM_NUM_PAGES; page_index++) {
         mem_page_t* page = &m->layers[layer][page_index];
         page->read_ptr = 0;
@@ -313,9 +608,17 @@ void mem_unmap_all(mem_t* m) {
             page->read_ptr = 0;
             page->write_ptr = 0;
         }
+        m->cow_pages[layer_index] = 0;
     }
+    /* no layer maps anything, so there's no need to search the layers for each page */
     for (size_t page_index = 0; page_index < MEM_NUM_PAGES; page_index++) {
-        _mem_update_page_table(m, page_index);
+        m->page_table[page_index].read_ptr = (uint8_t*)_mem_unmapped_page;
+        m->page_table[page_index].write_ptr = m->junk_page;
+        m->page_attr[page_index] = MEM_PAGEATTR_READONLY;
+        if (m->watch_pages & (1ULL<<page_index)) {
+            m->page_attr[page_index] |= MEM_PAGEATTR_WATCH;
+        }
+        _mem_check_flat_page(m, page_index);
     }
 }
 
@@ -330,6 +633,103 @@ void mem_write_range(mem_t* m, uint16_t addr, const uint8_t* src, uint32_t num_b
     }
 }
 
+void mem_set_write_tracking(mem_t* m, bool enabled) {
+    CHIPS_ASSERT(m);
+    m->track_writes = enabled;
+    for (size_t page_index = 0; page_index < MEM_NUM_PAGES; page_index++) {
+        m->page_attr[page_index] &= ~MEM_PAGEATTR_TRACK;
+        if (enabled && (0 == (m->page_attr[page_index] & MEM_PAGEATTR_READONLY))) {
+            m->page_attr[page_index] |= MEM_PAGEATTR_TRACK;
+        }
+    }
+    memset(m->dirty_lines, 0, sizeof(m->dirty_lines));
+}
+
+void mem_set_watch(mem_t* m, uint64_t pages, mem_watch_func_t func, void* user_data) {
+    CHIPS_ASSERT(m && (func || (0 == pages)));
+    m->watch_pages = pages;
+    m->watch_func = func;
+    m->watch_user_data = user_data;
+    for (size_t page_index = 0; page_index < MEM_NUM_PAGES; page_index++) {
+        m->page_attr[page_index] &= ~MEM_PAGEATTR_WATCH;
+        if (pages & (1ULL<<page_index)) {
+            m->page_attr[page_index] |= MEM_PAGEATTR_WATCH;
+        }
+    }
+}
+
+void mem_wr_attr(mem_t* m, uint16_t addr, uint8_t data) {
+    const size_t page_index = addr>>MEM_PAGE_SHIFT;
+    const uint8_t attr = m->page_attr[page_index];
+    if (attr & MEM_PAGEATTR_WATCH) {
+        m->watch_func(addr, data, m->watch_user_data);
+    }
+    if (m->flat) {
+        if (0 == (attr & MEM_PAGEATTR_READONLY)) {
+            m->flat[addr & m->flat_mask] = data;
+            if (attr & MEM_PAGEATTR_TRACK) {
+                mem_mark_dirty(m, addr & m->flat_mask);
+            }
+        }
+        return;
+    }
+    if (attr & MEM_PAGEATTR_COW) {
+        mem_cow_copy(m, page_index);
+    }
+    if (attr & MEM_PAGEATTR_TRACK) {
+        mem_mark_dirty(m, addr);
+    }
+    m->page_table[page_index].write_ptr[addr & MEM_PAGE_MASK] = data;
+}
+
+/* run code for each 64-bit word of dirty bits, with the mask of the lines overlapping the address range */
+#define _MEM_FOREACH_DIRTY_WORD(m, addr, size, word, mask, code) { \
+    CHIPS_ASSERT((size) <= MEM_ADDR_RANGE); \
+    if ((size) > 0) { \
+        const uint32_t first_line = (addr) >> MEM_DIRTY_LINE_SHIFT; \
+        const uint32_t last_line = first_line + ((((addr) & (MEM_DIRTY_LINE_SIZE-1)) + (size) - 1) >> MEM_DIRTY_LINE_SHIFT); \
+        for (uint32_t line = first_line; line <= last_line; line = (line | 63) + 1) { \
+            const uint32_t end = (last_line < (line | 63)) ? last_line : (line | 63); \
+            uint64_t* word = &(m)->dirty_lines[(line >> 6) & ((MEM_NUM_DIRTY_LINES / 64) - 1)]; \
+            const uint64_t mask = (~0ULL >> (63 - (end & 63))) & (~0ULL << (line & 63)); \
+            code; \
+        } \
+    } \
+}
+
+bool mem_is_dirty(mem_t* m, uint16_t addr, uint32_t size) {
+    CHIPS_ASSERT(m);
+    _MEM_FOREACH_DIRTY_WORD(m, addr, size, word, mask, {
+        if (*word & mask) {
+            return true;
+        }
+    });
+    return false;
+}
+
+void mem_clear_dirty(mem_t* m, uint16_t addr, uint32_t size) {
+    CHIPS_ASSERT(m);
+    _MEM_FOREACH_DIRTY_WORD(m, addr, size, word, mask, {
+        *word &= ~mask;
+    });
+}
+#undef _MEM_FOREACH_DIRTY_WORD
+
+uint64_t mem_dirty_pages(mem_t* m) {
+    CHIPS_ASSERT(m);
+    // each 64-bit word of dirty bits covers 4 pages with 16 lines each
+    uint64_t pages = 0;
+    for (size_t i = 0; i < (MEM_NUM_DIRTY_LINES / 64); i++) {
+        const uint64_t w = m->dirty_lines[i];
+        for (size_t j = 0; j < 4; j++) {
+            if (w & (0xFFFFULL << (j * 16))) {
+                pages |= 1ULL << (i * 4 + j);
+            }
+        }
+    }
+    return pages;
+}
+
 uint8_t mem_layer_rd(mem_t* mem, size_t layer, uint16_t addr) {
     CHIPS_ASSERT(layer < MEM_NUM_LAYERS);
     if (mem->layers[layer][addr>>MEM_PAGE_SHIFT].read_ptr) {
@@ -349,7 +749,7 @@ void mem_layer_wr(mem_t* mem, size_t layer, uint16_t addr, uint8_t data) {
 
 #define MEM_SPECIAL_OFFSET_NULLPTR (-1)
 #define MEM_SPECIAL_OFFSET_UNMAPPED_PAGE (-2)
-#define MEM_SPECIAL_OFFSET_JUNK_PAGE (-3)
+// NOTE: the junk-write-page is inside mem_t, so it's handled like any other offset
 
 static void mem_ptr_to_offset(uint8_t** ptr_ptr, uint8_t* base) {
     uint8_t* ptr = *ptr_ptr;
@@ -359,9 +759,6 @@ static void mem_ptr_to_offset(uint8_t** ptr_ptr, uint8_t* base) {
     else if (ptr == _mem_unmapped_page) {
         *ptr_ptr = (uint8_t*)(intptr_t)MEM_SPECIAL_OFFSET_UNMAPPED_PAGE;
     }
-    else if (ptr == _mem_junk_page) {
-        *ptr_ptr = (uint8_t*)(intptr_t)MEM_SPECIAL_OFFSET_JUNK_PAGE;
-    }
     else {
         CHIPS_ASSERT(base <= *ptr_ptr);
         *ptr_ptr = (uint8_t*) (*ptr_ptr - base);
@@ -375,10 +772,7 @@ static void mem_offset_to_ptr(uint8_t** ptr_ptr, uint8_t* base) {
             *ptr_ptr = 0;
             break;
         case MEM_SPECIAL_OFFSET_UNMAPPED_PAGE:
-            *ptr_ptr = _mem_unmapped_page;
-            break;
-        case MEM_SPECIAL_OFFSET_JUNK_PAGE:
-            *ptr_ptr = _mem_junk_page;
+            *ptr_ptr = (uint8_t*)_mem_unmapped_page;
             break;
         default:
             *ptr_ptr = (base + offset);
@@ -388,6 +782,8 @@ static void mem_offset_to_ptr(uint8_t** ptr_ptr, uint8_t* base) {
 
 void mem_snapshot_onsave(mem_t* snapshot, void* base) {
     uint8_t* base8 = (uint8_t*)base;
+    mem_set_watch(snapshot, 0, 0, 0);
+    mem_ptr_to_offset(&snapshot->flat, base8);
     for (size_t page = 0; page < MEM_NUM_PAGES; page++) {
         mem_ptr_to_offset(&snapshot->page_table[page].read_ptr, base8);
         mem_ptr_to_offset(&snapshot->page_table[page].write_ptr, base8);
@@ -402,6 +798,7 @@ void mem_snapshot_onsave(mem_t* snapshot, void* base) {
 
 void mem_snapshot_onload(mem_t* snapshot, void* base) {
     uint8_t* base8 = (uint8_t*)base;
+    mem_offset_to_ptr(&snapshot->flat, base8);
     for (size_t page = 0; page < MEM_NUM_PAGES; page++) {
         mem_offset_to_ptr(&snapshot->page_table[page].read_ptr, base8);
         mem_offset_to_ptr(&snapshot->page_table[page].write_ptr, base8);
@@ -0,0 +1,236 @@
+#pragma once
+/*#
+    # sched.h
+
+    A tiny tick-timestamped event scheduler for emulated systems.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    ## Overview
+
+    Instead of ticking every chip in every clock cycle, a system emulation
+    registers the next tick at which a chip needs attention (a timer
+    underflow, the next bit of a serial transfer, ...) as an event, and
+    runs the CPU back to back until the next event is due.
+
+    Events are identified by a small integer id (0..SCHED_MAX_EVENTS-1)
+    defined by the system emulation, and each id can only be scheduled
+    once. Scheduling an already scheduled id moves the event to the
+    new tick. The pending events are kept in a binary min-heap.
+
+    ~~~C
+    void sched_init(sched_t* sched)
+    ~~~
+        Initialize a scheduler without any pending events.
+
+    ~~~C
+    void sched_set(sched_t* sched, int id, uint64_t tick)
+    ~~~
+        Schedule (or reschedule) the event id at an absolute tick.
+
+    ~~~C
+    void sched_cancel(sched_t* sched, int id)
+    ~~~
+        Remove the event id from the scheduler, it's fine to cancel
+        an event which isn't scheduled.
+
+    ~~~C
+    uint64_t sched_next(const sched_t* sched)
+    ~~~
+        Return the tick of the next pending event, or SCHED_NEVER if
+        no event is pending. This is an inline function and can be
+        called in the hot loop.
+
+    ~~~C
+    int sched_pop(sched_t* sched, uint64_t tick)
+    ~~~
+        If the next event is due at or before tick, remove it from the
+        scheduler and return its id, otherwise return -1. Call this
+        in a loop to handle all due events:
+
+        ~~~C
+        int id;
+        while ((id = sched_pop(&sys->sched, sys->ticks)) >= 0) {
+            ...
+        }
+        ~~~
+
+    ## zlib/libpng license
+
+    Copyright (c) 2018 Andre Weissflog
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+        1. The origin of this software must not be misrepresented; you must not
+        claim that you wrote the original software. If you use this software in a
+        product, an acknowledgment in the product documentation would be
+        appreciated but is not required.
+        2. Altered source versions must be plainly marked as such, and must not
+        be misrepresented as being the original software.
+        3. This notice may not be removed or altered from any source
+        distribution.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHED_MAX_EVENTS (16)
+#define SCHED_NEVER (0xFFFFFFFFFFFFFFFFULL)
+
+typedef struct {
+    uint64_t tick;
+    int id;
+} sched_event_t;
+
+typedef struct {
+    int num;                                // number of pending events
+    sched_event_t heap[SCHED_MAX_EVENTS];   // min-heap of pending events, heap[0].tick is SCHED_NEVER if empty
+    int8_t pos[SCHED_MAX_EVENTS];           // heap index by event id, -1 if not scheduled
+} sched_t;
+
+// initialize a scheduler
+void sched_init(sched_t* sched);
+// schedule or reschedule an event at an absolute tick
+void sched_set(sched_t* sched, int id, uint64_t tick);
+// remove an event from the scheduler
+void sched_cancel(sched_t* sched, int id);
+// pop the next event if it is due at or before tick, return -1 if none is due
+int sched_pop(sched_t* sched, uint64_t tick);
+
+// return the tick of the next pending event, or SCHED_NEVER
+static inline uint64_t sched_next(const sched_t* sched) {
+    return sched->heap[0].tick;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+void sched_init(sched_t* s) {
+    CHIPS_ASSERT(s);
+    s->num = 0;
+    for (int i = 0; i < SCHED_MAX_EVENTS; i++) {
+        s->heap[i].tick = SCHED_NEVER;
+        s->heap[i].id = -1;
+        s->pos[i] = -1;
+    }
+}
+
+static inline void _sched_put(sched_t* s, int i, sched_event_t ev) {
+    s->heap[i] = ev;
+    s->pos[ev.id] = (int8_t)i;
+}
+
+static void _sched_up(sched_t* s, int i) {
+    const sched_event_t ev = s->heap[i];
+    while (i > 0) {
+        const int parent = (i - 1) >> 1;
+        if (s->heap[parent].tick <= ev.tick) {
+            break;
+        }
+        _sched_put(s, i, s->heap[parent]);
+        i = parent;
+    }
+    _sched_put(s, i, ev);
+}
+
+static void _sched_down(sched_t* s, int i) {
+    const sched_event_t ev = s->heap[i];
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= s->num) {
+            break;
+        }
+        if (((child + 1) < s->num) && (s->heap[child + 1].tick < s->heap[child].tick)) {
+            child++;
+        }
+        if (ev.tick <= s->heap[child].tick) {
+            break;
+        }
+        _sched_put(s, i, s->heap[child]);
+        i = child;
+    }
+    _sched_put(s, i, ev);
+}
+
+// remove the heap entry at index i
+static void _sched_remove(sched_t* s, int i) {
+    s->pos[s->heap[i].id] = -1;
+    s->num--;
+    if (i != s->num) {
+        const sched_event_t last = s->heap[s->num];
+        const uint64_t old_tick = s->heap[i].tick;
+        _sched_put(s, i, last);
+        if (last.tick < old_tick) {
+            _sched_up(s, i);
+        }
+        else {
+            _sched_down(s, i);
+        }
+    }
+    s->heap[s->num].tick = SCHED_NEVER;
+    s->heap[s->num].id = -1;
+}
+
+void sched_set(sched_t* s, int id, uint64_t tick) {
+    CHIPS_ASSERT(s && (id >= 0) && (id < SCHED_MAX_EVENTS));
+    int i = s->pos[id];
+    if (i < 0) {
+        i = s->num++;
+        _sched_put(s, i, (sched_event_t){ .tick = tick, .id = id });
+        _sched_up(s, i);
+    }
+    else {
+        const uint64_t old_tick = s->heap[i].tick;
+        s->heap[i].tick = tick;
+        if (tick < old_tick) {
+            _sched_up(s, i);
+        }
+        else {
+            _sched_down(s, i);
+        }
+    }
+}
+
+void sched_cancel(sched_t* s, int id) {
+    CHIPS_ASSERT(s && (id >= 0) && (id < SCHED_MAX_EVENTS));
+    if (s->pos[id] >= 0) {
+        _sched_remove(s, s->pos[id]);
+    }
+}
+
+int sched_pop(sched_t* s, uint64_t tick) {
+    CHIPS_ASSERT(s);
+    if ((s->num == 0) || (s->heap[0].tick > tick)) {
+        return -1;
+    }
+    const int id = s->heap[0].id;
+    _sched_remove(s, 0);
+    return id;
+}
+#endif /* CHIPS_IMPL */
@@ -0,0 +1,299 @@
+#pragma once
+/*#
+    # spsc.h
+
+    Lock-free single-producer/single-consumer ring buffer and triple buffer
+    to pass data between an emulation thread and a frontend thread.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including spsc.h:
+
+    - chips/chips_common.h
+
+    The implementation needs C11 atomics (stdatomic.h).
+
+    ## The Ring Buffer
+
+    A spsc_t passes fixed-size items (for instance keypad events or TTY
+    bytes) from exactly one producer thread to exactly one consumer
+    thread, neither thread ever blocks or takes a lock. The memory for
+    the items is provided by the caller, the number of items must be a
+    power of two:
+
+    ~~~C
+    static uint8_t tty_buf[256];
+    spsc_t tty;
+    spsc_init(&tty, &(spsc_desc_t){
+        .item_size = 1,
+        .num_items = 256,
+        .buffer = { .ptr = tty_buf, .size = sizeof(tty_buf) },
+    });
+    ~~~
+
+    ~~~C
+    bool spsc_push(spsc_t* ring, const void* item)
+    ~~~
+        Called on the producer thread, copies an item into the ring.
+        Returns false if the ring is full (the item is dropped).
+
+    ~~~C
+    bool spsc_pop(spsc_t* ring, void* item)
+    ~~~
+        Called on the consumer thread, copies the oldest item out of the
+        ring. Returns false if the ring is empty.
+
+    ~~~C
+    uint32_t spsc_count(spsc_t* ring)
+    ~~~
+        Returns the number of items in the ring, this is only a snapshot
+        when called while the other thread is active.
+
+    The read and write positions live on separate cache lines, and each
+    side keeps a cached copy of the other side's position, so the shared
+    cache lines are only touched when the cached copy says the ring is
+    full (or empty).
+
+    ## The Triple Buffer
+
+    A spsc_triple_t passes complete frames (for instance the KIM-1 LED
+    display frame) from the producer to the consumer. The producer always
+    has a back buffer to write into, and the consumer always has a front
+    buffer to read from, publishing a frame never waits for the consumer,
+    and reading a frame never waits for the producer. If the producer
+    publishes several frames before the consumer looks, the consumer only
+    sees the latest:
+
+    ~~~C
+    static uint8_t frames[3][6*7];
+    spsc_triple_t tb;
+    spsc_triple_init(&tb, frames[0], frames[1], frames[2]);
+
+    // producer thread:
+    uint8_t* back = spsc_triple_back(&tb);
+    ...write frame into back...
+    spsc_triple_publish(&tb);
+
+    // consumer thread:
+    const uint8_t* front = spsc_triple_front(&tb, 0);
+    ~~~
+
+    ~~~C
+    void* spsc_triple_back(spsc_triple_t* tb)
+    ~~~
+        Called on the producer thread, returns the buffer which the next
+        frame must be written to.
+
+    ~~~C
+    void spsc_triple_publish(spsc_triple_t* tb)
+    ~~~
+        Called on the producer thread, makes the back buffer the latest
+        frame, and takes a new back buffer.
+
+    ~~~C
+    const void* spsc_triple_front(spsc_triple_t* tb, bool* out_fresh)
+    ~~~
+        Called on the consumer thread, returns the latest published frame,
+        out_fresh (can be 0) is set to true if this frame wasn't returned
+        before. The returned buffer remains valid until the next call.
+
+    ## zlib/libpng license
+
+    Copyright (c) 2018 Andre Weissflog
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+        1. The origin of this software must not be misrepresented; you must not
+        claim that you wrote the original software. If you use this software in a
+        product, an acknowledgment in the product documentation would be
+        appreciated but is not required.
+        2. Altered source versions must be plainly marked as such, and must not
+        be misrepresented as being the original software.
+        3. This notice may not be removed or altered from any source
+        distribution.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPSC_CACHE_LINE_SIZE (64)
+
+// ring buffer setup parameters
+typedef struct {
+    uint32_t item_size;         // size of one item in bytes
+    uint32_t num_items;         // capacity in items, must be a power of two
+    chips_range_t buffer;       // memory for the items, at least item_size * num_items bytes
+} spsc_desc_t;
+
+// ring buffer state
+typedef struct {
+    // written by producer
+    _Alignas(SPSC_CACHE_LINE_SIZE) atomic_uint_fast32_t tail;
+    uint32_t cached_head;       // producer's copy of head
+    // written by consumer
+    _Alignas(SPSC_CACHE_LINE_SIZE) atomic_uint_fast32_t head;
+    uint32_t cached_tail;       // consumer's copy of tail
+    // read-only after spsc_init()
+    _Alignas(SPSC_CACHE_LINE_SIZE) uint8_t* buf;
+    uint32_t item_size;
+    uint32_t mask;
+} spsc_t;
+
+// triple buffer state
+typedef struct {
+    void* buf[3];
+    _Alignas(SPSC_CACHE_LINE_SIZE) atomic_uint_fast32_t middle;    // buffer index | SPSC_TRIPLE_FRESH
+    _Alignas(SPSC_CACHE_LINE_SIZE) uint32_t back;                  // owned by producer
+    _Alignas(SPSC_CACHE_LINE_SIZE) uint32_t front;                 // owned by consumer
+} spsc_triple_t;
+
+// initialize a ring buffer
+void spsc_init(spsc_t* ring, const spsc_desc_t* desc);
+// push an item (producer thread), returns false if the ring is full
+bool spsc_push(spsc_t* ring, const void* item);
+// pop an item (consumer thread), returns false if the ring is empty
+bool spsc_pop(spsc_t* ring, void* item);
+// return the number of items in the ring
+uint32_t spsc_count(spsc_t* ring);
+
+// initialize a triple buffer with three buffers of the same size
+void spsc_triple_init(spsc_triple_t* tb, void* buf0, void* buf1, void* buf2);
+// get the buffer to write the next frame into (producer thread)
+void* spsc_triple_back(spsc_triple_t* tb);
+// publish the back buffer as latest frame (producer thread)
+void spsc_triple_publish(spsc_triple_t* tb);
+// get the latest published frame (consumer thread)
+const void* spsc_triple_front(spsc_triple_t* tb, bool* out_fresh);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+#include <string.h> // memcpy, memset
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define SPSC_TRIPLE_FRESH (4)
+
+void spsc_init(spsc_t* ring, const spsc_desc_t* desc) {
+    CHIPS_ASSERT(ring && desc);
+    CHIPS_ASSERT((desc->item_size > 0) && (desc->num_items > 0));
+    CHIPS_ASSERT(0 == (desc->num_items & (desc->num_items - 1)));
+    CHIPS_ASSERT(desc->buffer.ptr && (desc->buffer.size >= ((size_t)desc->item_size * desc->num_items)));
+    memset(ring, 0, sizeof(spsc_t));
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    ring->buf = (uint8_t*) desc->buffer.ptr;
+    ring->item_size = desc->item_size;
+    ring->mask = desc->num_items - 1;
+}
+
+/*
+    head and tail are free-running counters, the item index is the
+    counter masked with (num_items - 1), the ring is full when tail
+    is num_items ahead of head. The release-store of tail publishes
+    the item to the consumer, the release-store of head hands the
+    item slot back to the producer.
+*/
+bool spsc_push(spsc_t* ring, const void* item) {
+    CHIPS_ASSERT(ring && item);
+    const uint32_t tail = (uint32_t) atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if ((uint32_t)(tail - ring->cached_head) > ring->mask) {
+        ring->cached_head = (uint32_t) atomic_load_explicit(&ring->head, memory_order_acquire);
+        if ((uint32_t)(tail - ring->cached_head) > ring->mask) {
+            return false;
+        }
+    }
+    memcpy(ring->buf + (tail & ring->mask) * ring->item_size, item, ring->item_size);
+    atomic_store_explicit(&ring->tail, (uint32_t)(tail + 1), memory_order_release);
+    return true;
+}
+
+bool spsc_pop(spsc_t* ring, void* item) {
+    CHIPS_ASSERT(ring && item);
+    const uint32_t head = (uint32_t) atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->cached_tail) {
+        ring->cached_tail = (uint32_t) atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == ring->cached_tail) {
+            return false;
+        }
+    }
+    memcpy(item, ring->buf + (head & ring->mask) * ring->item_size, ring->item_size);
+    atomic_store_explicit(&ring->head, (uint32_t)(head + 1), memory_order_release);
+    return true;
+}
+
+uint32_t spsc_count(spsc_t* ring) {
+    CHIPS_ASSERT(ring);
+    const uint32_t head = (uint32_t) atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint32_t tail = (uint32_t) atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return (uint32_t)(tail - head);
+}
+
+/*
+    Each of the three buffers is owned by exactly one of: the producer
+    (back), the consumer (front), or the shared middle slot. Publishing
+    swaps the back buffer into the middle slot and marks it fresh,
+    reading swaps a fresh middle buffer into the front. The acq_rel
+    exchange makes the frame contents visible together with the index.
+*/
+void spsc_triple_init(spsc_triple_t* tb, void* buf0, void* buf1, void* buf2) {
+    CHIPS_ASSERT(tb && buf0 && buf1 && buf2);
+    memset(tb, 0, sizeof(spsc_triple_t));
+    tb->buf[0] = buf0;
+    tb->buf[1] = buf1;
+    tb->buf[2] = buf2;
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+void* spsc_triple_back(spsc_triple_t* tb) {
+    CHIPS_ASSERT(tb);
+    return tb->buf[tb->back];
+}
+
+void spsc_triple_publish(spsc_triple_t* tb) {
+    CHIPS_ASSERT(tb);
+    const uint32_t prev = (uint32_t) atomic_exchange_explicit(&tb->middle, tb->back | SPSC_TRIPLE_FRESH, memory_order_acq_rel);
+    tb->back = prev & 3;
+}
+
+const void* spsc_triple_front(spsc_triple_t* tb, bool* out_fresh) {
+    CHIPS_ASSERT(tb);
+    bool fresh = false;
+    if (atomic_load_explicit(&tb->middle, memory_order_relaxed) & SPSC_TRIPLE_FRESH) {
+        const uint32_t prev = (uint32_t) atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+        tb->front = prev & 3;
+        fresh = true;
+    }
+    if (out_fresh) {
+        *out_fresh = fresh;
+    }
+    return tb->buf[tb->front];
+}
+
+#endif /* CHIPS_IMPL */
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -5,9 +6,14 @@
 #include <signal.h>
 #define CHIPS_IMPL
 #include "chips/chips_common.h"
-#include "chips/m6502.h"
 #include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/m6530.h"
+#include "chips/sched.h"
 #include "chips/clk.h"
+#include "chips/spsc.h"
+#include "systems/kim1_tape.h"
+#include "systems/kim1.h"
 
 int main(int, char**){
     printf("Hello, from gtkimone!\n");
@@ -1,5 +1,388 @@
 #pragma once
+/*#
+    # kim1.h
 
+    A MOS KIM-1 emulator in a C header.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1.h:
+
+    - chips/chips_common.h
+    - chips/mem.h
+    - chips/m6502.h
+    - chips/m6530.h
+    - chips/sched.h
+    - chips/clk.h
+    - systems/kim1_tape.h
+
+    (mem.h must come before m6502.h for the instruction-stepped mode)
+
+    ## The MOS KIM-1
+
+    A 6502 single board computer with 1 KB RAM, two 6530 RRIOT chips
+    (each with 1 KB ROM, 64 bytes RAM, two 8-bit I/O ports and an
+    interval timer), a hex keypad, a 6-digit LED display and a teletype
+    and cassette interface.
+
+    The address lines A10..A12 are decoded into eight 1 KB blocks (K0..K7),
+    A13..A15 are not decoded, so the 8 KB address space is mirrored
+    across the whole 64 KB address space. This is also how the CPU
+    finds the reset and interrupt vectors at FFFA..FFFF in the 6530-002 ROM.
+
+    ~~~
+    0000..03FF      K0: 1 KB RAM
+    0400..13FF      K1..K4: unused (expansion)
+    1400..16FF      K5: unused
+    1700..173F      K5: 6530-003 I/O and timer
+    1740..177F      K5: 6530-002 I/O and timer
+    1780..17BF      K5: 6530-003 RAM
+    17C0..17FF      K5: 6530-002 RAM
+    1800..1BFF      K6: 6530-003 ROM (tape and teletype routines)
+    1C00..1FFF      K7: 6530-002 ROM (monitor, keypad and display routines)
+    ~~~
+
+    The IRQ outputs of both RRIOTs are connected to the CPU IRQ pin (on
+    the real board this is done with a jumper from the 6530-003 PB7).
+
+    ## Execution modes
+
+    The RRIOTs are not ticked along with the CPU, instead they are only
+    brought up to date when the CPU accesses them, and everything that
+    needs to happen at a specific clock cycle without CPU involvement (like
+    the RRIOT timer interrupts) is registered as an event in a sched_t
+    scheduler. The run loop executes the CPU back to back until the next
+    event is due.
+
+    By default the CPU is cycle-stepped with m6502_tick(). Set
+    kim1_desc_t.instr_stepped to run the CPU instruction-by-instruction
+    with m6502_exec_instr() instead, this skips the per-cycle pin mask
+    roundtrip and is several times faster, but RRIOT register accesses
+    only happen with instruction granularity. When a debug callback is
+    installed, the cycle-stepped mode is always used.
+
+    Set kim1_desc_t.block_cache (together with instr_stepped) to run the
+    CPU with m6502_exec_block() on top of that: straight-line code runs
+    from a basic block cache in kim1_t (see m6502.h). Blocks end at each
+    I/O access, so the RRIOT timing is the same as in instruction-stepped
+    mode, but interrupts are only taken at the start of a block, and ROM
+    pages with installed traps aren't cached. After writing code into RAM
+    from the outside (for instance with mem_write_range()), call
+    m6502_block_cache_invalidate(&sys->blocks, addr, num_bytes).
+
+    ## Idle loop fast-forward
+
+    Set kim1_desc_t.idle_skip (together with instr_stepped) to skip over
+    idle loops, like the monitor's display/keypad scan loop when no key is
+    pressed. kim1_exec() picks the address of an instruction as candidate
+    loop head and records the machine state (CPU registers, pins, RRIOTs
+    and RAM). When the CPU comes back to that address within
+    KIM1_IDLE_MAX_PERIOD ticks with exactly the same state, and without
+    having read a RRIOT timer or interrupt flag or produced teletype or
+    tape output in between (the output isn't part of the compared state),
+    every further iteration would do exactly the same, so the loop is
+    fast-forwarded by a whole number of iterations to just before the
+    next scheduled event (like a timer interrupt) or the end of the time
+    slice. Port outputs (like the display) keep the values the loop
+    writes, and since inputs only change between kim1_exec() calls, a key
+    press or other input ends the idle loop at the start of the next time
+    slice.
+
+    Fast-forwarding gives exactly the same state as running the idle loop,
+    kim1_t.idle.skipped_ticks counts the skipped ticks.
+
+    ## Profiling
+
+    To find out where a guest program spends its time, install a
+    kim1_profile_t (it's about 1 MB, so it lives outside of kim1_t):
+
+    ~~~C
+    static kim1_profile_t prof;
+    kim1_profile_reset(&prof);
+    kim1_set_profile(&sys, &prof);
+    ...
+    kim1_exec(&sys, micro_seconds);
+    ...
+    kim1_profile_hot_t hot[16];
+    uint32_t num = kim1_profile_hot(&prof, hot, 16);
+    ~~~
+
+    While a profile is installed, kim1_exec() runs a separate loop which
+    counts instructions and clock cycles per opcode (op_instrs/op_cycles)
+    and per instruction address (pc_instrs/pc_cycles) at each opcode
+    fetch (M6502_SYNC). The cycles from one opcode fetch to the next are
+    counted for the instruction at the first fetch, this includes the
+    cycles of an interrupt which is taken after it, and of any ROM trap
+    at the next fetch. The regular run loops aren't touched, and the
+    profiling loop only does a few array increments per instruction, so
+    guest programs are profiled at close to full speed. Idle loops aren't
+    fast-forwarded and the basic block cache only runs single instructions
+    while a profile is installed (instruction- or cycle-stepped mode is
+    still used as configured), and a debug callback takes precedence over
+    the profile.
+
+    kim1_profile_hot() sorts the instruction addresses by cycles and
+    copies the hottest into an array. The addresses are CPU addresses,
+    so code which runs in different mirrors shows up at different
+    addresses. Call kim1_set_profile(&sys, 0) to stop profiling.
+
+    ## Breakpoints and Watchpoints
+
+    Instead of checking a debug callback in every tick, a debugger (or a
+    test harness which waits for a program to finish) can compile its
+    stop conditions into a kim1_breakpoints_t and run until one of them
+    is hit:
+
+    ~~~C
+    static kim1_breakpoints_t bp;
+    kim1_breakpoints_init(&bp);
+    kim1_add_breakpoint(&bp, 0x1C00);
+    kim1_add_watchpoint(&bp, 0x0010, 1, KIM1_WATCH_WRITE);
+    kim1_stop_t stop = kim1_run_until(&sys, &bp, max_ticks);
+    switch (stop.reason) {
+        case KIM1_STOP_BREAKPOINT: ...
+        case KIM1_STOP_WATCHPOINT: ... // stop.addr was accessed
+        case KIM1_STOP_TICKS: ...      // ran for max_ticks
+    }
+    ~~~
+
+    The breakpoints are a bit map over all instruction addresses, which
+    is only tested at opcode fetches. A breakpoint stops before the
+    instruction is executed, except at the first instruction of a
+    kim1_run_until() call, so that it can continue from a breakpoint.
+
+    Write watchpoints use the MEM_PAGEATTR_WATCH page attribute of mem_t
+    (see mem_set_watch()), so writes into other pages run as fast
+    as usual. Read watchpoints are tested for each read access into a
+    watched page, and also trigger on instruction fetches. A watchpoint
+    stops after the instruction which made the access. Both work with
+    decoded addresses (breakpoints and watchpoints also trigger in all
+    mirrors), and also cover the RRIOT registers and RAM in K5.
+
+    kim1_run_until() runs in the configured instruction- or cycle-stepped
+    mode (idle loops aren't fast-forwarded, the block cache only runs
+    single instructions and doesn't run cached code from read-watched
+    pages, and the debug callback and profile aren't called), and handles
+    events and traps like kim1_exec().
+
+    ## LED display
+
+    The six 7-segment digits are multiplexed: the 6530-002 port A
+    outputs PA0..PA6 drive the segments a..g, and PB1..PB4 select a
+    digit through a 74145 decoder (values 4..9 select the digits from
+    left to right). The emulator doesn't look at the ports in every tick,
+    instead each write to a 6530-002 port register adds the time since
+    the last change to a lit-time counter of each segment which was lit
+    until now.
+
+    At the end of each kim1_exec() call (usually once per host frame)
+    the lit-times are converted into a stable frame with one brightness
+    level (0..15) per segment, this frame is exposed with
+    kim1_display_info() as a KIM1_DISPLAY_NUM_SEGMENTS x
+    KIM1_DISPLAY_NUM_DIGITS framebuffer with 1 byte per pixel (a row
+    per digit, a column per segment) and a 16 entry palette. A segment
+    which was lit all the time its digit was selected in a regular scan
+    over all 6 digits is at full brightness.
+
+    ## Keypad
+
+    The 74145 decoder outputs 0..2 (PB1..PB4 values 0..2) select a row of
+    the keypad, and the keys of the selected row pull PA6..PA0 low. The
+    key codes are the codes returned by the monitor's GETKEY routine
+    (KIM1_KEY_0..KIM1_KEY_F, KIM1_KEY_AD, KIM1_KEY_DA, KIM1_KEY_PLUS,
+    KIM1_KEY_GO and KIM1_KEY_PC), row N reads the keys 7*N..7*N+6. The two
+    keys outside the matrix are wired to the CPU: KIM1_KEY_ST (stop) pulls
+    NMI low, and KIM1_KEY_RS (reset) resets the CPU and both RRIOTs. The
+    SST (single step) switch isn't emulated.
+
+    Key presses and releases are queued as events with a clock tick:
+
+    ~~~C
+    // press or release a key at the current tick
+    bool kim1_key_down(kim1_t* sys, int key);
+    bool kim1_key_up(kim1_t* sys, int key);
+    // press or release a key at a specific tick (for instance for scripted input)
+    bool kim1_key_event(kim1_t* sys, uint64_t tick, int key, bool down);
+    ~~~
+
+    The next queued event is a scheduler event which updates the
+    pressed keys, the port A input value is only computed from the
+    pressed keys and the selected row when the CPU reads port A. Since
+    the keys change at exact clock ticks (and idle loops aren't
+    fast-forwarded over a key event), scripted input gives the same
+    results in any execution mode and at any host speed. The functions
+    return false when the queue (KIM1_KEY_QUEUE_SIZE events) is full.
+
+    ## Teletype
+
+    Set kim1_desc_t.tty.enabled to close the TTY/keypad jumper, the
+    monitor then talks to a teletype instead of the keypad and display.
+    The serial line is bit-banged by the ROM through the 6530-002: the
+    receive line is PA7 and the transmit line is PB0 (1 is the idle/mark
+    level), the ROM routines GETCH and OUTCH time each bit with delay
+    loops. The host side of the teletype are two byte FIFOs:
+
+    ~~~C
+    // send bytes to the KIM-1, returns the number of bytes accepted
+    uint32_t kim1_tty_put(kim1_t* sys, const uint8_t* bytes, uint32_t num_bytes);
+    // receive bytes from the KIM-1, returns the number of bytes copied
+    uint32_t kim1_tty_get(kim1_t* sys, uint8_t* buf, uint32_t max_bytes);
+    ~~~
+
+    By default the bytes are serialized bit by bit at kim1_desc_t.tty.baud
+    (start bit, 8 data bits, stop bit): the next byte from the FIFO starts
+    with its start bit when the program samples PA7 after the previous
+    byte has ended, and the transmit line is decoded from the PB0 edges.
+    Both sides only do work when the CPU accesses port A or B, no
+    per-tick polling is involved. After a reset the monitor measures the
+    bit rate from the first received character, so send a RUBOUT (7F)
+    first. The receiver doesn't buffer like a UART, bytes which arrive
+    while the program isn't waiting in GETCH are lost, just like on the
+    real machine.
+
+    Set kim1_desc_t.tty.trap to bypass the bit-banging: when the CPU is
+    about to execute GETCH or OUTCH (or the GETCH start bit polling loop),
+    the byte is moved directly between the FIFO and the CPU registers
+    and the routine returns immediately, with the "trap code" prefetch
+    described in m6502.h. This makes paper-tape loads and listings run
+    at host speed. GETCH only traps when a byte is waiting in the FIFO,
+    otherwise it runs (and idles) normally, a byte which arrives while
+    it waits for the start bit is taken by the trap on the next pass of
+    the polling loop. The bit rate measurement after reset isn't trapped.
+    The trap is only installed if the 6530-002 ROM image has the original
+    monitor code at the trap addresses.
+
+    ## Cassette
+
+    The cassette interface is a kim1_tape_t (see kim1_tape.h), the tape
+    input is PB7 of the 6530-002, and while recording, the PB7 output is
+    decoded back into tape characters:
+
+    ~~~C
+    // insert a tape image (not copied, e.g. a memory-mapped file)
+    bool kim1_insert_tape(kim1_t* sys, chips_range_t image);
+    void kim1_remove_tape(kim1_t* sys);
+    bool kim1_is_tape_inserted(kim1_t* sys);
+    // press Play or Record (with a buffer for the recorded tape image), or Stop
+    void kim1_play_tape(kim1_t* sys);
+    void kim1_record_tape(kim1_t* sys, chips_range_t buffer);
+    void kim1_stop_tape(kim1_t* sys);
+    ~~~
+
+    The tape isn't ticked, the end of each tone run on the playing tape
+    is a scheduler event, so a tape load costs one event per half bit.
+
+    Set kim1_desc_t.tape.trap to replace the monitor's LOADT (1873) and
+    DUMPT (1800) routines with a direct copy between the tape image
+    and memory. The load trap only works with an inserted tape, and the
+    dump trap only while recording, otherwise the ROM routines run
+    normally. The trap is only installed if the 6530-003 ROM image has
+    the original tape code at these addresses.
+
+    ## Snapshots
+
+    kim1_t doesn't own any heap memory, so a snapshot is simply a
+    kim1_t copy with the host pointers (callbacks and mem_t page
+    pointers) patched to zero or offsets, this includes the tape image
+    and record buffer pointers (the target instance keeps its own tape):
+
+    ~~~C
+    static kim1_t snapshot;
+    uint32_t version = kim1_save_snapshot(&sys, &snapshot);
+    ...
+    if (!kim1_load_snapshot(&sys, version, &snapshot)) {
+        // snapshot version mismatch
+    }
+    ~~~
+
+    The snapshot blob can be written to a file as is, and loaded into
+    any kim1_t instance. Loading is a single memcpy() plus rebasing the
+    mem_t pointers to the target instance, the debug and CPU callbacks
+    of the target instance are preserved (and so is an installed
+    profile, see kim1_set_profile()). Neither function allocates
+    memory or uses static state, so snapshots are safe to load from
+    multiple threads into different instances.
+
+    kim1_replay.h uses snapshots as keyframes to record and replay whole
+    sessions, kim1_rewind.h keeps a delta-compressed history of the same
+    state to step back in time.
+
+    ## Forks
+
+    To spawn many short-lived instances from the same state, use
+    kim1_fork() instead of loading a snapshot:
+
+    ~~~C
+    kim1_fork(&fork, &parent);
+    ~~~
+
+    A fork copies the CPU, RRIOT and scheduler state of the parent, but
+    not its memory: the ROM pages are mapped read-only to the parent's
+    ROM images, and the RAM is mapped copy-on-write (see mem_map_cow()),
+    so the 1 KB RAM page is only copied into the fork on the first write.
+    Forks run with mem_t in paged mode (when compiled with MEM_FLAT, see
+    mem.h, the memory is copied into the fork instead). The parent must
+    not run, be discarded or be reloaded while forks of it exist (a fork
+    can be forked again, the new fork shares the memory the old fork
+    currently sees).
+
+    A snapshot of a fork is a regular self-contained snapshot.
+
+    ## Shared Images
+
+    By default kim1_init() copies the ROM images (and the optional
+    initial RAM contents in kim1_desc_t.ram) into the kim1_t instance.
+    With kim1_desc_t.share_images the images are mapped instead: the
+    ROM pages read straight from the ROM images, and the RAM page is
+    mapped copy-on-write, so it's only copied into the instance on the
+    first write. Many instances can share the same (for instance
+    memory-mapped, see kim1_image.h) images this way:
+
+    ~~~C
+    kim1_init(&sys, &(kim1_desc_t){
+        .share_images = true,
+        .roms = { .rom_002 = rom_002->data, .rom_003 = rom_003->data },
+        .ram = program->ram,
+    });
+    ~~~
+
+    The images are never written, and must remain valid and unchanged
+    while any instance (or fork of it) uses them. Like forks, such
+    instances run with mem_t in paged mode (with MEM_FLAT the images are
+    copied), and their snapshots are self-contained.
+
+    ## Memory Layout
+
+    kim1_t is aligned to the host cache line size (KIM1_CACHE_LINE_SIZE)
+    and puts the state which the tick and instruction loops touch at the
+    front. The CPU fills the first cache line, the second holds the pins,
+    the tick counter, a copy of the next event tick, the IRQ lines and the
+    idle loop candidate, and the RRIOT port and timer state follows in two
+    more lines (the RRIOT RAM is in a line of its own), so that an instance
+    runs from 6 cache lines plus the mem_t page attributes and flat pointer
+    and the RAM lines in use. The display, keypad, teletype and tape state,
+    the event heap, the idle loop head state, the mem_t mapping layers and
+    the block cache are cold and come behind. This matters most when many
+    instances share a core (see kim1_batch.h), the layout is part of the
+    snapshot format.
+
+    ## Links
+
+    http://www.zimmers.net/anonftp/pub/cbm/documents/chipdata/kim-1/
+
+#*/
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -9,18 +392,284 @@
 extern "C" {
 #endif
 
-typedef struct {
+#define KIM1_FREQUENCY (1000000)
+#define KIM1_IDLE_MAX_PERIOD (20000)    // max length of a fast-forwarded idle loop in ticks
+#define KIM1_IDLE_RETRY_TICKS (10000)   // ticks to wait before looking for a new idle loop
+#define KIM1_DISPLAY_NUM_DIGITS (6)
+#define KIM1_DISPLAY_NUM_SEGMENTS (7)
+#define KIM1_DISPLAY_NUM_LEVELS (16)    // brightness levels (and palette entries)
+#define KIM1_TTY_FIFO_SIZE (256)        // size of the TTY input and output FIFOs (power of 2)
+#define KIM1_TTY_DEFAULT_BAUD (300)
+#define KIM1_KEY_QUEUE_SIZE (32)        // max number of queued key events
+#define KIM1_CACHE_LINE_SIZE (64)       // host cache line size (see "Memory Layout")
+// bump snapshot version when kim1_t memory layout changes
+#define KIM1_SNAPSHOT_VERSION (12)
+
+// keypad key codes (same as the monitor's GETKEY codes for the keys in the matrix)
+#define KIM1_KEY_0      (0x00)      // ...up to KIM1_KEY_F (0x0F)
+#define KIM1_KEY_F      (0x0F)
+#define KIM1_KEY_AD     (0x10)      // address mode
+#define KIM1_KEY_DA     (0x11)      // data mode
+#define KIM1_KEY_PLUS   (0x12)      // next address
+#define KIM1_KEY_GO     (0x13)      // run program
+#define KIM1_KEY_PC     (0x14)      // recall program counter
+#define KIM1_KEY_ST     (0x15)      // stop (NMI)
+#define KIM1_KEY_RS     (0x16)      // reset
+#define KIM1_NUM_KEYS   (0x17)
+
+// scheduler event ids
+#define KIM1_EVENT_RRIOT002 (0)     // 6530-002 IRQ output change
+#define KIM1_EVENT_RRIOT003 (1)     // 6530-003 IRQ output change
+#define KIM1_EVENT_TAPE     (2)     // end of a tone run on the playing tape
+#define KIM1_EVENT_KEYPAD   (3)     // next queued key event
+#define KIM1_NUM_EVENTS     (4)
 
+// config parameters for kim1_init()
+typedef struct {
+    bool instr_stepped;             // run the CPU with m6502_exec_instr() instead of m6502_tick()
+    bool idle_skip;                 // fast-forward over idle loops (only in instr_stepped mode)
+    bool block_cache;               // run cached basic blocks (only in instr_stepped mode)
+    chips_debug_t debug;            // optional debugging hook
+    struct {
+        bool enabled;               // TTY/keypad jumper closed: the monitor uses the teletype
+        bool trap;                  // move whole bytes by trapping GETCH/OUTCH
+        uint32_t baud;              // bit rate of the serial line (default: KIM1_TTY_DEFAULT_BAUD)
+    } tty;
+    struct {
+        bool trap;                  // copy whole recordings by trapping LOADT/DUMPT
+    } tape;
+    struct {
+        chips_range_t rom_002;      // optional 1 KByte 6530-002 ROM dump (mapped at 1C00..1FFF)
+        chips_range_t rom_003;      // optional 1 KByte 6530-003 ROM dump (mapped at 1800..1BFF)
+    } roms;
+    chips_range_t ram;              // optional 1 KByte initial RAM contents (mapped at 0000..03FF)
+    bool share_images;              // map the ROM and RAM images without copying (see "Shared Images")
 } kim1_desc_t;
 
+// LED display decoder state
+typedef struct {
+    uint8_t digit;                  // currently selected digit (0..5), or 0xFF if none
+    uint8_t segments;               // currently lit segments of the selected digit
+    uint64_t last_tick;             // tick of the last port change
+    uint64_t frame_tick;            // start tick of the current frame
+    uint64_t lit[KIM1_DISPLAY_NUM_DIGITS][KIM1_DISPLAY_NUM_SEGMENTS];          // total lit ticks per segment
+    uint64_t frame_lit[KIM1_DISPLAY_NUM_DIGITS][KIM1_DISPLAY_NUM_SEGMENTS];    // lit ticks at the start of the current frame
+    uint8_t fb[KIM1_DISPLAY_NUM_DIGITS * KIM1_DISPLAY_NUM_SEGMENTS];           // the last published frame
+} kim1_display_t;
+
+// a key press or release
 typedef struct {
-    m6502_t cpu;
+    uint64_t tick;
+    uint8_t key;                    // KIM1_KEY_*
+    bool down;
+} kim1_key_event_t;
+
+// keypad state
+typedef struct {
+    uint32_t down;                  // one bit per pressed key (bit index is the key code)
+    uint32_t num_events;
+    kim1_key_event_t events[KIM1_KEY_QUEUE_SIZE];  // queued key events, sorted by tick
+} kim1_keypad_t;
+
+// a TTY byte FIFO, head and tail are free-running counters
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint8_t buf[KIM1_TTY_FIFO_SIZE];
+} kim1_tty_fifo_t;
+
+// teletype serial line state
+typedef struct {
+    bool enabled;
+    bool trap;                      // GETCH/OUTCH trap installed
+    uint32_t bit_ticks;             // length of one bit in ticks
+    // receiver (host to KIM-1, PA7)
+    bool rx_busy;                   // a byte is being shifted out on the receive line
+    bool rx_hold;                   // the GETCH start bit poll doesn't start a byte, the trap takes it
+    uint8_t rx_byte;
+    uint64_t rx_start_tick;         // tick of the current byte's start bit
+    // transmitter (KIM-1 to host, PB0)
+    bool tx_busy;                   // a byte is being decoded from the transmit line
+    uint8_t tx_level;               // current PB0 output level
+    uint8_t tx_bits;                // number of bits of the current byte sampled so far
+    uint8_t tx_byte;
+    uint64_t tx_start_tick;         // tick of the current byte's start bit
+    kim1_tty_fifo_t rx_fifo;
+    kim1_tty_fifo_t tx_fifo;
+} kim1_tty_t;
+
+// idle loop detection state
+typedef struct {
+    uint32_t pc;                    // candidate loop head address, or > 0xFFFF if none
+    bool volatile_read;             // a timer register was read or output produced since the candidate was recorded
+    uint64_t start_tick;            // tick when the candidate state was recorded
+    uint64_t retry_tick;            // earliest tick to record a new candidate
+    uint64_t skipped_ticks;         // number of fast-forwarded ticks
+} kim1_idle_t;
+
+// machine state at the idle loop candidate head (only touched at the loop head)
+typedef struct {
+    uint8_t a, x, y, s, p;
+    uint8_t irq_lines;
+    uint64_t pins;
     m6530_t rriot002;
     m6530_t rriot003;
-    mem_t mem;
+    uint8_t ram[0x0400];
+    uint64_t display_lit[KIM1_DISPLAY_NUM_DIGITS][KIM1_DISPLAY_NUM_SEGMENTS];  // display lit ticks at the loop head
+} kim1_idle_state_t;
+
+// instruction and cycle counters for kim1_set_profile()
+typedef struct {
+    uint64_t num_instrs;            // total number of counted instructions
+    uint64_t num_cycles;            // total number of counted cycles
+    uint64_t op_instrs[256];        // instructions per opcode
+    uint64_t op_cycles[256];        // cycles per opcode
+    uint64_t pc_instrs[0x10000];    // instructions per instruction address
+    uint64_t pc_cycles[0x10000];    // cycles per instruction address
+    // the last opcode fetch
+    bool started;
+    uint8_t last_op;
+    uint16_t last_pc;
+    uint64_t last_tick;
+} kim1_profile_t;
+
+// an instruction address returned by kim1_profile_hot()
+typedef struct {
+    uint16_t pc;
+    uint64_t instrs;
+    uint64_t cycles;
+} kim1_profile_hot_t;
+
+#define KIM1_MAX_WATCHPOINTS (16)
+// watchpoint modes
+#define KIM1_WATCH_READ  (1<<0)
+#define KIM1_WATCH_WRITE (1<<1)
+// kim1_run_until() stop reasons
+#define KIM1_STOP_TICKS      (0)    // max_ticks have been executed
+#define KIM1_STOP_BREAKPOINT (1)    // the next instruction is at a breakpoint
+#define KIM1_STOP_WATCHPOINT (2)    // the last instruction accessed a watched address
+
+// a watched memory range (in the decoded 8 KB address space)
+typedef struct {
+    uint16_t addr;
+    uint16_t size;
+    uint8_t mode;                   // KIM1_WATCH_READ and/or KIM1_WATCH_WRITE
+} kim1_watchpoint_t;
+
+// compiled stop conditions for kim1_run_until()
+typedef struct {
+    uint64_t pc[0x10000 / 64];      // one bit per breakpoint address
+    uint64_t rd_pages;              // 1 KByte pages with read watchpoints
+    uint64_t wr_pages;              // 1 KByte pages with write watchpoints
+    uint32_t num_watchpoints;
+    kim1_watchpoint_t watchpoints[KIM1_MAX_WATCHPOINTS];
+} kim1_breakpoints_t;
+
+// the result of kim1_run_until()
+typedef struct {
+    int reason;                     // KIM1_STOP_*
+    uint16_t pc;                    // address of the next instruction
+    uint16_t addr;                  // the watched address which was accessed (KIM1_STOP_WATCHPOINT)
+    bool write;                     // true if the access was a write (KIM1_STOP_WATCHPOINT)
+    uint64_t ticks;                 // executed ticks
+} kim1_stop_t;
+
+// KIM-1 emulator state (see "Memory Layout")
+typedef struct kim1_t {
+    // hot: touched by each tick or instruction
+    alignas(KIM1_CACHE_LINE_SIZE) m6502_t cpu;
+    alignas(KIM1_CACHE_LINE_SIZE) uint64_t pins;
+    uint64_t ticks;                 // clock cycles since power-on
+    uint64_t next_event_tick;       // copy of sched_next(&sched), kept up to date by the _kim1_sched_*() wrappers
+    uint8_t irq_lines;              // one bit per RRIOT with an active IRQ output (bit index is the event id)
+    kim1_idle_t idle;               // the loop head candidate
+    m6530_t rriot002;               // the RAM is in a separate cache line
+    m6530_t rriot003;
+    // cold: touched on port changes, events and host calls
+    kim1_display_t display;
+    kim1_keypad_t keypad;
+    kim1_tty_t tty;
+    kim1_tape_t tape;
+    sched_t sched;                  // the event heap, only touched when an event is due or (re)scheduled
+    kim1_idle_state_t idle_state;   // only touched at the idle loop head
+    mem_t mem;                      // the page attributes and flat pointer are hot, the mapping layers cold
+    bool valid;
+    bool instr_stepped;
+    bool idle_skip;
+    bool block_cache;
+    bool tape_trap;                 // LOADT/DUMPT trap installed
+    bool traps;                     // any ROM trap installed
+    chips_debug_t debug;
+    kim1_profile_t* profile;        // optional profiler counters, or 0
+    const struct kim1_t* parent;    // kim1_fork() parent which owns shared memory, or 0
+
+    // the decoded 8 KB address space, used as flat memory block by mem_t
+    alignas(KIM1_CACHE_LINE_SIZE) struct {
+        uint8_t ram[0x0400];        // 0000..03FF: 1 KB main RAM
+        uint8_t unmapped[0x1400];   // 0400..17FF: unused, reads as FF (K5 is handled as I/O)
+        uint8_t rom_003[0x0400];    // 1800..1BFF: 1 KB 6530-003 ROM image
+        uint8_t rom_002[0x0400];    // 1C00..1FFF: 1 KB 6530-002 ROM image
+    };
+    // behind the memory, so that kim1_fork() doesn't copy it
+    m6502_block_cache_t blocks;
 } kim1_t;
 
-void vic20_init(kim1_t* sys, const kim1_desc_t* desc);
+// initialize a new KIM-1 instance
+void kim1_init(kim1_t* sys, const kim1_desc_t* desc);
+// discard a KIM-1 instance
+void kim1_discard(kim1_t* sys);
+// reset a KIM-1 instance
+void kim1_reset(kim1_t* sys);
+// tick KIM-1 instance for a given number of microseconds, return number of executed ticks
+uint32_t kim1_exec(kim1_t* sys, uint32_t micro_seconds);
+// execute a single instruction (instruction-stepped, handles due events first), return number of executed ticks
+uint32_t kim1_step(kim1_t* sys);
+// create a fork which shares the ROM and (copy-on-write) RAM with the parent
+void kim1_fork(kim1_t* sys, const kim1_t* parent);
+// take a snapshot, patches pointers to zero or offsets, returns snapshot version
+uint32_t kim1_save_snapshot(kim1_t* sys, kim1_t* dst);
+// load a snapshot, returns false if snapshot version doesn't match
+bool kim1_load_snapshot(kim1_t* sys, uint32_t version, const kim1_t* src);
+// get the LED display frame as framebuffer (sys can be 0 to get only the dimensions)
+chips_display_info_t kim1_display_info(kim1_t* sys);
+// send bytes to the teletype input, returns number of bytes accepted
+uint32_t kim1_tty_put(kim1_t* sys, const uint8_t* bytes, uint32_t num_bytes);
+// receive bytes from the teletype output, returns number of bytes copied
+uint32_t kim1_tty_get(kim1_t* sys, uint8_t* buf, uint32_t max_bytes);
+// insert a tape image (not copied, must remain valid until removed)
+bool kim1_insert_tape(kim1_t* sys, chips_range_t image);
+// remove the tape image
+void kim1_remove_tape(kim1_t* sys);
+// return true if a tape is inserted
+bool kim1_is_tape_inserted(kim1_t* sys);
+// start the tape (press the Play button)
+void kim1_play_tape(kim1_t* sys);
+// start recording into a buffer (press the Record button), the recorded size is in sys->tape.rec_pos
+void kim1_record_tape(kim1_t* sys, chips_range_t buffer);
+// stop the tape (press the Stop button)
+void kim1_stop_tape(kim1_t* sys);
+// press a key (KIM1_KEY_*) at the current tick, returns false if the key event queue is full
+bool kim1_key_down(kim1_t* sys, int key);
+// release a key at the current tick, returns false if the key event queue is full
+bool kim1_key_up(kim1_t* sys, int key);
+// press or release a key at a tick (a tick in the past means now), returns false if the key event queue is full
+bool kim1_key_event(kim1_t* sys, uint64_t tick, int key, bool down);
+// clear all breakpoints and watchpoints
+void kim1_breakpoints_init(kim1_breakpoints_t* bp);
+// add a breakpoint (in all mirrors)
+void kim1_add_breakpoint(kim1_breakpoints_t* bp, uint16_t pc);
+// remove a breakpoint (in all mirrors)
+void kim1_remove_breakpoint(kim1_breakpoints_t* bp, uint16_t pc);
+// add a watchpoint (KIM1_WATCH_READ and/or KIM1_WATCH_WRITE), returns false if there are too many
+bool kim1_add_watchpoint(kim1_breakpoints_t* bp, uint16_t addr, uint16_t size, uint8_t mode);
+// run until a breakpoint or watchpoint is hit, or for max_ticks
+kim1_stop_t kim1_run_until(kim1_t* sys, const kim1_breakpoints_t* bp, uint64_t max_ticks);
+// install profiler counters (not copied, must remain valid until removed), or 0 to stop profiling
+void kim1_set_profile(kim1_t* sys, kim1_profile_t* prof);
+// clear all profiler counters
+void kim1_profile_reset(kim1_profile_t* prof);
+// copy the instruction addresses with the most cycles into an array (hottest first), returns number of entries
+uint32_t kim1_profile_hot(const kim1_profile_t* prof, kim1_profile_hot_t* out, uint32_t max_entries);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -35,4 +684,1428 @@ void vic20_init(kim1_t* sys, const kim1_desc_t* desc);
     #define CHIPS_ASSERT(c) assert(c)
 #endif
 
+// the 8 KB decoded address space is mirrored 8 times across 64 KB
+#define _KIM1_MIRROR_SIZE (0x2000)
+#define _KIM1_NUM_MIRRORS (8)
+_Static_assert(offsetof(kim1_t, rom_002) - offsetof(kim1_t, ram) == 0x1C00, "kim1_t flat memory layout");
+// the per-instruction state next to the CPU fills exactly one cache line, see "Memory Layout"
+_Static_assert((offsetof(kim1_t, pins) % KIM1_CACHE_LINE_SIZE) == 0, "kim1_t hot line start");
+_Static_assert((offsetof(kim1_t, idle) + sizeof(kim1_idle_t)) <= (offsetof(kim1_t, pins) + KIM1_CACHE_LINE_SIZE), "kim1_t hot line size");
+_Static_assert(offsetof(kim1_t, ticks) < offsetof(kim1_t, next_event_tick), "kim1_t hot line order");
+_Static_assert(offsetof(kim1_t, next_event_tick) < offsetof(kim1_t, irq_lines), "kim1_t hot line order");
+_Static_assert(offsetof(kim1_t, irq_lines) < offsetof(kim1_t, idle), "kim1_t hot line order");
+_Static_assert(offsetof(kim1_t, rriot002) == (offsetof(kim1_t, pins) + KIM1_CACHE_LINE_SIZE), "kim1_t RRIOT lines");
+// the event heap and idle loop head state are cold, but machine state, so they must be in the kim1_fork()/rewind prefix
+_Static_assert(offsetof(kim1_t, sched) > offsetof(kim1_t, tape), "kim1_t cold state order");
+_Static_assert((offsetof(kim1_t, idle_state) + sizeof(kim1_idle_state_t)) <= offsetof(kim1_t, mem), "kim1_t fork prefix");
+// the K5 I/O block as 1 KB page mask over all mirrors (for m6502_bus_t.io_pages)
+#define _KIM1_IO_PAGES (0x2020202020202020ULL)
+// kim1_idle_t.pc if there's no candidate idle loop
+#define _KIM1_IDLE_NO_PC (0x10000)
+// monitor ROM routines and memory locations used by the ROM traps
+#define _KIM1_ROM_DUMPT (0x1800)    // LDA #$AD; STA VEB
+#define _KIM1_ROM_LOADT (0x1873)    // LDA #$8D; STA VEB
+#define _KIM1_ROM_START (0x1C4F)
+#define _KIM1_ROM_GETCH (0x1E5A)    // STX TMPX; LDX #8; LDA #1
+#define _KIM1_ROM_GET1 (0x1E60)     // BIT SAD; BNE GET6; BMI GET1 (wait for start bit)
+#define _KIM1_ROM_OUTCH (0x1EA0)    // STA CHAR; STX TMPX
+#define _KIM1_ZP_POINTL (0xFA)
+#define _KIM1_ZP_POINTH (0xFB)
+#define _KIM1_ZP_TMPX (0xFD)
+#define _KIM1_ZP_CHAR (0xFE)
+#define _KIM1_TIMH (0x17F4)
+#define _KIM1_SAL (0x17F5)
+#define _KIM1_SAH (0x17F6)
+#define _KIM1_EAL (0x17F7)
+#define _KIM1_EAH (0x17F8)
+#define _KIM1_ID (0x17F9)
+
+/* event scheduler wrappers
+
+    The event heap lives in the cold part of kim1_t, the per-instruction
+    event check only reads kim1_t.next_event_tick in the hot line. All
+    changes to the heap go through these wrappers to keep the copy in sync.
+*/
+static inline void _kim1_sched_sync(kim1_t* sys) {
+    sys->next_event_tick = sched_next(&sys->sched);
+}
+
+static inline void _kim1_sched_set(kim1_t* sys, int id, uint64_t tick) {
+    sched_set(&sys->sched, id, tick);
+    _kim1_sched_sync(sys);
+}
+
+static inline void _kim1_sched_cancel(kim1_t* sys, int id) {
+    sched_cancel(&sys->sched, id);
+    _kim1_sched_sync(sys);
+}
+
+static inline int _kim1_sched_pop(kim1_t* sys) {
+    const int id = sched_pop(&sys->sched, sys->ticks);
+    _kim1_sched_sync(sys);
+    return id;
+}
+
+/* 1400..17FF (K5): RRIOT I/O, timers and RAM
+
+    Only 1700..17FF is decoded, A6 selects between the
+    6530-003 (A6=0) and 6530-002 (A6=1), 1400..16FF reads
+    as unmapped memory.
+
+    The RRIOTs are brought up to the current tick before each access,
+    in the instruction-stepped mode this is the first tick of the
+    current instruction.
+*/
+static inline m6530_t* _kim1_rriot(kim1_t* sys, int id) {
+    return (id == KIM1_EVENT_RRIOT002) ? &sys->rriot002 : &sys->rriot003;
+}
+
+// reschedule a RRIOT IRQ event after the timer state has changed
+static void _kim1_rriot_update(kim1_t* sys, int id) {
+    m6530_t* rriot = _kim1_rriot(sys, id);
+    const bool irq = m6530_irq(rriot);
+    const bool line = 0 != (sys->irq_lines & (1<<id));
+    const uint64_t irq_tick = m6530_irq_tick(rriot);
+    if (irq != line) {
+        // IRQ output changed right now, update the CPU pin at the next event check
+        _kim1_sched_set(sys, id, sys->ticks);
+    }
+    else if (!irq && (irq_tick != SCHED_NEVER)) {
+        _kim1_sched_set(sys, id, irq_tick);
+    }
+    else {
+        _kim1_sched_cancel(sys, id);
+    }
+}
+
+/* teletype serial line
+
+    A byte on the line is a start bit (0), 8 data bits (LSB first) and a
+    stop bit (1). The receive line level is computed from the tick when
+    it is read, the transmit line is decoded from the PB0 output level
+    changes by sampling each bit in its middle.
+*/
+static bool _kim1_tty_fifo_push(kim1_tty_fifo_t* fifo, uint8_t val) {
+    if ((fifo->tail - fifo->head) >= KIM1_TTY_FIFO_SIZE) {
+        return false;
+    }
+    fifo->buf[fifo->tail++ & (KIM1_TTY_FIFO_SIZE - 1)] = val;
+    return true;
+}
+
+static bool _kim1_tty_fifo_pop(kim1_tty_fifo_t* fifo, uint8_t* val) {
+    if (fifo->head == fifo->tail) {
+        return false;
+    }
+    *val = fifo->buf[fifo->head++ & (KIM1_TTY_FIFO_SIZE - 1)];
+    return true;
+}
+
+// the receive line level (PA7) at the current tick, starts the next byte if the line is idle
+static uint8_t _kim1_tty_rx_level(kim1_t* sys) {
+    kim1_tty_t* tty = &sys->tty;
+    if (tty->rx_busy) {
+        const uint64_t bit = (sys->ticks - tty->rx_start_tick) / tty->bit_ticks;
+        if (bit == 0) {
+            return 0;
+        }
+        else if (bit <= 8) {
+            return (tty->rx_byte >> (bit - 1)) & 1;
+        }
+        else if (bit == 9) {
+            return 1;
+        }
+        tty->rx_busy = false;
+    }
+    if (tty->rx_hold) {
+        return 1;
+    }
+    if (_kim1_tty_fifo_pop(&tty->rx_fifo, &tty->rx_byte)) {
+        tty->rx_busy = true;
+        tty->rx_start_tick = sys->ticks;
+        return 0;
+    }
+    return 1;
+}
+
+// sample all transmitted bits whose middle is before the current tick
+static void _kim1_tty_tx_sample(kim1_t* sys) {
+    kim1_tty_t* tty = &sys->tty;
+    while (tty->tx_busy) {
+        const uint64_t mid_tick = tty->tx_start_tick + tty->tx_bits * tty->bit_ticks + (tty->bit_ticks / 2);
+        if (mid_tick >= sys->ticks) {
+            break;
+        }
+        if ((tty->tx_bits >= 1) && (tty->tx_bits <= 8)) {
+            tty->tx_byte |= tty->tx_level << (tty->tx_bits - 1);
+        }
+        if (++tty->tx_bits == 10) {
+            // stop bit sampled, a framing error (stop bit is 0) drops the byte
+            if (tty->tx_level) {
+                _kim1_tty_fifo_push(&tty->tx_fifo, tty->tx_byte);
+            }
+            tty->tx_busy = false;
+        }
+    }
+}
+
+// called when a 6530-002 port register was written
+static void _kim1_tty_tx_update(kim1_t* sys) {
+    kim1_tty_t* tty = &sys->tty;
+    const uint8_t level = sys->rriot002.pb.pins & 1;
+    if (level != tty->tx_level) {
+        // the decoded output isn't part of the idle loop state
+        sys->idle.volatile_read = true;
+        _kim1_tty_tx_sample(sys);
+        tty->tx_level = level;
+        if (!tty->tx_busy && (0 == level)) {
+            tty->tx_busy = true;
+            tty->tx_start_tick = sys->ticks;
+            tty->tx_bits = 0;
+            tty->tx_byte = 0;
+        }
+    }
+}
+
+// the 6530-002 port A inputs
+static uint8_t _kim1_port_a_input(kim1_t* sys, uint16_t addr) {
+    uint8_t data = 0xFF;
+    // the keys of the selected row pull PA6..PA0 low, the first key of a row is PA6
+    const uint32_t row = (sys->rriot002.pb.pins >> 1) & 0x0F;
+    if ((row < 3) && sys->keypad.down) {
+        const uint32_t keys = (sys->keypad.down >> (row * 7)) & 0x7F;
+        for (uint32_t i = 0; i < 7; i++) {
+            if (keys & (1<<i)) {
+                data &= ~(0x40 >> i);
+            }
+        }
+    }
+    if (sys->tty.enabled) {
+        // the TTY/keypad jumper connects the decoder output 3 with PA0
+        if (((sys->rriot002.pb.pins >> 1) & 0x0F) == 3) {
+            data &= ~1;
+        }
+        // only a read of the port A data register samples the receive line
+        if ((addr & 7) == M6530_REG_PAD) {
+            if (0 == _kim1_tty_rx_level(sys)) {
+                data &= ~(1<<7);
+            }
+            // ...and the line level changes over time while a byte is received
+            if (sys->tty.rx_busy) {
+                sys->idle.volatile_read = true;
+            }
+        }
+    }
+    return data;
+}
+
+static uint8_t _kim1_io_read(uint16_t addr, void* user_data) {
+    kim1_t* sys = (kim1_t*) user_data;
+    if ((addr & 0x0300) == 0x0300) {
+        const int id = (addr & (1<<6)) ? KIM1_EVENT_RRIOT002 : KIM1_EVENT_RRIOT003;
+        m6530_t* rriot = _kim1_rriot(sys, id);
+        rriot->ticks = sys->ticks;
+        rriot->pa.inpr = (id == KIM1_EVENT_RRIOT002) ? _kim1_port_a_input(sys, addr) : 0xFF;
+        // the tape PLL output is PB7 of the 6530-002
+        rriot->pb.inpr = ((id == KIM1_EVENT_RRIOT002) && sys->tape.playing && !sys->tape.level) ? 0x7F : 0xFF;
+        const uint8_t data = m6530_read(rriot, addr & M6530_ADDR_PINS);
+        if ((addr & ((1<<7)|(1<<2))) == (1<<2)) {
+            // timer read may have cleared the interrupt flag or changed the interrupt enable
+            _kim1_rriot_update(sys, id);
+            // ...and the value depends on time, so a loop doing this isn't idle
+            sys->idle.volatile_read = true;
+        }
+        return data;
+    }
+    return 0xFF;
+}
+
+/* LED display decoder
+
+    Only changes of the 6530-002 port pins are tracked, the time between
+    two changes is added to the lit-time of the segments which were lit.
+*/
+static void _kim1_display_flush(kim1_t* sys) {
+    kim1_display_t* disp = &sys->display;
+    if ((disp->digit < KIM1_DISPLAY_NUM_DIGITS) && disp->segments) {
+        const uint64_t dt = sys->ticks - disp->last_tick;
+        for (int seg = 0; seg < KIM1_DISPLAY_NUM_SEGMENTS; seg++) {
+            if (disp->segments & (1<<seg)) {
+                disp->lit[disp->digit][seg] += dt;
+            }
+        }
+    }
+    disp->last_tick = sys->ticks;
+}
+
+static void _kim1_display_update(kim1_t* sys) {
+    const m6530_t* rriot = &sys->rriot002;
+    // segment lines are only driven when PA0..PA6 are outputs, digit select values 4..9 select digits 0..5
+    const uint8_t segments = rriot->pa.outr & rriot->pa.ddr & 0x7F;
+    const uint8_t sel = (rriot->pb.pins >> 1) & 0x0F;
+    const uint8_t digit = ((sel >= 4) && (sel <= 9)) ? (sel - 4) : 0xFF;
+    kim1_display_t* disp = &sys->display;
+    if ((segments != disp->segments) || (digit != disp->digit)) {
+        _kim1_display_flush(sys);
+        disp->segments = segments;
+        disp->digit = digit;
+    }
+}
+
+// convert the lit-times since the last call into a new frame
+static void _kim1_display_publish(kim1_t* sys) {
+    kim1_display_t* disp = &sys->display;
+    _kim1_display_flush(sys);
+    const uint64_t frame_ticks = sys->ticks - disp->frame_tick;
+    if (0 == frame_ticks) {
+        return;
+    }
+    for (int digit = 0; digit < KIM1_DISPLAY_NUM_DIGITS; digit++) {
+        for (int seg = 0; seg < KIM1_DISPLAY_NUM_SEGMENTS; seg++) {
+            const uint64_t lit = disp->lit[digit][seg] - disp->frame_lit[digit][seg];
+            // full brightness at a 1/6 duty cycle
+            uint64_t level = (lit * (KIM1_DISPLAY_NUM_LEVELS - 1) * KIM1_DISPLAY_NUM_DIGITS + (frame_ticks / 2)) / frame_ticks;
+            if (level > (KIM1_DISPLAY_NUM_LEVELS - 1)) {
+                level = KIM1_DISPLAY_NUM_LEVELS - 1;
+            }
+            disp->fb[digit * KIM1_DISPLAY_NUM_SEGMENTS + seg] = (uint8_t)level;
+            disp->frame_lit[digit][seg] = disp->lit[digit][seg];
+        }
+    }
+    disp->frame_tick = sys->ticks;
+}
+
+static void _kim1_io_write(uint16_t addr, uint8_t data, void* user_data) {
+    kim1_t* sys = (kim1_t*) user_data;
+    // K5 isn't mapped memory, but is watched for writes like memory (see kim1_run_until())
+    if (sys->mem.page_attr[addr >> MEM_PAGE_SHIFT] & MEM_PAGEATTR_WATCH) {
+        sys->mem.watch_func(addr, data, sys->mem.watch_user_data);
+    }
+    if ((addr & 0x0300) == 0x0300) {
+        const int id = (addr & (1<<6)) ? KIM1_EVENT_RRIOT002 : KIM1_EVENT_RRIOT003;
+        m6530_t* rriot = _kim1_rriot(sys, id);
+        rriot->ticks = sys->ticks;
+        m6530_write(rriot, addr & M6530_ADDR_PINS, data);
+        if ((addr & ((1<<7)|(1<<2))) == (1<<2)) {
+            _kim1_rriot_update(sys, id);
+        }
+        else if ((id == KIM1_EVENT_RRIOT002) && (0 == (addr & ((1<<7)|(1<<2))))) {
+            _kim1_display_update(sys);
+            _kim1_tty_tx_update(sys);
+            if (sys->tape.recording) {
+                const uint8_t level = sys->rriot002.pb.pins >> 7;
+                if (level != sys->tape.out_level) {
+                    sys->idle.volatile_read = true;
+                }
+                kim1_tape_output(&sys->tape, sys->ticks, level);
+            }
+        }
+    }
+}
+
+/* keypad
+
+    Key events are applied in tick order by the KIM1_EVENT_KEYPAD event,
+    which is always scheduled for the first queued event.
+*/
+static void _kim1_reset_chips(kim1_t* sys);
+
+static uint64_t _kim1_keypad_update(kim1_t* sys, uint64_t pins) {
+    kim1_keypad_t* kp = &sys->keypad;
+    uint32_t i = 0;
+    for (; (i < kp->num_events) && (kp->events[i].tick <= sys->ticks); i++) {
+        const kim1_key_event_t* ev = &kp->events[i];
+        const uint32_t mask = 1U << ev->key;
+        if (ev->down && (0 == (kp->down & mask)) && (ev->key == KIM1_KEY_RS)) {
+            pins |= M6502_RES;
+            _kim1_reset_chips(sys);
+        }
+        kp->down = ev->down ? (kp->down | mask) : (kp->down & ~mask);
+    }
+    kp->num_events -= i;
+    memmove(&kp->events[0], &kp->events[i], kp->num_events * sizeof(kim1_key_event_t));
+    if (kp->num_events > 0) {
+        _kim1_sched_set(sys, KIM1_EVENT_KEYPAD, kp->events[0].tick);
+    }
+    // the ST key pulls the NMI line low while it's pressed (the CPU sees the edge)
+    if (kp->down & (1U << KIM1_KEY_ST)) {
+        pins |= M6502_NMI;
+    }
+    else {
+        pins &= ~M6502_NMI;
+    }
+    // the input changes without the CPU doing anything, so a loop around this isn't idle
+    sys->idle.pc = _KIM1_IDLE_NO_PC;
+    return pins;
+}
+
+// handle all due scheduler events, returns updated CPU pins
+static uint64_t _kim1_handle_events(kim1_t* sys, uint64_t pins) {
+    int id;
+    while ((id = _kim1_sched_pop(sys)) >= 0) {
+        switch (id) {
+            case KIM1_EVENT_RRIOT002:
+            case KIM1_EVENT_RRIOT003:
+                {
+                    m6530_t* rriot = _kim1_rriot(sys, id);
+                    rriot->ticks = sys->ticks;
+                    if (m6530_irq(rriot)) {
+                        sys->irq_lines |= (1<<id);
+                    }
+                    else {
+                        sys->irq_lines &= ~(1<<id);
+                        const uint64_t irq_tick = m6530_irq_tick(rriot);
+                        if (irq_tick != SCHED_NEVER) {
+                            _kim1_sched_set(sys, id, irq_tick);
+                        }
+                    }
+                }
+                break;
+            case KIM1_EVENT_TAPE:
+                {
+                    const uint32_t run_ticks = kim1_tape_advance(&sys->tape);
+                    if (run_ticks > 0) {
+                        _kim1_sched_set(sys, KIM1_EVENT_TAPE, sys->ticks + run_ticks);
+                    }
+                }
+                break;
+            case KIM1_EVENT_KEYPAD:
+                pins = _kim1_keypad_update(sys, pins);
+                break;
+        }
+    }
+    // both RRIOT IRQ outputs are connected to the CPU IRQ pin
+    if (sys->irq_lines) {
+        pins |= M6502_IRQ;
+    }
+    else {
+        pins &= ~M6502_IRQ;
+    }
+    return pins;
+}
+
+// RAM and ROM pages in all mirrors, without the ROM pages which have trapped routines
+static uint64_t _kim1_code_pages(const kim1_t* sys) {
+    uint8_t pages = (1<<0) | (1<<6) | (1<<7);
+    if (sys->tape_trap) {
+        pages &= ~(1<<6);
+    }
+    if (sys->tty.trap) {
+        pages &= ~(1<<7);
+    }
+    return pages * 0x0101010101010101ULL;
+}
+
+static void _kim1_init_memory_map(kim1_t* sys) {
+    /*
+        NOTE: the K5 block with the RRIOT I/O and RAM areas isn't mapped,
+        accesses to this block are handled in _kim1_io_read() and _kim1_io_write()
+
+        The RAM and ROMs are laid out in kim1_t exactly like in the decoded
+        8 KB address space, so mem_t can run in flat mode, with the mirrors
+        handled by masking the address.
+    */
+    memset(sys->unmapped, 0xFF, sizeof(sys->unmapped));
+    mem_init(&sys->mem);
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        const uint16_t base = (uint16_t)(i * _KIM1_MIRROR_SIZE);
+        mem_map_ram(&sys->mem, 0, base + 0x0000, 0x0400, sys->ram);
+        mem_map_rom(&sys->mem, 0, base + 0x1800, 0x0400, sys->rom_003);
+        mem_map_rom(&sys->mem, 0, base + 0x1C00, 0x0400, sys->rom_002);
+    }
+    mem_set_flat(&sys->mem, sys->ram, _KIM1_MIRROR_SIZE);
+}
+
+/*
+    Map shared ROM and RAM images instead of the kim1_t memory block,
+    the ROMs are mapped read-only, and the RAM copy-on-write into
+    kim1_t.ram. Without flat mode, since the pages are scattered
+    across host memory.
+
+    With MEM_FLAT there are no copy-on-write pages, the images are copied
+    into the kim1_t memory block instead.
+*/
+static void _kim1_init_shared_memory_map(kim1_t* sys, const uint8_t* ram, const uint8_t* rom_003, const uint8_t* rom_002) {
+    #if defined(MEM_FLAT)
+    memmove(sys->ram, ram, sizeof(sys->ram));
+    memmove(sys->rom_003, rom_003, sizeof(sys->rom_003));
+    memmove(sys->rom_002, rom_002, sizeof(sys->rom_002));
+    _kim1_init_memory_map(sys);
+    #else
+    mem_init(&sys->mem);
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        const uint16_t base = (uint16_t)(i * _KIM1_MIRROR_SIZE);
+        mem_map_cow(&sys->mem, 0, base + 0x0000, 0x0400, ram, sys->ram);
+        mem_map_rom(&sys->mem, 0, base + 0x1800, 0x0400, rom_003);
+        mem_map_rom(&sys->mem, 0, base + 0x1C00, 0x0400, rom_002);
+    }
+    #endif
+}
+
+void kim1_init(kim1_t* sys, const kim1_desc_t* desc) {
+    CHIPS_ASSERT(sys && desc);
+    if (desc->debug.callback.func) { CHIPS_ASSERT(desc->debug.stopped); }
+
+    memset(sys, 0, sizeof(kim1_t));
+    sys->valid = true;
+    sys->instr_stepped = desc->instr_stepped;
+    sys->idle_skip = desc->instr_stepped && desc->idle_skip && (0 == desc->debug.callback.func);
+    sys->block_cache = desc->instr_stepped && desc->block_cache && (0 == desc->debug.callback.func);
+    sys->idle.pc = _KIM1_IDLE_NO_PC;
+    sys->display.digit = 0xFF;
+    sys->debug = desc->debug;
+    // the ROMs are optional (for running test programs without the monitor)
+    memset(sys->rom_002, 0xFF, sizeof(sys->rom_002));
+    memset(sys->rom_003, 0xFF, sizeof(sys->rom_003));
+    if (desc->roms.rom_002.ptr) {
+        CHIPS_ASSERT(desc->roms.rom_002.size == sizeof(sys->rom_002));
+    }
+    if (desc->roms.rom_003.ptr) {
+        CHIPS_ASSERT(desc->roms.rom_003.size == sizeof(sys->rom_003));
+    }
+    if (desc->ram.ptr) {
+        CHIPS_ASSERT(desc->ram.size == sizeof(sys->ram));
+    }
+    if (desc->share_images) {
+        // images which aren't provided map the (empty) private memory instead
+        _kim1_init_shared_memory_map(sys,
+            desc->ram.ptr ? (const uint8_t*) desc->ram.ptr : sys->ram,
+            desc->roms.rom_003.ptr ? (const uint8_t*) desc->roms.rom_003.ptr : sys->rom_003,
+            desc->roms.rom_002.ptr ? (const uint8_t*) desc->roms.rom_002.ptr : sys->rom_002);
+    }
+    else {
+        if (desc->roms.rom_002.ptr) {
+            memcpy(sys->rom_002, desc->roms.rom_002.ptr, sizeof(sys->rom_002));
+        }
+        if (desc->roms.rom_003.ptr) {
+            memcpy(sys->rom_003, desc->roms.rom_003.ptr, sizeof(sys->rom_003));
+        }
+        if (desc->ram.ptr) {
+            memcpy(sys->ram, desc->ram.ptr, sizeof(sys->ram));
+        }
+        _kim1_init_memory_map(sys);
+    }
+    const uint8_t* rom_003 = mem_readptr(&sys->mem, 0x1800);
+    const uint8_t* rom_002 = mem_readptr(&sys->mem, 0x1C00);
+
+    sys->tty.enabled = desc->tty.enabled;
+    sys->tty.bit_ticks = KIM1_FREQUENCY / (desc->tty.baud ? desc->tty.baud : KIM1_TTY_DEFAULT_BAUD);
+    CHIPS_ASSERT(sys->tty.bit_ticks > 0);
+    sys->tty.tx_level = 1;
+    if (desc->tty.enabled && desc->tty.trap) {
+        // only trap the monitor routines if they're where they're expected
+        static const uint8_t getch[] = { 0x86, _KIM1_ZP_TMPX, 0xA2, 0x08, 0xA9, 0x01, 0x2C, 0x40, 0x17 };
+        static const uint8_t outch[] = { 0x85, _KIM1_ZP_CHAR, 0x86, _KIM1_ZP_TMPX };
+        sys->tty.trap = (0 == memcmp(&rom_002[_KIM1_ROM_GETCH & 0x3FF], getch, sizeof(getch))) &&
+                        (0 == memcmp(&rom_002[_KIM1_ROM_OUTCH & 0x3FF], outch, sizeof(outch)));
+    }
+    kim1_tape_init(&sys->tape);
+    if (desc->tape.trap) {
+        static const uint8_t dumpt[] = { 0xA9, 0xAD, 0x8D, 0xEC, 0x17 };
+        static const uint8_t loadt[] = { 0xA9, 0x8D, 0x8D, 0xEC, 0x17 };
+        sys->tape_trap = (0 == memcmp(&rom_003[_KIM1_ROM_DUMPT & 0x3FF], dumpt, sizeof(dumpt))) &&
+                         (0 == memcmp(&rom_003[_KIM1_ROM_LOADT & 0x3FF], loadt, sizeof(loadt)));
+    }
+    sys->traps = sys->tty.trap || sys->tape_trap;
+    if (sys->block_cache) {
+        m6502_block_cache_init(&sys->blocks, _KIM1_MIRROR_SIZE - 1, _kim1_code_pages(sys));
+    }
+
+    sys->pins = m6502_init(&sys->cpu, &(m6502_desc_t){0});
+    m6530_init(&sys->rriot002);
+    m6530_init(&sys->rriot003);
+    sched_init(&sys->sched);
+    _kim1_sched_sync(sys);
+}
+
+void kim1_discard(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    kim1_tape_discard(&sys->tape);
+    sys->valid = false;
+}
+
+// the chips connected to the RST line (the CPU RES pin is set by the caller)
+static void _kim1_reset_chips(kim1_t* sys) {
+    m6530_reset(&sys->rriot002);
+    m6530_reset(&sys->rriot003);
+    // the serial line goes idle, bytes in the FIFOs are kept
+    sys->tty.rx_busy = false;
+    sys->tty.rx_hold = false;
+    sys->tty.tx_busy = false;
+    sys->tty.tx_level = 1;
+    _kim1_rriot_update(sys, KIM1_EVENT_RRIOT002);
+    _kim1_rriot_update(sys, KIM1_EVENT_RRIOT003);
+}
+
+void kim1_reset(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    sys->pins |= M6502_RES;
+    _kim1_reset_chips(sys);
+}
+
+static inline uint64_t _kim1_tick(kim1_t* sys, uint64_t pins) {
+
+    // tick the CPU
+    pins = m6502_tick(&sys->cpu, pins);
+
+    const uint16_t addr = M6502_GET_ADDR(pins);
+    if ((addr & 0x1C00) == 0x1400) {
+        if (pins & M6502_RW) {
+            M6502_SET_DATA(pins, _kim1_io_read(addr, sys));
+        }
+        else {
+            _kim1_io_write(addr, M6502_GET_DATA(pins), sys);
+        }
+    }
+    else {
+        // regular memory access
+        if (pins & M6502_RW) {
+            M6502_SET_DATA(pins, mem_rd(&sys->mem, addr));
+        }
+        else {
+            mem_wr(&sys->mem, addr, M6502_GET_DATA(pins));
+        }
+    }
+    return pins;
+}
+
+/* ROM traps
+
+    Called at the start of an instruction with the PC in a ROM page with
+    trapped routines. A trap emulates the effect of a ROM routine and
+    continues execution somewhere else with the "trap code" prefetch
+    (see m6502.h).
+*/
+static uint64_t _kim1_prefetch(kim1_t* sys, uint64_t pins, uint16_t next_pc) {
+    pins = (pins & ~(M6502_RW|0xFFFFFFULL)) | M6502_SYNC | M6502_RW;
+    M6502_SET_ADDR(pins, next_pc);
+    M6502_SET_DATA(pins, mem_rd(&sys->mem, next_pc));
+    m6502_set_pc(&sys->cpu, next_pc);
+    return pins;
+}
+
+// continue after the JSR which called the trapped routine
+static uint64_t _kim1_trap_rts(kim1_t* sys, uint64_t pins) {
+    m6502_t* cpu = &sys->cpu;
+    const uint8_t l = mem_rd(&sys->mem, 0x0100 | (uint8_t)(cpu->S + 1));
+    const uint8_t h = mem_rd(&sys->mem, 0x0100 | (uint8_t)(cpu->S + 2));
+    cpu->S += 2;
+    return _kim1_prefetch(sys, pins, (uint16_t)(((h<<8) | l) + 1));
+}
+
+// memory access from trap code, including the RRIOT RAM and I/O
+static uint8_t _kim1_trap_rd(uint16_t addr, void* user_data) {
+    kim1_t* sys = (kim1_t*) user_data;
+    return ((addr & 0x1C00) == 0x1400) ? _kim1_io_read(addr, sys) : mem_rd(&sys->mem, addr);
+}
+
+static void _kim1_trap_wr(kim1_t* sys, uint16_t addr, uint8_t data) {
+    if ((addr & 0x1C00) == 0x1400) {
+        _kim1_io_write(addr, data, sys);
+    }
+    else {
+        mem_wr(&sys->mem, addr, data);
+        if (sys->block_cache) {
+            m6502_block_cache_invalidate(&sys->blocks, addr, 1);
+        }
+    }
+}
+
+/*  GETCH/OUTCH, the registers and memory locations are left like the ROM
+    routines leave them, both end in DELAY, which leaves A = Y = TIMH =
+    FF and C and V clear (with a measured bit rate, CNTH30 < 80):
+
+    GETCH:  A = received byte & 7F (N, Z), X restored from TMPX, Y = FF,
+            CHAR = byte, TIMH = FF, C = V = 0
+    OUTCH:  A = FF, X unchanged (N, Z), Y = FF, TMPX = X, CHAR = 0 (shifted
+            out), TIMH = FF, C = V = 0
+
+    Returns false if the routine should run normally.
+
+    A byte can arrive between two time slices while the CPU waits in the
+    start bit polling loop (GET1) with the trap already declined, the
+    poll would then start the byte bit by bit. The declined trap at GET1
+    holds the receive line idle until the next instruction fetch in the
+    trap pages, so the trap takes the byte on the next pass instead.
+*/
+// the registers and TIMH as DELAY returns them, N and Z from nz
+static void _kim1_tty_trap_delay(kim1_t* sys, uint8_t nz) {
+    m6502_t* cpu = &sys->cpu;
+    _kim1_trap_wr(sys, _KIM1_TIMH, 0xFF);
+    cpu->Y = 0xFF;
+    cpu->P = (cpu->P & ~(M6502_NF|M6502_VF|M6502_ZF|M6502_CF)) | (nz & M6502_NF) | (nz ? 0 : M6502_ZF);
+}
+
+static bool _kim1_tty_trap(kim1_t* sys, uint16_t pc) {
+    m6502_t* cpu = &sys->cpu;
+    kim1_tty_t* tty = &sys->tty;
+    tty->rx_hold = false;
+    if (pc == _KIM1_ROM_OUTCH) {
+        _kim1_trap_wr(sys, _KIM1_ZP_TMPX, cpu->X);
+        _kim1_trap_wr(sys, _KIM1_ZP_CHAR, 0);
+        _kim1_tty_fifo_push(&tty->tx_fifo, cpu->A);
+        sys->idle.volatile_read = true;
+        cpu->A = 0xFF;
+        _kim1_tty_trap_delay(sys, cpu->X);
+        return true;
+    }
+    else if (((pc == _KIM1_ROM_GETCH) || (pc == _KIM1_ROM_GET1)) && !tty->rx_busy) {
+        uint8_t val;
+        if (!_kim1_tty_fifo_pop(&tty->rx_fifo, &val)) {
+            tty->rx_hold = (pc == _KIM1_ROM_GET1);
+            return false;
+        }
+        if (pc == _KIM1_ROM_GETCH) {
+            _kim1_trap_wr(sys, _KIM1_ZP_TMPX, cpu->X);
+        }
+        _kim1_trap_wr(sys, _KIM1_ZP_CHAR, val);
+        cpu->X = mem_rd(&sys->mem, _KIM1_ZP_TMPX);
+        cpu->A = val & 0x7F;
+        _kim1_tty_trap_delay(sys, cpu->A);
+        return true;
+    }
+    return false;
+}
+
+/*  LOADT/DUMPT, both return to the monitor with POINTH/POINTL showing
+    0000 on success or FFFF on error, like the ROM routines.
+
+    LOADT loads the next recording on the tape with the ID in 17F9 (00
+    loads any ID, FF any ID at the address in 17F5/17F6), and moves the
+    tape behind it. DUMPT records 17F5/17F6 up to (excluding) 17F7/17F8
+    with the ID in 17F9. Returns false if the routine should run normally.
+*/
+static bool _kim1_tape_trap(kim1_t* sys, uint16_t pc) {
+    kim1_tape_t* tape = &sys->tape;
+    const uint8_t id = _kim1_trap_rd(_KIM1_ID, sys);
+    const uint16_t sa = (uint16_t)((_kim1_trap_rd(_KIM1_SAH, sys) << 8) | _kim1_trap_rd(_KIM1_SAL, sys));
+    bool ok = false;
+    if (pc == _KIM1_ROM_LOADT) {
+        if (!kim1_tape_inserted(tape)) {
+            return false;
+        }
+        kim1_tape_block_t blk;
+        uint32_t pos = tape->run / 16;
+        while (kim1_tape_find_block(tape, pos, &blk) && (id != 0x00) && (id != 0xFF) && (blk.id != id)) {
+            pos = blk.end_pos;
+        }
+        if (blk.end_pos > 0) {
+            const uint16_t addr = (id == 0xFF) ? sa : blk.addr;
+            for (uint32_t i = 0; i < blk.num_bytes; i++) {
+                _kim1_trap_wr(sys, (uint16_t)(addr + i), kim1_tape_block_byte(tape, &blk, i));
+            }
+            ok = blk.checksum_ok;
+            pos = blk.end_pos;
+        }
+        else {
+            pos = tape->size;
+        }
+        const uint32_t run_ticks = kim1_tape_seek(tape, pos);
+        if (run_ticks > 0) {
+            _kim1_sched_set(sys, KIM1_EVENT_TAPE, sys->ticks + run_ticks);
+        }
+        else {
+            _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+        }
+    }
+    else if (pc == _KIM1_ROM_DUMPT) {
+        if (!tape->recording) {
+            return false;
+        }
+        const uint16_t ea = (uint16_t)((_kim1_trap_rd(_KIM1_EAH, sys) << 8) | _kim1_trap_rd(_KIM1_EAL, sys));
+        ok = kim1_tape_record_block(tape, id, sa, (uint16_t)(ea - sa), _kim1_trap_rd, sys);
+        sys->idle.volatile_read = true;
+    }
+    else {
+        return false;
+    }
+    _kim1_trap_wr(sys, _KIM1_ZP_POINTL, ok ? 0x00 : 0xFF);
+    _kim1_trap_wr(sys, _KIM1_ZP_POINTH, ok ? 0x00 : 0xFF);
+    return true;
+}
+
+static uint64_t _kim1_trap(kim1_t* sys, uint64_t pins) {
+    const uint16_t pc = M6502_GET_ADDR(pins) & (_KIM1_MIRROR_SIZE - 1);
+    if (sys->tty.trap && _kim1_tty_trap(sys, pc)) {
+        return _kim1_trap_rts(sys, pins);
+    }
+    if (sys->tape_trap && _kim1_tape_trap(sys, pc)) {
+        return _kim1_prefetch(sys, pins, _KIM1_ROM_START);
+    }
+    return pins;
+}
+
+// check whether the trap code needs to look at the instruction at the start
+static inline bool _kim1_trap_addr(uint64_t pins) {
+    const uint16_t page = M6502_GET_ADDR(pins) & (_KIM1_MIRROR_SIZE - 1) & ~0xFF;
+    return (page == (_KIM1_ROM_GETCH & ~0xFF)) || (page == (_KIM1_ROM_DUMPT & ~0xFF));
+}
+
+/* idle loop detection
+
+    The state comparison ignores the RRIOT tick counters (they're just the
+    tick of the last access), everything else must be identical. Teletype
+    and tape output isn't part of the state, a loop which produces output
+    sets kim1_idle_t.volatile_read instead.
+*/
+
+static void _kim1_idle_record(kim1_t* sys, uint64_t pins) {
+    kim1_idle_t* idle = &sys->idle;
+    idle->pc = M6502_GET_ADDR(pins);
+    idle->volatile_read = false;
+    idle->start_tick = sys->ticks;
+    kim1_idle_state_t* state = &sys->idle_state;
+    _kim1_display_flush(sys);
+    memcpy(state->display_lit, sys->display.lit, sizeof(state->display_lit));
+    state->a = sys->cpu.A;
+    state->x = sys->cpu.X;
+    state->y = sys->cpu.Y;
+    state->s = sys->cpu.S;
+    state->p = sys->cpu.P;
+    state->irq_lines = sys->irq_lines;
+    state->pins = pins;
+    state->rriot002 = sys->rriot002;
+    state->rriot003 = sys->rriot003;
+    // NOTE: in a fork, the RAM may still be shared with the parent
+    memcpy(state->ram, mem_readptr(&sys->mem, 0x0000), sizeof(state->ram));
+}
+
+static bool _kim1_idle_rriot_equal(const m6530_t* a, const m6530_t* b) {
+    return (0 == memcmp(&a->pa, &b->pa, sizeof(a->pa))) &&
+           (0 == memcmp(&a->pb, &b->pb, sizeof(a->pb))) &&
+           (a->timer.start == b->timer.start) &&
+           (a->timer.irq_tick == b->timer.irq_tick) &&
+           (a->timer.latch == b->timer.latch) &&
+           (a->timer.shift == b->timer.shift) &&
+           (a->timer.irq_enable == b->timer.irq_enable) &&
+           (a->pins == b->pins) &&
+           (0 == memcmp(a->ram, b->ram, sizeof(a->ram)));
+}
+
+static bool _kim1_idle_same_state(kim1_t* sys, uint64_t pins) {
+    const kim1_idle_state_t* state = &sys->idle_state;
+    return (state->pins == pins) &&
+           (state->a == sys->cpu.A) &&
+           (state->x == sys->cpu.X) &&
+           (state->y == sys->cpu.Y) &&
+           (state->s == sys->cpu.S) &&
+           (state->p == sys->cpu.P) &&
+           (state->irq_lines == sys->irq_lines) &&
+           _kim1_idle_rriot_equal(&state->rriot002, &sys->rriot002) &&
+           _kim1_idle_rriot_equal(&state->rriot003, &sys->rriot003) &&
+           (0 == memcmp(state->ram, mem_readptr(&sys->mem, 0x0000), sizeof(state->ram)));
+}
+
+// called at the start of an instruction at the candidate loop head
+static void _kim1_idle_check(kim1_t* sys, uint64_t pins, uint64_t end_tick) {
+    kim1_idle_t* idle = &sys->idle;
+    const uint64_t period = sys->ticks - idle->start_tick;
+    if (!idle->volatile_read && (period > 0) && _kim1_idle_same_state(sys, pins)) {
+        // skip whole loop iterations until right before the next event or the end of the time slice
+        uint64_t limit = sys->next_event_tick;
+        if (limit > end_tick) {
+            limit = end_tick;
+        }
+        _kim1_display_flush(sys);
+        if (limit > sys->ticks) {
+            // each skipped iteration lights the display segments exactly like the last one
+            const uint64_t num = (limit - sys->ticks) / period;
+            for (int digit = 0; digit < KIM1_DISPLAY_NUM_DIGITS; digit++) {
+                for (int seg = 0; seg < KIM1_DISPLAY_NUM_SEGMENTS; seg++) {
+                    sys->display.lit[digit][seg] += num * (sys->display.lit[digit][seg] - sys->idle_state.display_lit[digit][seg]);
+                }
+            }
+            sys->ticks += num * period;
+            sys->display.last_tick = sys->ticks;
+            idle->skipped_ticks += num * period;
+        }
+        // the state is unchanged, only the loop head tick moves
+        idle->start_tick = sys->ticks;
+        memcpy(sys->idle_state.display_lit, sys->display.lit, sizeof(sys->idle_state.display_lit));
+    }
+    else if (idle->volatile_read || (period > KIM1_IDLE_MAX_PERIOD)) {
+        idle->pc = _KIM1_IDLE_NO_PC;
+        idle->retry_tick = sys->ticks + KIM1_IDLE_RETRY_TICKS;
+    }
+}
+
+// called between runs of instructions, records a new candidate or drops an expired one
+static void _kim1_idle_update(kim1_t* sys, uint64_t pins) {
+    kim1_idle_t* idle = &sys->idle;
+    if (idle->pc == _KIM1_IDLE_NO_PC) {
+        if (sys->ticks >= idle->retry_tick) {
+            _kim1_idle_record(sys, pins);
+        }
+    }
+    else if ((sys->ticks - idle->start_tick) > KIM1_IDLE_MAX_PERIOD) {
+        idle->pc = _KIM1_IDLE_NO_PC;
+        idle->retry_tick = sys->ticks + KIM1_IDLE_RETRY_TICKS;
+    }
+}
+
+static inline m6502_bus_t _kim1_bus(kim1_t* sys) {
+    return (m6502_bus_t){
+        .mem = &sys->mem,
+        .io_pages = _KIM1_IO_PAGES,
+        .io_read = _kim1_io_read,
+        .io_write = _kim1_io_write,
+        .user_data = sys,
+    };
+}
+
+// the earlier of the end of the time slice and the next event
+static inline uint64_t _kim1_limit(kim1_t* sys, uint64_t end_tick) {
+    const uint64_t next = sys->next_event_tick;
+    return (next < end_tick) ? next : end_tick;
+}
+
+// execute a single instruction, with the block cache (which must see writes into cached code) if enabled
+static inline uint64_t _kim1_exec_one(kim1_t* sys, const m6502_bus_t* bus, uint64_t pins) {
+    if (sys->block_cache) {
+        // stops after the first instruction
+        m6502_exec_block(&sys->cpu, &sys->blocks, bus, &pins, &sys->ticks, sys->ticks + 1);
+    }
+    else {
+        sys->ticks += m6502_exec_instr(&sys->cpu, bus, &pins);
+    }
+    return pins;
+}
+
+uint32_t kim1_step(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    uint64_t pins = sys->pins;
+    if (sys->ticks >= sys->next_event_tick) {
+        pins = _kim1_handle_events(sys, pins);
+    }
+    const m6502_bus_t bus = _kim1_bus(sys);
+    const uint64_t start_tick = sys->ticks;
+    pins = _kim1_exec_one(sys, &bus, pins);
+    const uint32_t ticks = (uint32_t)(sys->ticks - start_tick);
+    if (sys->traps && _kim1_trap_addr(pins)) {
+        pins = _kim1_trap(sys, pins);
+    }
+    sys->pins = pins;
+    return ticks;
+}
+
+// count the instruction since the last opcode fetch, pins is at the next opcode fetch
+static inline void _kim1_profile_sync(kim1_profile_t* prof, uint64_t pins, uint64_t ticks) {
+    if (prof->started) {
+        const uint64_t cycles = ticks - prof->last_tick;
+        prof->num_instrs++;
+        prof->num_cycles += cycles;
+        prof->op_instrs[prof->last_op]++;
+        prof->op_cycles[prof->last_op] += cycles;
+        prof->pc_instrs[prof->last_pc]++;
+        prof->pc_cycles[prof->last_pc] += cycles;
+    }
+    prof->started = true;
+    prof->last_op = M6502_GET_DATA(pins);
+    prof->last_pc = M6502_GET_ADDR(pins);
+    prof->last_tick = ticks;
+}
+
+// called at the end of kim1_exec() and kim1_run_until()
+static void _kim1_slice_end(kim1_t* sys) {
+    _kim1_display_publish(sys);
+    // a byte may have ended without a PB0 edge after its stop bit
+    _kim1_tty_tx_sample(sys);
+}
+
+uint32_t kim1_exec(kim1_t* sys, uint32_t micro_seconds) {
+    CHIPS_ASSERT(sys && sys->valid);
+    const uint32_t num_ticks = clk_us_to_ticks(KIM1_FREQUENCY, micro_seconds);
+    const uint64_t start_tick = sys->ticks;
+    const uint64_t end_tick = start_tick + num_ticks;
+    uint64_t pins = sys->pins;
+    if ((0 == sys->debug.callback.func) && (0 == sys->profile)) {
+        if (sys->instr_stepped) {
+            // run whole instructions, may overshoot the time slice by a few ticks
+            const m6502_bus_t bus = _kim1_bus(sys);
+            const bool idle_skip = sys->idle_skip;
+            const bool traps = sys->traps;
+            while (sys->ticks < end_tick) {
+                if (idle_skip) {
+                    _kim1_idle_update(sys, pins);
+                }
+                // run back to back until the next event is due
+                if (sys->block_cache) {
+                    // a block stops at I/O accesses, which may have scheduled an earlier event
+                    uint64_t limit;
+                    while (sys->ticks < (limit = _kim1_limit(sys, end_tick))) {
+                        m6502_exec_block(&sys->cpu, &sys->blocks, &bus, &pins, &sys->ticks, limit);
+                        if (traps && _kim1_trap_addr(pins)) {
+                            pins = _kim1_trap(sys, pins);
+                        }
+                        if (M6502_GET_ADDR(pins) == sys->idle.pc) {
+                            _kim1_idle_check(sys, pins, end_tick);
+                        }
+                    }
+                }
+                else {
+                    while ((sys->ticks < end_tick) && (sys->ticks < sys->next_event_tick)) {
+                        sys->ticks += m6502_exec_instr(&sys->cpu, &bus, &pins);
+                        if (traps && _kim1_trap_addr(pins)) {
+                            pins = _kim1_trap(sys, pins);
+                        }
+                        if (M6502_GET_ADDR(pins) == sys->idle.pc) {
+                            _kim1_idle_check(sys, pins, end_tick);
+                        }
+                    }
+                }
+                pins = _kim1_handle_events(sys, pins);
+            }
+        }
+        else {
+            // run without debug callback, keep the loop free of anything but the tick
+            const bool traps = sys->traps;
+            while (sys->ticks < end_tick) {
+                while ((sys->ticks < end_tick) && (sys->ticks < sys->next_event_tick)) {
+                    pins = _kim1_tick(sys, pins);
+                    sys->ticks++;
+                    if (traps && (pins & M6502_SYNC) && _kim1_trap_addr(pins)) {
+                        pins = _kim1_trap(sys, pins);
+                    }
+                }
+                pins = _kim1_handle_events(sys, pins);
+            }
+        }
+    }
+    else if (0 == sys->debug.callback.func) {
+        // run with profiler, count at each opcode fetch after traps have been handled
+        const m6502_bus_t bus = _kim1_bus(sys);
+        kim1_profile_t* prof = sys->profile;
+        const bool instr_stepped = sys->instr_stepped;
+        while (sys->ticks < end_tick) {
+            while ((sys->ticks < end_tick) && (sys->ticks < sys->next_event_tick)) {
+                if (instr_stepped) {
+                    pins = _kim1_exec_one(sys, &bus, pins);
+                }
+                else {
+                    pins = _kim1_tick(sys, pins);
+                    sys->ticks++;
+                }
+                if (pins & M6502_SYNC) {
+                    if (sys->traps && _kim1_trap_addr(pins)) {
+                        pins = _kim1_trap(sys, pins);
+                    }
+                    _kim1_profile_sync(prof, pins, sys->ticks);
+                }
+            }
+            pins = _kim1_handle_events(sys, pins);
+        }
+    }
+    else {
+        // run with debug callback
+        while ((sys->ticks < end_tick) && !(*sys->debug.stopped)) {
+            if (sys->ticks >= sys->next_event_tick) {
+                pins = _kim1_handle_events(sys, pins);
+            }
+            pins = _kim1_tick(sys, pins);
+            sys->ticks++;
+            if (sys->traps && (pins & M6502_SYNC) && _kim1_trap_addr(pins)) {
+                pins = _kim1_trap(sys, pins);
+            }
+            sys->debug.callback.func(sys->debug.callback.user_data, pins);
+        }
+    }
+    sys->pins = pins;
+    _kim1_slice_end(sys);
+    return (uint32_t)(sys->ticks - start_tick);
+}
+
+void kim1_breakpoints_init(kim1_breakpoints_t* bp) {
+    CHIPS_ASSERT(bp);
+    memset(bp, 0, sizeof(kim1_breakpoints_t));
+}
+
+void kim1_add_breakpoint(kim1_breakpoints_t* bp, uint16_t pc) {
+    CHIPS_ASSERT(bp);
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        const uint16_t addr = (uint16_t)((pc & (_KIM1_MIRROR_SIZE - 1)) + i * _KIM1_MIRROR_SIZE);
+        bp->pc[addr >> 6] |= 1ULL << (addr & 63);
+    }
+}
+
+void kim1_remove_breakpoint(kim1_breakpoints_t* bp, uint16_t pc) {
+    CHIPS_ASSERT(bp);
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        const uint16_t addr = (uint16_t)((pc & (_KIM1_MIRROR_SIZE - 1)) + i * _KIM1_MIRROR_SIZE);
+        bp->pc[addr >> 6] &= ~(1ULL << (addr & 63));
+    }
+}
+
+bool kim1_add_watchpoint(kim1_breakpoints_t* bp, uint16_t addr, uint16_t size, uint8_t mode) {
+    CHIPS_ASSERT(bp && (size > 0) && (size <= _KIM1_MIRROR_SIZE));
+    CHIPS_ASSERT((0 != (mode & (KIM1_WATCH_READ|KIM1_WATCH_WRITE))) && (0 == (mode & ~(KIM1_WATCH_READ|KIM1_WATCH_WRITE))));
+    if (bp->num_watchpoints == KIM1_MAX_WATCHPOINTS) {
+        return false;
+    }
+    addr &= _KIM1_MIRROR_SIZE - 1;
+    bp->watchpoints[bp->num_watchpoints++] = (kim1_watchpoint_t){ .addr = addr, .size = size, .mode = mode };
+    // the watched pages in the first mirror (the range may wrap around), then in all mirrors
+    uint64_t pages = 0;
+    for (uint32_t offset = 0; offset < size; offset += MEM_PAGE_SIZE) {
+        pages |= 1ULL << (((addr + offset) & (_KIM1_MIRROR_SIZE - 1)) >> MEM_PAGE_SHIFT);
+    }
+    pages |= 1ULL << (((addr + size - 1) & (_KIM1_MIRROR_SIZE - 1)) >> MEM_PAGE_SHIFT);
+    pages *= 0x0101010101010101ULL;
+    if (mode & KIM1_WATCH_READ) {
+        bp->rd_pages |= pages;
+    }
+    if (mode & KIM1_WATCH_WRITE) {
+        bp->wr_pages |= pages;
+    }
+    return true;
+}
+
+static bool _kim1_watch_match(const kim1_breakpoints_t* bp, uint16_t addr, uint8_t mode) {
+    for (uint32_t i = 0; i < bp->num_watchpoints; i++) {
+        const kim1_watchpoint_t* w = &bp->watchpoints[i];
+        if ((w->mode & mode) && (((addr - w->addr) & (_KIM1_MIRROR_SIZE - 1)) < w->size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// bus wrapper for instruction-stepped kim1_run_until(), routes the read-watched pages through the watch check
+typedef struct {
+    kim1_t* sys;
+    const kim1_breakpoints_t* bp;
+    int hit;                        // 0, or KIM1_WATCH_READ/KIM1_WATCH_WRITE of the first hit watchpoint
+    uint16_t addr;
+} _kim1_watch_bus_t;
+
+// check a read access, the access must be matched right away since it may be one of many in a watched page
+static inline void _kim1_watch_read_check(_kim1_watch_bus_t* wb, uint16_t addr) {
+    if ((wb->bp->rd_pages & (1ULL << (addr >> MEM_PAGE_SHIFT))) && !wb->hit && _kim1_watch_match(wb->bp, addr, KIM1_WATCH_READ)) {
+        wb->hit = KIM1_WATCH_READ;
+        wb->addr = addr;
+    }
+}
+
+// mem_t watch callback for writes into watched pages
+static void _kim1_watch_written(uint16_t addr, uint8_t data, void* user_data) {
+    (void)data;
+    _kim1_watch_bus_t* wb = (_kim1_watch_bus_t*) user_data;
+    if (!wb->hit && _kim1_watch_match(wb->bp, addr, KIM1_WATCH_WRITE)) {
+        wb->hit = KIM1_WATCH_WRITE;
+        wb->addr = addr;
+    }
+}
+
+static uint8_t _kim1_watch_read(uint16_t addr, void* user_data) {
+    _kim1_watch_bus_t* wb = (_kim1_watch_bus_t*) user_data;
+    _kim1_watch_read_check(wb, addr);
+    if ((addr & 0x1C00) == 0x1400) {
+        return _kim1_io_read(addr, wb->sys);
+    }
+    return mem_rd(&wb->sys->mem, addr);
+}
+
+// the block cache doesn't see writes through the bus callbacks, so they're invalidated like trap writes
+static void _kim1_watch_write(uint16_t addr, uint8_t data, void* user_data) {
+    _kim1_watch_bus_t* wb = (_kim1_watch_bus_t*) user_data;
+    _kim1_trap_wr(wb->sys, addr, data);
+}
+
+kim1_stop_t kim1_run_until(kim1_t* sys, const kim1_breakpoints_t* bp, uint64_t max_ticks) {
+    CHIPS_ASSERT(sys && sys->valid && bp);
+    const uint64_t start_tick = sys->ticks;
+    const uint64_t end_tick = start_tick + max_ticks;
+    kim1_stop_t stop = { .reason = KIM1_STOP_TICKS };
+    _kim1_watch_bus_t wb = { .sys = sys, .bp = bp };
+    mem_set_watch(&sys->mem, bp->wr_pages, _kim1_watch_written, &wb);
+    const m6502_bus_t bus = {
+        .mem = &sys->mem,
+        .io_pages = _KIM1_IO_PAGES | bp->rd_pages,
+        .io_read = _kim1_watch_read,
+        .io_write = _kim1_watch_write,
+        .user_data = &wb,
+    };
+    const bool instr_stepped = sys->instr_stepped;
+    uint64_t pins = sys->pins;
+    while ((sys->ticks < end_tick) && (KIM1_STOP_TICKS == stop.reason)) {
+        while ((sys->ticks < end_tick) && (sys->ticks < sys->next_event_tick)) {
+            if (instr_stepped) {
+                pins = _kim1_exec_one(sys, &bus, pins);
+            }
+            else {
+                pins = _kim1_tick(sys, pins);
+                sys->ticks++;
+                if (pins & M6502_RW) {
+                    _kim1_watch_read_check(&wb, M6502_GET_ADDR(pins));
+                }
+                if (0 == (pins & M6502_SYNC)) {
+                    continue;
+                }
+            }
+            if (sys->traps && _kim1_trap_addr(pins)) {
+                pins = _kim1_trap(sys, pins);
+            }
+            // the stop conditions are checked at each opcode fetch
+            const uint16_t pc = M6502_GET_ADDR(pins);
+            if (wb.hit) {
+                stop = (kim1_stop_t){ .reason = KIM1_STOP_WATCHPOINT, .addr = wb.addr, .write = (wb.hit == KIM1_WATCH_WRITE) };
+                break;
+            }
+            if (bp->pc[pc >> 6] & (1ULL << (pc & 63))) {
+                stop.reason = KIM1_STOP_BREAKPOINT;
+                break;
+            }
+        }
+        if (KIM1_STOP_TICKS == stop.reason) {
+            pins = _kim1_handle_events(sys, pins);
+        }
+    }
+    mem_set_watch(&sys->mem, 0, 0, 0);
+    sys->pins = pins;
+    _kim1_slice_end(sys);
+    stop.pc = M6502_GET_ADDR(pins);
+    stop.ticks = sys->ticks - start_tick;
+    return stop;
+}
+
+void kim1_fork(kim1_t* sys, const kim1_t* parent) {
+    CHIPS_ASSERT(sys && parent && parent->valid && (sys != parent));
+    // copy everything but the memory, the memory block isn't touched until a RAM page is written
+    memcpy(sys, parent, offsetof(kim1_t, mem));
+    sys->valid = true;
+    sys->instr_stepped = parent->instr_stepped;
+    sys->idle_skip = parent->idle_skip;
+    sys->block_cache = parent->block_cache;
+    sys->tape_trap = parent->tape_trap;
+    sys->traps = parent->traps;
+    sys->debug = parent->debug;
+    // the fork must not count into the parent's profile
+    sys->profile = 0;
+    // the fork may play the parent's tape image, but must not record into the parent's buffer
+    if (sys->tape.recording) {
+        kim1_tape_stop(&sys->tape);
+    }
+    sys->tape.rec_ptr = 0;
+    sys->tape.rec_size = 0;
+    sys->tape.rec_pos = 0;
+    sys->parent = parent;
+    // share whatever the parent currently sees (its own memory, or the memory of its own parent)
+    mem_t* pmem = (mem_t*)&parent->mem;
+    const uint8_t* ram = mem_readptr(pmem, 0x0000);
+    const uint8_t* rom_003 = mem_readptr(pmem, 0x1800);
+    const uint8_t* rom_002 = mem_readptr(pmem, 0x1C00);
+    _kim1_init_shared_memory_map(sys, ram, rom_003, rom_002);
+    if (sys->block_cache) {
+        m6502_block_cache_init(&sys->blocks, _KIM1_MIRROR_SIZE - 1, _kim1_code_pages(sys));
+    }
+}
+
+uint32_t kim1_save_snapshot(kim1_t* sys, kim1_t* dst) {
+    CHIPS_ASSERT(sys && dst);
+    *dst = *sys;
+    void* base = sys;
+    if (0 == sys->mem.flat) {
+        // a fork's (or shared image) snapshot gets its own copy of the shared memory and the regular memory map
+        memcpy(dst->ram, mem_readptr(&sys->mem, 0x0000), sizeof(dst->ram));
+        memcpy(dst->rom_003, mem_readptr(&sys->mem, 0x1800), sizeof(dst->rom_003));
+        memcpy(dst->rom_002, mem_readptr(&sys->mem, 0x1C00), sizeof(dst->rom_002));
+        _kim1_init_memory_map(dst);
+        base = dst;
+    }
+    chips_debug_snapshot_onsave(&dst->debug);
+    dst->profile = 0;
+    dst->parent = 0;
+    m6502_snapshot_onsave(&dst->cpu);
+    kim1_tape_snapshot_onsave(&dst->tape);
+    mem_snapshot_onsave(&dst->mem, base);
+    return KIM1_SNAPSHOT_VERSION;
+}
+
+bool kim1_load_snapshot(kim1_t* sys, uint32_t version, const kim1_t* src) {
+    CHIPS_ASSERT(sys && src && (sys != src));
+    if (version != KIM1_SNAPSHOT_VERSION) {
+        return false;
+    }
+    // keep the host callbacks of the target instance
+    chips_debug_t debug = sys->debug;
+    kim1_profile_t* prof = sys->profile;
+    m6502_t cpu = sys->cpu;
+    kim1_tape_t tape = sys->tape;
+    memcpy(sys, src, sizeof(kim1_t));
+    chips_debug_snapshot_onload(&sys->debug, &debug);
+    sys->profile = prof;
+    if (prof) {
+        // don't count the jump in time
+        prof->started = false;
+    }
+    m6502_snapshot_onload(&sys->cpu, &cpu);
+    kim1_tape_snapshot_onload(&sys->tape, &tape);
+    if (!sys->tape.playing) {
+        _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    }
+    mem_snapshot_onload(&sys->mem, sys);
+    if (sys->block_cache) {
+        m6502_block_cache_reset(&sys->blocks);
+    }
+    return true;
+}
+
+uint32_t kim1_tty_put(kim1_t* sys, const uint8_t* bytes, uint32_t num_bytes) {
+    CHIPS_ASSERT(sys && sys->valid && (bytes || (0 == num_bytes)));
+    uint32_t i = 0;
+    for (; i < num_bytes; i++) {
+        if (!_kim1_tty_fifo_push(&sys->tty.rx_fifo, bytes[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+uint32_t kim1_tty_get(kim1_t* sys, uint8_t* buf, uint32_t max_bytes) {
+    CHIPS_ASSERT(sys && sys->valid && (buf || (0 == max_bytes)));
+    uint32_t i = 0;
+    for (; i < max_bytes; i++) {
+        if (!_kim1_tty_fifo_pop(&sys->tty.tx_fifo, &buf[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+bool kim1_insert_tape(kim1_t* sys, chips_range_t image) {
+    CHIPS_ASSERT(sys && sys->valid);
+    _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    return kim1_tape_insert(&sys->tape, image);
+}
+
+void kim1_remove_tape(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    kim1_tape_remove(&sys->tape);
+}
+
+bool kim1_is_tape_inserted(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    return kim1_tape_inserted(&sys->tape);
+}
+
+void kim1_play_tape(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    kim1_tape_play(&sys->tape);
+    const uint32_t run_ticks = kim1_tape_run_ticks(&sys->tape);
+    if (run_ticks > 0) {
+        _kim1_sched_set(sys, KIM1_EVENT_TAPE, sys->ticks + run_ticks);
+    }
+}
+
+void kim1_record_tape(kim1_t* sys, chips_range_t buffer) {
+    CHIPS_ASSERT(sys && sys->valid);
+    _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    kim1_tape_stop(&sys->tape);
+    kim1_tape_record(&sys->tape, buffer);
+    sys->tape.out_level = sys->rriot002.pb.pins >> 7;
+}
+
+void kim1_stop_tape(kim1_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    kim1_tape_stop(&sys->tape);
+}
+
+bool kim1_key_event(kim1_t* sys, uint64_t tick, int key, bool down) {
+    CHIPS_ASSERT(sys && sys->valid && (key >= 0) && (key < KIM1_NUM_KEYS));
+    kim1_keypad_t* kp = &sys->keypad;
+    if (kp->num_events == KIM1_KEY_QUEUE_SIZE) {
+        return false;
+    }
+    if (tick < sys->ticks) {
+        tick = sys->ticks;
+    }
+    // insert behind all events at the same or an earlier tick
+    uint32_t i = kp->num_events;
+    for (; (i > 0) && (kp->events[i - 1].tick > tick); i--) {
+        kp->events[i] = kp->events[i - 1];
+    }
+    kp->events[i] = (kim1_key_event_t){ .tick = tick, .key = (uint8_t)key, .down = down };
+    kp->num_events++;
+    _kim1_sched_set(sys, KIM1_EVENT_KEYPAD, kp->events[0].tick);
+    return true;
+}
+
+bool kim1_key_down(kim1_t* sys, int key) {
+    CHIPS_ASSERT(sys && sys->valid);
+    return kim1_key_event(sys, sys->ticks, key, true);
+}
+
+bool kim1_key_up(kim1_t* sys, int key) {
+    CHIPS_ASSERT(sys && sys->valid);
+    return kim1_key_event(sys, sys->ticks, key, false);
+}
+
+void kim1_set_profile(kim1_t* sys, kim1_profile_t* prof) {
+    CHIPS_ASSERT(sys && sys->valid);
+    sys->profile = prof;
+    if (prof) {
+        // the first instruction is counted from its opcode fetch on
+        prof->started = false;
+    }
+}
+
+void kim1_profile_reset(kim1_profile_t* prof) {
+    CHIPS_ASSERT(prof);
+    memset(prof, 0, sizeof(kim1_profile_t));
+}
+
+uint32_t kim1_profile_hot(const kim1_profile_t* prof, kim1_profile_hot_t* out, uint32_t max_entries) {
+    CHIPS_ASSERT(prof && (out || (0 == max_entries)));
+    // insertion into the sorted output array, fine for a short list of hot spots
+    uint32_t num = 0;
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        const uint64_t cycles = prof->pc_cycles[pc];
+        if ((0 == cycles) || ((num == max_entries) && ((0 == num) || (cycles <= out[num - 1].cycles)))) {
+            continue;
+        }
+        uint32_t i = (num < max_entries) ? num++ : (num - 1);
+        for (; (i > 0) && (out[i - 1].cycles < cycles); i--) {
+            out[i] = out[i - 1];
+        }
+        out[i] = (kim1_profile_hot_t){ .pc = (uint16_t)pc, .instrs = prof->pc_instrs[pc], .cycles = cycles };
+    }
+    return num;
+}
+
+// brightness levels from unlit to fully lit red LED segments (0xAABBGGRR)
+static const uint32_t _kim1_display_palette[KIM1_DISPLAY_NUM_LEVELS] = {
+    0xFF000020, 0xFF00002F, 0xFF00003E, 0xFF00004D, 0xFF00005C, 0xFF00006B, 0xFF00007A, 0xFF000089,
+    0xFF000098, 0xFF0000A7, 0xFF0000B6, 0xFF0000C5, 0xFF0000D4, 0xFF0808E3, 0xFF1010F2, 0xFF2020FF,
+};
+
+chips_display_info_t kim1_display_info(kim1_t* sys) {
+    CHIPS_ASSERT((0 == sys) || sys->valid);
+    const chips_display_info_t res = {
+        .frame = {
+            .dim = {
+                .width = KIM1_DISPLAY_NUM_SEGMENTS,
+                .height = KIM1_DISPLAY_NUM_DIGITS,
+            },
+            .bytes_per_pixel = 1,
+            .buffer = {
+                .ptr = sys ? sys->display.fb : 0,
+                .size = KIM1_DISPLAY_NUM_DIGITS * KIM1_DISPLAY_NUM_SEGMENTS,
+            }
+        },
+        .screen = {
+            .x = 0,
+            .y = 0,
+            .width = KIM1_DISPLAY_NUM_SEGMENTS,
+            .height = KIM1_DISPLAY_NUM_DIGITS,
+        },
+        .palette = {
+            .ptr = (void*)_kim1_display_palette,
+            .size = sizeof(_kim1_display_palette),
+        },
+    };
+    CHIPS_ASSERT(((sys == 0) && (res.frame.buffer.ptr == 0)) || ((sys != 0) && (res.frame.buffer.ptr != 0)));
+    return res;
+}
+
 #endif /* CHIPS_IMPL */
@@ -0,0 +1,334 @@
+#pragma once
+/*#
+    # kim1_batch.h
+
+    Run many independent KIM-1 programs in parallel on a thread pool.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1_batch.h:
+
+    - chips/chips_common.h
+    - chips/mem.h
+    - chips/m6502.h
+    - chips/m6530.h
+    - chips/sched.h
+    - chips/clk.h
+    - systems/kim1_tape.h
+    - systems/kim1.h
+
+    The implementation uses POSIX threads.
+
+    ## Usage
+
+    Describe each program to run in a kim1_batch_job_t, and call
+    kim1_batch_run() with an array of jobs, and an array of the same size
+    which receives the results:
+
+    ~~~C
+    kim1_batch_result_t results[NUM_JOBS];
+    kim1_batch_summary_t summary = kim1_batch_run(&(kim1_batch_desc_t){
+        .jobs = jobs,
+        .results = results,
+        .num_jobs = NUM_JOBS,
+        .num_threads = 0,   // 0 means one thread per CPU core
+    });
+    ~~~
+
+    Each job runs in its own kim1_t instance created on the stack of a
+    worker thread, in the instruction-stepped mode. The program image is
+    copied into the KIM-1 address space at job.load_addr. If job.start_addr
+    is not zero, the reset vector is patched to start execution there (this
+    works with and without ROM images, without ROM images, the ROM areas
+    read as FF).
+
+    A job ends when the CPU is caught in a 'JMP *' (the usual way test
+    programs signal success or failure), or after job.max_ticks (the
+    loop is checked every KIM1_BATCH_SLICE_TICKS ticks).
+
+    The jobs are initially distributed in equal contiguous chunks over
+    the worker threads, a worker which runs out of jobs steals jobs from
+    the other workers.
+
+    The results are written in job order, so the report is independent
+    from the number of threads and the scheduling order.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KIM1_BATCH_MAX_THREADS (64)
+#define KIM1_BATCH_SLICE_TICKS (10000)
+
+// a single program to run
+typedef struct {
+    const char* name;           // optional name for the report
+    chips_range_t rom_002;      // optional 6530-002 ROM image
+    chips_range_t rom_003;      // optional 6530-003 ROM image
+    chips_range_t program;      // program image
+    uint16_t load_addr;         // address where the program image is loaded
+    uint16_t start_addr;        // start address (if 0, the reset vector from the ROM is used)
+    uint64_t max_ticks;         // maximum number of ticks to run
+} kim1_batch_job_t;
+
+// how a job ended
+typedef enum {
+    KIM1_BATCH_TRAPPED,         // CPU caught in a 'JMP *' loop
+    KIM1_BATCH_TIMEOUT,         // max_ticks reached
+} kim1_batch_status_t;
+
+// the result of a single job
+typedef struct {
+    kim1_batch_status_t status;
+    uint64_t ticks;             // number of executed ticks
+    uint16_t pc;                // address of the next instruction
+    uint8_t a, x, y, s, p;
+    uint32_t ram_hash;          // FNV-1a hash over the 1 KB main RAM
+} kim1_batch_result_t;
+
+// kim1_batch_run() parameters
+typedef struct {
+    const kim1_batch_job_t* jobs;
+    kim1_batch_result_t* results;   // must have room for num_jobs items
+    int num_jobs;
+    int num_threads;                // 0: one thread per online CPU
+} kim1_batch_desc_t;
+
+// a summary over all jobs
+typedef struct {
+    int num_threads;                // number of worker threads actually used
+    int num_trapped;
+    int num_timeout;
+    int num_stolen;                 // number of jobs which ran on a different worker than initially assigned
+    uint64_t total_ticks;
+} kim1_batch_summary_t;
+
+// run a single job on the current thread
+void kim1_batch_run_job(const kim1_batch_job_t* job, kim1_batch_result_t* result);
+// run all jobs on a thread pool, returns when all jobs are finished
+kim1_batch_summary_t kim1_batch_run(const kim1_batch_desc_t* desc);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+
+#include <string.h> // memset
+#include <pthread.h>
+#include <unistd.h> // sysconf
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+// check if the CPU is at the start of a 'JMP *' instruction
+static bool _kim1_batch_trapped(kim1_t* sys) {
+    if (0 == (sys->pins & M6502_SYNC)) {
+        return false;
+    }
+    const uint16_t pc = M6502_GET_ADDR(sys->pins);
+    return (mem_rd(&sys->mem, pc) == 0x4C) && (mem_rd16(&sys->mem, pc + 1) == pc);
+}
+
+static uint32_t _kim1_batch_hash(const uint8_t* ptr, size_t num_bytes) {
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < num_bytes; i++) {
+        hash = (hash ^ ptr[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+void kim1_batch_run_job(const kim1_batch_job_t* job, kim1_batch_result_t* res) {
+    CHIPS_ASSERT(job && res);
+    kim1_t sys;
+    kim1_init(&sys, &(kim1_desc_t){
+        .instr_stepped = true,
+        .roms = {
+            .rom_002 = job->rom_002,
+            .rom_003 = job->rom_003,
+        }
+    });
+    if (job->program.ptr) {
+        mem_write_range(&sys.mem, job->load_addr, (const uint8_t*)job->program.ptr, (uint32_t)job->program.size);
+    }
+    if (job->start_addr != 0) {
+        // patch the reset vector in the private ROM copy
+        sys.rom_002[0x3FC] = (uint8_t)job->start_addr;
+        sys.rom_002[0x3FD] = (uint8_t)(job->start_addr >> 8);
+    }
+    memset(res, 0, sizeof(*res));
+    res->status = KIM1_BATCH_TIMEOUT;
+    while (sys.ticks < job->max_ticks) {
+        uint64_t slice = job->max_ticks - sys.ticks;
+        if (slice > KIM1_BATCH_SLICE_TICKS) {
+            slice = KIM1_BATCH_SLICE_TICKS;
+        }
+        // NOTE: KIM1_FREQUENCY is 1 MHz, so ticks are microseconds
+        kim1_exec(&sys, (uint32_t)slice);
+        if (_kim1_batch_trapped(&sys)) {
+            res->status = KIM1_BATCH_TRAPPED;
+            break;
+        }
+    }
+    res->ticks = sys.ticks;
+    res->pc = (sys.pins & M6502_SYNC) ? M6502_GET_ADDR(sys.pins) : sys.cpu.PC;
+    res->a = sys.cpu.A;
+    res->x = sys.cpu.X;
+    res->y = sys.cpu.Y;
+    res->s = sys.cpu.S;
+    res->p = sys.cpu.P;
+    res->ram_hash = _kim1_batch_hash(sys.ram, sizeof(sys.ram));
+    kim1_discard(&sys);
+}
+
+/*
+    Each worker owns a range of job indices [head, tail), the owner takes
+    jobs from the tail, thieves take jobs from the head. Since the job
+    list is fixed, the deque never grows, and a range is all that's needed.
+*/
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} _kim1_batch_queue_t;
+
+typedef struct {
+    const kim1_batch_desc_t* desc;
+    _kim1_batch_queue_t queues[KIM1_BATCH_MAX_THREADS];
+    int num_threads;
+} _kim1_batch_pool_t;
+
+typedef struct {
+    _kim1_batch_pool_t* pool;
+    int index;
+    int num_stolen;
+} _kim1_batch_worker_t;
+
+static int _kim1_batch_pop(_kim1_batch_queue_t* q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        job = --q->tail;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int _kim1_batch_steal(_kim1_batch_queue_t* q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        job = q->head++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static void* _kim1_batch_worker(void* arg) {
+    _kim1_batch_worker_t* w = (_kim1_batch_worker_t*) arg;
+    _kim1_batch_pool_t* pool = w->pool;
+    const kim1_batch_desc_t* desc = pool->desc;
+    while (true) {
+        int job = _kim1_batch_pop(&pool->queues[w->index]);
+        if (job < 0) {
+            // own queue is empty, try to steal from the others, starting with the next worker
+            for (int i = 1; (i < pool->num_threads) && (job < 0); i++) {
+                job = _kim1_batch_steal(&pool->queues[(w->index + i) % pool->num_threads]);
+            }
+            if (job < 0) {
+                // all queues are empty (jobs are never added while running)
+                break;
+            }
+            w->num_stolen++;
+        }
+        kim1_batch_run_job(&desc->jobs[job], &desc->results[job]);
+    }
+    return 0;
+}
+
+kim1_batch_summary_t kim1_batch_run(const kim1_batch_desc_t* desc) {
+    CHIPS_ASSERT(desc && desc->jobs && desc->results && (desc->num_jobs >= 0));
+    int num_threads = desc->num_threads;
+    if (num_threads <= 0) {
+        num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > KIM1_BATCH_MAX_THREADS) {
+        num_threads = KIM1_BATCH_MAX_THREADS;
+    }
+    if (num_threads > desc->num_jobs) {
+        num_threads = desc->num_jobs;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    _kim1_batch_pool_t p;
+    memset(&p, 0, sizeof(p));
+    p.desc = desc;
+    p.num_threads = num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&p.queues[i].lock, 0);
+        p.queues[i].head = (int)(((int64_t)desc->num_jobs * i) / num_threads);
+        p.queues[i].tail = (int)(((int64_t)desc->num_jobs * (i + 1)) / num_threads);
+    }
+
+    // the calling thread is worker 0
+    _kim1_batch_worker_t workers[KIM1_BATCH_MAX_THREADS];
+    pthread_t threads[KIM1_BATCH_MAX_THREADS];
+    for (int i = 0; i < num_threads; i++) {
+        workers[i] = (_kim1_batch_worker_t){ .pool = &p, .index = i };
+    }
+    for (int i = 1; i < num_threads; i++) {
+        if (0 != pthread_create(&threads[i], 0, _kim1_batch_worker, &workers[i])) {
+            // couldn't start the thread, its jobs will be stolen by the others
+            threads[i] = 0;
+            workers[i].pool = 0;
+        }
+    }
+    _kim1_batch_worker(&workers[0]);
+    for (int i = 1; i < num_threads; i++) {
+        if (workers[i].pool) {
+            pthread_join(threads[i], 0);
+        }
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_destroy(&p.queues[i].lock);
+    }
+
+    kim1_batch_summary_t summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.num_threads = num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        summary.num_stolen += workers[i].num_stolen;
+    }
+    for (int i = 0; i < desc->num_jobs; i++) {
+        const kim1_batch_result_t* res = &desc->results[i];
+        if (res->status == KIM1_BATCH_TRAPPED) {
+            summary.num_trapped++;
+        }
+        else {
+            summary.num_timeout++;
+        }
+        summary.total_ticks += res->ticks;
+    }
+    return summary;
+}
+
+#endif /* CHIPS_IMPL */
@@ -0,0 +1,410 @@
+#pragma once
+/*#
+    # kim1_image.h
+
+    A registry of memory-mapped KIM-1 ROM, program and tape images,
+    shared by any number of kim1_t instances in the same process.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    ~~~C
+    KIM1_IMAGE_NO_MMAP
+    ~~~
+        read files into allocated memory instead of mapping them (this
+        is the default on Windows)
+
+    You need to include the following headers before including kim1_image.h:
+
+    - chips/chips_common.h
+
+    ## Usage
+
+    Acquire each image from a kim1_images_t registry, an image which
+    is already in the registry isn't opened again, only its reference
+    count is incremented:
+
+    ~~~C
+    static kim1_images_t images;
+    kim1_images_init(&images);
+
+    const kim1_image_t* rom_002 = kim1_image_acquire(&images, &(kim1_image_desc_t){
+        .path = "6530-002.bin",
+    });
+    const kim1_image_t* prog = kim1_image_acquire(&images, &(kim1_image_desc_t){
+        .path = "hello.ptp",
+        .type = KIM1_IMAGE_PTP,
+    });
+    ...
+    kim1_image_release(&images, prog);
+    kim1_image_release(&images, rom_002);
+    kim1_images_discard(&images);
+    ~~~
+
+    kim1_image_acquire() returns 0 if the file can't be opened or
+    decoded, or the registry is full. The registry functions must be
+    called from one thread (or under a lock), the images they return
+    are read-only and can be used from any thread until released.
+
+    ## Image Types
+
+    - **KIM1_IMAGE_FILE** (default): the file is mapped as is, and
+      kim1_image_t.data points to the mapped bytes. Use this for 1 KB
+      ROM images (kim1_desc_t.roms with kim1_desc_t.share_images) and
+      for tape images (kim1_insert_tape()), neither is copied.
+    - **KIM1_IMAGE_RAW**: a raw program, loaded at
+      kim1_image_desc_t.load_addr into kim1_image_t.ram.
+    - **KIM1_IMAGE_PTP**: a paper tape in the format written by the
+      KIM-1 monitor's punch routine (';', byte count, address, data,
+      checksum as hex digits per record, and a final record with a
+      zero byte count), decoded into kim1_image_t.ram.
+
+    Programs must fit into the 1 KB main RAM. The decoded RAM page is
+    part of the registry entry, so it can be mapped copy-on-write into
+    any number of instances without copying it (kim1_desc_t.ram with
+    kim1_desc_t.share_images), and it's decoded only once no matter
+    how many times the program is acquired. The range of RAM written by
+    the program is in kim1_image_t.first_addr and .end_addr.
+
+    ## zlib/libpng license
+
+    Copyright (c) 2019 Andre Weissflog
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+        1. The origin of this software must not be misrepresented; you must not
+        claim that you wrote the original software. If you use this software in a
+        product, an acknowledgment in the product documentation would be
+        appreciated but is not required.
+        2. Altered source versions must be plainly marked as such, and must not
+        be misrepresented as being the original software.
+        3. This notice may not be removed or altered from any source
+        distribution.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KIM1_IMAGE_MAX_IMAGES (32)      // max number of images in a registry
+#define KIM1_IMAGE_MAX_PATH (256)       // max length of an image path (including the terminating zero)
+#define KIM1_IMAGE_RAM_SIZE (0x0400)    // size of a decoded program (the KIM-1 main RAM)
+
+// how an image file is interpreted
+typedef enum {
+    KIM1_IMAGE_FILE,                    // mapped as is (ROM and tape images)
+    KIM1_IMAGE_RAW,                     // raw program bytes
+    KIM1_IMAGE_PTP,                     // KIM-1 paper tape
+} kim1_image_type_t;
+
+// kim1_image_acquire() parameters
+typedef struct {
+    const char* path;
+    kim1_image_type_t type;
+    uint16_t load_addr;                 // load address of KIM1_IMAGE_RAW programs
+} kim1_image_desc_t;
+
+// a registry entry
+typedef struct {
+    uint32_t refs;                      // reference count, 0 if the entry is unused
+    char path[KIM1_IMAGE_MAX_PATH];
+    kim1_image_type_t type;
+    uint16_t load_addr;
+    bool mapped;                        // data is a memory-mapped file (otherwise allocated)
+    chips_range_t data;                 // the file contents
+    chips_range_t ram;                  // programs only: the decoded 1 KB RAM page
+    uint16_t first_addr;                // programs only: first RAM address written by the program
+    uint16_t end_addr;                  // programs only: RAM address after the last byte written by the program
+} kim1_image_t;
+
+// the image registry
+typedef struct {
+    bool valid;
+    kim1_image_t images[KIM1_IMAGE_MAX_IMAGES];
+} kim1_images_t;
+
+// initialize an image registry
+void kim1_images_init(kim1_images_t* reg);
+// discard an image registry, unmaps all images (released or not)
+void kim1_images_discard(kim1_images_t* reg);
+// get an image, opens the file only if it isn't in the registry yet, returns 0 on error
+const kim1_image_t* kim1_image_acquire(kim1_images_t* reg, const kim1_image_desc_t* desc);
+// release an image, it's unmapped when the last reference is released
+void kim1_image_release(kim1_images_t* reg, const kim1_image_t* image);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+#include <string.h> /* memset, memcpy, strlen, strcmp */
+#include <stdlib.h> /* malloc, free */
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+#if defined(_WIN32) && !defined(KIM1_IMAGE_NO_MMAP)
+    #define KIM1_IMAGE_NO_MMAP
+#endif
+#if defined(KIM1_IMAGE_NO_MMAP)
+    #include <stdio.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+void kim1_images_init(kim1_images_t* reg) {
+    CHIPS_ASSERT(reg);
+    memset(reg, 0, sizeof(kim1_images_t));
+    reg->valid = true;
+}
+
+static bool _kim1_image_open(kim1_image_t* img) {
+    #if defined(KIM1_IMAGE_NO_MMAP)
+        FILE* fp = fopen(img->path, "rb");
+        if (!fp) {
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        const long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        void* ptr = (size > 0) ? malloc((size_t)size) : 0;
+        if (ptr && (fread(ptr, 1, (size_t)size, fp) != (size_t)size)) {
+            free(ptr);
+            ptr = 0;
+        }
+        fclose(fp);
+        if (!ptr) {
+            return false;
+        }
+        img->data.ptr = ptr;
+        img->data.size = (size_t)size;
+        img->mapped = false;
+        return true;
+    #else
+        const int fd = open(img->path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void* ptr = MAP_FAILED;
+        if ((0 == fstat(fd, &st)) && (st.st_size > 0)) {
+            ptr = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        // the mapping stays valid after the file is closed
+        close(fd);
+        if (MAP_FAILED == ptr) {
+            return false;
+        }
+        img->data.ptr = ptr;
+        img->data.size = (size_t)st.st_size;
+        img->mapped = true;
+        return true;
+    #endif
+}
+
+static void _kim1_image_close(kim1_image_t* img) {
+    if (img->data.ptr) {
+        #if defined(KIM1_IMAGE_NO_MMAP)
+            free(img->data.ptr);
+        #else
+            munmap(img->data.ptr, img->data.size);
+        #endif
+    }
+    free(img->ram.ptr);
+    memset(img, 0, sizeof(kim1_image_t));
+}
+
+static int _kim1_image_hex_digit(uint8_t c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// decode a hex byte at *pos and advance *pos, returns -1 on error
+static int _kim1_image_hex(const uint8_t* ptr, size_t size, size_t* pos) {
+    if ((*pos + 2) > size) {
+        return -1;
+    }
+    const int h = _kim1_image_hex_digit(ptr[*pos]);
+    const int l = _kim1_image_hex_digit(ptr[*pos + 1]);
+    if ((h < 0) || (l < 0)) {
+        return -1;
+    }
+    *pos += 2;
+    return (h << 4) | l;
+}
+
+// write a program byte into the RAM page
+static bool _kim1_image_put(kim1_image_t* img, uint32_t addr, uint8_t val) {
+    if (addr >= KIM1_IMAGE_RAM_SIZE) {
+        return false;
+    }
+    ((uint8_t*)img->ram.ptr)[addr] = val;
+    if (addr < img->first_addr) {
+        img->first_addr = (uint16_t) addr;
+    }
+    if (addr >= img->end_addr) {
+        img->end_addr = (uint16_t)(addr + 1);
+    }
+    return true;
+}
+
+static bool _kim1_image_decode_raw(kim1_image_t* img) {
+    const uint8_t* src = (const uint8_t*) img->data.ptr;
+    for (size_t i = 0; i < img->data.size; i++) {
+        if (!_kim1_image_put(img, (uint32_t)(img->load_addr + i), src[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    A paper tape record is ';', the number of data bytes, the address
+    (high byte first), the data bytes and a 16-bit checksum (high byte
+    first) over the count, address and data bytes, all as hex digits.
+    Anything between records (CR, LF, NUL padding, XOFF) is ignored.
+    A record with a zero byte count ends the tape.
+*/
+static bool _kim1_image_decode_ptp(kim1_image_t* img) {
+    const uint8_t* src = (const uint8_t*) img->data.ptr;
+    const size_t size = img->data.size;
+    size_t pos = 0;
+    while (true) {
+        while ((pos < size) && (src[pos] != ';')) {
+            pos++;
+        }
+        if (pos >= size) {
+            // no end record
+            return false;
+        }
+        pos++;
+        const int count = _kim1_image_hex(src, size, &pos);
+        if (count == 0) {
+            return true;
+        }
+        const int addr_h = _kim1_image_hex(src, size, &pos);
+        const int addr_l = _kim1_image_hex(src, size, &pos);
+        if ((count < 0) || (addr_h < 0) || (addr_l < 0)) {
+            return false;
+        }
+        uint16_t sum = (uint16_t)(count + addr_h + addr_l);
+        const uint32_t addr = (uint32_t)((addr_h << 8) | addr_l);
+        for (int i = 0; i < count; i++) {
+            const int val = _kim1_image_hex(src, size, &pos);
+            if ((val < 0) || !_kim1_image_put(img, addr + (uint32_t)i, (uint8_t)val)) {
+                return false;
+            }
+            sum += (uint16_t) val;
+        }
+        const int chk_h = _kim1_image_hex(src, size, &pos);
+        const int chk_l = _kim1_image_hex(src, size, &pos);
+        if ((chk_h < 0) || (chk_l < 0) || (sum != (uint16_t)((chk_h << 8) | chk_l))) {
+            return false;
+        }
+    }
+}
+
+static bool _kim1_image_decode(kim1_image_t* img) {
+    if (img->type == KIM1_IMAGE_FILE) {
+        return true;
+    }
+    img->ram.ptr = calloc(1, KIM1_IMAGE_RAM_SIZE);
+    if (!img->ram.ptr) {
+        return false;
+    }
+    img->ram.size = KIM1_IMAGE_RAM_SIZE;
+    img->first_addr = KIM1_IMAGE_RAM_SIZE;
+    img->end_addr = 0;
+    const bool ok = (img->type == KIM1_IMAGE_RAW) ? _kim1_image_decode_raw(img) : _kim1_image_decode_ptp(img);
+    if (img->end_addr == 0) {
+        img->first_addr = 0;
+    }
+    return ok;
+}
+
+const kim1_image_t* kim1_image_acquire(kim1_images_t* reg, const kim1_image_desc_t* desc) {
+    CHIPS_ASSERT(reg && reg->valid && desc && desc->path);
+    if (strlen(desc->path) >= KIM1_IMAGE_MAX_PATH) {
+        return 0;
+    }
+    const uint16_t load_addr = (desc->type == KIM1_IMAGE_RAW) ? desc->load_addr : 0;
+    kim1_image_t* free_img = 0;
+    for (int i = 0; i < KIM1_IMAGE_MAX_IMAGES; i++) {
+        kim1_image_t* img = &reg->images[i];
+        if (img->refs == 0) {
+            if (!free_img) {
+                free_img = img;
+            }
+        }
+        else if ((img->type == desc->type) && (img->load_addr == load_addr) && (0 == strcmp(img->path, desc->path))) {
+            img->refs++;
+            return img;
+        }
+    }
+    if (!free_img) {
+        return 0;
+    }
+    memcpy(free_img->path, desc->path, strlen(desc->path) + 1);
+    free_img->type = desc->type;
+    free_img->load_addr = load_addr;
+    if (!_kim1_image_open(free_img)) {
+        memset(free_img, 0, sizeof(kim1_image_t));
+        return 0;
+    }
+    if (!_kim1_image_decode(free_img)) {
+        _kim1_image_close(free_img);
+        return 0;
+    }
+    free_img->refs = 1;
+    return free_img;
+}
+
+void kim1_image_release(kim1_images_t* reg, const kim1_image_t* image) {
+    CHIPS_ASSERT(reg && reg->valid && image);
+    CHIPS_ASSERT((image >= &reg->images[0]) && (image < &reg->images[KIM1_IMAGE_MAX_IMAGES]));
+    kim1_image_t* img = &reg->images[image - reg->images];
+    CHIPS_ASSERT(img->refs > 0);
+    if (--img->refs == 0) {
+        _kim1_image_close(img);
+    }
+}
+
+void kim1_images_discard(kim1_images_t* reg) {
+    CHIPS_ASSERT(reg && reg->valid);
+    for (int i = 0; i < KIM1_IMAGE_MAX_IMAGES; i++) {
+        if (reg->images[i].refs > 0) {
+            _kim1_image_close(&reg->images[i]);
+        }
+    }
+    reg->valid = false;
+}
+
+#endif /* CHIPS_IMPL */
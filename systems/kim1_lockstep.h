@@ -0,0 +1,622 @@
+#pragma once
+/*#
+    # kim1_lockstep.h
+
+    Run up to 16 KIM-1 instances in lockstep, with the CPU registers
+    stored as structure-of-arrays.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1_lockstep.h:
+
+    - chips/chips_common.h
+    - chips/mem.h
+    - chips/m6502.h
+    - chips/m6530.h
+    - chips/sched.h
+    - chips/clk.h
+    - systems/kim1_tape.h
+    - systems/kim1.h
+
+    ## Overview
+
+    This is meant for fuzzing, where many KIM-1 instances run the same
+    code with different inputs, and most of the time all instances
+    execute the same instruction at the same address.
+
+    Each lockstep 'step' executes exactly one instruction in each lane.
+    When all lanes are at the same address, with the same opcode, no
+    pending interrupt or scheduled event, and the opcode is a documented
+    instruction other than BRK, the instruction is executed for all lanes
+    at once: the operand fetch, the address computation, the memory read,
+    the operation itself, the memory write and the next opcode fetch are
+    each a loop over the lanes. The register and flag computations are
+    simple loops over the register arrays with a trip count of
+    num_lanes and no data-dependent branches, so the compiler can
+    auto-vectorize them (SSE/AVX2 on x86, NEON on ARM, there are no
+    intrinsics in the code). The memory accesses are per-lane, through
+    the lane's mem_t and the K5 RRIOT RAM and I/O like in kim1_step(),
+    so the effective addresses, the branch decisions and the tick counts
+    (page crossings, taken branches) may differ between lanes. In
+    decimal mode ADC and SBC compute the binary result for all lanes and
+    fix up the lanes with the D flag set.
+
+    In all other cases each lane executes the instruction on its own
+    with kim1_step(), with the registers copied from and back into the
+    lane's m6502_t. After an instruction which was executed for all
+    lanes, each lane checks for a trapped ROM routine at the next
+    address like kim1_step() does, so the lanes always stay identical
+    to instances which run with kim1_step().
+
+    ~~~C
+    kim1_lockstep_t ls;
+    kim1_lockstep_init(&ls, &(kim1_lockstep_desc_t){
+        .lanes = { &sys[0], &sys[1], ... },
+        .num_lanes = 16,
+    });
+    kim1_lockstep_run(&ls, 100000);  // run 100000 instructions in each lane
+    ~~~
+
+    The kim1_t instances are owned by the caller, and are fully up to
+    date whenever kim1_lockstep_run() returns. Each lane keeps its own
+    tick counter, since the lanes can take different code paths with
+    different cycle counts.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KIM1_LOCKSTEP_MAX_LANES (16)
+
+// kim1_lockstep_init() parameters
+typedef struct {
+    kim1_t* lanes[KIM1_LOCKSTEP_MAX_LANES];     // initialized kim1_t instances
+    int num_lanes;
+} kim1_lockstep_desc_t;
+
+// lockstep engine state
+typedef struct {
+    // structure-of-arrays CPU registers, only valid inside kim1_lockstep_run()
+    alignas(32) uint16_t PC[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t A[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t X[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t Y[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t S[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t P[KIM1_LOCKSTEP_MAX_LANES];
+    // per-instruction scratch: effective address, operand value and tick count of each lane
+    alignas(32) uint16_t ADDR[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t V[KIM1_LOCKSTEP_MAX_LANES];
+    alignas(32) uint8_t TICKS[KIM1_LOCKSTEP_MAX_LANES];
+    kim1_t* lanes[KIM1_LOCKSTEP_MAX_LANES];
+    int num_lanes;
+    bool valid;
+    uint64_t num_steps;             // number of executed lockstep steps
+    uint64_t num_vector_steps;      // ...of which executed for all lanes at once
+} kim1_lockstep_t;
+
+// initialize a lockstep engine
+void kim1_lockstep_init(kim1_lockstep_t* ls, const kim1_lockstep_desc_t* desc);
+// run a number of instructions in each lane
+void kim1_lockstep_run(kim1_lockstep_t* ls, uint32_t num_instrs);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+
+#include <string.h> // memset
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+void kim1_lockstep_init(kim1_lockstep_t* ls, const kim1_lockstep_desc_t* desc) {
+    CHIPS_ASSERT(ls && desc);
+    CHIPS_ASSERT((desc->num_lanes > 0) && (desc->num_lanes <= KIM1_LOCKSTEP_MAX_LANES));
+    memset(ls, 0, sizeof(*ls));
+    ls->num_lanes = desc->num_lanes;
+    for (int i = 0; i < ls->num_lanes; i++) {
+        CHIPS_ASSERT(desc->lanes[i] && desc->lanes[i]->valid);
+        ls->lanes[i] = desc->lanes[i];
+    }
+    ls->valid = true;
+}
+
+static void _kim1_lockstep_gather(kim1_lockstep_t* ls, int i) {
+    const m6502_t* cpu = &ls->lanes[i]->cpu;
+    ls->PC[i] = cpu->PC;
+    ls->A[i] = cpu->A;
+    ls->X[i] = cpu->X;
+    ls->Y[i] = cpu->Y;
+    ls->S[i] = cpu->S;
+    ls->P[i] = cpu->P;
+}
+
+static void _kim1_lockstep_scatter(kim1_lockstep_t* ls, int i) {
+    m6502_t* cpu = &ls->lanes[i]->cpu;
+    cpu->PC = ls->PC[i];
+    cpu->A = ls->A[i];
+    cpu->X = ls->X[i];
+    cpu->Y = ls->Y[i];
+    cpu->S = ls->S[i];
+    cpu->P = ls->P[i];
+}
+
+// operations of the opcodes which can be executed for all lanes at once
+enum {
+    _KIM1_LS_OP_NONE,       // runs with kim1_step()
+    _KIM1_LS_OP_ORA, _KIM1_LS_OP_AND, _KIM1_LS_OP_EOR, _KIM1_LS_OP_ADC, _KIM1_LS_OP_SBC,
+    _KIM1_LS_OP_CMP, _KIM1_LS_OP_CPX, _KIM1_LS_OP_CPY, _KIM1_LS_OP_BIT,
+    _KIM1_LS_OP_LDA, _KIM1_LS_OP_LDX, _KIM1_LS_OP_LDY, _KIM1_LS_OP_STA, _KIM1_LS_OP_STX, _KIM1_LS_OP_STY,
+    _KIM1_LS_OP_ASL, _KIM1_LS_OP_LSR, _KIM1_LS_OP_ROL, _KIM1_LS_OP_ROR, _KIM1_LS_OP_INC, _KIM1_LS_OP_DEC,
+    _KIM1_LS_OP_TAX, _KIM1_LS_OP_TAY, _KIM1_LS_OP_TXA, _KIM1_LS_OP_TYA, _KIM1_LS_OP_TSX, _KIM1_LS_OP_TXS,
+    _KIM1_LS_OP_INX, _KIM1_LS_OP_INY, _KIM1_LS_OP_DEX, _KIM1_LS_OP_DEY,
+    _KIM1_LS_OP_CLC, _KIM1_LS_OP_SEC, _KIM1_LS_OP_CLI, _KIM1_LS_OP_SEI, _KIM1_LS_OP_CLV, _KIM1_LS_OP_CLD, _KIM1_LS_OP_SED,
+    _KIM1_LS_OP_NOP, _KIM1_LS_OP_PHA, _KIM1_LS_OP_PHP, _KIM1_LS_OP_PLA, _KIM1_LS_OP_PLP,
+    _KIM1_LS_OP_JMP, _KIM1_LS_OP_JMPI, _KIM1_LS_OP_JSR, _KIM1_LS_OP_RTS, _KIM1_LS_OP_RTI, _KIM1_LS_OP_BRANCH,
+};
+
+// addressing modes
+enum {
+    _KIM1_LS_MODE_IMP,      // implied, or the accumulator
+    _KIM1_LS_MODE_IMM,      // #nn
+    _KIM1_LS_MODE_ZP,       // nn
+    _KIM1_LS_MODE_ZPX,      // nn,X
+    _KIM1_LS_MODE_ZPY,      // nn,Y
+    _KIM1_LS_MODE_ABS,      // nnnn
+    _KIM1_LS_MODE_ABX,      // nnnn,X
+    _KIM1_LS_MODE_ABY,      // nnnn,Y
+    _KIM1_LS_MODE_IZX,      // (nn,X)
+    _KIM1_LS_MODE_IZY,      // (nn),Y
+    _KIM1_LS_MODE_REL,      // branch offset
+};
+
+#define _KIM1_LS_F_RD (1<<0)      // the operation reads its operand (the accumulator in implied mode)
+#define _KIM1_LS_F_WR (1<<1)      // ...and writes the result back
+#define _KIM1_LS_F_PEN (1<<2)     // one more tick if the indexed address crosses a page
+
+typedef struct {
+    uint8_t op;                 // _KIM1_LS_OP_*
+    uint8_t mode;               // _KIM1_LS_MODE_*
+    uint8_t ticks;              // without the page crossing and branch penalties
+    uint8_t flags;              // _KIM1_LS_F_RD, _KIM1_LS_F_WR, _KIM1_LS_F_PEN
+} _kim1_lockstep_op_t;
+
+// the same instructions and tick counts as m6502_exec_instr(), all documented opcodes but BRK
+#define _KIM1_LS_E(o,m,t,f) { _KIM1_LS_OP_##o, _KIM1_LS_MODE_##m, t, f }
+#define _KIM1_LS_GROUP1(o,imm,zp,zpx,abs,abx,aby,izx,izy) \
+    [imm]=_KIM1_LS_E(o,IMM,2,_KIM1_LS_F_RD), [zp]=_KIM1_LS_E(o,ZP,3,_KIM1_LS_F_RD), [zpx]=_KIM1_LS_E(o,ZPX,4,_KIM1_LS_F_RD), \
+    [abs]=_KIM1_LS_E(o,ABS,4,_KIM1_LS_F_RD), [abx]=_KIM1_LS_E(o,ABX,4,_KIM1_LS_F_RD|_KIM1_LS_F_PEN), \
+    [aby]=_KIM1_LS_E(o,ABY,4,_KIM1_LS_F_RD|_KIM1_LS_F_PEN), [izx]=_KIM1_LS_E(o,IZX,6,_KIM1_LS_F_RD), \
+    [izy]=_KIM1_LS_E(o,IZY,5,_KIM1_LS_F_RD|_KIM1_LS_F_PEN)
+#define _KIM1_LS_RMW(o,zp,zpx,abs,abx) \
+    [zp]=_KIM1_LS_E(o,ZP,5,_KIM1_LS_F_RD|_KIM1_LS_F_WR), [zpx]=_KIM1_LS_E(o,ZPX,6,_KIM1_LS_F_RD|_KIM1_LS_F_WR), \
+    [abs]=_KIM1_LS_E(o,ABS,6,_KIM1_LS_F_RD|_KIM1_LS_F_WR), [abx]=_KIM1_LS_E(o,ABX,7,_KIM1_LS_F_RD|_KIM1_LS_F_WR)
+static const _kim1_lockstep_op_t _kim1_lockstep_ops[256] = {
+    // loads, ALU and compare
+    _KIM1_LS_GROUP1(ORA, 0x09,0x05,0x15,0x0D,0x1D,0x19,0x01,0x11),
+    _KIM1_LS_GROUP1(AND, 0x29,0x25,0x35,0x2D,0x3D,0x39,0x21,0x31),
+    _KIM1_LS_GROUP1(EOR, 0x49,0x45,0x55,0x4D,0x5D,0x59,0x41,0x51),
+    _KIM1_LS_GROUP1(ADC, 0x69,0x65,0x75,0x6D,0x7D,0x79,0x61,0x71),
+    _KIM1_LS_GROUP1(LDA, 0xA9,0xA5,0xB5,0xAD,0xBD,0xB9,0xA1,0xB1),
+    _KIM1_LS_GROUP1(CMP, 0xC9,0xC5,0xD5,0xCD,0xDD,0xD9,0xC1,0xD1),
+    _KIM1_LS_GROUP1(SBC, 0xE9,0xE5,0xF5,0xED,0xFD,0xF9,0xE1,0xF1),
+    [0xA2]=_KIM1_LS_E(LDX,IMM,2,_KIM1_LS_F_RD), [0xA6]=_KIM1_LS_E(LDX,ZP,3,_KIM1_LS_F_RD), [0xB6]=_KIM1_LS_E(LDX,ZPY,4,_KIM1_LS_F_RD),
+    [0xAE]=_KIM1_LS_E(LDX,ABS,4,_KIM1_LS_F_RD), [0xBE]=_KIM1_LS_E(LDX,ABY,4,_KIM1_LS_F_RD|_KIM1_LS_F_PEN),
+    [0xA0]=_KIM1_LS_E(LDY,IMM,2,_KIM1_LS_F_RD), [0xA4]=_KIM1_LS_E(LDY,ZP,3,_KIM1_LS_F_RD), [0xB4]=_KIM1_LS_E(LDY,ZPX,4,_KIM1_LS_F_RD),
+    [0xAC]=_KIM1_LS_E(LDY,ABS,4,_KIM1_LS_F_RD), [0xBC]=_KIM1_LS_E(LDY,ABX,4,_KIM1_LS_F_RD|_KIM1_LS_F_PEN),
+    [0xE0]=_KIM1_LS_E(CPX,IMM,2,_KIM1_LS_F_RD), [0xE4]=_KIM1_LS_E(CPX,ZP,3,_KIM1_LS_F_RD), [0xEC]=_KIM1_LS_E(CPX,ABS,4,_KIM1_LS_F_RD),
+    [0xC0]=_KIM1_LS_E(CPY,IMM,2,_KIM1_LS_F_RD), [0xC4]=_KIM1_LS_E(CPY,ZP,3,_KIM1_LS_F_RD), [0xCC]=_KIM1_LS_E(CPY,ABS,4,_KIM1_LS_F_RD),
+    [0x24]=_KIM1_LS_E(BIT,ZP,3,_KIM1_LS_F_RD), [0x2C]=_KIM1_LS_E(BIT,ABS,4,_KIM1_LS_F_RD),
+    // stores
+    [0x85]=_KIM1_LS_E(STA,ZP,3,_KIM1_LS_F_WR), [0x95]=_KIM1_LS_E(STA,ZPX,4,_KIM1_LS_F_WR), [0x8D]=_KIM1_LS_E(STA,ABS,4,_KIM1_LS_F_WR),
+    [0x9D]=_KIM1_LS_E(STA,ABX,5,_KIM1_LS_F_WR), [0x99]=_KIM1_LS_E(STA,ABY,5,_KIM1_LS_F_WR), [0x81]=_KIM1_LS_E(STA,IZX,6,_KIM1_LS_F_WR),
+    [0x91]=_KIM1_LS_E(STA,IZY,6,_KIM1_LS_F_WR),
+    [0x86]=_KIM1_LS_E(STX,ZP,3,_KIM1_LS_F_WR), [0x96]=_KIM1_LS_E(STX,ZPY,4,_KIM1_LS_F_WR), [0x8E]=_KIM1_LS_E(STX,ABS,4,_KIM1_LS_F_WR),
+    [0x84]=_KIM1_LS_E(STY,ZP,3,_KIM1_LS_F_WR), [0x94]=_KIM1_LS_E(STY,ZPX,4,_KIM1_LS_F_WR), [0x8C]=_KIM1_LS_E(STY,ABS,4,_KIM1_LS_F_WR),
+    // read-modify-write
+    [0x0A]=_KIM1_LS_E(ASL,IMP,2,_KIM1_LS_F_RD|_KIM1_LS_F_WR), [0x4A]=_KIM1_LS_E(LSR,IMP,2,_KIM1_LS_F_RD|_KIM1_LS_F_WR),
+    [0x2A]=_KIM1_LS_E(ROL,IMP,2,_KIM1_LS_F_RD|_KIM1_LS_F_WR), [0x6A]=_KIM1_LS_E(ROR,IMP,2,_KIM1_LS_F_RD|_KIM1_LS_F_WR),
+    _KIM1_LS_RMW(ASL, 0x06,0x16,0x0E,0x1E),
+    _KIM1_LS_RMW(LSR, 0x46,0x56,0x4E,0x5E),
+    _KIM1_LS_RMW(ROL, 0x26,0x36,0x2E,0x3E),
+    _KIM1_LS_RMW(ROR, 0x66,0x76,0x6E,0x7E),
+    _KIM1_LS_RMW(DEC, 0xC6,0xD6,0xCE,0xDE),
+    _KIM1_LS_RMW(INC, 0xE6,0xF6,0xEE,0xFE),
+    // register transfers, increments and flags
+    [0xAA]=_KIM1_LS_E(TAX,IMP,2,0), [0xA8]=_KIM1_LS_E(TAY,IMP,2,0), [0x8A]=_KIM1_LS_E(TXA,IMP,2,0),
+    [0x98]=_KIM1_LS_E(TYA,IMP,2,0), [0xBA]=_KIM1_LS_E(TSX,IMP,2,0), [0x9A]=_KIM1_LS_E(TXS,IMP,2,0),
+    [0xE8]=_KIM1_LS_E(INX,IMP,2,0), [0xC8]=_KIM1_LS_E(INY,IMP,2,0), [0xCA]=_KIM1_LS_E(DEX,IMP,2,0), [0x88]=_KIM1_LS_E(DEY,IMP,2,0),
+    [0x18]=_KIM1_LS_E(CLC,IMP,2,0), [0x38]=_KIM1_LS_E(SEC,IMP,2,0), [0x58]=_KIM1_LS_E(CLI,IMP,2,0), [0x78]=_KIM1_LS_E(SEI,IMP,2,0),
+    [0xB8]=_KIM1_LS_E(CLV,IMP,2,0), [0xD8]=_KIM1_LS_E(CLD,IMP,2,0), [0xF8]=_KIM1_LS_E(SED,IMP,2,0), [0xEA]=_KIM1_LS_E(NOP,IMP,2,0),
+    // stack
+    [0x48]=_KIM1_LS_E(PHA,IMP,3,0), [0x08]=_KIM1_LS_E(PHP,IMP,3,0), [0x68]=_KIM1_LS_E(PLA,IMP,4,0), [0x28]=_KIM1_LS_E(PLP,IMP,4,0),
+    // jumps, subroutines and branches
+    [0x4C]=_KIM1_LS_E(JMP,ABS,3,0), [0x6C]=_KIM1_LS_E(JMPI,ABS,5,0), [0x20]=_KIM1_LS_E(JSR,ABS,6,0),
+    [0x60]=_KIM1_LS_E(RTS,IMP,6,0), [0x40]=_KIM1_LS_E(RTI,IMP,6,0),
+    [0x10]=_KIM1_LS_E(BRANCH,REL,2,0), [0x30]=_KIM1_LS_E(BRANCH,REL,2,0), [0x50]=_KIM1_LS_E(BRANCH,REL,2,0),
+    [0x70]=_KIM1_LS_E(BRANCH,REL,2,0), [0x90]=_KIM1_LS_E(BRANCH,REL,2,0), [0xB0]=_KIM1_LS_E(BRANCH,REL,2,0),
+    [0xD0]=_KIM1_LS_E(BRANCH,REL,2,0), [0xF0]=_KIM1_LS_E(BRANCH,REL,2,0),
+};
+#undef _KIM1_LS_RMW
+#undef _KIM1_LS_GROUP1
+#undef _KIM1_LS_E
+
+// check if all lanes can execute the next instruction at once
+static bool _kim1_lockstep_uniform(kim1_lockstep_t* ls) {
+    const uint64_t pins0 = ls->lanes[0]->pins;
+    const uint8_t op = M6502_GET_DATA(pins0);
+    if (_KIM1_LS_OP_NONE == _kim1_lockstep_ops[op].op) {
+        return false;
+    }
+    for (int i = 0; i < ls->num_lanes; i++) {
+        const kim1_t* sys = ls->lanes[i];
+        const uint64_t pins = sys->pins;
+        if ((ls->PC[i] != ls->PC[0]) ||
+            (M6502_GET_DATA(pins) != op) ||
+            (0 == (pins & M6502_SYNC)) ||
+            (0 != (pins & (M6502_NMI|M6502_RES|M6502_RDY))) ||
+            ((0 != (pins & M6502_IRQ)) && (0 == (ls->P[i] & M6502_IF))) ||
+            (0 != (sys->cpu.irq_pip | sys->cpu.nmi_pip | sys->cpu.brk_flags)) ||
+            (sys->ticks >= sys->next_event_tick))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define _KIM1_LS_FOR(i) for (int i = 0; i < ls->num_lanes; i++)
+#define _KIM1_LS_NZ(i,v) ls->P[i]=(uint8_t)((ls->P[i]&~(M6502_NF|M6502_ZF))|((v)&M6502_NF)|((v)?0:M6502_ZF))
+#define _KIM1_LS_CMP(r) _KIM1_LS_FOR(i) { const uint8_t t = (uint8_t)(ls->r[i] - ls->V[i]); ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_ZF|M6502_CF)) | (t & M6502_NF) | (t ? 0 : M6502_ZF) | ((ls->r[i] >= ls->V[i]) ? M6502_CF : 0)); }
+// memory accesses of a lane, including the K5 RRIOT RAM and I/O (like the bus of kim1_step() and the trap code)
+#define _KIM1_LS_RD(i,a) _kim1_trap_rd((uint16_t)(a), ls->lanes[i])
+#define _KIM1_LS_WR(i,a,d) _kim1_trap_wr(ls->lanes[i], (uint16_t)(a), (uint8_t)(d))
+
+// one bit per lane which runs ADC/SBC in decimal mode
+static uint32_t _kim1_lockstep_bcd_lanes(const kim1_lockstep_t* ls) {
+    uint32_t mask = 0;
+    _KIM1_LS_FOR(i) {
+        if ((ls->P[i] & M6502_DF) && M6502_BCD_ENABLED(&ls->lanes[i]->cpu)) {
+            mask |= 1U << i;
+        }
+    }
+    return mask;
+}
+
+static void _kim1_lockstep_adc(kim1_lockstep_t* ls) {
+    uint16_t bcd[KIM1_LOCKSTEP_MAX_LANES];
+    const uint32_t bcd_lanes = _kim1_lockstep_bcd_lanes(ls);
+    _KIM1_LS_FOR(i) {
+        if (bcd_lanes & (1U << i)) {
+            bcd[i] = _M6502_ADC_BCD(ls->A[i], ls->V[i], ls->P[i] & M6502_CF);
+        }
+    }
+    _KIM1_LS_FOR(i) {
+        const uint16_t sum = (uint16_t)(ls->A[i] + ls->V[i] + (ls->P[i] & M6502_CF));
+        const uint8_t v = (uint8_t)(((~(ls->A[i] ^ ls->V[i]) & (ls->A[i] ^ sum)) & 0x80) >> 1);
+        const uint8_t r = (uint8_t)sum;
+        ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_VF|M6502_ZF|M6502_CF)) | (r & M6502_NF) | (r ? 0 : M6502_ZF) | v | (sum >> 8));
+        ls->A[i] = r;
+    }
+    _KIM1_LS_FOR(i) {
+        if (bcd_lanes & (1U << i)) {
+            ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_VF|M6502_ZF|M6502_CF)) | (bcd[i] >> 8));
+            ls->A[i] = (uint8_t)bcd[i];
+        }
+    }
+}
+
+static void _kim1_lockstep_sbc(kim1_lockstep_t* ls) {
+    uint16_t bcd[KIM1_LOCKSTEP_MAX_LANES];
+    const uint32_t bcd_lanes = _kim1_lockstep_bcd_lanes(ls);
+    _KIM1_LS_FOR(i) {
+        if (bcd_lanes & (1U << i)) {
+            bcd[i] = _M6502_SBC_BCD(ls->A[i], ls->V[i], ls->P[i] & M6502_CF);
+        }
+    }
+    _KIM1_LS_FOR(i) {
+        const uint16_t diff = (uint16_t)(ls->A[i] - ls->V[i] - (1 - (ls->P[i] & M6502_CF)));
+        const uint8_t v = (uint8_t)((((ls->A[i] ^ ls->V[i]) & (ls->A[i] ^ diff)) & 0x80) >> 1);
+        const uint8_t r = (uint8_t)diff;
+        ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_VF|M6502_ZF|M6502_CF)) | (r & M6502_NF) | (r ? 0 : M6502_ZF) | v | ((diff >> 8) ? 0 : M6502_CF));
+        ls->A[i] = r;
+    }
+    _KIM1_LS_FOR(i) {
+        if (bcd_lanes & (1U << i)) {
+            ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_VF|M6502_ZF|M6502_CF)) | (bcd[i] >> 8));
+            ls->A[i] = (uint8_t)bcd[i];
+        }
+    }
+}
+
+// compute the effective address (or fetch the immediate operand) from each lane's instruction bytes
+static void _kim1_lockstep_operand(kim1_lockstep_t* ls, const _kim1_lockstep_op_t* d) {
+    switch (d->mode) {
+        case _KIM1_LS_MODE_IMM:
+        case _KIM1_LS_MODE_REL:
+            _KIM1_LS_FOR(i) { ls->V[i] = _KIM1_LS_RD(i, ls->PC[i]); ls->PC[i]++; }
+            break;
+        case _KIM1_LS_MODE_ZP:
+            _KIM1_LS_FOR(i) { ls->ADDR[i] = _KIM1_LS_RD(i, ls->PC[i]); ls->PC[i]++; }
+            break;
+        case _KIM1_LS_MODE_ZPX:
+            _KIM1_LS_FOR(i) { ls->ADDR[i] = (uint8_t)(_KIM1_LS_RD(i, ls->PC[i]) + ls->X[i]); ls->PC[i]++; }
+            break;
+        case _KIM1_LS_MODE_ZPY:
+            _KIM1_LS_FOR(i) { ls->ADDR[i] = (uint8_t)(_KIM1_LS_RD(i, ls->PC[i]) + ls->Y[i]); ls->PC[i]++; }
+            break;
+        case _KIM1_LS_MODE_ABS:
+        case _KIM1_LS_MODE_ABX:
+        case _KIM1_LS_MODE_ABY:
+            _KIM1_LS_FOR(i) {
+                const uint8_t l = _KIM1_LS_RD(i, ls->PC[i]);
+                ls->ADDR[i] = (uint16_t)(l | (_KIM1_LS_RD(i, ls->PC[i] + 1) << 8));
+                ls->PC[i] += 2;
+            }
+            if (d->mode == _KIM1_LS_MODE_ABX) {
+                _KIM1_LS_FOR(i) {
+                    const uint16_t addr = (uint16_t)(ls->ADDR[i] + ls->X[i]);
+                    ls->TICKS[i] += (d->flags & _KIM1_LS_F_PEN) ? (((ls->ADDR[i] ^ addr) >> 8) & 1) : 0;
+                    ls->ADDR[i] = addr;
+                }
+            }
+            else if (d->mode == _KIM1_LS_MODE_ABY) {
+                _KIM1_LS_FOR(i) {
+                    const uint16_t addr = (uint16_t)(ls->ADDR[i] + ls->Y[i]);
+                    ls->TICKS[i] += (d->flags & _KIM1_LS_F_PEN) ? (((ls->ADDR[i] ^ addr) >> 8) & 1) : 0;
+                    ls->ADDR[i] = addr;
+                }
+            }
+            break;
+        case _KIM1_LS_MODE_IZX:
+            _KIM1_LS_FOR(i) {
+                const uint8_t z = (uint8_t)(_KIM1_LS_RD(i, ls->PC[i]) + ls->X[i]);
+                const uint8_t l = _KIM1_LS_RD(i, z);
+                ls->ADDR[i] = (uint16_t)(l | (_KIM1_LS_RD(i, (uint8_t)(z + 1)) << 8));
+                ls->PC[i]++;
+            }
+            break;
+        case _KIM1_LS_MODE_IZY:
+            _KIM1_LS_FOR(i) {
+                const uint8_t z = _KIM1_LS_RD(i, ls->PC[i]);
+                const uint8_t l = _KIM1_LS_RD(i, z);
+                const uint16_t base = (uint16_t)(l | (_KIM1_LS_RD(i, (uint8_t)(z + 1)) << 8));
+                const uint16_t addr = (uint16_t)(base + ls->Y[i]);
+                ls->TICKS[i] += (d->flags & _KIM1_LS_F_PEN) ? (((base ^ addr) >> 8) & 1) : 0;
+                ls->ADDR[i] = addr;
+                ls->PC[i]++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// execute one instruction for all lanes at once
+static void _kim1_lockstep_vector_step(kim1_lockstep_t* ls) {
+    const uint8_t opcode = M6502_GET_DATA(ls->lanes[0]->pins);
+    const _kim1_lockstep_op_t* d = &_kim1_lockstep_ops[opcode];
+    _KIM1_LS_FOR(i) {
+        ls->TICKS[i] = d->ticks;
+        ls->PC[i]++;
+    }
+    // the instruction bytes are read from each lane's memory, the code in RAM may differ between lanes
+    _kim1_lockstep_operand(ls, d);
+    if (d->flags & _KIM1_LS_F_RD) {
+        if (d->mode == _KIM1_LS_MODE_IMP) {
+            _KIM1_LS_FOR(i) { ls->V[i] = ls->A[i]; }
+        }
+        else if (d->mode != _KIM1_LS_MODE_IMM) {
+            _KIM1_LS_FOR(i) { ls->V[i] = _KIM1_LS_RD(i, ls->ADDR[i]); }
+        }
+    }
+    switch (d->op) {
+        case _KIM1_LS_OP_ORA: _KIM1_LS_FOR(i) { ls->A[i] |= ls->V[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_AND: _KIM1_LS_FOR(i) { ls->A[i] &= ls->V[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_EOR: _KIM1_LS_FOR(i) { ls->A[i] ^= ls->V[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_ADC: _kim1_lockstep_adc(ls); break;
+        case _KIM1_LS_OP_SBC: _kim1_lockstep_sbc(ls); break;
+        case _KIM1_LS_OP_CMP: _KIM1_LS_CMP(A); break;
+        case _KIM1_LS_OP_CPX: _KIM1_LS_CMP(X); break;
+        case _KIM1_LS_OP_CPY: _KIM1_LS_CMP(Y); break;
+        case _KIM1_LS_OP_BIT:
+            _KIM1_LS_FOR(i) {
+                ls->P[i] = (uint8_t)((ls->P[i] & ~(M6502_NF|M6502_VF|M6502_ZF)) | (ls->V[i] & (M6502_NF|M6502_VF)) | ((ls->A[i] & ls->V[i]) ? 0 : M6502_ZF));
+            }
+            break;
+        case _KIM1_LS_OP_LDA: _KIM1_LS_FOR(i) { ls->A[i] = ls->V[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_LDX: _KIM1_LS_FOR(i) { ls->X[i] = ls->V[i]; _KIM1_LS_NZ(i, ls->X[i]); } break;
+        case _KIM1_LS_OP_LDY: _KIM1_LS_FOR(i) { ls->Y[i] = ls->V[i]; _KIM1_LS_NZ(i, ls->Y[i]); } break;
+        case _KIM1_LS_OP_STA: _KIM1_LS_FOR(i) { ls->V[i] = ls->A[i]; } break;
+        case _KIM1_LS_OP_STX: _KIM1_LS_FOR(i) { ls->V[i] = ls->X[i]; } break;
+        case _KIM1_LS_OP_STY: _KIM1_LS_FOR(i) { ls->V[i] = ls->Y[i]; } break;
+        case _KIM1_LS_OP_ASL:
+            _KIM1_LS_FOR(i) {
+                const uint8_t c = ls->V[i] >> 7;
+                ls->V[i] = (uint8_t)(ls->V[i] << 1);
+                _KIM1_LS_NZ(i, ls->V[i]);
+                ls->P[i] = (uint8_t)((ls->P[i] & ~M6502_CF) | c);
+            }
+            break;
+        case _KIM1_LS_OP_LSR:
+            _KIM1_LS_FOR(i) {
+                const uint8_t c = ls->V[i] & 1;
+                ls->V[i] = ls->V[i] >> 1;
+                _KIM1_LS_NZ(i, ls->V[i]);
+                ls->P[i] = (uint8_t)((ls->P[i] & ~M6502_CF) | c);
+            }
+            break;
+        case _KIM1_LS_OP_ROL:
+            _KIM1_LS_FOR(i) {
+                const uint8_t c = ls->V[i] >> 7;
+                ls->V[i] = (uint8_t)((ls->V[i] << 1) | (ls->P[i] & M6502_CF));
+                _KIM1_LS_NZ(i, ls->V[i]);
+                ls->P[i] = (uint8_t)((ls->P[i] & ~M6502_CF) | c);
+            }
+            break;
+        case _KIM1_LS_OP_ROR:
+            _KIM1_LS_FOR(i) {
+                const uint8_t c = ls->V[i] & 1;
+                ls->V[i] = (uint8_t)((ls->V[i] >> 1) | ((ls->P[i] & M6502_CF) << 7));
+                _KIM1_LS_NZ(i, ls->V[i]);
+                ls->P[i] = (uint8_t)((ls->P[i] & ~M6502_CF) | c);
+            }
+            break;
+        case _KIM1_LS_OP_INC: _KIM1_LS_FOR(i) { ls->V[i]++; _KIM1_LS_NZ(i, ls->V[i]); } break;
+        case _KIM1_LS_OP_DEC: _KIM1_LS_FOR(i) { ls->V[i]--; _KIM1_LS_NZ(i, ls->V[i]); } break;
+        case _KIM1_LS_OP_TAX: _KIM1_LS_FOR(i) { ls->X[i] = ls->A[i]; _KIM1_LS_NZ(i, ls->X[i]); } break;
+        case _KIM1_LS_OP_TAY: _KIM1_LS_FOR(i) { ls->Y[i] = ls->A[i]; _KIM1_LS_NZ(i, ls->Y[i]); } break;
+        case _KIM1_LS_OP_TXA: _KIM1_LS_FOR(i) { ls->A[i] = ls->X[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_TYA: _KIM1_LS_FOR(i) { ls->A[i] = ls->Y[i]; _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_TSX: _KIM1_LS_FOR(i) { ls->X[i] = ls->S[i]; _KIM1_LS_NZ(i, ls->X[i]); } break;
+        case _KIM1_LS_OP_TXS: _KIM1_LS_FOR(i) { ls->S[i] = ls->X[i]; } break;
+        case _KIM1_LS_OP_INX: _KIM1_LS_FOR(i) { ls->X[i]++; _KIM1_LS_NZ(i, ls->X[i]); } break;
+        case _KIM1_LS_OP_INY: _KIM1_LS_FOR(i) { ls->Y[i]++; _KIM1_LS_NZ(i, ls->Y[i]); } break;
+        case _KIM1_LS_OP_DEX: _KIM1_LS_FOR(i) { ls->X[i]--; _KIM1_LS_NZ(i, ls->X[i]); } break;
+        case _KIM1_LS_OP_DEY: _KIM1_LS_FOR(i) { ls->Y[i]--; _KIM1_LS_NZ(i, ls->Y[i]); } break;
+        case _KIM1_LS_OP_CLC: _KIM1_LS_FOR(i) { ls->P[i] &= (uint8_t)~M6502_CF; } break;
+        case _KIM1_LS_OP_SEC: _KIM1_LS_FOR(i) { ls->P[i] |= M6502_CF; } break;
+        case _KIM1_LS_OP_CLI: _KIM1_LS_FOR(i) { ls->P[i] &= (uint8_t)~M6502_IF; } break;
+        case _KIM1_LS_OP_SEI: _KIM1_LS_FOR(i) { ls->P[i] |= M6502_IF; } break;
+        case _KIM1_LS_OP_CLV: _KIM1_LS_FOR(i) { ls->P[i] &= (uint8_t)~M6502_VF; } break;
+        case _KIM1_LS_OP_CLD: _KIM1_LS_FOR(i) { ls->P[i] &= (uint8_t)~M6502_DF; } break;
+        case _KIM1_LS_OP_SED: _KIM1_LS_FOR(i) { ls->P[i] |= M6502_DF; } break;
+        case _KIM1_LS_OP_PHA: _KIM1_LS_FOR(i) { _KIM1_LS_WR(i, 0x0100 | ls->S[i], ls->A[i]); ls->S[i]--; } break;
+        case _KIM1_LS_OP_PHP: _KIM1_LS_FOR(i) { _KIM1_LS_WR(i, 0x0100 | ls->S[i], ls->P[i] | M6502_XF); ls->S[i]--; } break;
+        case _KIM1_LS_OP_PLA: _KIM1_LS_FOR(i) { ls->S[i]++; ls->A[i] = _KIM1_LS_RD(i, 0x0100 | ls->S[i]); _KIM1_LS_NZ(i, ls->A[i]); } break;
+        case _KIM1_LS_OP_PLP: _KIM1_LS_FOR(i) { ls->S[i]++; ls->P[i] = (uint8_t)((_KIM1_LS_RD(i, 0x0100 | ls->S[i]) | M6502_BF) & ~M6502_XF); } break;
+        case _KIM1_LS_OP_JMP: _KIM1_LS_FOR(i) { ls->PC[i] = ls->ADDR[i]; } break;
+        case _KIM1_LS_OP_JMPI:
+            // with the 6502 page wrap bug
+            _KIM1_LS_FOR(i) {
+                const uint16_t a = ls->ADDR[i];
+                const uint8_t l = _KIM1_LS_RD(i, a);
+                ls->PC[i] = (uint16_t)(l | (_KIM1_LS_RD(i, (a & 0xFF00) | ((a + 1) & 0x00FF)) << 8));
+            }
+            break;
+        case _KIM1_LS_OP_JSR:
+            _KIM1_LS_FOR(i) {
+                const uint16_t ret = (uint16_t)(ls->PC[i] - 1);
+                _KIM1_LS_WR(i, 0x0100 | ls->S[i], ret >> 8);
+                ls->S[i]--;
+                _KIM1_LS_WR(i, 0x0100 | ls->S[i], ret);
+                ls->S[i]--;
+                ls->PC[i] = ls->ADDR[i];
+            }
+            break;
+        case _KIM1_LS_OP_RTS:
+            _KIM1_LS_FOR(i) {
+                ls->S[i]++;
+                const uint8_t l = _KIM1_LS_RD(i, 0x0100 | ls->S[i]);
+                ls->S[i]++;
+                const uint8_t h = _KIM1_LS_RD(i, 0x0100 | ls->S[i]);
+                ls->PC[i] = (uint16_t)(((h << 8) | l) + 1);
+            }
+            break;
+        case _KIM1_LS_OP_RTI:
+            _KIM1_LS_FOR(i) {
+                ls->S[i]++;
+                ls->P[i] = (uint8_t)((_KIM1_LS_RD(i, 0x0100 | ls->S[i]) | M6502_BF) & ~M6502_XF);
+                ls->S[i]++;
+                const uint8_t l = _KIM1_LS_RD(i, 0x0100 | ls->S[i]);
+                ls->S[i]++;
+                const uint8_t h = _KIM1_LS_RD(i, 0x0100 | ls->S[i]);
+                ls->PC[i] = (uint16_t)((h << 8) | l);
+            }
+            break;
+        case _KIM1_LS_OP_BRANCH: {
+            // bits 6,7 select the flag, bit 5 is the flag value for which the branch is taken
+            static const uint8_t flags[4] = { M6502_NF, M6502_VF, M6502_CF, M6502_ZF };
+            const uint8_t mask = flags[opcode >> 6];
+            const uint8_t taken_value = (opcode & 0x20) ? mask : 0;
+            // 1 more tick if taken, and another one if the target is in another page
+            _KIM1_LS_FOR(i) {
+                const uint16_t target = (uint16_t)(ls->PC[i] + (int8_t)ls->V[i]);
+                const bool taken = (ls->P[i] & mask) == taken_value;
+                ls->TICKS[i] += taken ? (uint8_t)(1 + (((target ^ ls->PC[i]) >> 8) & 1)) : 0;
+                ls->PC[i] = taken ? target : ls->PC[i];
+            }
+            break;
+        }
+        default: break;
+    }
+    if (d->flags & _KIM1_LS_F_WR) {
+        if (d->mode == _KIM1_LS_MODE_IMP) {
+            _KIM1_LS_FOR(i) { ls->A[i] = ls->V[i]; }
+        }
+        else {
+            _KIM1_LS_FOR(i) { _KIM1_LS_WR(i, ls->ADDR[i], ls->V[i]); }
+        }
+    }
+    // same pin state as after m6502_exec_instr()
+    _KIM1_LS_FOR(i) {
+        kim1_t* sys = ls->lanes[i];
+        const uint16_t pc = ls->PC[i];
+        uint64_t pins = (sys->pins & ~0xFFFFFFULL) | M6502_RW | M6502_SYNC | pc;
+        M6502_SET_DATA(pins, _KIM1_LS_RD(i, pc));
+        sys->cpu.PINS = pins;
+        sys->ticks += ls->TICKS[i];
+        // like in kim1_step(), the next instruction may be a trapped ROM routine (the trap works on the lane's m6502_t)
+        if (sys->traps && _kim1_trap_addr(pins)) {
+            _kim1_lockstep_scatter(ls, i);
+            pins = _kim1_trap(sys, pins);
+            _kim1_lockstep_gather(ls, i);
+        }
+        sys->pins = pins;
+    }
+}
+
+#undef _KIM1_LS_WR
+#undef _KIM1_LS_RD
+#undef _KIM1_LS_CMP
+#undef _KIM1_LS_NZ
+#undef _KIM1_LS_FOR
+#undef _KIM1_LS_F_PEN
+#undef _KIM1_LS_F_WR
+#undef _KIM1_LS_F_RD
+
+void kim1_lockstep_run(kim1_lockstep_t* ls, uint32_t num_instrs) {
+    CHIPS_ASSERT(ls && ls->valid);
+    for (int i = 0; i < ls->num_lanes; i++) {
+        _kim1_lockstep_gather(ls, i);
+    }
+    for (uint32_t n = 0; n < num_instrs; n++) {
+        if (_kim1_lockstep_uniform(ls)) {
+            _kim1_lockstep_vector_step(ls);
+            ls->num_vector_steps++;
+        }
+        else {
+            // diverged, run each lane on its own
+            for (int i = 0; i < ls->num_lanes; i++) {
+                _kim1_lockstep_scatter(ls, i);
+                kim1_step(ls->lanes[i]);
+                _kim1_lockstep_gather(ls, i);
+            }
+        }
+        ls->num_steps++;
+    }
+    for (int i = 0; i < ls->num_lanes; i++) {
+        _kim1_lockstep_scatter(ls, i);
+    }
+}
+
+#endif /* CHIPS_IMPL */
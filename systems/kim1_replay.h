@@ -0,0 +1,602 @@
+#pragma once
+/*#
+    # kim1_replay.h
+
+    Deterministic record and replay of KIM-1 sessions.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1_replay.h:
+
+    - chips/chips_common.h
+    - chips/mem.h
+    - chips/m6502.h
+    - chips/m6530.h
+    - chips/sched.h
+    - chips/clk.h
+    - systems/kim1_tape.h
+    - systems/kim1.h
+
+    ## Overview
+
+    A KIM-1 session is fully determined by its start state and the
+    external inputs, so a recording only needs to store the inputs
+    (keypad events, TTY bytes, cassette transport commands and resets)
+    with the tick at which they happened. This input log is a compact
+    byte stream, each input is a varint with the number of ticks since
+    the previous input and the input type, followed by a few bytes of
+    input data. A key press is typically 4..8 bytes, so even hours of
+    interactive use only produce kilobytes of log.
+
+    To seek in a long recording without re-executing it from the start,
+    the recorder also takes keyframes at regular intervals, a keyframe is
+    a regular kim1_t snapshot (see kim1_save_snapshot()) together with
+    the input log position at that time.
+
+    ## Recording
+
+    The log and keyframe memory is provided by the caller:
+
+    ~~~C
+    static uint8_t log[64 * 1024];
+    static kim1_rec_keyframe_t keyframes[64];
+    kim1_rec_t rec;
+    kim1_rec_init(&rec, &sys, &(kim1_rec_desc_t){
+        .log = { .ptr = log, .size = sizeof(log) },
+        .keyframes = keyframes,
+        .max_keyframes = 64,
+        .keyframe_ticks = 0,    // 0 means KIM1_REC_DEFAULT_KEYFRAME_TICKS
+    });
+    ~~~
+
+    kim1_rec_init() takes the first keyframe from the current state
+    of the kim1_t instance. From then on, run the instance with
+    kim1_rec_exec() instead of kim1_exec(), and feed all inputs through
+    the kim1_rec_*() wrappers of the kim1_t input functions, which log
+    each input that was accepted by the kim1_t instance:
+
+    ~~~C
+    kim1_rec_exec(&rec, frame_time_us);
+    kim1_rec_key_down(&rec, KIM1_KEY_GO);
+    kim1_rec_tty_put(&rec, bytes, num_bytes);
+    ~~~
+
+    When all keyframe slots are in use, every other keyframe is dropped
+    and the keyframe interval is doubled, so a recording of any length
+    fits, with keyframes spread evenly over the session. When the input
+    log is full, recording stops (kim1_rec_t.overflow is set, and
+    kim1_rec_t.overflow_tick is the tick of the first lost input), the
+    kim1_t instance itself keeps running unaffected.
+
+    The recording is the used part of the log buffer (kim1_rec_t.log_pos
+    bytes) and the keyframes (kim1_rec_t.num_keyframes items), both can
+    be written to a file as is.
+
+    ## Replay
+
+    Replay into any initialized kim1_t instance, the configuration
+    (execution mode, ROMs, etc) comes from the keyframes:
+
+    ~~~C
+    kim1_replay_t rp;
+    kim1_replay_init(&rp, &replay_sys, &(kim1_replay_desc_t){
+        .log = { .ptr = rec.log, .size = rec.log_pos },
+        .keyframes = rec.keyframes,
+        .num_keyframes = rec.num_keyframes,
+        .tape = tape_image,     // the tape image which was inserted while recording
+    });
+    kim1_replay_seek(&rp, tick);    // jump to any tick of the session
+    kim1_replay_run(&rp, tick);     // run forward to a tick
+    ~~~
+
+    kim1_replay_seek() loads the latest keyframe at or before the tick
+    (unless the instance is already between that keyframe and the tick),
+    and re-executes the instance and the logged inputs up to the tick,
+    kim1_replay_run() only runs forward. Inputs logged at the target tick
+    itself are applied, so the state matches the recorded instance
+    right before its next kim1_rec_exec(). Replay runs at full emulation
+    speed, which is a few hundred times faster than the 1 MHz of the
+    original machine, so seeking in even hour-long sessions only takes a
+    fraction of a second.
+
+    Tape images and record buffers aren't part of the recording (like
+    in snapshots). A logged tape insert inserts kim1_replay_desc_t.tape,
+    this must be the image which was inserted while recording. A logged
+    start of a tape recording records into kim1_replay_desc_t.tape_record
+    if provided, otherwise it only stops the tape (which is equivalent
+    for the emulation, since recording is output only). The tape edges
+    aren't logged, they are a function of the tape image and the logged
+    Play command.
+
+    The replay needs the recorded instance to only be driven by
+    kim1_rec_exec() and the kim1_rec_*() input functions, and the replay
+    instance to only be driven by kim1_replay_seek() and kim1_replay_run().
+    An input which was logged in the middle of an instruction-stepped
+    time slice (or replayed at a different tick for any other reason)
+    is applied at the next possible tick, and counted in
+    kim1_replay_t.num_diverged.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KIM1_REC_DEFAULT_KEYFRAME_TICKS (10 * KIM1_FREQUENCY)
+
+// a keyframe with the input log position at the time it was taken
+typedef struct {
+    uint64_t tick;              // kim1_t.ticks when the keyframe was taken
+    uint64_t log_tick;          // tick of the last input logged before the keyframe
+    uint32_t log_pos;           // input log size when the keyframe was taken
+    uint32_t version;           // snapshot version
+    kim1_t snapshot;
+} kim1_rec_keyframe_t;
+
+// kim1_rec_init() parameters
+typedef struct {
+    chips_range_t log;              // memory for the input log
+    kim1_rec_keyframe_t* keyframes; // memory for the keyframes
+    uint32_t max_keyframes;         // number of keyframes, at least 2
+    uint64_t keyframe_ticks;        // initial ticks between keyframes (default: KIM1_REC_DEFAULT_KEYFRAME_TICKS)
+} kim1_rec_desc_t;
+
+// recorder state
+typedef struct {
+    kim1_t* sys;
+    uint8_t* log;
+    uint32_t log_size;
+    uint32_t log_pos;               // size of the recorded input log
+    uint64_t log_tick;              // tick of the last logged input
+    kim1_rec_keyframe_t* keyframes;
+    uint32_t max_keyframes;
+    uint32_t num_keyframes;
+    uint64_t keyframe_ticks;
+    uint64_t next_keyframe_tick;
+    bool overflow;                  // the input log ran full, recording has stopped
+    uint64_t overflow_tick;         // tick of the first input which didn't fit into the log
+    bool valid;
+} kim1_rec_t;
+
+// kim1_replay_init() parameters
+typedef struct {
+    chips_range_t log;                      // the recorded input log
+    const kim1_rec_keyframe_t* keyframes;   // the recorded keyframes
+    uint32_t num_keyframes;
+    chips_range_t tape;                     // tape image for logged tape inserts
+    chips_range_t tape_record;              // optional record buffer for logged tape recordings
+} kim1_replay_desc_t;
+
+// replay state
+typedef struct {
+    kim1_t* sys;
+    const uint8_t* log;
+    uint32_t log_size;
+    uint32_t log_pos;               // read position of the next input's data
+    uint64_t log_tick;              // recorded tick of the last replayed input
+    const kim1_rec_keyframe_t* keyframes;
+    uint32_t num_keyframes;
+    chips_range_t tape;
+    chips_range_t tape_record;
+    bool has_next;                  // the next input's header has been decoded
+    uint8_t next_type;
+    uint64_t next_tick;             // recorded tick of the next input
+    uint32_t num_diverged;          // number of inputs which weren't replayed at their recorded tick
+    bool corrupt;                   // the input log ended in the middle of an input
+    bool valid;
+} kim1_replay_t;
+
+// start recording a kim1_t instance, takes the first keyframe
+void kim1_rec_init(kim1_rec_t* rec, kim1_t* sys, const kim1_rec_desc_t* desc);
+// run the recorded instance (see kim1_exec()), takes keyframes
+uint32_t kim1_rec_exec(kim1_rec_t* rec, uint32_t micro_seconds);
+// logged kim1_key_event()
+bool kim1_rec_key_event(kim1_rec_t* rec, uint64_t tick, int key, bool down);
+// logged kim1_key_down()
+bool kim1_rec_key_down(kim1_rec_t* rec, int key);
+// logged kim1_key_up()
+bool kim1_rec_key_up(kim1_rec_t* rec, int key);
+// logged kim1_tty_put()
+uint32_t kim1_rec_tty_put(kim1_rec_t* rec, const uint8_t* bytes, uint32_t num_bytes);
+// logged kim1_reset()
+void kim1_rec_reset(kim1_rec_t* rec);
+// logged kim1_insert_tape()
+bool kim1_rec_insert_tape(kim1_rec_t* rec, chips_range_t image);
+// logged kim1_remove_tape()
+void kim1_rec_remove_tape(kim1_rec_t* rec);
+// logged kim1_play_tape()
+void kim1_rec_play_tape(kim1_rec_t* rec);
+// logged kim1_record_tape()
+void kim1_rec_record_tape(kim1_rec_t* rec, chips_range_t buffer);
+// logged kim1_stop_tape()
+void kim1_rec_stop_tape(kim1_rec_t* rec);
+
+// start replaying a recording into a kim1_t instance, loads the first keyframe
+void kim1_replay_init(kim1_replay_t* rp, kim1_t* sys, const kim1_replay_desc_t* desc);
+// jump to a tick of the recording, returns false if the tick is before the first keyframe
+bool kim1_replay_seek(kim1_replay_t* rp, uint64_t tick);
+// run forward to a tick, replaying all inputs logged up to the tick
+void kim1_replay_run(kim1_replay_t* rp, uint64_t tick);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+
+#include <string.h> // memset, memcpy
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+/*
+    Each input starts with a varint header ((ticks since previous input) << 3) | type,
+    followed by the type's data:
+
+    KEY:            key | (down << 7), varint (ticks from logging to the key event)
+    TTY:            varint number of bytes, bytes
+    all others:     no data
+*/
+#define _KIM1_REC_KEY           (0)
+#define _KIM1_REC_TTY           (1)
+#define _KIM1_REC_RESET         (2)
+#define _KIM1_REC_TAPE_INSERT   (3)
+#define _KIM1_REC_TAPE_REMOVE   (4)
+#define _KIM1_REC_TAPE_PLAY     (5)
+#define _KIM1_REC_TAPE_RECORD   (6)
+#define _KIM1_REC_TAPE_STOP     (7)
+#define _KIM1_REC_MAX_HEADER_SIZE (32)
+
+static uint32_t _kim1_rec_put_varint(uint8_t* dst, uint64_t val) {
+    uint32_t n = 0;
+    while (val >= 0x80) {
+        dst[n++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    dst[n++] = (uint8_t)val;
+    return n;
+}
+
+// encode an input header for the current tick, returns its size
+static uint32_t _kim1_rec_header(kim1_rec_t* rec, uint8_t* dst, uint8_t type) {
+    return _kim1_rec_put_varint(dst, ((rec->sys->ticks - rec->log_tick) << 3) | type);
+}
+
+// append an input (header and optional data) to the log, all or nothing
+static void _kim1_rec_append(kim1_rec_t* rec, const uint8_t* head, uint32_t head_size, const uint8_t* data, uint32_t data_size) {
+    if (rec->overflow) {
+        return;
+    }
+    if ((rec->log_size - rec->log_pos) < (head_size + data_size)) {
+        rec->overflow = true;
+        rec->overflow_tick = rec->sys->ticks;
+        return;
+    }
+    memcpy(rec->log + rec->log_pos, head, head_size);
+    rec->log_pos += head_size;
+    if (data_size > 0) {
+        memcpy(rec->log + rec->log_pos, data, data_size);
+        rec->log_pos += data_size;
+    }
+    rec->log_tick = rec->sys->ticks;
+}
+
+static void _kim1_rec_log(kim1_rec_t* rec, uint8_t type) {
+    uint8_t head[_KIM1_REC_MAX_HEADER_SIZE];
+    _kim1_rec_append(rec, head, _kim1_rec_header(rec, head, type), 0, 0);
+}
+
+static void _kim1_rec_keyframe(kim1_rec_t* rec) {
+    if (rec->num_keyframes == rec->max_keyframes) {
+        // keep every other keyframe (and always the first), and double the interval
+        uint32_t num = 1;
+        for (uint32_t i = 2; i < rec->num_keyframes; i += 2) {
+            memcpy(&rec->keyframes[num++], &rec->keyframes[i], sizeof(kim1_rec_keyframe_t));
+        }
+        rec->num_keyframes = num;
+        rec->keyframe_ticks *= 2;
+    }
+    kim1_rec_keyframe_t* kf = &rec->keyframes[rec->num_keyframes++];
+    kf->tick = rec->sys->ticks;
+    kf->log_tick = rec->log_tick;
+    kf->log_pos = rec->log_pos;
+    kf->version = kim1_save_snapshot(rec->sys, &kf->snapshot);
+    rec->next_keyframe_tick = rec->sys->ticks + rec->keyframe_ticks;
+}
+
+void kim1_rec_init(kim1_rec_t* rec, kim1_t* sys, const kim1_rec_desc_t* desc) {
+    CHIPS_ASSERT(rec && sys && sys->valid && desc);
+    CHIPS_ASSERT(desc->log.ptr && (desc->log.size > 0) && (desc->log.size <= UINT32_MAX));
+    CHIPS_ASSERT(desc->keyframes && (desc->max_keyframes >= 2));
+    memset(rec, 0, sizeof(kim1_rec_t));
+    rec->sys = sys;
+    rec->log = (uint8_t*) desc->log.ptr;
+    rec->log_size = (uint32_t) desc->log.size;
+    rec->log_tick = sys->ticks;
+    rec->keyframes = desc->keyframes;
+    rec->max_keyframes = desc->max_keyframes;
+    rec->keyframe_ticks = desc->keyframe_ticks ? desc->keyframe_ticks : KIM1_REC_DEFAULT_KEYFRAME_TICKS;
+    rec->valid = true;
+    _kim1_rec_keyframe(rec);
+}
+
+uint32_t kim1_rec_exec(kim1_rec_t* rec, uint32_t micro_seconds) {
+    CHIPS_ASSERT(rec && rec->valid);
+    const uint32_t ticks = kim1_exec(rec->sys, micro_seconds);
+    // keyframes are only useful as long as the log is complete
+    if (!rec->overflow && (rec->sys->ticks >= rec->next_keyframe_tick)) {
+        _kim1_rec_keyframe(rec);
+    }
+    return ticks;
+}
+
+bool kim1_rec_key_event(kim1_rec_t* rec, uint64_t tick, int key, bool down) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_t* sys = rec->sys;
+    if (!kim1_key_event(sys, tick, key, down)) {
+        return false;
+    }
+    if (tick < sys->ticks) {
+        tick = sys->ticks;
+    }
+    uint8_t head[_KIM1_REC_MAX_HEADER_SIZE];
+    uint32_t n = _kim1_rec_header(rec, head, _KIM1_REC_KEY);
+    head[n++] = (uint8_t)(key | (down ? 0x80 : 0));
+    n += _kim1_rec_put_varint(&head[n], tick - sys->ticks);
+    _kim1_rec_append(rec, head, n, 0, 0);
+    return true;
+}
+
+bool kim1_rec_key_down(kim1_rec_t* rec, int key) {
+    CHIPS_ASSERT(rec && rec->valid);
+    return kim1_rec_key_event(rec, rec->sys->ticks, key, true);
+}
+
+bool kim1_rec_key_up(kim1_rec_t* rec, int key) {
+    CHIPS_ASSERT(rec && rec->valid);
+    return kim1_rec_key_event(rec, rec->sys->ticks, key, false);
+}
+
+uint32_t kim1_rec_tty_put(kim1_rec_t* rec, const uint8_t* bytes, uint32_t num_bytes) {
+    CHIPS_ASSERT(rec && rec->valid);
+    // only the bytes which the FIFO accepted are logged
+    const uint32_t num = kim1_tty_put(rec->sys, bytes, num_bytes);
+    if (num > 0) {
+        uint8_t head[_KIM1_REC_MAX_HEADER_SIZE];
+        uint32_t n = _kim1_rec_header(rec, head, _KIM1_REC_TTY);
+        n += _kim1_rec_put_varint(&head[n], num);
+        _kim1_rec_append(rec, head, n, bytes, num);
+    }
+    return num;
+}
+
+void kim1_rec_reset(kim1_rec_t* rec) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_reset(rec->sys);
+    _kim1_rec_log(rec, _KIM1_REC_RESET);
+}
+
+bool kim1_rec_insert_tape(kim1_rec_t* rec, chips_range_t image) {
+    CHIPS_ASSERT(rec && rec->valid);
+    if (!kim1_insert_tape(rec->sys, image)) {
+        return false;
+    }
+    _kim1_rec_log(rec, _KIM1_REC_TAPE_INSERT);
+    return true;
+}
+
+void kim1_rec_remove_tape(kim1_rec_t* rec) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_remove_tape(rec->sys);
+    _kim1_rec_log(rec, _KIM1_REC_TAPE_REMOVE);
+}
+
+void kim1_rec_play_tape(kim1_rec_t* rec) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_play_tape(rec->sys);
+    _kim1_rec_log(rec, _KIM1_REC_TAPE_PLAY);
+}
+
+void kim1_rec_record_tape(kim1_rec_t* rec, chips_range_t buffer) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_record_tape(rec->sys, buffer);
+    _kim1_rec_log(rec, _KIM1_REC_TAPE_RECORD);
+}
+
+void kim1_rec_stop_tape(kim1_rec_t* rec) {
+    CHIPS_ASSERT(rec && rec->valid);
+    kim1_stop_tape(rec->sys);
+    _kim1_rec_log(rec, _KIM1_REC_TAPE_STOP);
+}
+
+static bool _kim1_replay_get_varint(kim1_replay_t* rp, uint64_t* out_val) {
+    uint64_t val = 0;
+    for (uint32_t shift = 0; (shift < 64) && (rp->log_pos < rp->log_size); shift += 7) {
+        const uint8_t b = rp->log[rp->log_pos++];
+        val |= (uint64_t)(b & 0x7F) << shift;
+        if (0 == (b & 0x80)) {
+            *out_val = val;
+            return true;
+        }
+    }
+    rp->corrupt = true;
+    return false;
+}
+
+// decode the header of the next input
+static void _kim1_replay_next(kim1_replay_t* rp) {
+    uint64_t head;
+    rp->has_next = false;
+    if ((rp->log_pos < rp->log_size) && _kim1_replay_get_varint(rp, &head)) {
+        rp->has_next = true;
+        rp->next_type = (uint8_t)(head & 7);
+        rp->next_tick = rp->log_tick + (head >> 3);
+    }
+}
+
+// run until the instance reaches a tick (instruction-stepped instances stop at the first instruction boundary at or after it)
+static void _kim1_replay_exec(kim1_t* sys, uint64_t tick) {
+    while (sys->ticks < tick) {
+        uint64_t num_ticks = tick - sys->ticks;
+        if (num_ticks > KIM1_FREQUENCY) {
+            num_ticks = KIM1_FREQUENCY;
+        }
+        // a KIM-1 tick is one microsecond
+        kim1_exec(sys, (uint32_t)num_ticks);
+    }
+}
+
+// replay the next input
+static void _kim1_replay_apply(kim1_replay_t* rp) {
+    kim1_t* sys = rp->sys;
+    if (sys->ticks != rp->next_tick) {
+        rp->num_diverged++;
+    }
+    switch (rp->next_type) {
+        case _KIM1_REC_KEY: {
+            uint64_t ahead;
+            if ((rp->log_pos < rp->log_size)) {
+                const uint8_t key = rp->log[rp->log_pos++];
+                if (_kim1_replay_get_varint(rp, &ahead) && ((key & 0x7F) < KIM1_NUM_KEYS)) {
+                    kim1_key_event(sys, sys->ticks + ahead, key & 0x7F, 0 != (key & 0x80));
+                }
+            }
+            else {
+                rp->corrupt = true;
+            }
+        } break;
+        case _KIM1_REC_TTY: {
+            uint64_t num;
+            if (_kim1_replay_get_varint(rp, &num)) {
+                if (num <= (rp->log_size - rp->log_pos)) {
+                    kim1_tty_put(sys, rp->log + rp->log_pos, (uint32_t)num);
+                    rp->log_pos += (uint32_t)num;
+                }
+                else {
+                    rp->corrupt = true;
+                }
+            }
+        } break;
+        case _KIM1_REC_RESET:
+            kim1_reset(sys);
+            break;
+        case _KIM1_REC_TAPE_INSERT:
+            kim1_insert_tape(sys, rp->tape);
+            break;
+        case _KIM1_REC_TAPE_REMOVE:
+            kim1_remove_tape(sys);
+            break;
+        case _KIM1_REC_TAPE_PLAY:
+            kim1_play_tape(sys);
+            break;
+        case _KIM1_REC_TAPE_RECORD:
+            if (rp->tape_record.ptr) {
+                kim1_record_tape(sys, rp->tape_record);
+            }
+            else {
+                kim1_stop_tape(sys);
+            }
+            break;
+        case _KIM1_REC_TAPE_STOP:
+            kim1_stop_tape(sys);
+            break;
+    }
+    rp->log_tick = rp->next_tick;
+    if (rp->corrupt) {
+        rp->has_next = false;
+    }
+    else {
+        _kim1_replay_next(rp);
+    }
+}
+
+static bool _kim1_replay_load(kim1_replay_t* rp, const kim1_rec_keyframe_t* kf) {
+    kim1_t* sys = rp->sys;
+    // the snapshot keeps the tape image and record buffer of the target instance
+    if (kf->snapshot.tape.size > 0) {
+        kim1_insert_tape(sys, rp->tape);
+    }
+    else {
+        kim1_remove_tape(sys);
+    }
+    if (kf->snapshot.tape.recording && rp->tape_record.ptr) {
+        kim1_record_tape(sys, rp->tape_record);
+    }
+    if (!kim1_load_snapshot(sys, kf->version, &kf->snapshot)) {
+        return false;
+    }
+    rp->log_pos = kf->log_pos;
+    rp->log_tick = kf->log_tick;
+    rp->corrupt = false;
+    _kim1_replay_next(rp);
+    return true;
+}
+
+void kim1_replay_init(kim1_replay_t* rp, kim1_t* sys, const kim1_replay_desc_t* desc) {
+    CHIPS_ASSERT(rp && sys && sys->valid && desc);
+    CHIPS_ASSERT((desc->log.ptr || (0 == desc->log.size)) && (desc->log.size <= UINT32_MAX));
+    CHIPS_ASSERT(desc->keyframes && (desc->num_keyframes > 0));
+    memset(rp, 0, sizeof(kim1_replay_t));
+    rp->sys = sys;
+    rp->log = (const uint8_t*) desc->log.ptr;
+    rp->log_size = (uint32_t) desc->log.size;
+    rp->keyframes = desc->keyframes;
+    rp->num_keyframes = desc->num_keyframes;
+    rp->tape = desc->tape;
+    rp->tape_record = desc->tape_record;
+    rp->valid = _kim1_replay_load(rp, &rp->keyframes[0]);
+}
+
+bool kim1_replay_seek(kim1_replay_t* rp, uint64_t tick) {
+    CHIPS_ASSERT(rp && rp->valid);
+    if (tick < rp->keyframes[0].tick) {
+        return false;
+    }
+    // find the latest keyframe at or before the tick
+    uint32_t lo = 0;
+    uint32_t hi = rp->num_keyframes;
+    while ((hi - lo) > 1) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (rp->keyframes[mid].tick <= tick) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    // running on is cheaper than loading the keyframe if the instance is already past it
+    const kim1_rec_keyframe_t* kf = &rp->keyframes[lo];
+    if ((rp->sys->ticks < kf->tick) || (rp->sys->ticks > tick)) {
+        if (!_kim1_replay_load(rp, kf)) {
+            return false;
+        }
+    }
+    kim1_replay_run(rp, tick);
+    return true;
+}
+
+void kim1_replay_run(kim1_replay_t* rp, uint64_t tick) {
+    CHIPS_ASSERT(rp && rp->valid);
+    while (rp->has_next && (rp->next_tick <= tick)) {
+        _kim1_replay_exec(rp->sys, rp->next_tick);
+        _kim1_replay_apply(rp);
+    }
+    _kim1_replay_exec(rp->sys, tick);
+}
+
+#endif /* CHIPS_IMPL */
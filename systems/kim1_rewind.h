@@ -0,0 +1,361 @@
+#pragma once
+/*#
+    # kim1_rewind.h
+
+    A rewind buffer for the KIM-1 with delta-compressed history.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1_rewind.h:
+
+    - chips/chips_common.h
+    - chips/mem.h
+    - chips/m6502.h
+    - chips/m6530.h
+    - chips/sched.h
+    - chips/clk.h
+    - systems/kim1_tape.h
+    - systems/kim1.h
+
+    ## Overview
+
+    The rewind buffer captures the state of a kim1_t instance at regular
+    intervals, so that a frontend can step back in time, or rewind by a
+    few seconds. The captured state is everything a snapshot contains
+    except for the ROMs, the memory map and the block cache: the CPU,
+    RRIOT, scheduler, display, keypad, TTY and tape state in the kim1_t
+    struct in front of kim1_t.mem, and the 1 KB RAM.
+
+    The state is split into 16-byte chunks, and each capture only stores
+    the chunks which changed since the previous capture, as 'undo'
+    chunks with their previous contents. The RAM chunks are only compared
+    when mem_t write tracking (see mem_set_write_tracking()) has marked
+    their 64-byte line as written, the rewind buffer switches on write
+    tracking for the instance. The current state is kept as a copy, and
+    rewinding applies the undo chunks to it from the latest capture
+    backwards, so a rewind touches only the chunks written since the
+    target capture, and is far below a millisecond even for many seconds.
+    Since nothing refers to the oldest capture's undo chunks, dropping the
+    oldest captures is free.
+
+    ## Usage
+
+    The memory for the captures and the undo chunks is provided by the
+    caller, when either runs out, the oldest captures are dropped:
+
+    ~~~C
+    static kim1_rewind_entry_t entries[4096];
+    static kim1_rewind_chunk_t chunks[128 * 1024];     // 18 bytes each
+    kim1_rewind_t rw;
+    kim1_rewind_init(&rw, &sys, &(kim1_rewind_desc_t){
+        .entries = entries,
+        .num_entries = 4096,
+        .chunks = chunks,
+        .num_chunks = 128 * 1024,
+        .interval_ticks = 0,    // 0 means KIM1_REWIND_DEFAULT_INTERVAL_TICKS (20 ms)
+    });
+    ~~~
+
+    A running program typically changes the CPU, RRIOT and scheduler
+    chunks, some display chunks, and a few RAM chunks from one capture
+    to the next, which is a few hundred bytes per capture, or a few MB
+    for minutes of history with captures every 20 ms.
+
+    Call kim1_rewind_update() after each kim1_exec(), this captures the
+    state whenever the capture interval has elapsed. To go back in time:
+
+    ~~~C
+    // rewind by 5 seconds (or as far back as the history reaches)
+    kim1_rewind_to(&rw, sys.ticks - 5 * KIM1_FREQUENCY);
+    // step back to the previous capture
+    kim1_rewind_step_back(&rw);
+    ~~~
+
+    Both restore the state of a capture, and drop all later captures.
+    Like loading a snapshot, this keeps the host-side tape image and
+    record buffer of the instance, and the block cache is reset.
+
+    The RAM is only captured correctly while all writes go through
+    mem_t, so call kim1_rewind_clear() to start a new history after
+    loading a snapshot, or after writing to kim1_t.ram directly, and
+    don't switch off write tracking while a rewind buffer is in use.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KIM1_REWIND_DEFAULT_INTERVAL_TICKS (KIM1_FREQUENCY / 50)
+#define KIM1_REWIND_CHUNK_SIZE (16)
+// the captured state: the kim1_t struct in front of kim1_t.mem (padded to whole chunks), and the RAM
+#define KIM1_REWIND_STATE_SIZE (((offsetof(kim1_t, mem) + KIM1_REWIND_CHUNK_SIZE - 1) & ~(KIM1_REWIND_CHUNK_SIZE - 1)) + 0x0400)
+
+// a state chunk as it was before a capture
+typedef struct {
+    uint16_t index;                         // chunk index in the captured state
+    uint8_t data[KIM1_REWIND_CHUNK_SIZE];
+} kim1_rewind_chunk_t;
+
+// a capture
+typedef struct {
+    uint64_t tick;              // kim1_t.ticks at the capture
+    uint32_t first_chunk;       // free-running index of the first undo chunk
+    uint32_t num_chunks;        // number of undo chunks back to the previous capture
+} kim1_rewind_entry_t;
+
+// kim1_rewind_init() parameters
+typedef struct {
+    kim1_rewind_entry_t* entries;   // memory for the captures
+    uint32_t num_entries;           // at least 2
+    kim1_rewind_chunk_t* chunks;    // memory for the undo chunks
+    uint32_t num_chunks;
+    uint64_t interval_ticks;        // ticks between captures (default: KIM1_REWIND_DEFAULT_INTERVAL_TICKS)
+} kim1_rewind_desc_t;
+
+// rewind buffer state
+typedef struct {
+    kim1_t* sys;
+    kim1_rewind_entry_t* entries;
+    uint32_t max_entries;
+    uint32_t oldest;                // ring index of the oldest capture
+    uint32_t num;                   // number of captures
+    kim1_rewind_chunk_t* chunks;
+    uint32_t max_chunks;
+    uint32_t chunk_head;            // free-running index of the next undo chunk
+    uint64_t interval_ticks;
+    uint64_t next_tick;             // tick of the next capture in kim1_rewind_update()
+    bool valid;
+    // the state at the latest capture
+    uint8_t state[KIM1_REWIND_STATE_SIZE];
+} kim1_rewind_t;
+
+// initialize a rewind buffer for a kim1_t instance, and capture the current state
+void kim1_rewind_init(kim1_rewind_t* rw, kim1_t* sys, const kim1_rewind_desc_t* desc);
+// drop the history and capture the current state
+void kim1_rewind_clear(kim1_rewind_t* rw);
+// capture the state if the capture interval has elapsed (call after kim1_exec()), returns true if captured
+bool kim1_rewind_update(kim1_rewind_t* rw);
+// capture the current state
+void kim1_rewind_capture(kim1_rewind_t* rw);
+// restore the latest capture at or before a tick, returns false if the history doesn't reach back that far
+bool kim1_rewind_to(kim1_rewind_t* rw, uint64_t tick);
+// restore the latest capture before the current state, returns false if there's none
+bool kim1_rewind_step_back(kim1_rewind_t* rw);
+// return the tick of the oldest capture
+uint64_t kim1_rewind_oldest_tick(kim1_rewind_t* rw);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+
+#include <string.h> // memcpy, memcmp
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define _KIM1_REWIND_PREFIX_SIZE (offsetof(kim1_t, mem))
+#define _KIM1_REWIND_RAM_OFFSET (KIM1_REWIND_STATE_SIZE - 0x0400)
+#define _KIM1_REWIND_NUM_CHUNKS (KIM1_REWIND_STATE_SIZE / KIM1_REWIND_CHUNK_SIZE)
+#define _KIM1_REWIND_CHUNKS_PER_LINE (MEM_DIRTY_LINE_SIZE / KIM1_REWIND_CHUNK_SIZE)
+
+static inline kim1_rewind_entry_t* _kim1_rewind_entry(kim1_rewind_t* rw, uint32_t i) {
+    return &rw->entries[(rw->oldest + i) % rw->max_entries];
+}
+
+// the oldest capture's undo chunks lead to a dropped capture, so the live chunks start with the second capture
+static uint32_t _kim1_rewind_chunk_tail(kim1_rewind_t* rw) {
+    return (rw->num >= 2) ? _kim1_rewind_entry(rw, 1)->first_chunk : rw->chunk_head;
+}
+
+// copy the current state of the instance into a state buffer
+static void _kim1_rewind_read(kim1_rewind_t* rw, uint8_t* state) {
+    memcpy(state, rw->sys, _KIM1_REWIND_PREFIX_SIZE);
+    memcpy(state + _KIM1_REWIND_RAM_OFFSET, mem_readptr(&rw->sys->mem, 0x0000), 0x0400);
+}
+
+// has a RAM line been written since the last capture (in any mirror)
+static bool _kim1_rewind_line_dirty(kim1_rewind_t* rw, uint32_t line) {
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        if (mem_is_dirty(&rw->sys->mem, (uint16_t)(i * _KIM1_MIRROR_SIZE + line * MEM_DIRTY_LINE_SIZE), MEM_DIRTY_LINE_SIZE)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _kim1_rewind_clear_dirty(kim1_rewind_t* rw) {
+    for (uint32_t i = 0; i < _KIM1_NUM_MIRRORS; i++) {
+        mem_clear_dirty(&rw->sys->mem, (uint16_t)(i * _KIM1_MIRROR_SIZE), 0x0400);
+    }
+}
+
+// go over the chunks which differ between the instance and the latest capture
+#define _KIM1_REWIND_FOREACH_CHANGED(rw, cur, index, code) { \
+    const uint32_t num_prefix_chunks = _KIM1_REWIND_RAM_OFFSET / KIM1_REWIND_CHUNK_SIZE; \
+    for (uint32_t index = 0; index < _KIM1_REWIND_NUM_CHUNKS; index++) { \
+        if ((index >= num_prefix_chunks) && (0 == ((index - num_prefix_chunks) % _KIM1_REWIND_CHUNKS_PER_LINE))) { \
+            if (!_kim1_rewind_line_dirty(rw, (index - num_prefix_chunks) / _KIM1_REWIND_CHUNKS_PER_LINE)) { \
+                index += _KIM1_REWIND_CHUNKS_PER_LINE - 1; \
+                continue; \
+            } \
+        } \
+        const uint32_t offset = index * KIM1_REWIND_CHUNK_SIZE; \
+        if (0 != memcmp(&(cur)[offset], &(rw)->state[offset], KIM1_REWIND_CHUNK_SIZE)) { \
+            code; \
+        } \
+    } \
+}
+
+void kim1_rewind_capture(kim1_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->valid);
+    kim1_t* sys = rw->sys;
+    uint8_t cur[KIM1_REWIND_STATE_SIZE] = {0};
+    _kim1_rewind_read(rw, cur);
+    uint32_t num_changed = 0;
+    _KIM1_REWIND_FOREACH_CHANGED(rw, cur, index, { num_changed++; });
+    // drop the oldest captures until the new capture and its undo chunks fit
+    while ((rw->num > 0) && ((rw->num == rw->max_entries) || ((rw->max_chunks - (rw->chunk_head - _kim1_rewind_chunk_tail(rw))) < num_changed))) {
+        rw->oldest = (rw->oldest + 1) % rw->max_entries;
+        rw->num--;
+    }
+    kim1_rewind_entry_t* entry = _kim1_rewind_entry(rw, rw->num);
+    entry->tick = sys->ticks;
+    entry->first_chunk = rw->chunk_head;
+    entry->num_chunks = 0;
+    // the first capture doesn't need undo chunks
+    const bool store = rw->num > 0;
+    _KIM1_REWIND_FOREACH_CHANGED(rw, cur, index, {
+        if (store) {
+            kim1_rewind_chunk_t* chunk = &rw->chunks[rw->chunk_head++ % rw->max_chunks];
+            chunk->index = (uint16_t)index;
+            memcpy(chunk->data, &rw->state[offset], KIM1_REWIND_CHUNK_SIZE);
+            entry->num_chunks++;
+        }
+        memcpy(&rw->state[offset], &cur[offset], KIM1_REWIND_CHUNK_SIZE);
+    });
+    rw->num++;
+    _kim1_rewind_clear_dirty(rw);
+    rw->next_tick = sys->ticks + rw->interval_ticks;
+}
+#undef _KIM1_REWIND_FOREACH_CHANGED
+
+void kim1_rewind_clear(kim1_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->valid);
+    rw->num = 0;
+    mem_set_write_tracking(&rw->sys->mem, true);
+    // the first capture after clearing copies the whole state
+    _kim1_rewind_read(rw, rw->state);
+    kim1_rewind_capture(rw);
+}
+
+void kim1_rewind_init(kim1_rewind_t* rw, kim1_t* sys, const kim1_rewind_desc_t* desc) {
+    CHIPS_ASSERT(rw && sys && sys->valid && desc);
+    CHIPS_ASSERT(desc->entries && (desc->num_entries >= 2));
+    CHIPS_ASSERT(desc->chunks && (desc->num_chunks > 0));
+    memset(rw, 0, sizeof(kim1_rewind_t));
+    rw->sys = sys;
+    rw->entries = desc->entries;
+    rw->max_entries = desc->num_entries;
+    rw->chunks = desc->chunks;
+    rw->max_chunks = desc->num_chunks;
+    rw->interval_ticks = desc->interval_ticks ? desc->interval_ticks : KIM1_REWIND_DEFAULT_INTERVAL_TICKS;
+    rw->valid = true;
+    kim1_rewind_clear(rw);
+}
+
+bool kim1_rewind_update(kim1_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->valid);
+    if (rw->sys->ticks < rw->next_tick) {
+        return false;
+    }
+    kim1_rewind_capture(rw);
+    return true;
+}
+
+// restore capture i and drop all later captures
+static void _kim1_rewind_restore(kim1_rewind_t* rw, uint32_t i) {
+    CHIPS_ASSERT(i < rw->num);
+    kim1_t* sys = rw->sys;
+    // undo the captures after i, newest first
+    for (uint32_t k = rw->num - 1; k > i; k--) {
+        const kim1_rewind_entry_t* entry = _kim1_rewind_entry(rw, k);
+        for (uint32_t c = entry->num_chunks; c-- > 0;) {
+            const kim1_rewind_chunk_t* chunk = &rw->chunks[(entry->first_chunk + c) % rw->max_chunks];
+            memcpy(&rw->state[chunk->index * KIM1_REWIND_CHUNK_SIZE], chunk->data, KIM1_REWIND_CHUNK_SIZE);
+        }
+    }
+    if ((i + 1) < rw->num) {
+        rw->chunk_head = _kim1_rewind_entry(rw, i + 1)->first_chunk;
+    }
+    rw->num = i + 1;
+    // the tape image and record buffer belong to the host
+    kim1_tape_t tape = sys->tape;
+    memcpy(sys, rw->state, _KIM1_REWIND_PREFIX_SIZE);
+    kim1_tape_snapshot_onload(&sys->tape, &tape);
+    if (!sys->tape.playing) {
+        _kim1_sched_cancel(sys, KIM1_EVENT_TAPE);
+    }
+    mem_write_range(&sys->mem, 0x0000, &rw->state[_KIM1_REWIND_RAM_OFFSET], 0x0400);
+    _kim1_rewind_clear_dirty(rw);
+    if (sys->block_cache) {
+        m6502_block_cache_reset(&sys->blocks);
+    }
+    if (sys->profile) {
+        // don't count the jump in time
+        sys->profile->started = false;
+    }
+    rw->next_tick = sys->ticks + rw->interval_ticks;
+}
+
+bool kim1_rewind_to(kim1_rewind_t* rw, uint64_t tick) {
+    CHIPS_ASSERT(rw && rw->valid);
+    uint32_t i = rw->num;
+    while ((i > 0) && (_kim1_rewind_entry(rw, i - 1)->tick > tick)) {
+        i--;
+    }
+    if (0 == i) {
+        return false;
+    }
+    _kim1_rewind_restore(rw, i - 1);
+    return true;
+}
+
+bool kim1_rewind_step_back(kim1_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->valid);
+    // the latest capture is only a step back if the instance has run since
+    if (rw->sys->ticks != _kim1_rewind_entry(rw, rw->num - 1)->tick) {
+        _kim1_rewind_restore(rw, rw->num - 1);
+        return true;
+    }
+    if (rw->num < 2) {
+        return false;
+    }
+    _kim1_rewind_restore(rw, rw->num - 2);
+    return true;
+}
+
+uint64_t kim1_rewind_oldest_tick(kim1_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->valid);
+    return _kim1_rewind_entry(rw, 0)->tick;
+}
+
+#endif /* CHIPS_IMPL */
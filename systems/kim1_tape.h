@@ -0,0 +1,552 @@
+#pragma once
+/*#
+    # kim1_tape.h
+
+    The KIM-1 cassette interface in a header.
+
+    Do this:
+    ~~~C
+    #define CHIPS_IMPL
+    ~~~
+    before you include this file in *one* C or C++ file to create the
+    implementation.
+
+    Optionally provide the following macros with your own implementation
+    ~~~C
+    CHIPS_ASSERT(c)
+    ~~~
+        your own assert macro (default: assert(c))
+
+    You need to include the following headers before including kim1_tape.h:
+
+    - chips/chips_common.h
+
+    ## The KIM-1 Tape Format
+
+    The KIM-1 records characters as 8 bits (LSB first) with two tones per
+    bit, each bit takes 7.452 ms. A bit starts with 3700 Hz and ends with
+    2400 Hz, a 1 bit has a short 3700 Hz part (1/3 of the bit) and a
+    0 bit a long one (2/3 of the bit). On the cassette input, a PLL turns
+    the tones into a digital level on PB7 of the 6530-002 (1 while it
+    hears 3700 Hz), on the output, the monitor toggles PB7 at the
+    tone frequency.
+
+    A recording made with the monitor's DUMPT routine (1800) is a
+    sequence of characters:
+
+    ~~~
+    SYN x 100       16 16 16 ...
+    '*'             2A
+    ID              2 hex digits
+    SAL, SAH        start address, 2 hex digits each
+    data            2 hex digits per byte
+    '/'             2F
+    CHKL, CHKH      16-bit sum over SAL, SAH and the data bytes, 2 hex digits each
+    EOT, EOT        04 04
+    ~~~
+
+    A tape image as used by kim1_tape_t is exactly this character
+    sequence, one byte per recorded character, with any number of
+    recordings back to back. kim1_tape_encode() creates an image from a
+    memory block.
+
+    ## Playback
+
+    The tape image isn't copied, kim1_tape_insert() only keeps a pointer,
+    so the image can be a memory-mapped file of any size, and must remain
+    valid while it is inserted:
+
+    ~~~C
+    kim1_tape_insert(&tape, (chips_range_t){ .ptr = ptr, .size = size });
+    kim1_tape_play(&tape);
+    ~~~
+
+    The tape isn't ticked, instead the playback is a schedule of tone runs
+    (a run is the 3700 Hz or 2400 Hz part of a bit). The run lengths are
+    computed from the tape position (character, bit, and which half of
+    the bit), so the schedule needs no memory besides the image itself.
+    kim1_tape_run_ticks() returns the length of the current run in ticks,
+    kim1_tape_advance() moves to the next run and returns its length
+    (or 0 at the end of the tape). The system emulator schedules an event
+    at the end of each run, kim1_tape_t.level is the PLL output.
+
+    ## Recording
+
+    Provide a buffer to record into, and call kim1_tape_output() with each
+    change of the cassette output level:
+
+    ~~~C
+    kim1_tape_record(&tape, (chips_range_t){ .ptr = buf, .size = sizeof(buf) });
+    ...
+    kim1_tape_output(&tape, tick, level);
+    ...
+    kim1_tape_stop(&tape);
+    uint32_t num_bytes = tape.rec_pos;
+    ~~~
+
+    The recorder measures the time between output edges to tell the
+    tones apart, decodes the bits from the tone lengths, and starts
+    writing characters to the buffer after it found the first SYN
+    character. The result is a tape image which can be played back.
+
+    ## Blocks
+
+    kim1_tape_find_block() searches a tape image for the next complete
+    recording and returns its ID, address, and size, kim1_tape_block_byte()
+    returns a data byte of that recording, and kim1_tape_seek() moves the
+    tape to a character position (for instance behind the recording).
+    kim1_tape_record_block() appends a complete recording of a memory
+    block to the record buffer without going through the tones. This is
+    used for trapping the monitor's load and dump routines.
+
+    ## zlib/libpng license
+
+    Copyright (c) 2019 Andre Weissflog
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+        1. The origin of this software must not be misrepresented; you must not
+        claim that you wrote the original software. If you use this software in a
+        product, an acknowledgment in the product documentation would be
+        appreciated but is not required.
+        2. Altered source versions must be plainly marked as such, and must not
+        be misrepresented as being the original software.
+        3. This notice may not be removed or altered from any source
+        distribution.
+#*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bit timing in 1 MHz ticks */
+#define KIM1_TAPE_BIT_TICKS     (7452)
+#define KIM1_TAPE_SHORT_TICKS   (2484)
+#define KIM1_TAPE_LONG_TICKS    (4968)
+/* half periods of the tones in 1 MHz ticks */
+#define KIM1_TAPE_HALF_3700     (135)
+#define KIM1_TAPE_HALF_2400     (208)
+
+/* special characters */
+#define KIM1_TAPE_SYN           (0x16)
+#define KIM1_TAPE_START         (0x2A)  // '*'
+#define KIM1_TAPE_END           (0x2F)  // '/'
+#define KIM1_TAPE_EOT           (0x04)
+#define KIM1_TAPE_NUM_SYN       (100)
+
+/* a recording found in a tape image */
+typedef struct {
+    uint8_t id;
+    uint16_t addr;
+    uint32_t num_bytes;
+    bool checksum_ok;
+    uint32_t data_pos;      // image offset of the first data character
+    uint32_t end_pos;       // image offset after the recording
+} kim1_tape_block_t;
+
+/* memory read callback for kim1_tape_record_block() */
+typedef uint8_t (*kim1_tape_read_t)(uint16_t addr, void* user_data);
+
+/* tape drive state */
+typedef struct {
+    bool valid;
+    // playback
+    const uint8_t* ptr;     // tape image, not owned (size > 0: a tape is inserted)
+    uint32_t size;
+    uint32_t run;           // current tone run: character = run/16, bit = (run/2)&7, 2400 Hz part = run&1
+    bool playing;
+    uint8_t level;          // PLL output, 1 while playing a 3700 Hz part
+    // recording
+    uint8_t* rec_ptr;       // record buffer, not owned
+    uint32_t rec_size;
+    uint32_t rec_pos;       // number of recorded characters
+    bool recording;
+    uint8_t out_level;      // current cassette output level
+    uint64_t edge_tick;     // tick of the last output edge
+    uint8_t tone;           // tone of the last half period: 0: none, 1: 3700 Hz, 2: 2400 Hz
+    uint32_t tone_ticks[2]; // length of the 3700 Hz and 2400 Hz parts of the current bit
+    uint8_t shift;          // bit shift register, LSB first
+    uint8_t num_bits;       // number of bits in the shift register after sync
+    bool synced;            // a SYN character was found
+} kim1_tape_t;
+
+/* initialize a kim1_tape_t instance */
+void kim1_tape_init(kim1_tape_t* tape);
+/* discard a kim1_tape_t instance */
+void kim1_tape_discard(kim1_tape_t* tape);
+/* insert a tape image (not copied, must remain valid until removed) */
+bool kim1_tape_insert(kim1_tape_t* tape, chips_range_t image);
+/* remove the tape image */
+void kim1_tape_remove(kim1_tape_t* tape);
+/* return true if a tape is inserted */
+bool kim1_tape_inserted(kim1_tape_t* tape);
+/* start playback at the current position */
+void kim1_tape_play(kim1_tape_t* tape);
+/* start recording into a buffer (not copied, must remain valid until stopped) */
+void kim1_tape_record(kim1_tape_t* tape, chips_range_t buffer);
+/* stop playback or recording */
+void kim1_tape_stop(kim1_tape_t* tape);
+/* length of the current tone run in ticks, 0 at the end of the tape */
+uint32_t kim1_tape_run_ticks(kim1_tape_t* tape);
+/* move to the next tone run, returns its length in ticks, or 0 at the end of the tape */
+uint32_t kim1_tape_advance(kim1_tape_t* tape);
+/* move the tape to the start of a character, returns the length of the run there (0 at the end of the tape) */
+uint32_t kim1_tape_seek(kim1_tape_t* tape, uint32_t pos);
+/* cassette output level change while recording */
+void kim1_tape_output(kim1_tape_t* tape, uint64_t tick, uint8_t level);
+/* find the next complete recording starting at image offset pos */
+bool kim1_tape_find_block(const kim1_tape_t* tape, uint32_t pos, kim1_tape_block_t* block);
+/* return data byte i of a recording */
+uint8_t kim1_tape_block_byte(const kim1_tape_t* tape, const kim1_tape_block_t* block, uint32_t i);
+/* append a recording of a memory block to the record buffer, returns false if it doesn't fit */
+bool kim1_tape_record_block(kim1_tape_t* tape, uint8_t id, uint16_t addr, uint32_t num_bytes, kim1_tape_read_t read, void* user_data);
+/* encode a memory block as tape image, returns the image size (0 if dst is too small) */
+uint32_t kim1_tape_encode(uint8_t id, uint16_t addr, const uint8_t* data, uint32_t num_bytes, chips_range_t dst);
+/* size of the tape image for a memory block */
+uint32_t kim1_tape_encoded_size(uint32_t num_bytes);
+// prepare kim1_tape_t snapshot for saving
+void kim1_tape_snapshot_onsave(kim1_tape_t* snapshot);
+// fixup kim1_tape_t snapshot after loading
+void kim1_tape_snapshot_onload(kim1_tape_t* snapshot, kim1_tape_t* sys);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#ifdef CHIPS_IMPL
+#include <string.h> /* memset */
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+/* output edges further apart than this are silence */
+#define _KIM1_TAPE_MAX_HALF (1000)
+
+void kim1_tape_init(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape);
+    memset(tape, 0, sizeof(kim1_tape_t));
+    tape->valid = true;
+}
+
+void kim1_tape_discard(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    tape->valid = false;
+}
+
+bool kim1_tape_insert(kim1_tape_t* tape, chips_range_t image) {
+    CHIPS_ASSERT(tape && tape->valid);
+    kim1_tape_remove(tape);
+    if ((0 == image.ptr) || (0 == image.size) || (image.size > (UINT32_MAX / 16))) {
+        return false;
+    }
+    tape->ptr = (const uint8_t*) image.ptr;
+    tape->size = (uint32_t) image.size;
+    return true;
+}
+
+void kim1_tape_remove(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    tape->playing = false;
+    tape->level = 0;
+    tape->ptr = 0;
+    tape->size = 0;
+    tape->run = 0;
+}
+
+bool kim1_tape_inserted(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    return tape->size > 0;
+}
+
+static uint8_t _kim1_tape_run_level(const kim1_tape_t* tape) {
+    return (tape->playing && (0 == (tape->run & 1))) ? 1 : 0;
+}
+
+void kim1_tape_play(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    tape->playing = (tape->run / 16) < tape->size;
+    tape->level = _kim1_tape_run_level(tape);
+}
+
+void kim1_tape_record(kim1_tape_t* tape, chips_range_t buffer) {
+    CHIPS_ASSERT(tape && tape->valid && buffer.ptr && (buffer.size > 0));
+    tape->rec_ptr = (uint8_t*) buffer.ptr;
+    tape->rec_size = (buffer.size > UINT32_MAX) ? UINT32_MAX : (uint32_t) buffer.size;
+    tape->rec_pos = 0;
+    tape->recording = true;
+    tape->tone = 0;
+    tape->tone_ticks[0] = tape->tone_ticks[1] = 0;
+    tape->shift = 0;
+    tape->num_bits = 0;
+    tape->synced = false;
+}
+
+static void _kim1_tape_rec_bit(kim1_tape_t* tape, uint8_t bit) {
+    tape->shift = (tape->shift >> 1) | (bit << 7);
+    if (!tape->synced) {
+        if (tape->shift == KIM1_TAPE_SYN) {
+            tape->synced = true;
+            tape->num_bits = 8;
+        }
+    }
+    else {
+        tape->num_bits++;
+    }
+    if (tape->num_bits == 8) {
+        tape->num_bits = 0;
+        if (tape->rec_pos < tape->rec_size) {
+            tape->rec_ptr[tape->rec_pos++] = tape->shift;
+        }
+    }
+}
+
+// a bit ends with the end of its 2400 Hz part
+static void _kim1_tape_rec_end_bit(kim1_tape_t* tape) {
+    if ((tape->tone_ticks[0] > 0) && (tape->tone_ticks[1] > 0)) {
+        _kim1_tape_rec_bit(tape, (tape->tone_ticks[0] < tape->tone_ticks[1]) ? 1 : 0);
+    }
+    tape->tone_ticks[0] = tape->tone_ticks[1] = 0;
+}
+
+void kim1_tape_stop(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    if (tape->recording) {
+        if (tape->tone == 2) {
+            _kim1_tape_rec_end_bit(tape);
+        }
+        tape->recording = false;
+        tape->tone = 0;
+    }
+    tape->playing = false;
+    tape->level = 0;
+}
+
+static uint32_t _kim1_tape_run_length(const kim1_tape_t* tape, uint32_t run) {
+    const uint8_t c = tape->ptr[run / 16];
+    const uint8_t bit = (c >> ((run / 2) & 7)) & 1;
+    // a 1 bit has a short 3700 Hz part, a 0 bit a long one
+    return ((run & 1) ^ bit) ? KIM1_TAPE_SHORT_TICKS : KIM1_TAPE_LONG_TICKS;
+}
+
+uint32_t kim1_tape_run_ticks(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    if (!tape->playing) {
+        return 0;
+    }
+    return _kim1_tape_run_length(tape, tape->run);
+}
+
+uint32_t kim1_tape_advance(kim1_tape_t* tape) {
+    CHIPS_ASSERT(tape && tape->valid);
+    if (!tape->playing) {
+        return 0;
+    }
+    tape->run++;
+    if ((tape->run / 16) >= tape->size) {
+        // end of tape, the PLL output stays low
+        tape->playing = false;
+        tape->level = 0;
+        return 0;
+    }
+    tape->level = _kim1_tape_run_level(tape);
+    return _kim1_tape_run_length(tape, tape->run);
+}
+
+uint32_t kim1_tape_seek(kim1_tape_t* tape, uint32_t pos) {
+    CHIPS_ASSERT(tape && tape->valid);
+    tape->run = ((pos < tape->size) ? pos : tape->size) * 16;
+    if (tape->run / 16 >= tape->size) {
+        tape->playing = false;
+    }
+    tape->level = _kim1_tape_run_level(tape);
+    return kim1_tape_run_ticks(tape);
+}
+
+void kim1_tape_output(kim1_tape_t* tape, uint64_t tick, uint8_t level) {
+    CHIPS_ASSERT(tape && tape->valid);
+    level &= 1;
+    if (!tape->recording || (level == tape->out_level)) {
+        tape->out_level = level;
+        return;
+    }
+    tape->out_level = level;
+    const uint64_t half = tick - tape->edge_tick;
+    tape->edge_tick = tick;
+    uint8_t tone = 0;
+    if (half <= _KIM1_TAPE_MAX_HALF) {
+        tone = (half < ((KIM1_TAPE_HALF_3700 + KIM1_TAPE_HALF_2400) / 2)) ? 1 : 2;
+    }
+    if ((tape->tone == 2) && (tone != 2)) {
+        _kim1_tape_rec_end_bit(tape);
+    }
+    if (tone != 0) {
+        tape->tone_ticks[tone - 1] += (uint32_t) half;
+    }
+    tape->tone = tone;
+}
+
+static int _kim1_tape_hex_digit(uint8_t c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// decode two hex digit characters at pos, returns -1 if they're not hex digits
+static int _kim1_tape_hex(const kim1_tape_t* tape, uint32_t pos) {
+    if ((pos + 2) > tape->size) {
+        return -1;
+    }
+    const int h = _kim1_tape_hex_digit(tape->ptr[pos]);
+    const int l = _kim1_tape_hex_digit(tape->ptr[pos + 1]);
+    if ((h < 0) || (l < 0)) {
+        return -1;
+    }
+    return (h << 4) | l;
+}
+
+bool kim1_tape_find_block(const kim1_tape_t* tape, uint32_t pos, kim1_tape_block_t* block) {
+    CHIPS_ASSERT(tape && tape->valid && block);
+    memset(block, 0, sizeof(kim1_tape_block_t));
+    for (; pos < tape->size; pos++) {
+        // a recording starts with a SYN followed by '*'
+        if ((tape->ptr[pos] != KIM1_TAPE_SYN) || ((pos + 1) >= tape->size) || (tape->ptr[pos + 1] != KIM1_TAPE_START)) {
+            continue;
+        }
+        uint32_t p = pos + 2;
+        const int id = _kim1_tape_hex(tape, p);
+        const int sal = _kim1_tape_hex(tape, p + 2);
+        const int sah = _kim1_tape_hex(tape, p + 4);
+        if ((id < 0) || (sal < 0) || (sah < 0)) {
+            continue;
+        }
+        p += 6;
+        uint16_t sum = (uint16_t)(sal + sah);
+        const uint32_t data_pos = p;
+        int val;
+        while ((val = _kim1_tape_hex(tape, p)) >= 0) {
+            sum += (uint16_t) val;
+            p += 2;
+        }
+        if ((p >= tape->size) || (tape->ptr[p] != KIM1_TAPE_END)) {
+            continue;
+        }
+        const int chkl = _kim1_tape_hex(tape, p + 1);
+        const int chkh = _kim1_tape_hex(tape, p + 3);
+        block->id = (uint8_t) id;
+        block->addr = (uint16_t)((sah << 8) | sal);
+        block->num_bytes = (p - data_pos) / 2;
+        block->checksum_ok = (chkl >= 0) && (chkh >= 0) && (sum == (uint16_t)((chkh << 8) | chkl));
+        block->data_pos = data_pos;
+        block->end_pos = p + 5;
+        return true;
+    }
+    return false;
+}
+
+uint8_t kim1_tape_block_byte(const kim1_tape_t* tape, const kim1_tape_block_t* block, uint32_t i) {
+    CHIPS_ASSERT(tape && tape->valid && block && (i < block->num_bytes));
+    return (uint8_t) _kim1_tape_hex(tape, block->data_pos + i * 2);
+}
+
+uint32_t kim1_tape_encoded_size(uint32_t num_bytes) {
+    // SYNs, '*', ID, SAL, SAH, data, '/', CHKL, CHKH, EOT, EOT
+    return KIM1_TAPE_NUM_SYN + 1 + 6 + num_bytes * 2 + 1 + 4 + 2;
+}
+
+static uint8_t* _kim1_tape_put_hex(uint8_t* dst, uint8_t val) {
+    static const char digits[] = "0123456789ABCDEF";
+    *dst++ = (uint8_t) digits[val >> 4];
+    *dst++ = (uint8_t) digits[val & 0xF];
+    return dst;
+}
+
+// dst must have room for kim1_tape_encoded_size(num_bytes) characters
+static uint32_t _kim1_tape_encode(uint8_t id, uint16_t addr, uint32_t num_bytes, kim1_tape_read_t read, void* user_data, uint8_t* dst) {
+    uint8_t* p = dst;
+    memset(p, KIM1_TAPE_SYN, KIM1_TAPE_NUM_SYN);
+    p += KIM1_TAPE_NUM_SYN;
+    *p++ = KIM1_TAPE_START;
+    p = _kim1_tape_put_hex(p, id);
+    p = _kim1_tape_put_hex(p, (uint8_t) addr);
+    p = _kim1_tape_put_hex(p, (uint8_t)(addr >> 8));
+    uint16_t sum = (uint16_t)((addr & 0xFF) + (addr >> 8));
+    for (uint32_t i = 0; i < num_bytes; i++) {
+        const uint8_t val = read((uint16_t)(addr + i), user_data);
+        p = _kim1_tape_put_hex(p, val);
+        sum += val;
+    }
+    *p++ = KIM1_TAPE_END;
+    p = _kim1_tape_put_hex(p, (uint8_t) sum);
+    p = _kim1_tape_put_hex(p, (uint8_t)(sum >> 8));
+    *p++ = KIM1_TAPE_EOT;
+    *p++ = KIM1_TAPE_EOT;
+    CHIPS_ASSERT((uint32_t)(p - dst) == kim1_tape_encoded_size(num_bytes));
+    return (uint32_t)(p - dst);
+}
+
+typedef struct {
+    uint16_t addr;
+    const uint8_t* data;
+} _kim1_tape_array_t;
+
+static uint8_t _kim1_tape_read_array(uint16_t addr, void* user_data) {
+    const _kim1_tape_array_t* arr = (const _kim1_tape_array_t*) user_data;
+    return arr->data[(uint16_t)(addr - arr->addr)];
+}
+
+uint32_t kim1_tape_encode(uint8_t id, uint16_t addr, const uint8_t* data, uint32_t num_bytes, chips_range_t dst) {
+    CHIPS_ASSERT(dst.ptr && (data || (0 == num_bytes)) && (num_bytes <= 0x10000));
+    if (dst.size < kim1_tape_encoded_size(num_bytes)) {
+        return 0;
+    }
+    _kim1_tape_array_t arr = { .addr = addr, .data = data };
+    return _kim1_tape_encode(id, addr, num_bytes, _kim1_tape_read_array, &arr, (uint8_t*) dst.ptr);
+}
+
+bool kim1_tape_record_block(kim1_tape_t* tape, uint8_t id, uint16_t addr, uint32_t num_bytes, kim1_tape_read_t read, void* user_data) {
+    CHIPS_ASSERT(tape && tape->valid && read && (num_bytes <= 0x10000));
+    if (!tape->recording || ((tape->rec_size - tape->rec_pos) < kim1_tape_encoded_size(num_bytes))) {
+        return false;
+    }
+    tape->rec_pos += _kim1_tape_encode(id, addr, num_bytes, read, user_data, tape->rec_ptr + tape->rec_pos);
+    return true;
+}
+
+void kim1_tape_snapshot_onsave(kim1_tape_t* snapshot) {
+    CHIPS_ASSERT(snapshot);
+    snapshot->ptr = 0;
+    snapshot->rec_ptr = 0;
+}
+
+void kim1_tape_snapshot_onload(kim1_tape_t* snapshot, kim1_tape_t* sys) {
+    CHIPS_ASSERT(snapshot && sys);
+    // the tape images belong to the host, keep the ones of the target instance
+    snapshot->ptr = sys->ptr;
+    snapshot->size = sys->size;
+    snapshot->rec_ptr = sys->rec_ptr;
+    snapshot->rec_size = sys->rec_size;
+    if (snapshot->rec_pos > snapshot->rec_size) {
+        snapshot->rec_pos = snapshot->rec_size;
+    }
+    if ((snapshot->run / 16) >= snapshot->size) {
+        snapshot->playing = false;
+        snapshot->level = 0;
+    }
+    if (0 == snapshot->rec_ptr) {
+        snapshot->recording = false;
+    }
+}
+
+#endif /* CHIPS_IMPL */
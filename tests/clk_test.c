@@ -0,0 +1,160 @@
+/*
+    clk_test: deterministic tests of the clk_pacer_t in chips/clk.h
+
+    Usage:
+
+        clk_test pacer
+
+    pacer: drives clk_pacer_update() with synthetic host timestamps
+    (irregular steps of 1 to 20 ms, the pacing starts at a fixed time
+    instead of the host clock) on a clock frequency which doesn't divide
+    a nanosecond, and runs the returned ticks, sometimes with a few ticks
+    of instruction overshoot. After many slices the ticks which were run
+    must match the elapsed host time exactly (minus the overshoot),
+    in real time and at 3 times the speed. A gap of a second must return
+    max_lag_us worth of ticks and count the rest as dropped, without
+    drift afterwards. In turbo mode each update returns one slice, no
+    matter how much host time passed, and nothing is dropped.
+
+    The exit code is 0 if the test passed, and 1 if not.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/clk.h"
+
+#define TEST_FREQ_HZ (1022727)
+#define TEST_SLICE_US (10000)
+#define TEST_MAX_LAG_US (100000)
+#define TEST_SLICES (100000)
+#define TEST_START_NS (1000000000000ULL)
+#define TEST_GAP_NS (1000000000ULL)
+
+static clk_pacer_t pacer;
+static uint64_t now_ns;
+static uint64_t start_ns;
+static uint64_t run_ticks;
+static uint32_t seed = 0x12345678;
+
+static uint32_t rnd(void) {
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+// restart the pacing at the synthetic host time (clk_pacer_set_mode() uses the host clock)
+static void pacer_start(clk_pace_mode_t mode, uint32_t multiple) {
+    clk_pacer_set_mode(&pacer, mode, multiple);
+    pacer.last_ns = now_ns;
+    start_ns = now_ns;
+    run_ticks = 0;
+}
+
+// advance the host time, and run the due ticks (with overshoot in every 4th slice), returns the due ticks
+static uint32_t pacer_step(uint64_t delta_ns) {
+    now_ns += delta_ns;
+    const uint32_t ticks = clk_pacer_update(&pacer, now_ns);
+    const uint32_t overshoot = ((ticks > 0) && (0 == (rnd() & 3))) ? (rnd() % 7) : 0;
+    run_ticks += ticks + overshoot;
+    clk_pacer_done(&pacer, ticks + overshoot);
+    return ticks;
+}
+
+static void pacer_run(int num_slices) {
+    for (int i = 0; i < num_slices; i++) {
+        pacer_step(1000000 + (rnd() % 19000001));
+    }
+}
+
+// the ticks which were run (and dropped) since the start must match the host time, except for the ticks run ahead
+static bool check_drift(const char* what, uint64_t rate, uint64_t dropped) {
+    const uint64_t elapsed_ns = now_ns - start_ns;
+    const uint64_t expected = (elapsed_ns / 1000000000) * rate + ((elapsed_ns % 1000000000) * rate) / 1000000000;
+    const uint64_t ahead = pacer.done - pacer.due;
+    const uint64_t ticks = run_ticks - ahead + dropped;
+    // the fraction of a tick at a drop is split between the dropped and the due ticks
+    const uint64_t slack = (dropped > 0) ? 1 : 0;
+    // at most one slice of overshoot, and the 5 ticks test_pacer() adds
+    if ((pacer.done < pacer.due) || (ahead > (6 + 5)) || (ticks > expected) || ((ticks + slack) < expected)) {
+        fprintf(stderr, "pacer: %s: %llu ticks run (%llu ahead) and %llu dropped in %llu ns, expected %llu\n",
+            what, (unsigned long long)run_ticks, (unsigned long long)ahead, (unsigned long long)dropped,
+            (unsigned long long)elapsed_ns, (unsigned long long)expected);
+        return false;
+    }
+    return true;
+}
+
+static int test_pacer(void) {
+    now_ns = TEST_START_NS;
+    clk_pacer_init(&pacer, &(clk_pacer_desc_t){
+        .freq_hz = TEST_FREQ_HZ,
+        .mode = CLK_PACE_REALTIME,
+        .slice_us = TEST_SLICE_US,
+        .max_lag_us = TEST_MAX_LAG_US,
+    });
+    const uint32_t max_lag_ticks = clk_us_to_ticks(TEST_FREQ_HZ, TEST_MAX_LAG_US);
+
+    pacer_start(CLK_PACE_REALTIME, 0);
+    pacer_run(TEST_SLICES);
+    if (!check_drift("realtime", TEST_FREQ_HZ, 0) || (pacer.dropped != 0)) {
+        return 1;
+    }
+    // the overshoot is subtracted from the next slice
+    clk_pacer_done(&pacer, 5);
+    run_ticks += 5;
+    if ((0 != clk_pacer_update(&pacer, now_ns)) || !check_drift("realtime with overshoot", TEST_FREQ_HZ, 0)) {
+        fprintf(stderr, "pacer: the next slice doesn't wait for the overshoot\n");
+        return 1;
+    }
+
+    // the host was suspended for a second
+    const uint64_t dropped_before = pacer.dropped;
+    const uint32_t ticks = pacer_step(TEST_GAP_NS);
+    const uint64_t dropped = pacer.dropped - dropped_before;
+    if ((ticks != max_lag_ticks) || (dropped == 0)) {
+        fprintf(stderr, "pacer: after a gap of %llu ns %u ticks due and %llu dropped, expected %u due\n",
+            (unsigned long long)TEST_GAP_NS, ticks, (unsigned long long)dropped, max_lag_ticks);
+        return 1;
+    }
+    pacer_run(TEST_SLICES / 10);
+    if (!check_drift("realtime after a gap", TEST_FREQ_HZ, pacer.dropped) || (pacer.dropped != dropped)) {
+        return 1;
+    }
+
+    pacer_start(CLK_PACE_MULTIPLE, 3);
+    pacer_run(TEST_SLICES);
+    if (!check_drift("3x speed", 3 * TEST_FREQ_HZ, 0) || (pacer.dropped != dropped)) {
+        return 1;
+    }
+
+    pacer_start(CLK_PACE_TURBO, 0);
+    for (int i = 0; i < 100; i++) {
+        if (pacer_step((i & 1) ? TEST_GAP_NS : 0) != pacer.slice_ticks) {
+            fprintf(stderr, "pacer: turbo mode doesn't return one slice\n");
+            return 1;
+        }
+    }
+    if ((pacer.dropped != dropped) || (pacer.due != 0) || (pacer.done != 0)) {
+        fprintf(stderr, "pacer: turbo mode was paced\n");
+        return 1;
+    }
+    // back to real time from the current host time, the turbo run isn't caught up or dropped
+    pacer_start(CLK_PACE_REALTIME, 0);
+    pacer_run(TEST_SLICES / 10);
+    if (!check_drift("realtime after turbo", TEST_FREQ_HZ, 0) || (pacer.dropped != dropped)) {
+        return 1;
+    }
+    printf("pacer: %d slices without drift in real time and at 3x speed, %llu ticks dropped after a %llu ns gap\n",
+        2 * TEST_SLICES, (unsigned long long)dropped, (unsigned long long)TEST_GAP_NS);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if ((argc == 2) && (0 == strcmp(argv[1], "pacer"))) {
+        return test_pacer();
+    }
+    fprintf(stderr, "usage: clk_test pacer\n");
+    return 1;
+}
@@ -0,0 +1,2315 @@
+/*
+    kim1_test: trace comparisons of the KIM-1 execution tiers
+
+    Usage:
+
+        kim1_test trace PROGRAM
+        kim1_test run PROGRAM
+        kim1_test lockstep PROGRAM
+        kim1_test replay
+        kim1_test rewind
+        kim1_test snapshot
+        kim1_test fork
+        kim1_test teletype
+        kim1_test tape
+        kim1_test idle
+        kim1_test watch
+        kim1_test image DIR
+        kim1_test batch
+        kim1_test profile
+        kim1_test monitor ROM_002 ROM_003
+
+    The tiers are cycle-stepped (the reference), instruction-stepped,
+    instruction-stepped with block cache, and both instruction-stepped
+    tiers with idle loop fast-forward.
+
+    trace: runs all tiers in lockstep with kim1_run_until() and a
+    breakpoint on each address, and compares the tick counter and the CPU
+    registers after each instruction, and the RAM every 1000 instructions.
+
+    run: runs each tier with kim1_exec() in 60 Hz frame slices, brings
+    them to the same instruction boundary, and compares the tick counter,
+    the CPU registers and the RAM. The emulated clock frequency of each
+    tier is reported.
+
+    lockstep: runs 16 (and then 5) lanes with kim1_lockstep_run() and the
+    same number of instances with kim1_step(), each lane with different
+    input, and compares each lane with its kim1_step() twin after each
+    instruction (CPU registers and pins, RAM, RRIOT and display state and
+    the teletype output).
+
+    replay: records the scan program in each tier with kim1_rec_exec(),
+    with key presses and teletype input, and with a small number of
+    keyframe slots which run full. The recording is replayed into another
+    instance, which is compared with the recorded instance at several
+    ticks, forward with kim1_replay_run() and then backwards with
+    kim1_replay_seek(). No input may diverge from its recorded tick.
+
+    rewind: runs the timer program in each tier with a rewind capture
+    after each frame, with too few capture entries (and then too few undo
+    chunks) for all frames, and compares the states restored with
+    kim1_rewind_to() and kim1_rewind_step_back() with snapshots taken at
+    the captures.
+
+    snapshot: runs the timer program in each tier, saves a snapshot with
+    key events still queued, and checks that loading it into another
+    instance and back into the same one runs into the same state.
+
+    fork: forks the timer program in each tier, and checks that a fork
+    runs like a full copy, that forks diverge (copy-on-write RAM) without
+    changing the parent, and that a fork of a fork does the same.
+
+    teletype: an echo program bit-banged on the serial line (without the
+    monitor), and through the trapped GETCH and OUTCH, in each tier. And
+    OUTCH and GETCH called with the monitor's code, once bit-banged and
+    once trapped, must leave the same registers and memory.
+
+    tape: the trapped LOADT and DUMPT (on a fake 6530-003 ROM) in each
+    tier, with tape images from kim1_tape_encode().
+
+    idle: loops which produce teletype and tape output, but otherwise
+    come back to the same state at each pass, must produce the same
+    output with and without idle loop fast-forward.
+
+    watch: self-modifying code with kim1_exec() and kim1_run_until() and
+    read watchpoints on its RAM page in each tier, the blocks cached by
+    kim1_exec() must neither hide the watched instruction bytes nor run
+    with stale code.
+
+    image: paper tape and raw program decoding, the reference counts of
+    acquired images (the image files are written into DIR), and instances
+    which share the mapped images.
+
+    batch: kim1_batch_run() with different numbers of worker threads
+    against single jobs.
+
+    profile: the counters of a profiled loop with known instruction and
+    cycle counts, and the kim1_profile_hot() order, in each tier.
+
+    The instruction-stepped tiers bring the RRIOTs forward to the first
+    tick of an instruction, not to the tick of the actual bus access (see
+    kim1.h), so the RRIOT I/O and timer state and the LED display frame
+    are compared at the end between the instruction-stepped tiers only.
+
+    The built-in PROGRAMs run without the ROMs (the reset and IRQ vectors
+    are patched):
+
+    - scan: a display scan loop with a delay loop, which reads the keypad
+      while keys are pressed and released
+    - timer: a main loop which waits in an idle loop for the 6530-003
+      timer interrupt, the interrupt handler counts in decimal mode
+    - tty: prints a string through the trapped monitor OUTCH and OUTSP
+      routines (on a fake 6530-002 ROM with just these routines)
+    - modes: most addressing modes, the stack instructions and decimal
+      mode on a per-lane pseudo-random number
+
+    monitor: runs "trace" and "run" on the KIM-1 monitor from reset, with
+    key presses which enter and run a small program. The exit code is 77
+    (the ctest SKIP_RETURN_CODE) if the ROM images don't exist.
+
+    Otherwise the exit code is 0 if all tiers are identical, and 1 if not.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/m6530.h"
+#include "chips/sched.h"
+#include "chips/clk.h"
+#include "systems/kim1_tape.h"
+#include "systems/kim1.h"
+#include "systems/kim1_lockstep.h"
+#include "systems/kim1_replay.h"
+#include "systems/kim1_rewind.h"
+#include "systems/kim1_image.h"
+#include "systems/kim1_batch.h"
+
+#define TEST_SKIPPED (77)
+#define TEST_TRACE_INSTRS (300000)
+#define TEST_TRACE_RAM_CHECK (1000)
+#define TEST_RUN_TICKS (20000000)
+#define TEST_FRAME_US (1000000 / 60)
+#define TEST_LOCKSTEP_INSTRS (100000)
+#define TEST_REPLAY_FRAMES (360)
+#define TEST_REPLAY_CHECK_FRAMES (50)
+#define TEST_REPLAY_KEYFRAME_TICKS (200000)
+#define TEST_REPLAY_MAX_KEYFRAMES (8)
+#define TEST_REWIND_FRAMES (40)
+#define TEST_REWIND_ENTRIES (16)
+#define TEST_REWIND_FEW_CHUNKS (200)
+#define TEST_SNAPSHOT_FRAMES (30)
+#define TEST_FORK_FRAMES (20)
+#define TEST_TTY_BAUD (1000)
+#define TEST_TTY_FRAMES (30)
+#define TEST_TTY_ROM_TICKS (100000)
+#define TEST_TAPE_MAX_TICKS (100000)
+#define TEST_IDLE_TICKS (1000000)
+#define TEST_IDLE_SLICE_US (1000)
+#define TEST_WATCH_TICKS (20000)
+#define TEST_WATCH_SHORT_TICKS (2000)
+#define TEST_BATCH_JOBS (12)
+#define TEST_BATCH_MAX_TICKS (100000)
+
+typedef struct {
+    const char* name;
+    bool instr_stepped;
+    bool block_cache;
+    bool idle_skip;
+} tier_t;
+
+static const tier_t tiers[] = {
+    { .name = "cycle" },
+    { .name = "instr", .instr_stepped = true },
+    { .name = "block", .instr_stepped = true, .block_cache = true },
+    { .name = "instr+idle", .instr_stepped = true, .idle_skip = true },
+    { .name = "block+idle", .instr_stepped = true, .block_cache = true, .idle_skip = true },
+};
+#define NUM_TIERS ((int)(sizeof(tiers) / sizeof(tiers[0])))
+// the instruction-stepped tiers access the RRIOTs at the first tick of an instruction, so their I/O state is compared with this tier
+#define IO_REF_TIER (1)
+
+typedef struct {
+    uint64_t tick;
+    int key;
+    bool down;
+} key_event_t;
+
+typedef struct {
+    const char* name;
+    const uint8_t* code;            // loaded at 0200, 0 to run the monitor
+    size_t code_size;
+    uint16_t irq_addr;              // IRQ handler (patched IRQ vector), 0 to keep the vector
+    const key_event_t* keys;
+    int num_keys;
+    bool tty;                       // run with the teletype (the receive line is PA7)
+    bool tty_trap;                  // ...and the GETCH/OUTCH trap (on the fake 6530-002 ROM)
+    uint32_t baud;                  // teletype bit rate, 0 for the default
+    bool tape_trap;                 // the LOADT/DUMPT trap (on the fake 6530-002 and 6530-003 ROMs)
+    void (*init_lane)(kim1_t* sys, int lane);   // optional per-lane input for the lockstep test
+} program_t;
+
+/*
+    0200 A9 7F      LDA #$7F
+    0202 8D 41 17   STA $1741       ; PADD: segments are outputs
+    0205 A9 1E      LDA #$1E
+    0207 8D 43 17   STA $1743       ; PBDD: digit select are outputs
+    020A A0 00      LDY #$00
+    020C A2 09      LDX #$09
+    020E B9 40 02   LDA $0240,Y
+    0211 8D 40 17   STA $1740       ; segments
+    0214 8E 42 17   STX $1742       ; digit select
+    0217 A9 7F      LDA #$7F
+    0219 38         SEC
+    021A E9 01      SBC #$01
+    021C D0 FB      BNE $0219       ; delay
+    021E AD 40 17   LDA $1740       ; read keypad
+    0221 99 48 02   STA $0248,Y
+    0224 E8         INX
+    0225 E8         INX
+    0226 C8         INY
+    0227 C0 06      CPY #$06
+    0229 D0 E3      BNE $020E
+    022B F0 DD      BEQ $020A
+    ...
+    0240            segment patterns for 6 digits
+*/
+static const uint8_t prog_scan[] = {
+    0xA9, 0x7F, 0x8D, 0x41, 0x17, 0xA9, 0x1E, 0x8D, 0x43, 0x17, 0xA0, 0x00, 0xA2, 0x09, 0xB9, 0x40,
+    0x02, 0x8D, 0x40, 0x17, 0x8E, 0x42, 0x17, 0xA9, 0x7F, 0x38, 0xE9, 0x01, 0xD0, 0xFB, 0xAD, 0x40,
+    0x17, 0x99, 0x48, 0x02, 0xE8, 0xE8, 0xC8, 0xC0, 0x06, 0xD0, 0xE3, 0xF0, 0xDD, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D,
+};
+
+static const key_event_t keys_scan[] = {
+    { 1000000, KIM1_KEY_0 + 5, true },
+    { 1300000, KIM1_KEY_0 + 5, false },
+    { 2000000, KIM1_KEY_0 + 0xA, true },
+    { 2000500, KIM1_KEY_0 + 0xA, false },
+    { 7000000, KIM1_KEY_PLUS, true },
+    { 9000000, KIM1_KEY_PLUS, false },
+};
+
+/*
+    0200 D8         CLD
+    0201 A2 FF      LDX #$FF
+    0203 9A         TXS
+    0204 A9 7F      LDA #$7F
+    0206 8D 41 17   STA $1741       ; PADD: segments are outputs
+    0209 A9 1E      LDA #$1E
+    020B 8D 43 17   STA $1743       ; PBDD: digit select are outputs
+    020E A9 00      LDA #$00
+    0210 85 10      STA $10         ; BCD interrupt counter
+    0212 85 11      STA $11
+    0214 58         CLI
+    0215 A9 3F      LDA #$3F
+    0217 8D 0D 17   STA $170D       ; 6530-003 timer, 8 cycle prescaler, interrupt enabled
+    021A A5 10      LDA $10
+    021C 29 0F      AND #$0F
+    021E AA         TAX
+    021F BD 40 02   LDA $0240,X
+    0222 8D 40 17   STA $1740       ; segments of the lowest counter digit
+    0225 A9 09      LDA #$09
+    0227 8D 42 17   STA $1742       ; digit select
+    022A A5 12      LDA $12
+    022C F0 FC      BEQ $022A       ; idle loop: wait for the interrupt
+    022E A9 00      LDA #$00
+    0230 85 12      STA $12
+    0232 4C 15 02   JMP $0215
+    ...
+    0240            7-segment patterns for 0..9
+    ...
+    0280 48         PHA
+    0281 AD 06 17   LDA $1706       ; read the timer, clears the interrupt flag and disables the interrupt
+    0284 85 13      STA $13
+    0286 F8         SED
+    0287 18         CLC
+    0288 A5 10      LDA $10
+    028A 69 01      ADC #$01
+    028C 85 10      STA $10
+    028E A5 11      LDA $11
+    0290 69 00      ADC #$00
+    0292 85 11      STA $11
+    0294 D8         CLD
+    0295 E6 12      INC $12
+    0297 68         PLA
+    0298 40         RTI
+*/
+static const uint8_t prog_timer[] = {
+    0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x7F, 0x8D, 0x41, 0x17, 0xA9, 0x1E, 0x8D, 0x43, 0x17, 0xA9, 0x00,
+    0x85, 0x10, 0x85, 0x11, 0x58, 0xA9, 0x3F, 0x8D, 0x0D, 0x17, 0xA5, 0x10, 0x29, 0x0F, 0xAA, 0xBD,
+    0x40, 0x02, 0x8D, 0x40, 0x17, 0xA9, 0x09, 0x8D, 0x42, 0x17, 0xA5, 0x12, 0xF0, 0xFC, 0xA9, 0x00,
+    0x85, 0x12, 0x4C, 0x15, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x48, 0xAD, 0x06, 0x17, 0x85, 0x13, 0xF8, 0x18, 0xA5, 0x10, 0x69, 0x01, 0x85, 0x10, 0xA5, 0x11,
+    0x69, 0x00, 0x85, 0x11, 0xD8, 0xE6, 0x12, 0x68, 0x40,
+};
+
+// a different key per lane, pressed for 100 ms
+static void init_lane_scan(kim1_t* sys, int lane) {
+    kim1_key_event(sys, 200000 + (uint64_t)lane * 30000, KIM1_KEY_0 + lane, true);
+    kim1_key_event(sys, 300000 + (uint64_t)lane * 30000, KIM1_KEY_0 + lane, false);
+}
+
+// a different timer period per group of lanes, the lanes drift apart and meet again in the idle loop
+static void init_lane_timer(kim1_t* sys, int lane) {
+    mem_wr(&sys->mem, 0x0216, (uint8_t)(0x3F - (lane & 3)));
+}
+
+/*
+    Prints a string with the monitor's OUTCH (1EA0) and a space with
+    OUTSP (1E9E), which is "LDA #$20" and falls through into OUTCH. This
+    runs on a fake 6530-002 ROM, which only has the code at GETCH and
+    OUTCH which kim1_init() checks before installing the GETCH/OUTCH
+    trap, but OUTCH itself is a JMP to itself, so it must be trapped.
+
+    0200 A2 00      LDX #$00
+    0202 B5 10      LDA $10,X       ; per-lane string, 0-terminated
+    0204 F0 07      BEQ $020D
+    0206 20 A0 1E   JSR OUTCH
+    0209 E8         INX
+    020A 4C 02 02   JMP $0202
+    020D 20 9E 1E   JSR OUTSP
+    0210 4C 00 02   JMP $0200
+*/
+static const uint8_t prog_tty[] = {
+    0xA2, 0x00, 0xB5, 0x10, 0xF0, 0x07, 0x20, 0xA0, 0x1E, 0xE8, 0x4C, 0x02, 0x02, 0x20, 0x9E, 0x1E,
+    0x4C, 0x00, 0x02,
+};
+
+static void init_lane_tty(kim1_t* sys, int lane) {
+    static const char hex[] = "0123456789ABCDEF";
+    const uint8_t str[] = { 'L', 'A', 'N', 'E', (uint8_t)hex[lane & 15], 0 };
+    mem_write_range(&sys->mem, 0x0010, str, sizeof(str));
+}
+
+/*
+    Runs most addressing modes, the stack instructions and decimal
+    mode on a per-lane pseudo-random number, the lanes take different
+    branches and use different effective addresses.
+
+    0200 D8         CLD
+    0201 A2 FF      LDX #$FF
+    0203 9A         TXS
+    0204 A9 80      LDA #$80
+    0206 85 30      STA $30         ; ($30) = 0280
+    0208 A9 02      LDA #$02
+    020A 85 31      STA $31
+    020C A9 F8      LDA #$F8
+    020E 85 32      STA $32         ; ($32) = 17F8, the 6530-003 RAM
+    0210 A9 17      LDA #$17
+    0212 85 33      STA $33
+    0214 A9 1E      LDA #$1E
+    0216 85 34      STA $34         ; ($34) = 021E
+    0218 A9 02      LDA #$02
+    021A 85 35      STA $35
+    021C EA         NOP
+    021D EA         NOP
+    021E A5 20      LDA $20         ; per-lane seed
+    0220 0A         ASL A
+    0221 26 21      ROL $21
+    0223 90 04      BCC $0229       ; both paths take 3 instructions
+    0225 49 1D      EOR #$1D
+    0227 B0 02      BCS $022B
+    0229 EA         NOP
+    022A EA         NOP
+    022B 85 20      STA $20
+    022D A4 20      LDY $20
+    022F 91 30      STA ($30),Y
+    0231 B1 30      LDA ($30),Y     ; crosses a page for Y >= 80
+    0233 A2 02      LDX #$02
+    0235 41 2E      EOR ($2E,X)
+    0237 99 F0 02   STA $02F0,Y
+    023A A6 20      LDX $20
+    023C FE F0 02   INC $02F0,X
+    023F BD F0 02   LDA $02F0,X
+    0242 A0 03      LDY #$03
+    0244 91 32      STA ($32),Y
+    0246 AD FB 17   LDA $17FB
+    0249 F8         SED
+    024A 38         SEC
+    024B E5 21      SBC $21
+    024D 69 19      ADC #$19
+    024F D8         CLD
+    0250 08         PHP
+    0251 68         PLA
+    0252 85 22      STA $22
+    0254 24 22      BIT $22
+    0256 70 04      BVS $025C       ; both paths take 3 instructions
+    0258 C6 22      DEC $22
+    025A 50 02      BVC $025E
+    025C EA         NOP
+    025D EA         NOP
+    025E 46 22      LSR $22
+    0260 6E 22 00   ROR $0022
+    0263 20 69 02   JSR $0269
+    0266 6C 34 00   JMP ($0034)
+    0269 48         PHA
+    026A BA         TSX
+    026B BD 02 01   LDA $0102,X     ; low byte of the return address
+    026E A8         TAY
+    026F 68         PLA
+    0270 60         RTS
+*/
+static const uint8_t prog_modes[] = {
+    0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x80, 0x85, 0x30, 0xA9, 0x02, 0x85, 0x31, 0xA9, 0xF8, 0x85, 0x32,
+    0xA9, 0x17, 0x85, 0x33, 0xA9, 0x1E, 0x85, 0x34, 0xA9, 0x02, 0x85, 0x35, 0xEA, 0xEA, 0xA5, 0x20,
+    0x0A, 0x26, 0x21, 0x90, 0x04, 0x49, 0x1D, 0xB0, 0x02, 0xEA, 0xEA, 0x85, 0x20, 0xA4, 0x20, 0x91,
+    0x30, 0xB1, 0x30, 0xA2, 0x02, 0x41, 0x2E, 0x99, 0xF0, 0x02, 0xA6, 0x20, 0xFE, 0xF0, 0x02, 0xBD,
+    0xF0, 0x02, 0xA0, 0x03, 0x91, 0x32, 0xAD, 0xFB, 0x17, 0xF8, 0x38, 0xE5, 0x21, 0x69, 0x19, 0xD8,
+    0x08, 0x68, 0x85, 0x22, 0x24, 0x22, 0x70, 0x04, 0xC6, 0x22, 0x50, 0x02, 0xEA, 0xEA, 0x46, 0x22,
+    0x6E, 0x22, 0x00, 0x20, 0x69, 0x02, 0x6C, 0x34, 0x00, 0x48, 0xBA, 0xBD, 0x02, 0x01, 0xA8, 0x68,
+    0x60,
+};
+
+static void init_lane_modes(kim1_t* sys, int lane) {
+    mem_wr(&sys->mem, 0x0020, (uint8_t)(lane * 17 + 1));
+    mem_wr(&sys->mem, 0x0021, (uint8_t)lane);
+}
+
+/*
+    Echoes each byte from the teletype with the case swapped, bit-banged
+    on the serial line without the monitor: waits for the start bit on
+    PA7, samples the 8 data bits in their middle, and sends the byte back
+    on PB0. The delay loop is timed for 1000 baud (1000 ticks per bit).
+
+    0200 A9 01      LDA #$01
+    0202 8D 42 17   STA $1742       ; idle (mark) level
+    0205 8D 43 17   STA $1743       ; PBDD: PB0 (transmit line) is an output
+    0208 2C 40 17   BIT $1740       ; wait for the start bit on PA7
+    020B 30 FB      BMI $0208
+    020D A0 61      LDY #$61        ; half a bit
+    020F 20 50 02   JSR $0250
+    0212 A2 08      LDX #$08
+    0214 A0 C2      LDY #$C2        ; one bit, sample each data bit in its middle
+    0216 20 50 02   JSR $0250
+    0219 AD 40 17   LDA $1740
+    021C 0A         ASL A           ; PA7 -> C
+    021D 66 00      ROR $00         ; LSB first
+    021F CA         DEX
+    0220 D0 F2      BNE $0214
+    0222 A5 00      LDA $00
+    0224 49 20      EOR #$20        ; swap the case
+    0226 85 00      STA $00
+    0228 A9 00      LDA #$00        ; start bit
+    022A A2 09      LDX #$09        ; then 8 data bits and the stop bit
+    022C 8D 42 17   STA $1742
+    022F A0 C2      LDY #$C2
+    0231 20 50 02   JSR $0250
+    0234 38         SEC             ; shifts in ones, the 9th bit is the stop bit
+    0235 66 00      ROR $00
+    0237 A9 00      LDA #$00
+    0239 2A         ROL A           ; C -> PB0
+    023A CA         DEX
+    023B D0 EF      BNE $022C
+    023D 8D 42 17   STA $1742       ; stop bit
+    0240 A0 C2      LDY #$C2
+    0242 20 50 02   JSR $0250
+    0245 4C 08 02   JMP $0208
+    ...
+    0250 88         DEY             ; 5*Y+13 cycles with the LDY, JSR and RTS
+    0251 D0 FD      BNE $0250
+    0253 60         RTS
+*/
+static const uint8_t prog_echo[] = {
+    0xA9, 0x01, 0x8D, 0x42, 0x17, 0x8D, 0x43, 0x17, 0x2C, 0x40, 0x17, 0x30, 0xFB, 0xA0, 0x61, 0x20,
+    0x50, 0x02, 0xA2, 0x08, 0xA0, 0xC2, 0x20, 0x50, 0x02, 0xAD, 0x40, 0x17, 0x0A, 0x66, 0x00, 0xCA,
+    0xD0, 0xF2, 0xA5, 0x00, 0x49, 0x20, 0x85, 0x00, 0xA9, 0x00, 0xA2, 0x09, 0x8D, 0x42, 0x17, 0xA0,
+    0xC2, 0x20, 0x50, 0x02, 0x38, 0x66, 0x00, 0xA9, 0x00, 0x2A, 0xCA, 0xD0, 0xEF, 0x8D, 0x42, 0x17,
+    0xA0, 0xC2, 0x20, 0x50, 0x02, 0x4C, 0x08, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x88, 0xD0, 0xFD, 0x60,
+};
+
+/*
+    The same echo through the trapped monitor GETCH and OUTCH routines
+    (on the fake 6530-002 ROM, GETCH waits in the start bit polling loop).
+
+    0200 20 5A 1E   JSR GETCH
+    0203 49 20      EOR #$20        ; swap the case
+    0205 20 A0 1E   JSR OUTCH
+    0208 4C 00 02   JMP $0200
+*/
+static const uint8_t prog_getch[] = {
+    0x20, 0x5A, 0x1E, 0x49, 0x20, 0x20, 0xA0, 0x1E, 0x4C, 0x00, 0x02,
+};
+
+/*
+    Calls the monitor's OUTCH with 'K' and then GETCH at 1000 baud, and
+    stores the registers and flags after each call in 0010..0017. The
+    byte for GETCH is sent when the program reaches 022C.
+
+    0200 A9 00      LDA #$00
+    0202 8D F3 17   STA $17F3       ; CNTH30
+    0205 A9 43      LDA #$43
+    0207 8D F2 17   STA $17F2       ; CNTL30: a bit time of about 1000 cycles
+    020A A9 07      LDA #$07
+    020C 8D 42 17   STA $1742       ; PB0 high, keypad row 3 (the teletype jumper on PA0)
+    020F A9 1F      LDA #$1F
+    0211 8D 43 17   STA $1743       ; PBDD
+    0214 A9 4B      LDA #'K'
+    0216 A2 A5      LDX #$A5
+    0218 A0 33      LDY #$33
+    021A 38         SEC
+    021B 20 A0 1E   JSR OUTCH
+    021E 85 10      STA $10
+    0220 86 11      STX $11
+    0222 84 12      STY $12
+    0224 08         PHP
+    0225 68         PLA
+    0226 85 13      STA $13
+    0228 A2 5A      LDX #$5A
+    022A A0 33      LDY #$33
+    022C 20 5A 1E   JSR GETCH
+    022F 85 14      STA $14
+    0231 86 15      STX $15
+    0233 84 16      STY $16
+    0235 08         PHP
+    0236 68         PLA
+    0237 85 17      STA $17
+    0239 4C 39 02   JMP $0239
+*/
+static const uint8_t prog_tty_regs[] = {
+    0xA9, 0x00, 0x8D, 0xF3, 0x17, 0xA9, 0x43, 0x8D, 0xF2, 0x17, 0xA9, 0x07, 0x8D, 0x42, 0x17, 0xA9,
+    0x1F, 0x8D, 0x43, 0x17, 0xA9, 0x4B, 0xA2, 0xA5, 0xA0, 0x33, 0x38, 0x20, 0xA0, 0x1E, 0x85, 0x10,
+    0x86, 0x11, 0x84, 0x12, 0x08, 0x68, 0x85, 0x13, 0xA2, 0x5A, 0xA0, 0x33, 0x20, 0x5A, 0x1E, 0x85,
+    0x14, 0x86, 0x15, 0x84, 0x16, 0x08, 0x68, 0x85, 0x17, 0x4C, 0x39, 0x02,
+};
+
+/*
+    Calls the monitor's LOADT or DUMPT routine with the parameters in
+    0010..0016 (SAL, SAH, EAL, EAH, ID and the routine address), the
+    trapped routine returns to START (1C4F).
+
+    0200 A5 10      LDA $10
+    0202 8D F5 17   STA $17F5       ; SAL
+    0205 A5 11      LDA $11
+    0207 8D F6 17   STA $17F6       ; SAH
+    020A A5 12      LDA $12
+    020C 8D F7 17   STA $17F7       ; EAL
+    020F A5 13      LDA $13
+    0211 8D F8 17   STA $17F8       ; EAH
+    0214 A5 14      LDA $14
+    0216 8D F9 17   STA $17F9       ; ID
+    0219 6C 15 00   JMP ($0015)
+*/
+static const uint8_t prog_tape[] = {
+    0xA5, 0x10, 0x8D, 0xF5, 0x17, 0xA5, 0x11, 0x8D, 0xF6, 0x17, 0xA5, 0x12, 0x8D, 0xF7, 0x17, 0xA5,
+    0x13, 0x8D, 0xF8, 0x17, 0xA5, 0x14, 0x8D, 0xF9, 0x17, 0x6C, 0x15, 0x00,
+};
+
+/*
+    Toggles the teletype transmit line (PB0) and the cassette output
+    (PB7) in a loop which is otherwise idle.
+
+    0200 A9 81      LDA #$81
+    0202 8D 43 17   STA $1743       ; PBDD: PB0 and PB7 are outputs
+    0205 A9 00      LDA #$00
+    0207 8D 42 17   STA $1742       ; PB0 and PB7 low
+    020A A9 81      LDA #$81
+    020C 8D 42 17   STA $1742       ; ...and high
+    020F 4C 05 02   JMP $0205
+*/
+static const uint8_t prog_edges[] = {
+    0xA9, 0x81, 0x8D, 0x43, 0x17, 0xA9, 0x00, 0x8D, 0x42, 0x17, 0xA9, 0x81, 0x8D, 0x42, 0x17, 0x4C,
+    0x05, 0x02,
+};
+
+/*
+    Self-modifying code: calls a subroutine which stores an immediate
+    value, and increments that value every 256 calls, so the subroutine
+    stays in the block cache for a while between the changes.
+
+    0200 20 40 02   JSR $0240
+    0203 E6 11      INC $11
+    0205 D0 F9      BNE $0200
+    0207 EE 41 02   INC $0241
+    020A 4C 00 02   JMP $0200
+    ...
+    0240 A9 00      LDA #$00        ; the operand at 0241 is incremented
+    0242 85 10      STA $10
+    0244 60         RTS
+*/
+static const uint8_t prog_smc[] = {
+    0x20, 0x40, 0x02, 0xE6, 0x11, 0xD0, 0xF9, 0xEE, 0x41, 0x02, 0x4C, 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xA9, 0x00, 0x85, 0x10, 0x60,
+};
+
+// 6530-002 ROM with just enough of the monitor for the GETCH/OUTCH trap, and START as endless loop
+static uint8_t fake_rom_002[0x0400];
+// 6530-003 ROM with just the start of LOADT and DUMPT for the tape trap
+static uint8_t fake_rom_003[0x0400];
+// 6530-002 ROM with the monitor's GETCH, OUTCH, DELAY and DEHALF, and the reset vector to 0200
+static uint8_t tty_rom_002[0x0400];
+
+static void init_fake_roms(void) {
+    static const uint8_t start[] = { 0x4C, 0x4F, 0x1C };
+    static const uint8_t getch[] = { 0x86, 0xFD, 0xA2, 0x08, 0xA9, 0x01, 0x2C, 0x40, 0x17, 0x4C, 0x60, 0x1E };
+    static const uint8_t outsp[] = { 0xA9, 0x20, 0x85, 0xFE, 0x86, 0xFD, 0x4C, 0xA4, 0x1E };
+    static const uint8_t dumpt[] = { 0xA9, 0xAD, 0x8D, 0xEC, 0x17 };
+    static const uint8_t loadt[] = { 0xA9, 0x8D, 0x8D, 0xEC, 0x17 };
+    memset(fake_rom_002, 0xFF, sizeof(fake_rom_002));
+    memcpy(&fake_rom_002[0x1C4F & 0x3FF], start, sizeof(start));
+    memcpy(&fake_rom_002[0x1E5A & 0x3FF], getch, sizeof(getch));
+    memcpy(&fake_rom_002[0x1E9E & 0x3FF], outsp, sizeof(outsp));
+    memset(fake_rom_003, 0xFF, sizeof(fake_rom_003));
+    memcpy(&fake_rom_003[0x1800 & 0x3FF], dumpt, sizeof(dumpt));
+    memcpy(&fake_rom_003[0x1873 & 0x3FF], loadt, sizeof(loadt));
+    static const uint8_t tty_getch[] = {
+        0x86, 0xFD, 0xA2, 0x08, 0xA9, 0x01, 0x2C, 0x40, 0x17, 0xD0, 0x22, 0x30, 0xF9, 0x20, 0xD4, 0x1E,
+        0x20, 0xEB, 0x1E, 0xAD, 0x40, 0x17, 0x29, 0x80, 0x46, 0xFE, 0x05, 0xFE, 0x85, 0xFE, 0x20, 0xD4,
+        0x1E, 0xCA, 0xD0, 0xEF, 0x20, 0xEB, 0x1E, 0xA6, 0xFD, 0xA5, 0xFE, 0x2A, 0x4A, 0x60,
+    };
+    static const uint8_t tty_outch[] = {
+        0x85, 0xFE, 0x86, 0xFD, 0x20, 0xD4, 0x1E, 0xAD, 0x42, 0x17, 0x29, 0xFE, 0x8D, 0x42, 0x17, 0x20,
+        0xD4, 0x1E, 0xA2, 0x08, 0xAD, 0x42, 0x17, 0x29, 0xFE, 0x46, 0xFE, 0x69, 0x00, 0x8D, 0x42, 0x17,
+        0x20, 0xD4, 0x1E, 0xCA, 0xD0, 0xEE, 0xAD, 0x42, 0x17, 0x09, 0x01, 0x8D, 0x42, 0x17, 0x20, 0xD4,
+        0x1E, 0xA6, 0xFD, 0x60,
+        // DELAY and DEHALF
+        0xAD, 0xF3, 0x17, 0x8D, 0xF4, 0x17, 0xAD, 0xF2, 0x17, 0x38, 0xE9, 0x01, 0xB0, 0x03, 0xCE, 0xF4,
+        0x17, 0xAC, 0xF4, 0x17, 0x10, 0xF3, 0x60, 0xAD, 0xF3, 0x17, 0x8D, 0xF4, 0x17, 0xAD, 0xF2, 0x17,
+        0x4A, 0x4E, 0xF4, 0x17, 0x90, 0xE3, 0x09, 0x80, 0xB0, 0xE0,
+    };
+    memset(tty_rom_002, 0xFF, sizeof(tty_rom_002));
+    memcpy(&tty_rom_002[0x1E5A & 0x3FF], tty_getch, sizeof(tty_getch));
+    memcpy(&tty_rom_002[0x1EA0 & 0x3FF], tty_outch, sizeof(tty_outch));
+    tty_rom_002[0x3FC] = 0x00;
+    tty_rom_002[0x3FD] = 0x02;
+}
+
+// enter "0200 A9 42 85 00 4C 4F 1C" (LDA #$42; STA $00; JMP START) with the keypad, and run it
+static const int monitor_key_seq[] = {
+    KIM1_KEY_AD, 0x0, 0x2, 0x0, 0x0, KIM1_KEY_DA,
+    0xA, 0x9, KIM1_KEY_PLUS, 0x4, 0x2, KIM1_KEY_PLUS, 0x8, 0x5, KIM1_KEY_PLUS,
+    0x0, 0x0, KIM1_KEY_PLUS, 0x4, 0xC, KIM1_KEY_PLUS, 0x4, 0xF, KIM1_KEY_PLUS, 0x1, 0xC,
+    KIM1_KEY_AD, 0x0, 0x2, 0x0, 0x0, KIM1_KEY_GO,
+};
+#define MONITOR_NUM_KEYS ((int)(sizeof(monitor_key_seq) / sizeof(monitor_key_seq[0])))
+static key_event_t keys_monitor[2 * MONITOR_NUM_KEYS];
+
+static kim1_t systems[NUM_TIERS];
+static int next_key[NUM_TIERS];
+static kim1_breakpoints_t bp_all;
+static chips_range_t rom_002;
+static chips_range_t rom_003;
+
+static void init_system(kim1_t* sys, const tier_t* tier, const program_t* prog) {
+    kim1_init(sys, &(kim1_desc_t){
+        .instr_stepped = tier->instr_stepped,
+        .block_cache = tier->block_cache,
+        .idle_skip = tier->idle_skip,
+        .tty = { .enabled = prog->tty || prog->tty_trap, .trap = prog->tty_trap, .baud = prog->baud },
+        .tape = { .trap = prog->tape_trap },
+        .roms = {
+            .rom_002 = (prog->tty_trap || prog->tape_trap) ? (chips_range_t){ .ptr = fake_rom_002, .size = sizeof(fake_rom_002) } : rom_002,
+            .rom_003 = prog->tape_trap ? (chips_range_t){ .ptr = fake_rom_003, .size = sizeof(fake_rom_003) } : rom_003,
+        },
+    });
+    CHIPS_ASSERT((sys->tty.trap == prog->tty_trap) && (sys->tape_trap == prog->tape_trap));
+    if (prog->code) {
+        mem_write_range(&sys->mem, 0x0200, prog->code, (uint32_t)prog->code_size);
+        sys->rom_002[0x3FC] = 0x00;
+        sys->rom_002[0x3FD] = 0x02;
+    }
+    if (prog->irq_addr) {
+        sys->rom_002[0x3FE] = (uint8_t)prog->irq_addr;
+        sys->rom_002[0x3FF] = (uint8_t)(prog->irq_addr >> 8);
+    }
+}
+
+// queue the key events of the next 100 ms (the key event queue is too small for all of them)
+static void feed_keys(int tier, const program_t* prog) {
+    kim1_t* sys = &systems[tier];
+    int* next = &next_key[tier];
+    while ((*next < prog->num_keys) && (prog->keys[*next].tick < (sys->ticks + 100000))) {
+        const key_event_t* k = &prog->keys[*next];
+        if (!kim1_key_event(sys, k->tick, k->key, k->down)) {
+            break;
+        }
+        (*next)++;
+    }
+}
+
+static void print_state(const char* name, const kim1_t* sys) {
+    const m6502_t* c = &sys->cpu;
+    fprintf(stderr, "  %-11s ticks=%llu pc=%04X a=%02X x=%02X y=%02X s=%02X p=%02X\n",
+        name, (unsigned long long)sys->ticks, M6502_GET_ADDR(sys->pins), c->A, c->X, c->Y, c->S, c->P);
+}
+
+static bool same_cpu(const kim1_t* a, const kim1_t* b) {
+    return (a->ticks == b->ticks) && (M6502_GET_ADDR(a->pins) == M6502_GET_ADDR(b->pins)) &&
+           (a->cpu.A == b->cpu.A) && (a->cpu.X == b->cpu.X) && (a->cpu.Y == b->cpu.Y) &&
+           (a->cpu.S == b->cpu.S) && (a->cpu.P == b->cpu.P);
+}
+
+// the part of the RRIOT state which doesn't depend on how far the RRIOT has been brought forward
+static bool same_rriot(const m6530_t* a, const m6530_t* b) {
+    return (0 == memcmp(&a->pa, &b->pa, sizeof(a->pa))) &&
+           (0 == memcmp(&a->pb, &b->pb, sizeof(a->pb))) &&
+           (a->timer.start == b->timer.start) &&
+           (a->timer.irq_tick == b->timer.irq_tick) &&
+           (a->timer.latch == b->timer.latch) &&
+           (a->timer.shift == b->timer.shift) &&
+           (a->timer.irq_enable == b->timer.irq_enable) &&
+           (0 == memcmp(a->ram, b->ram, sizeof(a->ram)));
+}
+
+static bool check_cpu(const char* what, int tier) {
+    if (!same_cpu(&systems[0], &systems[tier])) {
+        fprintf(stderr, "%s: %s differs from %s\n", what, tiers[tier].name, tiers[0].name);
+        print_state(tiers[0].name, &systems[0]);
+        print_state(tiers[tier].name, &systems[tier]);
+        return false;
+    }
+    return true;
+}
+
+static bool check_ram(const char* what, int tier) {
+    const kim1_t* ref = &systems[0];
+    const kim1_t* sys = &systems[tier];
+    for (uint32_t addr = 0; addr < sizeof(sys->ram); addr++) {
+        if (sys->ram[addr] != ref->ram[addr]) {
+            fprintf(stderr, "%s: %s RAM differs at %04X: %02X (expected %02X)\n",
+                what, tiers[tier].name, addr, sys->ram[addr], ref->ram[addr]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_io(const char* what, int tier) {
+    if (tier <= IO_REF_TIER) {
+        return true;
+    }
+    const kim1_t* ref = &systems[IO_REF_TIER];
+    const kim1_t* sys = &systems[tier];
+    if (!same_rriot(&ref->rriot002, &sys->rriot002) || !same_rriot(&ref->rriot003, &sys->rriot003)) {
+        fprintf(stderr, "%s: %s RRIOT state differs from %s\n", what, tiers[tier].name, tiers[IO_REF_TIER].name);
+        return false;
+    }
+    if (sys->irq_lines != ref->irq_lines) {
+        fprintf(stderr, "%s: %s IRQ lines differ from %s\n", what, tiers[tier].name, tiers[IO_REF_TIER].name);
+        return false;
+    }
+    if (0 != memcmp(sys->display.fb, ref->display.fb, sizeof(sys->display.fb))) {
+        fprintf(stderr, "%s: %s LED display frame differs from %s\n", what, tiers[tier].name, tiers[IO_REF_TIER].name);
+        return false;
+    }
+    return true;
+}
+
+static int test_trace(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        init_system(&systems[t], &tiers[t], prog);
+        next_key[t] = 0;
+    }
+    char what[64];
+    for (uint32_t i = 0; i < TEST_TRACE_INSTRS; i++) {
+        for (int t = 0; t < NUM_TIERS; t++) {
+            feed_keys(t, prog);
+            kim1_run_until(&systems[t], &bp_all, 100);
+        }
+        snprintf(what, sizeof(what), "%s: instruction %u", prog->name, i);
+        for (int t = 1; t < NUM_TIERS; t++) {
+            if (!check_cpu(what, t)) {
+                return 1;
+            }
+            if ((0 == (i % TEST_TRACE_RAM_CHECK)) && !check_ram(what, t)) {
+                return 1;
+            }
+        }
+    }
+    for (int t = 1; t < NUM_TIERS; t++) {
+        if (!check_ram(prog->name, t) || !check_io(prog->name, t)) {
+            return 1;
+        }
+    }
+    printf("%s: %u instructions (%llu ticks) identical in all tiers\n",
+        prog->name, TEST_TRACE_INSTRS, (unsigned long long)systems[0].ticks);
+    return 0;
+}
+
+static int test_run(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        kim1_t* sys = &systems[t];
+        init_system(sys, &tiers[t], prog);
+        next_key[t] = 0;
+        const uint64_t start_ns = clk_now_ns();
+        while (sys->ticks < TEST_RUN_TICKS) {
+            feed_keys(t, prog);
+            const uint64_t left = TEST_RUN_TICKS - sys->ticks;
+            kim1_exec(sys, (left < TEST_FRAME_US) ? (uint32_t)left : TEST_FRAME_US);
+        }
+        const double seconds = (double)(clk_now_ns() - start_ns) * 1e-9;
+        // the instruction-stepped tiers stop at the first instruction boundary after TEST_RUN_TICKS
+        if (0 == (sys->pins & M6502_SYNC)) {
+            kim1_run_until(sys, &bp_all, 100);
+        }
+        printf("%s: %-11s %10llu ticks %8.3f seconds %9.3f MHz", prog->name, tiers[t].name,
+            (unsigned long long)sys->ticks, seconds, (double)sys->ticks / (seconds * 1e6));
+        if (tiers[t].idle_skip) {
+            printf(" (%llu idle ticks skipped)", (unsigned long long)sys->idle.skipped_ticks);
+        }
+        printf("\n");
+    }
+    for (int t = 1; t < NUM_TIERS; t++) {
+        if (!check_cpu(prog->name, t) || !check_ram(prog->name, t) || !check_io(prog->name, t)) {
+            return 1;
+        }
+    }
+    printf("%s: all tiers identical after %llu ticks\n", prog->name, (unsigned long long)systems[0].ticks);
+    return 0;
+}
+
+/*
+    lockstep: runs the program in 16 lanes with kim1_lockstep_run(), and
+    in 16 separate instances with kim1_step(), with the same per-lane
+    input, and compares each lane with its scalar twin after each step.
+*/
+static kim1_t lanes[KIM1_LOCKSTEP_MAX_LANES];
+static kim1_t scalar[KIM1_LOCKSTEP_MAX_LANES];
+static kim1_lockstep_t lockstep;
+
+static bool check_lane(const char* what, int lane) {
+    const kim1_t* a = &lanes[lane];
+    const kim1_t* b = &scalar[lane];
+    if (!same_cpu(a, b) || (a->pins != b->pins)) {
+        fprintf(stderr, "%s: lane %d differs from kim1_step()\n", what, lane);
+        print_state("lockstep", a);
+        print_state("kim1_step", b);
+        return false;
+    }
+    if (0 != memcmp(a->ram, b->ram, sizeof(a->ram))) {
+        fprintf(stderr, "%s: lane %d RAM differs from kim1_step()\n", what, lane);
+        return false;
+    }
+    if (!same_rriot(&a->rriot002, &b->rriot002) || !same_rriot(&a->rriot003, &b->rriot003) ||
+        (a->irq_lines != b->irq_lines) || (0 != memcmp(a->display.lit, b->display.lit, sizeof(a->display.lit))))
+    {
+        fprintf(stderr, "%s: lane %d I/O state differs from kim1_step()\n", what, lane);
+        return false;
+    }
+    uint8_t out_a[KIM1_TTY_FIFO_SIZE], out_b[KIM1_TTY_FIFO_SIZE];
+    const uint32_t num_a = kim1_tty_get(&lanes[lane], out_a, sizeof(out_a));
+    const uint32_t num_b = kim1_tty_get(&scalar[lane], out_b, sizeof(out_b));
+    if ((num_a != num_b) || (0 != memcmp(out_a, out_b, num_a))) {
+        fprintf(stderr, "%s: lane %d teletype output differs from kim1_step()\n", what, lane);
+        return false;
+    }
+    return true;
+}
+
+static int test_lockstep(const program_t* prog, int num_lanes) {
+    kim1_lockstep_desc_t desc = { .num_lanes = num_lanes };
+    for (int i = 0; i < num_lanes; i++) {
+        init_system(&lanes[i], &tiers[IO_REF_TIER], prog);
+        init_system(&scalar[i], &tiers[IO_REF_TIER], prog);
+        if (prog->init_lane) {
+            prog->init_lane(&lanes[i], i);
+            prog->init_lane(&scalar[i], i);
+        }
+        desc.lanes[i] = &lanes[i];
+    }
+    kim1_lockstep_init(&lockstep, &desc);
+    char what[64];
+    for (uint32_t n = 0; n < TEST_LOCKSTEP_INSTRS; n++) {
+        kim1_lockstep_run(&lockstep, 1);
+        snprintf(what, sizeof(what), "%s: %d lanes: instruction %u", prog->name, num_lanes, n);
+        for (int i = 0; i < num_lanes; i++) {
+            kim1_step(&scalar[i]);
+            if (!check_lane(what, i)) {
+                return 1;
+            }
+        }
+    }
+    printf("%s: %d lanes: %u instructions identical to kim1_step(), %llu of %llu steps for all lanes at once\n",
+        prog->name, num_lanes, TEST_LOCKSTEP_INSTRS,
+        (unsigned long long)lockstep.num_vector_steps, (unsigned long long)lockstep.num_steps);
+    if (0 == lockstep.num_vector_steps) {
+        fprintf(stderr, "%s: no instruction was executed for all lanes at once\n", prog->name);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+    replay: records the program in each tier with key presses and TTY
+    input through the kim1_rec_*() functions, with so many keyframes that
+    the keyframe slots run full, then replays the recording into another
+    instance and compares it with the recorded instance at several ticks,
+    forward with kim1_replay_run() and backwards across keyframes with
+    kim1_replay_seek().
+*/
+static kim1_rec_keyframe_t keyframes[TEST_REPLAY_MAX_KEYFRAMES];
+static uint8_t replay_log[4096];
+static kim1_t checkpoints[TEST_REPLAY_FRAMES / TEST_REPLAY_CHECK_FRAMES];
+static kim1_t replay_sys;
+
+// the machine state which must be identical after recording and replaying (or rewinding)
+static bool check_same(const char* what, const kim1_t* ref, const kim1_t* sys) {
+    if (!same_cpu(ref, sys) || (ref->pins != sys->pins)) {
+        fprintf(stderr, "%s: CPU state differs\n", what);
+        print_state("expected", ref);
+        print_state("actual", sys);
+        return false;
+    }
+    if (0 != memcmp(ref->ram, sys->ram, sizeof(ref->ram))) {
+        fprintf(stderr, "%s: RAM differs\n", what);
+        return false;
+    }
+    if (!same_rriot(&ref->rriot002, &sys->rriot002) || !same_rriot(&ref->rriot003, &sys->rriot003) ||
+        (ref->irq_lines != sys->irq_lines) || (0 != memcmp(ref->display.lit, sys->display.lit, sizeof(ref->display.lit))))
+    {
+        fprintf(stderr, "%s: I/O state differs\n", what);
+        return false;
+    }
+    if ((ref->keypad.down != sys->keypad.down) || (ref->keypad.num_events != sys->keypad.num_events) ||
+        (ref->tty.rx_busy != sys->tty.rx_busy) || (ref->tty.rx_fifo.head != sys->tty.rx_fifo.head) ||
+        (ref->tty.rx_fifo.tail != sys->tty.rx_fifo.tail))
+    {
+        fprintf(stderr, "%s: keypad or teletype input state differs\n", what);
+        return false;
+    }
+    return true;
+}
+
+// the inputs of the recorded session, before the time slice of a frame
+static void replay_input(kim1_rec_t* rec, int frame) {
+    static const uint8_t hello[] = { 'H', 'E', 'L', 'L', 'O' };
+    static const uint8_t kim[] = { 'K', 'I', 'M' };
+    switch (frame) {
+        case 20:  kim1_rec_key_down(rec, KIM1_KEY_0 + 5); break;
+        case 30:  kim1_rec_tty_put(rec, hello, sizeof(hello)); break;
+        case 40:  kim1_rec_key_up(rec, KIM1_KEY_0 + 5); break;
+        case 60:  kim1_rec_key_event(rec, rec->sys->ticks + 12345, KIM1_KEY_0 + 0xA, true); break;
+        case 70:  kim1_rec_key_event(rec, rec->sys->ticks + 500, KIM1_KEY_0 + 0xA, false); break;
+        case 150: kim1_rec_tty_put(rec, kim, sizeof(kim)); break;
+        case 200: kim1_rec_key_down(rec, KIM1_KEY_PLUS); break;
+        case 260: kim1_rec_key_up(rec, KIM1_KEY_PLUS); break;
+        default: break;
+    }
+}
+
+static int test_replay_tier(const program_t* prog, int t) {
+    kim1_t* sys = &systems[t];
+    const char* name = tiers[t].name;
+    init_system(sys, &tiers[t], prog);
+    kim1_rec_t rec;
+    kim1_rec_init(&rec, sys, &(kim1_rec_desc_t){
+        .log = { .ptr = replay_log, .size = sizeof(replay_log) },
+        .keyframes = keyframes,
+        .max_keyframes = TEST_REPLAY_MAX_KEYFRAMES,
+        .keyframe_ticks = TEST_REPLAY_KEYFRAME_TICKS,
+    });
+    int num_checkpoints = 0;
+    for (int frame = 0; frame < TEST_REPLAY_FRAMES; frame++) {
+        replay_input(&rec, frame);
+        // the state right before a time slice, after the inputs at that tick
+        if ((frame > 0) && (0 == (frame % TEST_REPLAY_CHECK_FRAMES))) {
+            kim1_save_snapshot(sys, &checkpoints[num_checkpoints++]);
+        }
+        kim1_rec_exec(&rec, TEST_FRAME_US);
+    }
+    if (rec.overflow) {
+        fprintf(stderr, "replay: %s: the input log overflowed\n", name);
+        return 1;
+    }
+    // more keyframes than slots: every other keyframe was dropped, evenly spread from the start of the session
+    if ((rec.keyframe_ticks <= TEST_REPLAY_KEYFRAME_TICKS) || (rec.num_keyframes > TEST_REPLAY_MAX_KEYFRAMES) ||
+        (rec.num_keyframes < (TEST_REPLAY_MAX_KEYFRAMES / 2)) || (keyframes[0].tick != 0))
+    {
+        fprintf(stderr, "replay: %s: %u keyframes every %llu ticks, keyframes weren't thinned out\n",
+            name, rec.num_keyframes, (unsigned long long)rec.keyframe_ticks);
+        return 1;
+    }
+    for (uint32_t i = 1; i < rec.num_keyframes; i++) {
+        if ((keyframes[i].tick - keyframes[i - 1].tick) < (rec.keyframe_ticks / 2)) {
+            fprintf(stderr, "replay: %s: keyframe %u at tick %llu is too close to the one before\n",
+                name, i, (unsigned long long)keyframes[i].tick);
+            return 1;
+        }
+    }
+    init_system(&replay_sys, &tiers[t], prog);
+    kim1_replay_t rp;
+    kim1_replay_init(&rp, &replay_sys, &(kim1_replay_desc_t){
+        .log = { .ptr = replay_log, .size = rec.log_pos },
+        .keyframes = keyframes,
+        .num_keyframes = rec.num_keyframes,
+    });
+    char what[64];
+    for (int i = 0; i < num_checkpoints; i++) {
+        snprintf(what, sizeof(what), "replay: %s: run to tick %llu", name, (unsigned long long)checkpoints[i].ticks);
+        kim1_replay_run(&rp, checkpoints[i].ticks);
+        if (!check_same(what, &checkpoints[i], &replay_sys)) {
+            return 1;
+        }
+    }
+    // backwards, each seek loads an earlier keyframe
+    for (int i = num_checkpoints - 2; i >= 0; i--) {
+        snprintf(what, sizeof(what), "replay: %s: seek back to tick %llu", name, (unsigned long long)checkpoints[i].ticks);
+        if (!kim1_replay_seek(&rp, checkpoints[i].ticks) || !check_same(what, &checkpoints[i], &replay_sys)) {
+            return 1;
+        }
+    }
+    if ((0 != rp.num_diverged) || rp.corrupt) {
+        fprintf(stderr, "replay: %s: %u inputs diverged%s\n", name, rp.num_diverged, rp.corrupt ? ", log corrupt" : "");
+        return 1;
+    }
+    printf("replay: %s: %u log bytes, %u keyframes every %llu ticks, %d checkpoints identical\n",
+        name, rec.log_pos, rec.num_keyframes, (unsigned long long)rec.keyframe_ticks, num_checkpoints);
+    return 0;
+}
+
+static int test_replay(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const int res = test_replay_tier(prog, t);
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    rewind: runs the program in each tier with a capture after each frame
+    and a snapshot of each capture, with fewer capture entries than
+    frames, and checks that kim1_rewind_to() restores exactly the state of
+    the chosen capture (and that running on from there gives the same
+    states again), that kim1_rewind_step_back() steps back one capture at
+    a time down to the oldest one, and that the oldest captures are
+    dropped when the entries or the undo chunks run out.
+*/
+static kim1_rewind_entry_t rewind_entries[TEST_REWIND_FRAMES + 1];
+static kim1_rewind_chunk_t rewind_chunks[16 * 1024];
+static kim1_t rewind_snapshots[TEST_REWIND_FRAMES + 1];
+static kim1_rewind_t rewind_buf;
+
+// run one frame and capture it, snapshots[frame] is the state at the capture, returns false if nothing was captured
+static bool rewind_frame(kim1_t* sys, int frame) {
+    kim1_exec(sys, TEST_FRAME_US);
+    const bool captured = kim1_rewind_update(&rewind_buf);
+    kim1_save_snapshot(sys, &rewind_snapshots[frame]);
+    if (!captured) {
+        fprintf(stderr, "rewind: frame %d wasn't captured\n", frame);
+    }
+    return captured;
+}
+
+static const kim1_t* rewind_snapshot_at(uint64_t tick) {
+    for (int i = 0; i <= TEST_REWIND_FRAMES; i++) {
+        if (rewind_snapshots[i].ticks == tick) {
+            return &rewind_snapshots[i];
+        }
+    }
+    return 0;
+}
+
+static int test_rewind_tier(const program_t* prog, int t, uint32_t num_entries, uint32_t num_chunks) {
+    kim1_t* sys = &systems[t];
+    char what[96];
+    init_system(sys, &tiers[t], prog);
+    // the ticks of a frame are the capture interval, so each frame is captured
+    kim1_rewind_init(&rewind_buf, sys, &(kim1_rewind_desc_t){
+        .entries = rewind_entries,
+        .num_entries = num_entries,
+        .chunks = rewind_chunks,
+        .num_chunks = num_chunks,
+        .interval_ticks = 1,
+    });
+    kim1_save_snapshot(sys, &rewind_snapshots[0]);
+    for (int frame = 1; frame <= TEST_REWIND_FRAMES; frame++) {
+        if (!rewind_frame(sys, frame)) {
+            return 1;
+        }
+    }
+    snprintf(what, sizeof(what), "rewind: %s: %u entries, %u chunks", tiers[t].name, num_entries, num_chunks);
+    // the oldest captures were dropped, the newest ones are left
+    const uint32_t num = rewind_buf.num;
+    const kim1_t* oldest = rewind_snapshot_at(kim1_rewind_oldest_tick(&rewind_buf));
+    if ((num > num_entries) || (num >= (TEST_REWIND_FRAMES + 1)) || (num < 2) ||
+        (0 == oldest) || (oldest != &rewind_snapshots[TEST_REWIND_FRAMES + 1 - num]) ||
+        ((rewind_buf.chunk_head - _kim1_rewind_chunk_tail(&rewind_buf)) > num_chunks))
+    {
+        fprintf(stderr, "%s: %u captures left, oldest at tick %llu\n",
+            what, num, (unsigned long long)kim1_rewind_oldest_tick(&rewind_buf));
+        return 1;
+    }
+    if (kim1_rewind_to(&rewind_buf, oldest->ticks - 1)) {
+        fprintf(stderr, "%s: rewind before the oldest capture succeeded\n", what);
+        return 1;
+    }
+    // a tick between two captures restores the earlier one, then run on to the last frame again
+    const int target = TEST_REWIND_FRAMES - (int)num / 2;
+    if (!kim1_rewind_to(&rewind_buf, rewind_snapshots[target].ticks + 1) ||
+        !check_same(what, &rewind_snapshots[target], sys))
+    {
+        fprintf(stderr, "%s: rewind to frame %d failed\n", what, target);
+        return 1;
+    }
+    for (int frame = target + 1; frame <= TEST_REWIND_FRAMES; frame++) {
+        const kim1_t ref = rewind_snapshots[frame];
+        if (!rewind_frame(sys, frame) || !check_same(what, &ref, sys)) {
+            fprintf(stderr, "%s: frame %d differs after rewinding to frame %d\n", what, frame, target);
+            return 1;
+        }
+    }
+    // in the middle of a capture interval, a step back returns to the latest capture
+    kim1_exec(sys, TEST_FRAME_US / 2);
+    if (!kim1_rewind_step_back(&rewind_buf) || !check_same(what, &rewind_snapshots[TEST_REWIND_FRAMES], sys)) {
+        fprintf(stderr, "%s: step back to the latest capture failed\n", what);
+        return 1;
+    }
+    // at a capture, each step back goes one capture further back, down to the oldest one
+    const int oldest_frame = TEST_REWIND_FRAMES + 1 - (int)rewind_buf.num;
+    oldest = &rewind_snapshots[oldest_frame];
+    for (int frame = TEST_REWIND_FRAMES - 1; frame >= oldest_frame; frame--) {
+        if (!kim1_rewind_step_back(&rewind_buf) || !check_same(what, &rewind_snapshots[frame], sys)) {
+            fprintf(stderr, "%s: step back to frame %d failed\n", what, frame);
+            return 1;
+        }
+    }
+    if ((1 != rewind_buf.num) || kim1_rewind_step_back(&rewind_buf) || !check_same(what, oldest, sys)) {
+        fprintf(stderr, "%s: step back beyond the oldest capture\n", what);
+        return 1;
+    }
+    printf("%s: %u of %d captures kept, rewind and step back identical\n", what, num, TEST_REWIND_FRAMES + 1);
+    return 0;
+}
+
+static int test_rewind(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        // running out of entries, and running out of undo chunks
+        int res = test_rewind_tier(prog, t, TEST_REWIND_ENTRIES, sizeof(rewind_chunks) / sizeof(rewind_chunks[0]));
+        if (0 == res) {
+            res = test_rewind_tier(prog, t, TEST_REWIND_FRAMES + 1, TEST_REWIND_FEW_CHUNKS);
+        }
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    snapshot: runs the timer program in each tier with a key event queued
+    beyond the snapshot tick, saves a snapshot, runs on and loads the
+    snapshot both into another instance and back into the same one, and
+    checks that both run into the same state as the original. A snapshot
+    with the wrong version must not load.
+*/
+static kim1_t snapshot;
+static kim1_t snapshot_ref;
+static kim1_t snapshot_sys;
+
+static void snapshot_run(kim1_t* sys) {
+    for (int frame = 0; frame < TEST_SNAPSHOT_FRAMES; frame++) {
+        kim1_exec(sys, TEST_FRAME_US);
+    }
+}
+
+static int test_snapshot_tier(const program_t* prog, int t) {
+    kim1_t* sys = &systems[t];
+    char what[64];
+    snprintf(what, sizeof(what), "snapshot: %s", tiers[t].name);
+    init_system(sys, &tiers[t], prog);
+    snapshot_run(sys);
+    // the key events are still queued when the snapshot is taken
+    kim1_key_event(sys, sys->ticks + 5 * TEST_FRAME_US, KIM1_KEY_0 + 7, true);
+    kim1_key_event(sys, sys->ticks + 20 * TEST_FRAME_US, KIM1_KEY_0 + 7, false);
+    kim1_key_event(sys, sys->ticks + 25 * TEST_FRAME_US, KIM1_KEY_PLUS, true);
+    const uint32_t version = kim1_save_snapshot(sys, &snapshot);
+    if (version != KIM1_SNAPSHOT_VERSION) {
+        fprintf(stderr, "%s: snapshot version %u\n", what, version);
+        return 1;
+    }
+    snapshot_run(sys);
+    kim1_save_snapshot(sys, &snapshot_ref);
+    if (0 == snapshot_ref.keypad.down) {
+        fprintf(stderr, "%s: the queued key event wasn't handled\n", what);
+        return 1;
+    }
+    // into another instance
+    init_system(&snapshot_sys, &tiers[t], prog);
+    if (kim1_load_snapshot(&snapshot_sys, version + 1, &snapshot) || (0 != snapshot_sys.ticks)) {
+        fprintf(stderr, "%s: a snapshot with the wrong version was loaded\n", what);
+        return 1;
+    }
+    if (!kim1_load_snapshot(&snapshot_sys, version, &snapshot) || !check_same(what, &snapshot, &snapshot_sys)) {
+        fprintf(stderr, "%s: loading into another instance failed\n", what);
+        return 1;
+    }
+    snapshot_run(&snapshot_sys);
+    if (!check_same(what, &snapshot_ref, &snapshot_sys)) {
+        fprintf(stderr, "%s: another instance differs after running on from the snapshot\n", what);
+        return 1;
+    }
+    // back in time in the same instance
+    if (!kim1_load_snapshot(sys, version, &snapshot) || !check_same(what, &snapshot, sys)) {
+        fprintf(stderr, "%s: loading into the same instance failed\n", what);
+        return 1;
+    }
+    snapshot_run(sys);
+    if (!check_same(what, &snapshot_ref, sys)) {
+        fprintf(stderr, "%s: the same instance differs after running on from the snapshot\n", what);
+        return 1;
+    }
+    printf("%s: identical after loading the snapshot at tick %llu and running to tick %llu\n",
+        what, (unsigned long long)snapshot.ticks, (unsigned long long)snapshot_ref.ticks);
+    return 0;
+}
+
+static int test_snapshot(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const int res = test_snapshot_tier(prog, t);
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    fork: forks the timer program in each tier twice, runs one fork as
+    is and the other with a faster timer, and checks that the first fork
+    runs into the same state as a full copy (loaded from a snapshot) of
+    the parent, that the forks diverge, and that the parent's state and
+    RAM stay unchanged. A fork of a fork must behave the same way.
+*/
+static kim1_t fork_parent_ref;
+static kim1_t fork_a;
+static kim1_t fork_b;
+static kim1_t fork_c;
+static kim1_t fork_twin;
+static kim1_t fork_snapshot;
+
+static void fork_run(kim1_t* sys, int num_frames) {
+    for (int frame = 0; frame < num_frames; frame++) {
+        kim1_exec(sys, TEST_FRAME_US);
+    }
+}
+
+// a fork's RAM may still be the parent's, so it's compared through a (self-contained) snapshot
+static bool check_fork(const char* what, const kim1_t* ref, kim1_t* fork) {
+    kim1_save_snapshot(fork, &fork_snapshot);
+    if (fork_snapshot.parent) {
+        fprintf(stderr, "%s: the snapshot still points to the parent\n", what);
+        return false;
+    }
+    return check_same(what, ref, &fork_snapshot);
+}
+
+static int test_fork_tier(const program_t* prog, int t) {
+    kim1_t* parent = &systems[t];
+    char what[64];
+    snprintf(what, sizeof(what), "fork: %s", tiers[t].name);
+    init_system(parent, &tiers[t], prog);
+    fork_run(parent, TEST_FORK_FRAMES);
+    const uint32_t version = kim1_save_snapshot(parent, &fork_parent_ref);
+    init_system(&fork_twin, &tiers[t], prog);
+    if (!kim1_load_snapshot(&fork_twin, version, &fork_parent_ref)) {
+        fprintf(stderr, "%s: the parent's snapshot can't be loaded\n", what);
+        return 1;
+    }
+
+    kim1_fork(&fork_a, parent);
+    kim1_fork(&fork_b, parent);
+    if (!check_fork(what, &fork_parent_ref, &fork_a)) {
+        fprintf(stderr, "%s: the fork differs from its parent\n", what);
+        return 1;
+    }
+    #if !defined(MEM_FLAT)
+    if (mem_readptr(&fork_a.mem, 0x0000) != mem_readptr(&parent->mem, 0x0000)) {
+        fprintf(stderr, "%s: the fork doesn't share the parent's RAM before the first write\n", what);
+        return 1;
+    }
+    #endif
+    // a different timer period (like init_lane_timer()) in the second fork
+    mem_wr(&fork_b.mem, 0x0216, 0x20);
+    fork_run(&fork_a, TEST_FORK_FRAMES);
+    fork_run(&fork_b, TEST_FORK_FRAMES);
+    fork_run(&fork_twin, TEST_FORK_FRAMES);
+    if (!check_fork(what, &fork_twin, &fork_a)) {
+        fprintf(stderr, "%s: the fork differs from a copy of its parent\n", what);
+        return 1;
+    }
+    #if !defined(MEM_FLAT)
+    if (mem_readptr(&fork_a.mem, 0x0000) == mem_readptr(&parent->mem, 0x0000)) {
+        fprintf(stderr, "%s: the fork still uses the parent's RAM after writing it\n", what);
+        return 1;
+    }
+    #endif
+    kim1_save_snapshot(&fork_b, &fork_snapshot);
+    if ((fork_snapshot.ram[0x0216] != 0x20) || (fork_snapshot.ram[0x10] == fork_twin.ram[0x10])) {
+        fprintf(stderr, "%s: the forks didn't diverge (BCD counters %02X and %02X)\n",
+            what, fork_snapshot.ram[0x10], fork_twin.ram[0x10]);
+        return 1;
+    }
+    // a fork of the first fork (which must not run while the new fork exists)
+    kim1_fork(&fork_c, &fork_a);
+    fork_run(&fork_c, TEST_FORK_FRAMES);
+    fork_run(&fork_twin, TEST_FORK_FRAMES);
+    if (!check_fork(what, &fork_twin, &fork_c)) {
+        fprintf(stderr, "%s: the fork of a fork differs from a copy\n", what);
+        return 1;
+    }
+    if (!check_same(what, &fork_parent_ref, parent) || (parent->ram[0x0216] != prog->code[0x16])) {
+        fprintf(stderr, "%s: the parent was changed by its forks\n", what);
+        return 1;
+    }
+    kim1_discard(&fork_c);
+    kim1_discard(&fork_b);
+    kim1_discard(&fork_a);
+    printf("%s: forks identical to a full copy, diverged without changing the parent\n", what);
+    return 0;
+}
+
+static int test_fork(const program_t* prog) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const int res = test_fork_tier(prog, t);
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    teletype: sends a string to the echo program in each tier, once
+    bit-banged on the serial line and once through the trapped GETCH and
+    OUTCH, with idle time in between, and checks the received bytes. A
+    bit-banged echo takes 20 bit times (the byte and its echo), which is
+    more than a frame, the trapped echo must answer all bytes in one frame.
+*/
+static int test_teletype_tier(const program_t* prog, int t) {
+    static const uint8_t first[] = "hello, kim-1";
+    static const uint8_t second[] = "Echo";
+    kim1_t* sys = &systems[t];
+    char what[64];
+    snprintf(what, sizeof(what), "teletype: %s: %s", prog->name, tiers[t].name);
+    init_system(sys, &tiers[t], prog);
+    kim1_exec(sys, TEST_FRAME_US);
+    uint8_t expected[sizeof(first) - 1 + sizeof(second) - 1];
+    uint8_t received[sizeof(expected) + 1];
+    uint32_t num_received = 0;
+    for (int part = 0; part < 2; part++) {
+        const uint8_t* str = (0 == part) ? first : second;
+        const uint32_t len = (uint32_t)strlen((const char*)str);
+        for (uint32_t i = 0; i < len; i++) {
+            expected[num_received + i] = str[i] ^ 0x20;
+        }
+        if (len != kim1_tty_put(sys, str, len)) {
+            fprintf(stderr, "%s: the input FIFO is full\n", what);
+            return 1;
+        }
+        kim1_exec(sys, TEST_FRAME_US);
+        const uint32_t num = kim1_tty_get(sys, &received[num_received], sizeof(received) - num_received);
+        if (prog->tty_trap ? (num != len) : (num > 1)) {
+            fprintf(stderr, "%s: %u of %u bytes echoed after one frame\n", what, num, len);
+            return 1;
+        }
+        num_received += num;
+        // and idle without input until the next part
+        for (int frame = 1; frame < TEST_TTY_FRAMES; frame++) {
+            kim1_exec(sys, TEST_FRAME_US);
+            num_received += kim1_tty_get(sys, &received[num_received], sizeof(received) - num_received);
+        }
+    }
+    if ((num_received != sizeof(expected)) || (0 != memcmp(received, expected, sizeof(expected)))) {
+        fprintf(stderr, "%s: received %u bytes, expected %u:", what, num_received, (uint32_t)sizeof(expected));
+        for (uint32_t i = 0; i < num_received; i++) {
+            fprintf(stderr, " %02X", received[i]);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    printf("%s: %u bytes echoed\n", what, num_received);
+    return 0;
+}
+
+/*
+    Runs the OUTCH and GETCH program on the monitor's code, bit-banged or
+    trapped, returns the teletype output, or -1 if the program got stuck.
+*/
+static int tty_regs_run(kim1_t* sys, const tier_t* tier, bool trap, kim1_breakpoints_t* bp) {
+    kim1_init(sys, &(kim1_desc_t){
+        .instr_stepped = tier->instr_stepped,
+        .block_cache = tier->block_cache,
+        .idle_skip = tier->idle_skip,
+        .tty = { .enabled = true, .trap = trap, .baud = TEST_TTY_BAUD },
+        .roms = { .rom_002 = { .ptr = tty_rom_002, .size = sizeof(tty_rom_002) } },
+    });
+    CHIPS_ASSERT(sys->tty.trap == trap);
+    mem_write_range(&sys->mem, 0x0200, prog_tty_regs, sizeof(prog_tty_regs));
+    kim1_breakpoints_init(bp);
+    kim1_add_breakpoint(bp, 0x022C);
+    if (0x022C != kim1_run_until(sys, bp, TEST_TTY_ROM_TICKS).pc) {
+        return -1;
+    }
+    kim1_tty_put(sys, (const uint8_t*)"k", 1);
+    kim1_breakpoints_init(bp);
+    kim1_add_breakpoint(bp, 0x0239);
+    if (0x0239 != kim1_run_until(sys, bp, TEST_TTY_ROM_TICKS).pc) {
+        return -1;
+    }
+    uint8_t out[2];
+    return (1 == kim1_tty_get(sys, out, sizeof(out))) ? out[0] : -1;
+}
+
+// the trapped OUTCH and GETCH must leave the registers and memory like the monitor's code (except the stack page)
+static int test_teletype_regs_tier(int t) {
+    static kim1_t ref;
+    static kim1_breakpoints_t bp;
+    kim1_t* sys = &systems[t];
+    const int ref_out = tty_regs_run(&ref, &tiers[t], false, &bp);
+    const int out = tty_regs_run(sys, &tiers[t], true, &bp);
+    if ((ref_out != 'K') || (out != 'K') || (mem_rd(&ref.mem, 0x0014) != 'k')) {
+        fprintf(stderr, "teletype: regs: %s: sent %d and %d, received %02X, expected 'K' and 'k'\n",
+            tiers[t].name, ref_out, out, mem_rd(&ref.mem, 0x0014));
+        return 1;
+    }
+    for (uint16_t addr = 0x0000; addr < 0x0400; addr++) {
+        if (((addr >> 8) != 1) && (mem_rd(&ref.mem, addr) != mem_rd(&sys->mem, addr))) {
+            fprintf(stderr, "teletype: regs: %s: %04X is %02X trapped, expected %02X\n",
+                tiers[t].name, addr, mem_rd(&sys->mem, addr), mem_rd(&ref.mem, addr));
+            return 1;
+        }
+    }
+    if ((0 != memcmp(ref.rriot002.ram, sys->rriot002.ram, sizeof(ref.rriot002.ram))) ||
+        (0 != memcmp(ref.rriot003.ram, sys->rriot003.ram, sizeof(ref.rriot003.ram))) ||
+        (ref.cpu.A != sys->cpu.A) || (ref.cpu.X != sys->cpu.X) || (ref.cpu.Y != sys->cpu.Y) ||
+        (ref.cpu.S != sys->cpu.S) || (ref.cpu.P != sys->cpu.P))
+    {
+        fprintf(stderr, "teletype: regs: %s: the RRIOT RAM or the CPU registers differ from the monitor's code\n", tiers[t].name);
+        return 1;
+    }
+    printf("teletype: regs: %s: same registers and memory as the monitor's OUTCH and GETCH\n", tiers[t].name);
+    return 0;
+}
+
+static int test_teletype(void) {
+    const program_t progs[] = {
+        { .name = "bits", .code = prog_echo, .code_size = sizeof(prog_echo), .tty = true, .baud = TEST_TTY_BAUD },
+        { .name = "trap", .code = prog_getch, .code_size = sizeof(prog_getch), .tty_trap = true },
+    };
+    for (int i = 0; i < 2; i++) {
+        for (int t = 0; t < NUM_TIERS; t++) {
+            const int res = test_teletype_tier(&progs[i], t);
+            if (0 != res) {
+                return res;
+            }
+        }
+    }
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const int res = test_teletype_regs_tier(t);
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    tape: loads tape images made with kim1_tape_encode() with the trapped
+    LOADT (by ID, behind the end of the tape, to the address in 17F5/17F6,
+    and with a checksum error), dumps a memory block with the trapped
+    DUMPT, compares the recording with kim1_tape_encode(), and loads it
+    back.
+*/
+static uint8_t tape_image_buf[2 * 1024];
+static uint8_t tape_bad_buf[1024];
+static uint8_t tape_rec_buf[1024];
+static uint8_t tape_expected_buf[1024];
+static kim1_breakpoints_t bp_start;
+
+// calls LOADT or DUMPT through the tape program, returns POINTH/POINTL (0000: ok, FFFF: error), or -1 if it didn't return
+static int tape_call(kim1_t* sys, uint16_t routine, uint8_t id, uint16_t sa, uint16_t ea) {
+    const uint8_t params[] = {
+        (uint8_t)sa, (uint8_t)(sa >> 8), (uint8_t)ea, (uint8_t)(ea >> 8), id, (uint8_t)routine, (uint8_t)(routine >> 8),
+    };
+    mem_write_range(&sys->mem, 0x0010, params, sizeof(params));
+    kim1_reset(sys);
+    const kim1_stop_t stop = kim1_run_until(sys, &bp_start, TEST_TAPE_MAX_TICKS);
+    if ((stop.reason != KIM1_STOP_BREAKPOINT) || (stop.pc != 0x1C4F)) {
+        return -1;
+    }
+    return (mem_rd(&sys->mem, 0x00FB) << 8) | mem_rd(&sys->mem, 0x00FA);
+}
+
+static bool tape_check_ram(const char* what, const kim1_t* sys, uint16_t addr, const uint8_t* data, uint32_t num_bytes) {
+    for (uint32_t i = 0; i < num_bytes; i++) {
+        if (sys->ram[addr + i] != data[i]) {
+            fprintf(stderr, "%s: RAM at %04X is %02X, expected %02X\n", what, addr + i, sys->ram[addr + i], data[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int test_tape_tier(const program_t* prog, int t) {
+    static const uint8_t zeros[0x80];
+    uint8_t a[0x80], b[0x40], c[0x80];
+    for (uint32_t i = 0; i < sizeof(a); i++) {
+        a[i] = (uint8_t)(i * 7 + 3);
+        c[i] = (uint8_t)(0xC3 ^ (i * 13));
+    }
+    for (uint32_t i = 0; i < sizeof(b); i++) {
+        b[i] = (uint8_t)(0xFF - i * 5);
+    }
+    // two recordings back to back
+    const uint32_t size_a = kim1_tape_encode(0x11, 0x0300, a, sizeof(a), (chips_range_t){ .ptr = tape_image_buf, .size = sizeof(tape_image_buf) });
+    const uint32_t size_b = kim1_tape_encode(0x22, 0x0340, b, sizeof(b), (chips_range_t){ .ptr = &tape_image_buf[size_a], .size = sizeof(tape_image_buf) - size_a });
+    CHIPS_ASSERT((size_a > 0) && (size_b > 0));
+    const chips_range_t image = { .ptr = tape_image_buf, .size = size_a + size_b };
+    // the first recording with a wrong data digit
+    memcpy(tape_bad_buf, tape_image_buf, size_a);
+    tape_bad_buf[KIM1_TAPE_NUM_SYN + 8] = (tape_bad_buf[KIM1_TAPE_NUM_SYN + 8] == '0') ? '1' : '0';
+
+    kim1_t* sys = &systems[t];
+    char what[64];
+    snprintf(what, sizeof(what), "tape: %s", tiers[t].name);
+    init_system(sys, &tiers[t], prog);
+    kim1_insert_tape(sys, image);
+    int res = tape_call(sys, 0x1873, 0x22, 0, 0);
+    if ((0x0000 != res) || !tape_check_ram(what, sys, 0x0340, b, sizeof(b)) || !tape_check_ram(what, sys, 0x0300, zeros, 0x40)) {
+        fprintf(stderr, "%s: LOADT by ID failed (%04X)\n", what, res);
+        return 1;
+    }
+    // the tape is behind both recordings now
+    res = tape_call(sys, 0x1873, 0x11, 0, 0);
+    if ((0xFFFF != res) || !tape_check_ram(what, sys, 0x0300, zeros, 0x40)) {
+        fprintf(stderr, "%s: LOADT behind the end of the tape didn't fail (%04X)\n", what, res);
+        return 1;
+    }
+    kim1_remove_tape(sys);
+    kim1_insert_tape(sys, image);
+    res = tape_call(sys, 0x1873, 0xFF, 0x0380, 0);
+    if ((0x0000 != res) || !tape_check_ram(what, sys, 0x0380, a, sizeof(a))) {
+        fprintf(stderr, "%s: LOADT to the start address failed (%04X)\n", what, res);
+        return 1;
+    }
+    kim1_remove_tape(sys);
+    kim1_insert_tape(sys, (chips_range_t){ .ptr = tape_bad_buf, .size = size_a });
+    res = tape_call(sys, 0x1873, 0x00, 0, 0);
+    if (0xFFFF != res) {
+        fprintf(stderr, "%s: LOADT with a checksum error didn't fail (%04X)\n", what, res);
+        return 1;
+    }
+    kim1_remove_tape(sys);
+
+    mem_write_range(&sys->mem, 0x0300, c, sizeof(c));
+    kim1_record_tape(sys, (chips_range_t){ .ptr = tape_rec_buf, .size = sizeof(tape_rec_buf) });
+    res = tape_call(sys, 0x1800, 0x33, 0x0300, 0x0380);
+    kim1_stop_tape(sys);
+    const uint32_t size_c = kim1_tape_encode(0x33, 0x0300, c, sizeof(c), (chips_range_t){ .ptr = tape_expected_buf, .size = sizeof(tape_expected_buf) });
+    if ((0x0000 != res) || (sys->tape.rec_pos != size_c) || (0 != memcmp(tape_rec_buf, tape_expected_buf, size_c))) {
+        fprintf(stderr, "%s: DUMPT recorded %u bytes (%04X), expected the %u bytes of kim1_tape_encode()\n",
+            what, sys->tape.rec_pos, res, size_c);
+        return 1;
+    }
+    mem_write_range(&sys->mem, 0x0300, zeros, sizeof(zeros));
+    kim1_insert_tape(sys, (chips_range_t){ .ptr = tape_rec_buf, .size = sys->tape.rec_pos });
+    res = tape_call(sys, 0x1873, 0x33, 0, 0);
+    if ((0x0000 != res) || !tape_check_ram(what, sys, 0x0300, c, sizeof(c))) {
+        fprintf(stderr, "%s: LOADT of the DUMPT recording failed (%04X)\n", what, res);
+        return 1;
+    }
+    printf("%s: LOADT and DUMPT identical to kim1_tape_encode() images\n", what);
+    return 0;
+}
+
+static int test_tape(const program_t* prog) {
+    kim1_breakpoints_init(&bp_start);
+    kim1_add_breakpoint(&bp_start, 0x1C4F);
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const int res = test_tape_tier(prog, t);
+        if (0 != res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+/*
+    idle: runs a loop which prints through the trapped OUTCH, and a loop
+    which toggles the teletype and cassette outputs while recording, in
+    small time slices (so that the output FIFO doesn't run full), and
+    compares the teletype output and the tape recorder state of the
+    instruction-stepped tiers with and without idle loop fast-forward.
+*/
+static uint8_t idle_out[NUM_TIERS][128 * 1024];
+static uint32_t idle_num_out[NUM_TIERS];
+static uint8_t idle_rec[NUM_TIERS][256];
+
+static void idle_drain(int t) {
+    idle_num_out[t] += kim1_tty_get(&systems[t], &idle_out[t][idle_num_out[t]], sizeof(idle_out[t]) - idle_num_out[t]);
+}
+
+static bool same_recorder(const kim1_tape_t* a, const kim1_tape_t* b) {
+    return (a->edge_tick == b->edge_tick) && (a->tone == b->tone) &&
+           (a->tone_ticks[0] == b->tone_ticks[0]) && (a->tone_ticks[1] == b->tone_ticks[1]) &&
+           (a->shift == b->shift) && (a->num_bits == b->num_bits) && (a->rec_pos == b->rec_pos);
+}
+
+static int test_idle(const program_t* prog, bool record) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        kim1_t* sys = &systems[t];
+        init_system(sys, &tiers[t], prog);
+        if (prog->init_lane) {
+            prog->init_lane(sys, 0);
+        }
+        if (record) {
+            kim1_record_tape(sys, (chips_range_t){ .ptr = idle_rec[t], .size = sizeof(idle_rec[t]) });
+        }
+        idle_num_out[t] = 0;
+        while (sys->ticks < TEST_IDLE_TICKS) {
+            const uint64_t left = TEST_IDLE_TICKS - sys->ticks;
+            kim1_exec(sys, (left < TEST_IDLE_SLICE_US) ? (uint32_t)left : TEST_IDLE_SLICE_US);
+            idle_drain(t);
+        }
+        if (0 == (sys->pins & M6502_SYNC)) {
+            kim1_run_until(sys, &bp_all, 100);
+            idle_drain(t);
+        }
+        if (idle_num_out[t] == sizeof(idle_out[t])) {
+            fprintf(stderr, "idle: %s: %s: the output buffer is full\n", prog->name, tiers[t].name);
+            return 1;
+        }
+    }
+    const kim1_t* ref = &systems[IO_REF_TIER];
+    if (0 == idle_num_out[IO_REF_TIER]) {
+        fprintf(stderr, "idle: %s: no teletype output\n", prog->name);
+        return 1;
+    }
+    for (int t = 1; t < NUM_TIERS; t++) {
+        const kim1_t* sys = &systems[t];
+        if (!check_cpu(prog->name, t) || !check_ram(prog->name, t)) {
+            return 1;
+        }
+        if ((t > IO_REF_TIER) && ((idle_num_out[t] != idle_num_out[IO_REF_TIER]) ||
+            (0 != memcmp(idle_out[t], idle_out[IO_REF_TIER], idle_num_out[t]))))
+        {
+            fprintf(stderr, "idle: %s: %s: %u teletype bytes, %s has %u\n",
+                prog->name, tiers[t].name, idle_num_out[t], tiers[IO_REF_TIER].name, idle_num_out[IO_REF_TIER]);
+            return 1;
+        }
+        if ((t > IO_REF_TIER) && !same_recorder(&ref->tape, &sys->tape)) {
+            fprintf(stderr, "idle: %s: %s: tape recorder state differs from %s\n", prog->name, tiers[t].name, tiers[IO_REF_TIER].name);
+            return 1;
+        }
+    }
+    printf("idle: %s: %u teletype bytes identical with idle loop fast-forward (%llu and %llu ticks skipped)\n",
+        prog->name, idle_num_out[IO_REF_TIER],
+        (unsigned long long)systems[3].idle.skipped_ticks, (unsigned long long)systems[4].idle.skipped_ticks);
+    return 0;
+}
+
+/*
+    watch: runs the self-modifying code with kim1_exec() (which caches the
+    subroutine in the block cache tiers), then with kim1_run_until() and
+    a read watchpoint elsewhere in the RAM page (so that the page is read
+    through the watch check) across at least one change of the code, then
+    with kim1_exec() again for less than 256 calls, and compares all tiers
+    after each step. Then a read watchpoint on the LDA operand must stop
+    right after the LDA in all tiers.
+*/
+static kim1_breakpoints_t bp_watch;
+static kim1_breakpoints_t bp_smc_head;
+
+// the tiers stop at different instruction boundaries, bring them to the next loop head
+static void smc_align(kim1_t* sys) {
+    if (!((sys->pins & M6502_SYNC) && (M6502_GET_ADDR(sys->pins) == 0x0200))) {
+        kim1_run_until(sys, &bp_smc_head, 100);
+    }
+}
+
+static bool check_tiers(const char* what) {
+    for (int t = 1; t < NUM_TIERS; t++) {
+        if (!check_cpu(what, t) || !check_ram(what, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int test_watch(const program_t* prog) {
+    kim1_breakpoints_init(&bp_smc_head);
+    kim1_add_breakpoint(&bp_smc_head, 0x0200);
+    for (int t = 0; t < NUM_TIERS; t++) {
+        init_system(&systems[t], &tiers[t], prog);
+        kim1_exec(&systems[t], TEST_WATCH_TICKS);
+        smc_align(&systems[t]);
+    }
+    if (!check_tiers("watch: exec")) {
+        return 1;
+    }
+    kim1_breakpoints_init(&bp_watch);
+    kim1_add_watchpoint(&bp_watch, 0x0300, 1, KIM1_WATCH_READ);
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const kim1_stop_t stop = kim1_run_until(&systems[t], &bp_watch, TEST_WATCH_TICKS);
+        if (stop.reason != KIM1_STOP_TICKS) {
+            fprintf(stderr, "watch: %s: unexpected stop %d at %04X\n", tiers[t].name, stop.reason, stop.pc);
+            return 1;
+        }
+        smc_align(&systems[t]);
+    }
+    if (!check_tiers("watch: run_until")) {
+        return 1;
+    }
+    for (int t = 0; t < NUM_TIERS; t++) {
+        kim1_exec(&systems[t], TEST_WATCH_SHORT_TICKS);
+        smc_align(&systems[t]);
+    }
+    if (!check_tiers("watch: exec after run_until")) {
+        return 1;
+    }
+    kim1_breakpoints_init(&bp_watch);
+    kim1_add_watchpoint(&bp_watch, 0x0241, 1, KIM1_WATCH_READ);
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const kim1_stop_t stop = kim1_run_until(&systems[t], &bp_watch, TEST_WATCH_TICKS);
+        if ((stop.reason != KIM1_STOP_WATCHPOINT) || (stop.addr != 0x0241) || stop.write || (stop.pc != 0x0242)) {
+            fprintf(stderr, "watch: %s: stop %d at %04X (address %04X), expected the watchpoint at 0241 before 0242\n",
+                tiers[t].name, stop.reason, stop.pc, stop.addr);
+            return 1;
+        }
+    }
+    if (!check_tiers("watch: watchpoint")) {
+        return 1;
+    }
+    printf("watch: %s: self-modifying code and watched operand identical in all tiers (%llu block cache hits)\n",
+        prog->name, (unsigned long long)systems[2].blocks.num_hits);
+    return 0;
+}
+
+/*
+    image: writes paper tape, raw program and ROM image files into DIR,
+    checks the decoded RAM page and the first/end addresses of a paper
+    tape and of a raw program at two load addresses, and that a paper
+    tape with a checksum error, without end record, or with data at or
+    behind 0400 isn't acquired. Acquiring an image again must return the
+    same entry with an incremented reference count (but not with another
+    type or load address), releasing the last reference frees the entry.
+    Instances with kim1_desc_t.share_images must run from the mapped
+    images in each tier like instances with copies of them, without
+    writing the images.
+*/
+/*
+    0200 A9 42      LDA #$42
+    0202 85 10      STA $10
+    0204 E6 11      INC $11
+    0206 4C 04 02   JMP $0204
+*/
+static const uint8_t prog_image[] = {
+    0xA9, 0x42, 0x85, 0x10, 0xE6, 0x11, 0x4C, 0x04, 0x02,
+};
+static kim1_images_t images;
+static uint8_t ptp_ram[KIM1_IMAGE_RAM_SIZE];
+static uint8_t raw_ram[KIM1_IMAGE_RAM_SIZE];
+static uint8_t image_rom[0x0400];
+static char image_ptp[1024];
+static char image_bad[1024];
+static kim1_t image_ref;
+static kim1_t image_snapshot;
+
+static bool write_file(const char* path, const void* data, size_t size) {
+    FILE* fp = fopen(path, "wb");
+    if (0 == fp) {
+        fprintf(stderr, "image: can't write %s\n", path);
+        return false;
+    }
+    const bool ok = (fwrite(data, 1, size, fp) == size);
+    return (0 == fclose(fp)) && ok;
+}
+
+// append a paper tape record (with the CR, LF and NUL padding which the monitor punches behind it), returns the new length
+static size_t ptp_record(char* dst, size_t len, uint16_t addr, const uint8_t* data, int count) {
+    uint16_t sum = (uint16_t)(count + (addr >> 8) + (addr & 0xFF));
+    len += (size_t)sprintf(&dst[len], ";%02X%04X", count, addr);
+    for (int i = 0; i < count; i++) {
+        len += (size_t)sprintf(&dst[len], "%02X", data[i]);
+        sum += data[i];
+    }
+    len += (size_t)sprintf(&dst[len], "%04X\r\n", sum);
+    memset(&dst[len], 0, 6);
+    return len + 6;
+}
+
+static size_t ptp_end(char* dst, size_t len, int num_records) {
+    return len + (size_t)sprintf(&dst[len], ";00%04X%04X\r\n", num_records, num_records);
+}
+
+static int num_acquired(void) {
+    int num = 0;
+    for (int i = 0; i < KIM1_IMAGE_MAX_IMAGES; i++) {
+        if (images.images[i].refs > 0) {
+            num++;
+        }
+    }
+    return num;
+}
+
+static bool check_program(const char* what, const kim1_image_t* img, const uint8_t* ram, uint16_t first_addr, uint16_t end_addr) {
+    if (0 == img) {
+        fprintf(stderr, "image: %s wasn't acquired\n", what);
+        return false;
+    }
+    if ((img->first_addr != first_addr) || (img->end_addr != end_addr) || (img->ram.size != KIM1_IMAGE_RAM_SIZE) ||
+        (0 != memcmp(img->ram.ptr, ram, KIM1_IMAGE_RAM_SIZE)))
+    {
+        fprintf(stderr, "image: %s decoded to %04X..%04X, expected %04X..%04X\n",
+            what, img->first_addr, img->end_addr, first_addr, end_addr);
+        return false;
+    }
+    return true;
+}
+
+// a broken paper tape must neither be acquired nor leave an entry behind
+static bool check_bad_ptp(const char* what, const char* path, size_t len) {
+    const int num = num_acquired();
+    if (!write_file(path, image_bad, len)) {
+        return false;
+    }
+    if ((0 != kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = path, .type = KIM1_IMAGE_PTP })) || (num_acquired() != num)) {
+        fprintf(stderr, "image: paper tape with %s was acquired\n", what);
+        return false;
+    }
+    return true;
+}
+
+static int test_image_shared(const kim1_image_t* prog, const kim1_image_t* rom) {
+    for (int t = 0; t < NUM_TIERS; t++) {
+        kim1_desc_t desc = {
+            .instr_stepped = tiers[t].instr_stepped,
+            .block_cache = tiers[t].block_cache,
+            .idle_skip = tiers[t].idle_skip,
+            .roms = { .rom_002 = rom->data },
+            .ram = prog->ram,
+        };
+        kim1_init(&image_ref, &desc);
+        desc.share_images = true;
+        kim1_t* sys = &systems[t];
+        kim1_init(sys, &desc);
+        #if !defined(MEM_FLAT)
+        if ((mem_readptr(&sys->mem, 0x1C00) != (uint8_t*)rom->data.ptr) ||
+            (mem_readptr(&sys->mem, 0x0200) != (uint8_t*)prog->ram.ptr + 0x0200))
+        {
+            fprintf(stderr, "image: %s: the images aren't mapped into the instance\n", tiers[t].name);
+            return 1;
+        }
+        #endif
+        for (int frame = 0; frame < TEST_FORK_FRAMES; frame++) {
+            kim1_exec(&image_ref, TEST_FRAME_US);
+            kim1_exec(sys, TEST_FRAME_US);
+        }
+        // the instance's RAM may still be the image, so it's compared through a (self-contained) snapshot
+        kim1_save_snapshot(sys, &image_snapshot);
+        if (!check_same(tiers[t].name, &image_ref, &image_snapshot) || (image_snapshot.ram[0x10] != 0x42)) {
+            fprintf(stderr, "image: %s: the instance with shared images differs from the one with copies\n", tiers[t].name);
+            return 1;
+        }
+        kim1_discard(sys);
+        kim1_discard(&image_ref);
+        if (0 != memcmp(prog->ram.ptr, ptp_ram, KIM1_IMAGE_RAM_SIZE)) {
+            fprintf(stderr, "image: %s: the shared RAM image was written\n", tiers[t].name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_image(const char* dir) {
+    static const uint8_t tail[0x10] = {
+        0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+    };
+    static const uint8_t nops[2] = { 0xEA, 0xEA };
+    char ptp_path[512], bad_path[512], raw_path[512], rom_path[512];
+    snprintf(ptp_path, sizeof(ptp_path), "%s/kim1_test_image.ptp", dir);
+    snprintf(bad_path, sizeof(bad_path), "%s/kim1_test_bad.ptp", dir);
+    snprintf(raw_path, sizeof(raw_path), "%s/kim1_test_image.bin", dir);
+    snprintf(rom_path, sizeof(rom_path), "%s/kim1_test_rom_002.bin", dir);
+    kim1_images_init(&images);
+
+    // the program, and a record which ends at the end of the RAM
+    size_t len = ptp_record(image_ptp, 0, 0x0200, prog_image, sizeof(prog_image));
+    len = ptp_record(image_ptp, len, 0x03F0, tail, sizeof(tail));
+    const size_t ptp_len = ptp_end(image_ptp, len, 2);
+    memcpy(&ptp_ram[0x0200], prog_image, sizeof(prog_image));
+    memcpy(&ptp_ram[0x03F0], tail, sizeof(tail));
+    if (!write_file(ptp_path, image_ptp, ptp_len)) {
+        return 1;
+    }
+    const kim1_image_t* ptp = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = ptp_path, .type = KIM1_IMAGE_PTP });
+    if (!check_program("paper tape", ptp, ptp_ram, 0x0200, 0x0400)) {
+        return 1;
+    }
+
+    // the last checksum digit of the first record
+    memcpy(image_bad, image_ptp, ptp_len);
+    const size_t chk = 1 + 2 * (3 + sizeof(prog_image) + 2) - 1;
+    image_bad[chk] = (image_bad[chk] == '0') ? '1' : '0';
+    if (!check_bad_ptp("a checksum error", bad_path, ptp_len)) {
+        return 1;
+    }
+    memcpy(image_bad, image_ptp, len);
+    if (!check_bad_ptp("no end record", bad_path, len)) {
+        return 1;
+    }
+    if (!check_bad_ptp("data across 0400", bad_path, ptp_end(image_bad, ptp_record(image_bad, 0, 0x03FF, nops, 2), 1))) {
+        return 1;
+    }
+    if (!check_bad_ptp("data at 0400", bad_path, ptp_end(image_bad, ptp_record(image_bad, 0, 0x0400, nops, 1), 1))) {
+        return 1;
+    }
+    remove(bad_path);
+    if (0 != kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = bad_path, .type = KIM1_IMAGE_PTP })) {
+        fprintf(stderr, "image: a missing file was acquired\n");
+        return 1;
+    }
+
+    // a raw program at two load addresses, and one which doesn't fit
+    if (!write_file(raw_path, prog_image, sizeof(prog_image))) {
+        return 1;
+    }
+    memcpy(&raw_ram[0x0300], prog_image, sizeof(prog_image));
+    const kim1_image_t* raw_300 = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = raw_path, .type = KIM1_IMAGE_RAW, .load_addr = 0x0300 });
+    if (!check_program("raw program at 0300", raw_300, raw_ram, 0x0300, 0x0309)) {
+        return 1;
+    }
+    memset(raw_ram, 0, sizeof(raw_ram));
+    memcpy(&raw_ram[0x0200], prog_image, sizeof(prog_image));
+    const kim1_image_t* raw = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = raw_path, .type = KIM1_IMAGE_RAW, .load_addr = 0x0200 });
+    if (!check_program("raw program at 0200", raw, raw_ram, 0x0200, 0x0209) || (raw == raw_300)) {
+        fprintf(stderr, "image: the raw program at 0200 isn't a separate entry\n");
+        return 1;
+    }
+    if (0 != kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = raw_path, .type = KIM1_IMAGE_RAW, .load_addr = 0x03FC })) {
+        fprintf(stderr, "image: a raw program across 0400 was acquired\n");
+        return 1;
+    }
+
+    // the same images again, and the paper tape as plain file
+    const kim1_image_t* ptp_2 = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = ptp_path, .type = KIM1_IMAGE_PTP });
+    const kim1_image_t* raw_2 = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = raw_path, .type = KIM1_IMAGE_RAW, .load_addr = 0x0200 });
+    const kim1_image_t* file = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = ptp_path });
+    if ((ptp_2 != ptp) || (ptp->refs != 2) || (raw_2 != raw) || (raw->refs != 2) || (num_acquired() != 4)) {
+        fprintf(stderr, "image: acquired images were opened again (%d entries)\n", num_acquired());
+        return 1;
+    }
+    if ((0 == file) || (file == ptp) || (file->refs != 1) || (0 != file->ram.ptr) ||
+        (file->data.size != ptp_len) || (0 != memcmp(file->data.ptr, image_ptp, ptp_len)))
+    {
+        fprintf(stderr, "image: the paper tape as file isn't a separate undecoded entry\n");
+        return 1;
+    }
+    kim1_image_release(&images, ptp_2);
+    kim1_image_release(&images, raw_300);
+    kim1_image_release(&images, file);
+    kim1_image_release(&images, raw_2);
+    if ((ptp->refs != 1) || (raw->refs != 1) || (raw_300->refs != 0) || (0 != raw_300->ram.ptr) ||
+        (file->refs != 0) || (0 != file->data.ptr) || (num_acquired() != 2) ||
+        !check_program("paper tape after release", ptp, ptp_ram, 0x0200, 0x0400))
+    {
+        fprintf(stderr, "image: wrong reference counts after release\n");
+        return 1;
+    }
+    kim1_image_release(&images, raw);
+
+    // a ROM image with the reset vector at 0200
+    memset(image_rom, 0xFF, sizeof(image_rom));
+    image_rom[0x3FC] = 0x00;
+    image_rom[0x3FD] = 0x02;
+    if (!write_file(rom_path, image_rom, sizeof(image_rom))) {
+        return 1;
+    }
+    const kim1_image_t* rom = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = rom_path });
+    if ((0 == rom) || (rom->data.size != sizeof(image_rom)) || (0 != memcmp(rom->data.ptr, image_rom, sizeof(image_rom)))) {
+        fprintf(stderr, "image: ROM image wasn't acquired\n");
+        return 1;
+    }
+    const int res = test_image_shared(ptp, rom);
+    if (0 != res) {
+        return res;
+    }
+    kim1_image_release(&images, rom);
+    kim1_image_release(&images, ptp);
+    if (0 != num_acquired()) {
+        fprintf(stderr, "image: %d entries left after releasing all images\n", num_acquired());
+        return 1;
+    }
+    kim1_images_discard(&images);
+    remove(ptp_path);
+    remove(raw_path);
+    remove(rom_path);
+    printf("image: paper tape and raw programs decoded, broken paper tapes rejected, shared images identical to copies\n");
+    return 0;
+}
+
+/*
+    batch: runs jobs which count down a loop counter from a per-job start
+    value and end in a 'JMP *', some of them with too few ticks, with
+    kim1_batch_run() on 1, 4 and more threads than jobs. The results must
+    be in job order and identical to kim1_batch_run_job() on the main
+    thread, and the summary must count the trapped and timed out jobs.
+    The longest jobs come first, so that the other workers steal them.
+*/
+/*
+    0200 A2 nn      LDX #nn         ; the per-job loop count
+    0202 A0 00      LDY #$00
+    0204 88         DEY
+    0205 D0 FD      BNE $0204
+    0207 CA         DEX
+    0208 86 10      STX $10
+    020A D0 F6      BNE $0202
+    020C 4C 0C 02   JMP $020C
+*/
+static const uint8_t prog_batch[] = {
+    0xA2, 0x00, 0xA0, 0x00, 0x88, 0xD0, 0xFD, 0xCA, 0x86, 0x10, 0xD0, 0xF6, 0x4C, 0x0C, 0x02,
+};
+static uint8_t batch_code[TEST_BATCH_JOBS][sizeof(prog_batch)];
+static kim1_batch_job_t batch_jobs[TEST_BATCH_JOBS];
+static kim1_batch_result_t batch_ref[TEST_BATCH_JOBS];
+static kim1_batch_result_t batch_results[TEST_BATCH_JOBS];
+
+static int test_batch(void) {
+    int num_trapped = 0;
+    uint64_t total_ticks = 0;
+    for (int i = 0; i < TEST_BATCH_JOBS; i++) {
+        // every third job times out in the middle of the loop
+        const bool timeout = (i % 3) == 1;
+        memcpy(batch_code[i], prog_batch, sizeof(prog_batch));
+        batch_code[i][1] = (uint8_t)(TEST_BATCH_JOBS + 1 - i);
+        batch_jobs[i] = (kim1_batch_job_t){
+            .program = { .ptr = batch_code[i], .size = sizeof(prog_batch) },
+            .load_addr = 0x0200,
+            .start_addr = 0x0200,
+            .max_ticks = timeout ? (uint64_t)(TEST_BATCH_JOBS - i) * 1000 + 333 : TEST_BATCH_MAX_TICKS,
+        };
+        kim1_batch_run_job(&batch_jobs[i], &batch_ref[i]);
+        const kim1_batch_result_t* ref = &batch_ref[i];
+        const bool trapped = (ref->status == KIM1_BATCH_TRAPPED) && (ref->pc == 0x020C) && (ref->x == 0);
+        if ((timeout && ((ref->status != KIM1_BATCH_TIMEOUT) || (ref->ticks < batch_jobs[i].max_ticks))) || (!timeout && !trapped)) {
+            fprintf(stderr, "batch: job %d: status %d at %04X after %llu ticks\n",
+                i, ref->status, ref->pc, (unsigned long long)ref->ticks);
+            return 1;
+        }
+        num_trapped += trapped ? 1 : 0;
+        total_ticks += ref->ticks;
+    }
+    static const int num_threads[] = { 1, 4, 2 * TEST_BATCH_JOBS };
+    for (int n = 0; n < (int)(sizeof(num_threads) / sizeof(num_threads[0])); n++) {
+        memset(batch_results, 0xFF, sizeof(batch_results));
+        const kim1_batch_summary_t summary = kim1_batch_run(&(kim1_batch_desc_t){
+            .jobs = batch_jobs,
+            .results = batch_results,
+            .num_jobs = TEST_BATCH_JOBS,
+            .num_threads = num_threads[n],
+        });
+        for (int i = 0; i < TEST_BATCH_JOBS; i++) {
+            const kim1_batch_result_t* res = &batch_results[i];
+            const kim1_batch_result_t* ref = &batch_ref[i];
+            if ((res->status != ref->status) || (res->ticks != ref->ticks) || (res->pc != ref->pc) ||
+                (res->a != ref->a) || (res->x != ref->x) || (res->y != ref->y) || (res->s != ref->s) || (res->p != ref->p) ||
+                (res->ram_hash != ref->ram_hash))
+            {
+                fprintf(stderr, "batch: %d threads: job %d: status %d at %04X (RAM hash %08X), expected status %d at %04X (RAM hash %08X)\n",
+                    num_threads[n], i, res->status, res->pc, res->ram_hash, ref->status, ref->pc, ref->ram_hash);
+                return 1;
+            }
+        }
+        const int expected_threads = (num_threads[n] < TEST_BATCH_JOBS) ? num_threads[n] : TEST_BATCH_JOBS;
+        if ((summary.num_threads != expected_threads) || (summary.num_trapped != num_trapped) ||
+            (summary.num_timeout != (TEST_BATCH_JOBS - num_trapped)) || (summary.total_ticks != total_ticks) ||
+            (summary.num_stolen < 0) || (summary.num_stolen > TEST_BATCH_JOBS))
+        {
+            fprintf(stderr, "batch: %d threads: summary of %d threads, %d trapped, %d timed out, %llu ticks, expected %d, %d, %d, %llu\n",
+                num_threads[n], summary.num_threads, summary.num_trapped, summary.num_timeout, (unsigned long long)summary.total_ticks,
+                expected_threads, num_trapped, TEST_BATCH_JOBS - num_trapped, (unsigned long long)total_ticks);
+            return 1;
+        }
+        printf("batch: %d threads: %d jobs identical to single jobs (%d trapped, %d stolen)\n",
+            summary.num_threads, TEST_BATCH_JOBS, summary.num_trapped, summary.num_stolen);
+    }
+    return 0;
+}
+
+/*
+    profile: profiles the countdown loop of the batch program with 4
+    passes and a short time in the final 'JMP *' in each tier, and checks
+    the instruction and cycle counts per address and per opcode, that
+    the instruction which was fetched before the profile was installed
+    isn't counted, and the order (by cycles, equal cycles by address)
+    and truncation of kim1_profile_hot().
+*/
+static kim1_profile_t profile;
+
+typedef struct {
+    uint16_t pc;
+    uint64_t instrs;
+    uint64_t cycles;
+} profile_expect_t;
+
+// the loop with 4 passes, hottest first, the 'JMP *' is checked separately
+static const profile_expect_t profile_loop[] = {
+    { 0x0205, 4 * 256, 4 * (255 * 3 + 2) },     // BNE, taken except at the end of each pass
+    { 0x0204, 4 * 256, 4 * 256 * 2 },           // DEY
+    { 0x0208, 4, 4 * 3 },                       // STX zp
+    { 0x020A, 4, 3 * 3 + 2 },                   // BNE, taken except at the end
+    { 0x0202, 4, 4 * 2 },                       // LDY #
+    { 0x0207, 4, 4 * 2 },                       // DEX
+};
+#define PROFILE_LOOP_ENTRIES ((int)(sizeof(profile_loop) / sizeof(profile_loop[0])))
+#define PROFILE_LOOP_CYCLES (4 * (255 * 3 + 2) + 4 * 256 * 2 + 4 * 3 + 3 * 3 + 2 + 4 * 2 + 4 * 2)
+
+static bool check_hot(const char* what, uint32_t max_entries, const kim1_profile_hot_t* expected, uint32_t num_expected) {
+    kim1_profile_hot_t hot[16];
+    const uint32_t num = kim1_profile_hot(&profile, hot, max_entries);
+    bool ok = num == num_expected;
+    for (uint32_t i = 0; ok && (i < num); i++) {
+        ok = (hot[i].pc == expected[i].pc) && (hot[i].instrs == expected[i].instrs) && (hot[i].cycles == expected[i].cycles);
+    }
+    if (!ok) {
+        fprintf(stderr, "profile: %s: kim1_profile_hot(%u) returned:\n", what, max_entries);
+        for (uint32_t i = 0; i < num; i++) {
+            fprintf(stderr, "  %04X %llu instructions, %llu cycles\n",
+                hot[i].pc, (unsigned long long)hot[i].instrs, (unsigned long long)hot[i].cycles);
+        }
+    }
+    return ok;
+}
+
+static int test_profile(const program_t* prog) {
+    kim1_breakpoints_t bp_head;
+    kim1_breakpoints_init(&bp_head);
+    kim1_add_breakpoint(&bp_head, 0x0200);
+    for (int t = 0; t < NUM_TIERS; t++) {
+        kim1_t* sys = &systems[t];
+        const char* what = tiers[t].name;
+        init_system(sys, &tiers[t], prog);
+        mem_wr(&sys->mem, 0x0201, 4);
+        if (kim1_run_until(sys, &bp_head, 100).reason != KIM1_STOP_BREAKPOINT) {
+            fprintf(stderr, "profile: %s: the program didn't start\n", what);
+            return 1;
+        }
+        const uint64_t start_tick = sys->ticks;
+        kim1_profile_reset(&profile);
+        kim1_set_profile(sys, &profile);
+        kim1_exec(sys, PROFILE_LOOP_CYCLES + 300);
+        kim1_set_profile(sys, 0);
+
+        uint64_t sum_instrs = 0, sum_cycles = 0;
+        for (uint32_t pc = 0; pc < 0x10000; pc++) {
+            sum_instrs += profile.pc_instrs[pc];
+            sum_cycles += profile.pc_cycles[pc];
+        }
+        // the JMP * runs until the end of the time slice, the LDX # (2 cycles) before it isn't counted
+        const uint64_t jmp_instrs = profile.pc_instrs[0x020C];
+        if ((sum_instrs != profile.num_instrs) || (sum_cycles != profile.num_cycles) ||
+            ((profile.num_cycles + 2) != (profile.last_tick - start_tick)) || (profile.pc_instrs[0x0200] != 0) ||
+            (profile.pc_cycles[0x020C] != 3 * jmp_instrs) || (jmp_instrs < 99) || (jmp_instrs > 101))
+        {
+            fprintf(stderr, "profile: %s: %llu instructions and %llu cycles in %llu ticks, %llu JMP instructions\n",
+                what, (unsigned long long)profile.num_instrs, (unsigned long long)profile.num_cycles,
+                (unsigned long long)(profile.last_tick - start_tick), (unsigned long long)jmp_instrs);
+            return 1;
+        }
+        for (int i = 0; i < PROFILE_LOOP_ENTRIES; i++) {
+            const profile_expect_t* e = &profile_loop[i];
+            if ((profile.pc_instrs[e->pc] != e->instrs) || (profile.pc_cycles[e->pc] != e->cycles)) {
+                fprintf(stderr, "profile: %s: %04X has %llu instructions and %llu cycles, expected %llu and %llu\n",
+                    what, e->pc, (unsigned long long)profile.pc_instrs[e->pc], (unsigned long long)profile.pc_cycles[e->pc],
+                    (unsigned long long)e->instrs, (unsigned long long)e->cycles);
+                return 1;
+            }
+        }
+        if ((profile.op_instrs[0x88] != 4 * 256) || (profile.op_cycles[0x88] != 4 * 256 * 2) ||
+            (profile.op_instrs[0xD0] != 4 * 256 + 4) || (profile.op_cycles[0xD0] != 4 * (255 * 3 + 2) + 3 * 3 + 2) ||
+            (profile.op_instrs[0x4C] != jmp_instrs) || (profile.op_instrs[0xA2] != 0))
+        {
+            fprintf(stderr, "profile: %s: wrong per-opcode counts\n", what);
+            return 1;
+        }
+
+        // the two hottest loop addresses, the JMP *, then the rest of the loop
+        kim1_profile_hot_t expected[PROFILE_LOOP_ENTRIES + 1];
+        for (int i = 0, j = 0; i < PROFILE_LOOP_ENTRIES + 1; i++) {
+            if (i == 2) {
+                expected[i] = (kim1_profile_hot_t){ .pc = 0x020C, .instrs = jmp_instrs, .cycles = 3 * jmp_instrs };
+            }
+            else {
+                expected[i] = (kim1_profile_hot_t){ .pc = profile_loop[j].pc, .instrs = profile_loop[j].instrs, .cycles = profile_loop[j].cycles };
+                j++;
+            }
+        }
+        if (!check_hot(what, 16, expected, PROFILE_LOOP_ENTRIES + 1) ||
+            !check_hot(what, 3, expected, 3) ||
+            !check_hot(what, 6, expected, 6) ||
+            !check_hot(what, 0, expected, 0))
+        {
+            return 1;
+        }
+    }
+    printf("profile: %s: per-address and per-opcode counts and hot spots identical in all tiers\n", prog->name);
+    return 0;
+}
+
+static bool load_rom(const char* path, chips_range_t* out) {
+    static uint8_t roms[2][0x0400];
+    uint8_t* ptr = roms[(out == &rom_002) ? 0 : 1];
+    FILE* fp = fopen(path, "rb");
+    if (0 == fp) {
+        return false;
+    }
+    const size_t size = fread(ptr, 1, 0x0400, fp);
+    fclose(fp);
+    *out = (chips_range_t){ .ptr = ptr, .size = size };
+    return size == 0x0400;
+}
+
+int main(int argc, char* argv[]) {
+    init_fake_roms();
+    kim1_breakpoints_init(&bp_all);
+    for (uint32_t addr = 0; addr < 0x2000; addr++) {
+        kim1_add_breakpoint(&bp_all, (uint16_t)addr);
+    }
+    if ((argc == 4) && (0 == strcmp(argv[1], "monitor"))) {
+        if (!load_rom(argv[2], &rom_002) || !load_rom(argv[3], &rom_003)) {
+            printf("monitor: ROM images not found, skipped\n");
+            return TEST_SKIPPED;
+        }
+        // one key every 100 ms, held for 50 ms
+        for (int i = 0; i < MONITOR_NUM_KEYS; i++) {
+            const uint64_t tick = 500000 + (uint64_t)i * 100000;
+            keys_monitor[2 * i] = (key_event_t){ tick, monitor_key_seq[i], true };
+            keys_monitor[2 * i + 1] = (key_event_t){ tick + 50000, monitor_key_seq[i], false };
+        }
+        const program_t prog = { .name = "monitor", .keys = keys_monitor, .num_keys = 2 * MONITOR_NUM_KEYS };
+        const int res = test_trace(&prog);
+        return (0 != res) ? res : test_run(&prog);
+    }
+    if ((argc == 3) && ((0 == strcmp(argv[1], "trace")) || (0 == strcmp(argv[1], "run")) || (0 == strcmp(argv[1], "lockstep")))) {
+        program_t prog;
+        if (0 == strcmp(argv[2], "scan")) {
+            prog = (program_t){ .name = "scan", .code = prog_scan, .code_size = sizeof(prog_scan),
+                .keys = keys_scan, .num_keys = (int)(sizeof(keys_scan) / sizeof(keys_scan[0])),
+                .init_lane = init_lane_scan };
+        }
+        else if (0 == strcmp(argv[2], "timer")) {
+            prog = (program_t){ .name = "timer", .code = prog_timer, .code_size = sizeof(prog_timer), .irq_addr = 0x0280,
+                .init_lane = init_lane_timer };
+        }
+        else if (0 == strcmp(argv[2], "tty")) {
+            prog = (program_t){ .name = "tty", .code = prog_tty, .code_size = sizeof(prog_tty), .tty_trap = true,
+                .init_lane = init_lane_tty };
+        }
+        else if (0 == strcmp(argv[2], "modes")) {
+            prog = (program_t){ .name = "modes", .code = prog_modes, .code_size = sizeof(prog_modes),
+                .init_lane = init_lane_modes };
+        }
+        else {
+            fprintf(stderr, "unknown program %s\n", argv[2]);
+            return 1;
+        }
+        if (0 == strcmp(argv[1], "lockstep")) {
+            // all lanes, and a partial set
+            const int res = test_lockstep(&prog, KIM1_LOCKSTEP_MAX_LANES);
+            return (0 != res) ? res : test_lockstep(&prog, 5);
+        }
+        return (0 == strcmp(argv[1], "trace")) ? test_trace(&prog) : test_run(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "replay"))) {
+        // the scan program reads the teletype receive line (PA7) with the keypad
+        const program_t prog = { .name = "scan", .code = prog_scan, .code_size = sizeof(prog_scan), .tty = true };
+        return test_replay(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "rewind"))) {
+        const program_t prog = { .name = "timer", .code = prog_timer, .code_size = sizeof(prog_timer), .irq_addr = 0x0280 };
+        return test_rewind(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "snapshot"))) {
+        const program_t prog = { .name = "timer", .code = prog_timer, .code_size = sizeof(prog_timer), .irq_addr = 0x0280 };
+        return test_snapshot(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "fork"))) {
+        const program_t prog = { .name = "timer", .code = prog_timer, .code_size = sizeof(prog_timer), .irq_addr = 0x0280 };
+        return test_fork(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "teletype"))) {
+        return test_teletype();
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "tape"))) {
+        const program_t prog = { .name = "tape", .code = prog_tape, .code_size = sizeof(prog_tape), .tape_trap = true };
+        return test_tape(&prog);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "idle"))) {
+        const program_t tty = { .name = "tty", .code = prog_tty, .code_size = sizeof(prog_tty), .tty_trap = true,
+            .init_lane = init_lane_tty };
+        const program_t edges = { .name = "edges", .code = prog_edges, .code_size = sizeof(prog_edges), .tty = true };
+        const int res = test_idle(&tty, false);
+        return (0 != res) ? res : test_idle(&edges, true);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "watch"))) {
+        const program_t prog = { .name = "smc", .code = prog_smc, .code_size = sizeof(prog_smc) };
+        return test_watch(&prog);
+    }
+    if ((argc == 3) && (0 == strcmp(argv[1], "image"))) {
+        return test_image(argv[2]);
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "batch"))) {
+        return test_batch();
+    }
+    if ((argc == 2) && (0 == strcmp(argv[1], "profile"))) {
+        const program_t prog = { .name = "countdown", .code = prog_batch, .code_size = sizeof(prog_batch) };
+        return test_profile(&prog);
+    }
+    fprintf(stderr, "usage: kim1_test trace PROGRAM | run PROGRAM | lockstep PROGRAM | replay | rewind | snapshot | fork | teletype | tape | idle | watch | image DIR | batch | profile | monitor ROM_002 ROM_003\n");
+    return 1;
+}
@@ -0,0 +1,465 @@
+/*
+    m6502_test: conformance and differential tests for the three m6502
+    execution tiers, m6502_tick() (the reference), m6502_exec_instr() and
+    m6502_exec_block()
+
+    Usage:
+
+        m6502_test decimal
+        m6502_test opcodes SHARD NUM_SHARDS
+        m6502_test program FILE [LOAD [START [SUCCESS]]]
+
+    decimal: all decimal mode ADC and SBC combinations of A, operand and
+    carry (like Bruce Clark's decimal test), the accumulator and the N, V,
+    Z and C flags are checked against a reference model of the NMOS 6502
+    in each tier.
+
+    opcodes: executes each opcode (but the JAMs) from many pseudo-random
+    CPU and memory states in all tiers and compares the registers, the
+    pin mask, the number of cycles and the written memory. The opcodes
+    are split into shards (opcode % NUM_SHARDS == SHARD), so that ctest
+    can run them in parallel.
+
+    program: runs a self-checking 6502 test program like Klaus Dormann's
+    6502_functional_test.bin in all tiers in lockstep, comparing the state
+    after each basic block of m6502_exec_block(), until the program is
+    caught in a trap (a jump or branch to itself), which must be at the
+    SUCCESS address. The addresses are hex, the defaults are the ones of
+    the standard 6502_functional_test.bin build (load at 0000, start at
+    0400, success at 3469). Afterwards each tier runs the program alone,
+    and the emulated clock frequency of each tier is reported.
+
+    The exit code is 0 if the test passed, 1 if it failed, and 77 (the
+    ctest SKIP_RETURN_CODE) if FILE doesn't exist.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/clk.h"
+
+#define TEST_SKIPPED (77)
+#define TEST_OPCODE_TRIALS (2000)
+#define TEST_MAX_CYCLES (200000000ULL)
+// in the lockstep mode, the whole memory is compared after this many blocks
+#define TEST_MEM_CHECK_BLOCKS (1<<16)
+// with MEM_FLAT, all mem_t instances must be in flat mode
+#if defined(MEM_FLAT)
+#define TEST_FLAT_ONLY (true)
+#else
+#define TEST_FLAT_ONLY (false)
+#endif
+
+typedef enum {
+    TIER_TICK,
+    TIER_INSTR,
+    TIER_BLOCK,
+    NUM_TIERS,
+} tier_t;
+
+static const char* tier_names[NUM_TIERS] = { "m6502_tick", "m6502_exec_instr", "m6502_exec_block" };
+
+// a CPU with 64 KB of RAM, the instruction-stepped tiers run on flat memory, m6502_tick() on paged memory (but with MEM_FLAT)
+typedef struct {
+    tier_t tier;
+    m6502_t cpu;
+    uint64_t pins;
+    uint64_t ticks;
+    mem_t mem;
+    m6502_bus_t bus;
+    m6502_block_cache_t blocks;
+    uint8_t ram[1<<16];
+} machine_t;
+
+static machine_t machines[NUM_TIERS];
+static uint8_t image[1<<16];
+static m6502_t reset_cpu;
+
+static void machine_init(machine_t* m, tier_t tier, const uint8_t* ram) {
+    m->tier = tier;
+    memcpy(m->ram, ram, sizeof(m->ram));
+    mem_init(&m->mem);
+    mem_map_ram(&m->mem, 0, 0x0000, 0x10000, m->ram);
+    if ((tier != TIER_TICK) || TEST_FLAT_ONLY) {
+        mem_set_flat(&m->mem, m->ram, 0x10000);
+    }
+    m->bus = (m6502_bus_t){ .mem = &m->mem };
+    m6502_block_cache_init(&m->blocks, 0xFFFF, ~0ULL);
+    m->cpu = reset_cpu;
+    m->pins = 0;
+    m->ticks = 0;
+}
+
+// jump to an address like trap code does (see m6502.h), which leaves the pins at the opcode fetch
+static void machine_goto(machine_t* m, uint16_t pc) {
+    m->pins = M6502_SYNC | M6502_RW;
+    M6502_SET_ADDR(m->pins, pc);
+    M6502_SET_DATA(m->pins, mem_rd(&m->mem, pc));
+    m6502_set_pc(&m->cpu, pc);
+}
+
+// write a byte from the host, the block cache must see it
+static void machine_poke(machine_t* m, uint16_t addr, uint8_t data) {
+    m->ram[addr] = data;
+    m6502_block_cache_invalidate(&m->blocks, addr, 1);
+}
+
+static uint64_t machine_tick(machine_t* m, uint64_t pins) {
+    pins = m6502_tick(&m->cpu, pins);
+    const uint16_t addr = M6502_GET_ADDR(pins);
+    if (pins & M6502_RW) {
+        M6502_SET_DATA(pins, mem_rd(&m->mem, addr));
+    }
+    else {
+        mem_wr(&m->mem, addr, M6502_GET_DATA(pins));
+    }
+    return pins;
+}
+
+// run a single instruction (or with the block cache, a basic block up to end_tick), returns number of instructions
+static uint32_t machine_step(machine_t* m, uint64_t end_tick) {
+    switch (m->tier) {
+        case TIER_TICK:
+            do {
+                m->pins = machine_tick(m, m->pins);
+                m->ticks++;
+            } while (0 == (m->pins & M6502_SYNC));
+            return 1;
+        case TIER_INSTR:
+            m->ticks += m6502_exec_instr(&m->cpu, &m->bus, &m->pins);
+            return 1;
+        default:
+            return m6502_exec_block(&m->cpu, &m->blocks, &m->bus, &m->pins, &m->ticks, end_tick);
+    }
+}
+
+static void print_state(const machine_t* m) {
+    const m6502_t* c = &m->cpu;
+    fprintf(stderr, "  %-17s ticks=%llu pc=%04X a=%02X x=%02X y=%02X s=%02X p=%02X pins=%016llX\n",
+        tier_names[m->tier], (unsigned long long)m->ticks, M6502_GET_ADDR(m->pins),
+        c->A, c->X, c->Y, c->S, c->P, (unsigned long long)m->pins);
+}
+
+static bool same_state(const machine_t* a, const machine_t* b) {
+    return (a->ticks == b->ticks) && (a->pins == b->pins) &&
+           (a->cpu.A == b->cpu.A) && (a->cpu.X == b->cpu.X) && (a->cpu.Y == b->cpu.Y) &&
+           (a->cpu.S == b->cpu.S) && (a->cpu.P == b->cpu.P);
+}
+
+// compare the registers of all tiers with the reference
+static bool check_states(const char* what) {
+    for (int i = 1; i < NUM_TIERS; i++) {
+        if (!same_state(&machines[TIER_TICK], &machines[i])) {
+            fprintf(stderr, "%s: %s differs from %s\n", what, tier_names[i], tier_names[TIER_TICK]);
+            print_state(&machines[TIER_TICK]);
+            print_state(&machines[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_memory(const char* what) {
+    for (int i = 1; i < NUM_TIERS; i++) {
+        for (uint32_t addr = 0; addr < 0x10000; addr++) {
+            if (machines[i].ram[addr] != machines[TIER_TICK].ram[addr]) {
+                fprintf(stderr, "%s: %s memory differs at %04X: %02X (expected %02X)\n",
+                    what, tier_names[i], addr, machines[i].ram[addr], machines[TIER_TICK].ram[addr]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static uint32_t lcg_state = 1;
+static uint8_t rnd8(void) {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return (uint8_t)(lcg_state >> 24);
+}
+
+/*== decimal mode ============================================================*/
+
+// NMOS decimal ADC, from "Decimal Mode" by Bruce Clark, Appendix A, returns (NVZC flags<<8)|result
+static uint16_t ref_adc(uint8_t a, uint8_t b, uint8_t c) {
+    int al = (a & 0x0F) + (b & 0x0F) + c;
+    if (al >= 0x0A) {
+        al = ((al + 0x06) & 0x0F) + 0x10;
+    }
+    int sum = (a & 0xF0) + (b & 0xF0) + al;
+    const int ssum = (int8_t)(a & 0xF0) + (int8_t)(b & 0xF0) + al;
+    if (sum >= 0xA0) {
+        sum += 0x60;
+    }
+    uint8_t p = 0;
+    p |= (ssum & 0x80) ? M6502_NF : 0;
+    p |= ((ssum < -128) || (ssum > 127)) ? M6502_VF : 0;
+    p |= (0 == (uint8_t)(a + b + c)) ? M6502_ZF : 0;
+    p |= (sum >= 0x100) ? M6502_CF : 0;
+    return (uint16_t)((p << 8) | (uint8_t)sum);
+}
+
+// NMOS decimal SBC, the flags are the same as in binary mode
+static uint16_t ref_sbc(uint8_t a, uint8_t b, uint8_t c) {
+    int al = (a & 0x0F) - (b & 0x0F) + c - 1;
+    if (al < 0) {
+        al = ((al - 0x06) & 0x0F) - 0x10;
+    }
+    int diff = (a & 0xF0) - (b & 0xF0) + al;
+    if (diff < 0) {
+        diff -= 0x60;
+    }
+    const int bin = a - b + c - 1;
+    uint8_t p = 0;
+    p |= (bin & 0x80) ? M6502_NF : 0;
+    p |= ((a ^ b) & (a ^ bin) & 0x80) ? M6502_VF : 0;
+    p |= (0 == (uint8_t)bin) ? M6502_ZF : 0;
+    p |= (bin >= 0) ? M6502_CF : 0;
+    return (uint16_t)((p << 8) | (uint8_t)diff);
+}
+
+static int test_decimal(void) {
+    memset(image, 0xEA, sizeof(image));
+    for (int i = 0; i < NUM_TIERS; i++) {
+        machine_init(&machines[i], (tier_t)i, image);
+    }
+    uint64_t num_checks = 0;
+    const uint64_t start_ns = clk_now_ns();
+    for (int sbc = 0; sbc < 2; sbc++) {
+        for (uint32_t c = 0; c < 2; c++) {
+            for (uint32_t a = 0; a < 256; a++) {
+                for (uint32_t b = 0; b < 256; b++) {
+                    const uint16_t res = sbc ? ref_sbc(a, b, c) : ref_adc(a, b, c);
+                    for (int i = 0; i < NUM_TIERS; i++) {
+                        machine_t* m = &machines[i];
+                        machine_poke(m, 0x0200, sbc ? 0xE9 : 0x69);     // ADC/SBC #b
+                        machine_poke(m, 0x0201, (uint8_t)b);
+                        m6502_set_a(&m->cpu, (uint8_t)a);
+                        m6502_set_p(&m->cpu, M6502_DF | M6502_XF | (c ? M6502_CF : 0));
+                        machine_goto(m, 0x0200);
+                        machine_step(m, m->ticks + 1);
+                        const uint8_t flags = m->cpu.P & (M6502_NF|M6502_VF|M6502_ZF|M6502_CF);
+                        if ((m->cpu.A != (uint8_t)res) || (flags != (res >> 8))) {
+                            fprintf(stderr, "decimal %s: %s: A=%02X operand=%02X C=%u: result %02X flags %02X (expected %02X flags %02X)\n",
+                                sbc ? "SBC" : "ADC", tier_names[i], a, b, c, m->cpu.A, flags, (uint8_t)res, res >> 8);
+                            return 1;
+                        }
+                        num_checks++;
+                    }
+                }
+            }
+        }
+    }
+    const double seconds = (double)(clk_now_ns() - start_ns) * 1e-9;
+    printf("decimal: %llu ADC/SBC results correct in %.3f seconds\n", (unsigned long long)num_checks, seconds);
+    return 0;
+}
+
+/*== opcodes =================================================================*/
+
+static bool is_jam(uint8_t op) {
+    return ((op & 0x0F) == 0x02) && (op != 0x82) && (op != 0xA2) && (op != 0xC2) && (op != 0xE2);
+}
+
+// compare the 64-byte lines any tier has written to, and bring the tiers back to the same memory
+static bool check_written(uint8_t op, uint32_t trial) {
+    bool ok = true;
+    for (uint32_t addr = 0; addr < 0x10000; addr += MEM_DIRTY_LINE_SIZE) {
+        bool dirty = false;
+        for (int i = 0; i < NUM_TIERS; i++) {
+            dirty |= mem_is_dirty(&machines[i].mem, (uint16_t)addr, MEM_DIRTY_LINE_SIZE);
+        }
+        if (!dirty) {
+            continue;
+        }
+        const uint8_t* ref = &machines[TIER_TICK].ram[addr];
+        for (int i = 1; i < NUM_TIERS; i++) {
+            if (ok && (0 != memcmp(&machines[i].ram[addr], ref, MEM_DIRTY_LINE_SIZE))) {
+                fprintf(stderr, "opcode %02X trial %u: %s memory differs in %04X..%04X\n",
+                    op, trial, tier_names[i], addr, addr + MEM_DIRTY_LINE_SIZE - 1);
+                ok = false;
+            }
+            memcpy(&machines[i].ram[addr], ref, MEM_DIRTY_LINE_SIZE);
+            m6502_block_cache_invalidate(&machines[i].blocks, (uint16_t)addr, MEM_DIRTY_LINE_SIZE);
+        }
+    }
+    for (int i = 0; i < NUM_TIERS; i++) {
+        mem_clear_dirty(&machines[i].mem, 0, MEM_ADDR_RANGE);
+    }
+    return ok;
+}
+
+static int test_opcodes(uint32_t shard, uint32_t num_shards) {
+    lcg_state = 1 + shard;
+    for (uint32_t i = 0; i < sizeof(image); i++) {
+        image[i] = rnd8();
+    }
+    for (int i = 0; i < NUM_TIERS; i++) {
+        machine_init(&machines[i], (tier_t)i, image);
+        mem_set_write_tracking(&machines[i].mem, true);
+    }
+    uint32_t num_ops = 0;
+    uint64_t num_cycles = 0;
+    for (uint32_t op = shard; op < 256; op += num_shards) {
+        if (is_jam((uint8_t)op)) {
+            continue;
+        }
+        num_ops++;
+        for (uint32_t trial = 0; trial < TEST_OPCODE_TRIALS; trial++) {
+            const uint16_t pc = (uint16_t)((rnd8() << 8) | rnd8());
+            const uint8_t a = rnd8(), x = rnd8(), y = rnd8(), s = rnd8(), p = rnd8();
+            for (int i = 0; i < NUM_TIERS; i++) {
+                machine_t* m = &machines[i];
+                machine_poke(m, pc, (uint8_t)op);
+                m->cpu = reset_cpu;
+                m6502_set_a(&m->cpu, a);
+                m6502_set_x(&m->cpu, x);
+                m6502_set_y(&m->cpu, y);
+                m6502_set_s(&m->cpu, s);
+                m6502_set_p(&m->cpu, p | M6502_XF);
+                machine_goto(m, pc);
+                m->ticks = 0;
+                mem_clear_dirty(&m->mem, 0, MEM_ADDR_RANGE);
+                machine_step(m, 1);
+            }
+            char what[32];
+            snprintf(what, sizeof(what), "opcode %02X trial %u", op, trial);
+            if (!check_states(what) || !check_written((uint8_t)op, trial)) {
+                return 1;
+            }
+            num_cycles += machines[TIER_TICK].ticks;
+        }
+    }
+    printf("opcodes: shard %u/%u, %u opcodes x %u states identical in all tiers (%llu cycles)\n",
+        shard, num_shards, num_ops, TEST_OPCODE_TRIALS, (unsigned long long)num_cycles);
+    return 0;
+}
+
+/*== test programs ===========================================================*/
+
+// true if the last instruction jumped or branched to itself
+static bool is_trapped(const machine_t* m, uint16_t prev_pc) {
+    return M6502_GET_ADDR(m->pins) == prev_pc;
+}
+
+static bool load_program(const char* path, uint16_t load_addr) {
+    FILE* fp = fopen(path, "rb");
+    if (0 == fp) {
+        return false;
+    }
+    memset(image, 0, sizeof(image));
+    const size_t size = fread(&image[load_addr], 1, sizeof(image) - load_addr, fp);
+    fclose(fp);
+    printf("program: %s, %u bytes at %04X\n", path, (uint32_t)size, load_addr);
+    return true;
+}
+
+static void reset_machines(uint16_t start_addr) {
+    for (int i = 0; i < NUM_TIERS; i++) {
+        machine_init(&machines[i], (tier_t)i, image);
+        machine_goto(&machines[i], start_addr);
+    }
+}
+
+// run all tiers in lockstep, with the reference catching up after each block of the block cache tier
+static int run_lockstep(uint16_t start_addr, uint16_t success_addr) {
+    reset_machines(start_addr);
+    machine_t* blk = &machines[TIER_BLOCK];
+    uint64_t num_blocks = 0;
+    char what[64];
+    while (blk->ticks < TEST_MAX_CYCLES) {
+        const uint16_t pc = M6502_GET_ADDR(blk->pins);
+        const uint32_t num_instrs = machine_step(blk, TEST_MAX_CYCLES);
+        for (int i = 0; i < TIER_BLOCK; i++) {
+            while (machines[i].ticks < blk->ticks) {
+                machine_step(&machines[i], 0);
+            }
+        }
+        snprintf(what, sizeof(what), "block at %04X (tick %llu)", pc, (unsigned long long)blk->ticks);
+        if (!check_states(what)) {
+            return 1;
+        }
+        if ((0 == (++num_blocks % TEST_MEM_CHECK_BLOCKS)) && !check_memory(what)) {
+            return 1;
+        }
+        if ((1 == num_instrs) && is_trapped(blk, pc)) {
+            if (!check_memory(what)) {
+                return 1;
+            }
+            if (pc != success_addr) {
+                fprintf(stderr, "program: trapped at %04X after %llu cycles (success is %04X)\n",
+                    pc, (unsigned long long)blk->ticks, success_addr);
+                return 1;
+            }
+            printf("program: all tiers identical in %llu blocks, success at %04X after %llu cycles\n",
+                (unsigned long long)num_blocks, pc, (unsigned long long)blk->ticks);
+            return 0;
+        }
+    }
+    fprintf(stderr, "program: no trap after %llu cycles\n", (unsigned long long)TEST_MAX_CYCLES);
+    return 1;
+}
+
+// run each tier on its own to measure the emulated clock frequency
+static void run_timed(uint16_t start_addr) {
+    reset_machines(start_addr);
+    for (int i = 0; i < NUM_TIERS; i++) {
+        machine_t* m = &machines[i];
+        const uint64_t start_ns = clk_now_ns();
+        uint16_t pc;
+        uint32_t num_instrs;
+        do {
+            pc = M6502_GET_ADDR(m->pins);
+            num_instrs = machine_step(m, TEST_MAX_CYCLES);
+        } while (!((1 == num_instrs) && is_trapped(m, pc)) && (m->ticks < TEST_MAX_CYCLES));
+        const double seconds = (double)(clk_now_ns() - start_ns) * 1e-9;
+        printf("program: %-17s %10llu cycles %8.3f seconds %9.3f MHz\n", tier_names[i],
+            (unsigned long long)m->ticks, seconds, (double)m->ticks / (seconds * 1e6));
+    }
+}
+
+static int test_program(int argc, char* argv[]) {
+    const char* path = argv[0];
+    const uint16_t load_addr = (argc > 1) ? (uint16_t)strtoul(argv[1], 0, 16) : 0x0000;
+    const uint16_t start_addr = (argc > 2) ? (uint16_t)strtoul(argv[2], 0, 16) : 0x0400;
+    const uint16_t success_addr = (argc > 3) ? (uint16_t)strtoul(argv[3], 0, 16) : 0x3469;
+    if (!load_program(path, load_addr)) {
+        printf("program: %s not found, skipped\n", path);
+        return TEST_SKIPPED;
+    }
+    const int res = run_lockstep(start_addr, success_addr);
+    if (0 == res) {
+        run_timed(start_addr);
+    }
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    // all tiers start from a CPU which has run through the reset sequence
+    uint64_t pins = m6502_init(&reset_cpu, &(m6502_desc_t){0});
+    do {
+        pins = m6502_tick(&reset_cpu, pins);
+    } while (0 == (pins & M6502_SYNC));
+    if ((argc == 2) && (0 == strcmp(argv[1], "decimal"))) {
+        return test_decimal();
+    }
+    else if ((argc == 4) && (0 == strcmp(argv[1], "opcodes"))) {
+        const uint32_t num_shards = (uint32_t)strtoul(argv[3], 0, 10);
+        const uint32_t shard = (uint32_t)strtoul(argv[2], 0, 10);
+        if ((num_shards == 0) || (shard >= num_shards)) {
+            fprintf(stderr, "invalid shard %s/%s\n", argv[2], argv[3]);
+            return 1;
+        }
+        return test_opcodes(shard, num_shards);
+    }
+    else if ((argc >= 3) && (argc <= 6) && (0 == strcmp(argv[1], "program"))) {
+        return test_program(argc - 2, &argv[2]);
+    }
+    fprintf(stderr, "usage: m6502_test decimal | opcodes SHARD NUM_SHARDS | program FILE [LOAD [START [SUCCESS]]]\n");
+    return 1;
+}
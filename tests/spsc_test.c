@@ -0,0 +1,170 @@
+/*
+    spsc_test: two-thread stress tests for the lock-free ring buffer and
+    triple buffer in chips/spsc.h
+
+    Usage:
+
+        spsc_test ring
+        spsc_test triple
+
+    ring: a producer thread pushes sequence-numbered items through a small
+    spsc_t while a consumer thread pops them, the consumer checks that
+    every item arrives exactly once, in order and not torn (each item
+    carries its sequence number twice, once inverted). Both sides yield
+    and retry when the ring is full or empty, so the full and the empty
+    paths run often.
+
+    triple: a producer thread writes frames with an increasing frame
+    number in every word and publishes them through a spsc_triple_t, the
+    consumer checks that each frame it sees is complete (all words equal),
+    that the frame numbers never go backwards, that a fresh frame always
+    has a newer number, and that it finally sees the last frame.
+
+    The exit code is 0 if the test passed, and 1 if not.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/spsc.h"
+
+#define TEST_RING_ITEMS (2000000)
+#define TEST_RING_SIZE (64)
+#define TEST_TRIPLE_FRAMES (1000000)
+#define TEST_FRAME_WORDS (256)
+
+typedef struct {
+    uint32_t seq;
+    uint32_t inv;       // ~seq
+} item_t;
+
+static item_t ring_buf[TEST_RING_SIZE];
+static spsc_t ring;
+
+static uint32_t frames[3][TEST_FRAME_WORDS];
+static spsc_triple_t triple;
+
+static void* ring_producer(void* arg) {
+    (void)arg;
+    for (uint32_t seq = 0; seq < TEST_RING_ITEMS; seq++) {
+        const item_t item = { .seq = seq, .inv = ~seq };
+        while (!spsc_push(&ring, &item)) {
+            // full, let the consumer run (this may run on a single core)
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+static int test_ring(void) {
+    spsc_init(&ring, &(spsc_desc_t){
+        .item_size = sizeof(item_t),
+        .num_items = TEST_RING_SIZE,
+        .buffer = { .ptr = ring_buf, .size = sizeof(ring_buf) },
+    });
+    pthread_t producer;
+    if (0 != pthread_create(&producer, 0, ring_producer, 0)) {
+        fprintf(stderr, "ring: failed to start the producer thread\n");
+        return 1;
+    }
+    int res = 0;
+    uint64_t num_empty = 0;
+    for (uint32_t expected = 0; expected < TEST_RING_ITEMS; ) {
+        item_t item;
+        if (!spsc_pop(&ring, &item)) {
+            num_empty++;
+            sched_yield();
+            continue;
+        }
+        if ((item.seq != expected) || (item.inv != ~expected)) {
+            fprintf(stderr, "ring: item %u is %08X/%08X, expected %08X/%08X\n",
+                expected, item.seq, item.inv, expected, ~expected);
+            res = 1;
+            break;
+        }
+        expected++;
+    }
+    pthread_join(producer, 0);
+    if ((0 == res) && (0 != spsc_count(&ring))) {
+        fprintf(stderr, "ring: %u items left after the last one\n", spsc_count(&ring));
+        res = 1;
+    }
+    if (0 == res) {
+        printf("ring: %u items in order through a %u item ring (%llu times empty)\n",
+            TEST_RING_ITEMS, TEST_RING_SIZE, (unsigned long long)num_empty);
+    }
+    return res;
+}
+
+static void* triple_producer(void* arg) {
+    (void)arg;
+    for (uint32_t frame = 1; frame <= TEST_TRIPLE_FRAMES; frame++) {
+        uint32_t* back = (uint32_t*) spsc_triple_back(&triple);
+        for (int i = 0; i < TEST_FRAME_WORDS; i++) {
+            back[i] = frame;
+        }
+        spsc_triple_publish(&triple);
+    }
+    return 0;
+}
+
+static int test_triple(void) {
+    memset(frames, 0, sizeof(frames));
+    spsc_triple_init(&triple, frames[0], frames[1], frames[2]);
+    pthread_t producer;
+    if (0 != pthread_create(&producer, 0, triple_producer, 0)) {
+        fprintf(stderr, "triple: failed to start the producer thread\n");
+        return 1;
+    }
+    int res = 0;
+    uint32_t last = 0;
+    uint64_t num_fresh = 0;
+    while (last < TEST_TRIPLE_FRAMES) {
+        bool fresh = false;
+        const uint32_t* front = (const uint32_t*) spsc_triple_front(&triple, &fresh);
+        const uint32_t frame = front[0];
+        for (int i = 1; i < TEST_FRAME_WORDS; i++) {
+            if (front[i] != frame) {
+                fprintf(stderr, "triple: torn frame %u, word %d is %u\n", frame, i, front[i]);
+                res = 1;
+                break;
+            }
+        }
+        if (0 != res) {
+            break;
+        }
+        if ((frame < last) || (fresh && (frame == last))) {
+            fprintf(stderr, "triple: frame %u%s after frame %u\n", frame, fresh ? " (fresh)" : "", last);
+            res = 1;
+            break;
+        }
+        num_fresh += fresh ? 1 : 0;
+        last = frame;
+        if (!fresh) {
+            sched_yield();
+        }
+    }
+    pthread_join(producer, 0);
+    if (0 == res) {
+        printf("triple: %u frames published, %llu seen, never torn or out of order\n",
+            TEST_TRIPLE_FRAMES, (unsigned long long)num_fresh);
+    }
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 2) {
+        if (0 == strcmp(argv[1], "ring")) {
+            return test_ring();
+        }
+        if (0 == strcmp(argv[1], "triple")) {
+            return test_triple();
+        }
+    }
+    fprintf(stderr, "usage: spsc_test ring | triple\n");
+    return 1;
+}
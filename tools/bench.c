@@ -0,0 +1,533 @@
+/*
+    gtkimone_bench: measure the emulation speed of the m6502 core, mem_t
+    and the kim1 system, and print the results as JSON
+
+    Usage:
+
+        gtkimone_bench [options]
+
+    Options:
+
+        -c CYCLES       number of emulated cycles per benchmark (default: 20000000)
+        -n RUNS         number of runs per benchmark, the fastest run is reported (default: 3)
+        -r002 FILE      6530-002 ROM image, enables the kim1 monitor benchmarks
+        -r003 FILE      6530-003 ROM image
+        -o FILE         write the JSON report to FILE instead of stdout
+
+    Each result has the number of emulated cycles (for the mem_t benchmarks:
+    memory accesses), the wall clock time of the fastest run, the emulated
+    clock frequency in MHz and the time per emulated cycle in nanoseconds.
+
+    The kim1 programs run without the ROMs by default (the reset vector is
+    patched to start the program), the monitor idle benchmarks run the
+    display/keyboard scan loop of the KIM-1 monitor and need both ROM images.
+    The 16_lanes benchmarks run 16 instances of the hex display program,
+    one after the other with kim1_exec() and together with the lockstep
+    runner (see systems/kim1_lockstep.h), the cycles are the sum over all
+    instances.
+
+    Configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers. By
+    default flat mode mem_t instances still read and write through the
+    page table, configure with -DMEM_FLAT=ON to measure the flat-only
+    mem_rd()/mem_wr() (see chips/mem.h), the paged mem_t benchmark is
+    skipped then.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/m6530.h"
+#include "chips/sched.h"
+#include "chips/clk.h"
+#include "systems/kim1_tape.h"
+#include "systems/kim1.h"
+#include "systems/kim1_lockstep.h"
+
+#define BENCH_MAX_RESULTS (24)
+#define BENCH_NUM_LANES (KIM1_LOCKSTEP_MAX_LANES)
+
+typedef struct {
+    const char* name;
+    uint64_t cycles;
+    double seconds;
+    uint32_t checksum;  // derived from the emulator state, so the work can't be optimized away
+} bench_result_t;
+
+typedef struct {
+    uint64_t cycles;
+    int runs;
+    chips_range_t rom_002;
+    chips_range_t rom_003;
+    int num_results;
+    bench_result_t results[BENCH_MAX_RESULTS];
+} bench_t;
+
+typedef uint64_t (*bench_func_t)(bench_t* b, uint32_t* checksum);
+
+/*
+    A loop which copies a page and adds 1 to each byte, for the raw CPU benchmarks:
+
+    0200 A2 00      LDX #$00
+    0202 BD 00 03   LDA $0300,X
+    0205 69 01      ADC #$01
+    0207 9D 00 04   STA $0400,X
+    020A E8         INX
+    020B D0 F5      BNE $0202
+    020D 4C 00 02   JMP $0200
+*/
+static const uint8_t prog_copy_loop[] = {
+    0xA2, 0x00, 0xBD, 0x00, 0x03, 0x69, 0x01, 0x9D, 0x00, 0x04, 0xE8, 0xD0, 0xF5, 0x4C, 0x00, 0x02,
+};
+
+/*
+    A display scan loop like the KIM-1 monitor's idle loop (SCAND/KEYIN),
+    writes the segments and digit select of 6 display digits to the
+    6530-002 ports, with a delay per digit, and reads the keyboard:
+
+    0200 A9 7F      LDA #$7F
+    0202 8D 41 17   STA $1741       ; PADD: segments are outputs
+    0205 A9 1E      LDA #$1E
+    0207 8D 43 17   STA $1743       ; PBDD: digit select are outputs
+    020A A0 00      LDY #$00
+    020C A2 09      LDX #$09
+    020E B9 40 02   LDA $0240,Y
+    0211 8D 40 17   STA $1740       ; segments
+    0214 8E 42 17   STX $1742       ; digit select
+    0217 A9 7F      LDA #$7F
+    0219 38         SEC
+    021A E9 01      SBC #$01
+    021C D0 FB      BNE $0219       ; delay
+    021E AD 40 17   LDA $1740       ; read keyboard
+    0221 8D 48 02   STA $0248
+    0224 E8         INX
+    0225 E8         INX
+    0226 C8         INY
+    0227 C0 06      CPY #$06
+    0229 D0 E3      BNE $020E
+    022B F0 DD      BEQ $020A
+    ...
+    0240            segment patterns for 6 digits
+*/
+static const uint8_t prog_scan_loop[] = {
+    0xA9, 0x7F, 0x8D, 0x41, 0x17, 0xA9, 0x1E, 0x8D, 0x43, 0x17, 0xA0, 0x00, 0xA2, 0x09, 0xB9, 0x40,
+    0x02, 0x8D, 0x40, 0x17, 0x8E, 0x42, 0x17, 0xA9, 0x7F, 0x38, 0xE9, 0x01, 0xD0, 0xFB, 0xAD, 0x40,
+    0x17, 0x8D, 0x48, 0x02, 0xE8, 0xE8, 0xC8, 0xC0, 0x06, 0xD0, 0xE3, 0xF0, 0xDD, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D,
+};
+
+/*
+    Convert a counter to two 7-segment digits (like the monitor's hex
+    display routine), and write them to the display buffer and port:
+
+    0200 A9 00      LDA #$00
+    0202 85 10      STA $10
+    0204 A5 10      LDA $10
+    0206 4A         LSR A
+    0207 4A         LSR A
+    0208 4A         LSR A
+    0209 4A         LSR A
+    020A AA         TAX
+    020B BD 40 02   LDA $0240,X
+    020E 85 F9      STA $F9
+    0210 8D 40 17   STA $1740
+    0213 A5 10      LDA $10
+    0215 29 0F      AND #$0F
+    0217 AA         TAX
+    0218 BD 40 02   LDA $0240,X
+    021B 85 FA      STA $FA
+    021D 8D 40 17   STA $1740
+    0220 E6 10      INC $10
+    0222 4C 04 02   JMP $0204
+    ...
+    0240            7-segment patterns for 0..F
+*/
+static const uint8_t prog_hex_display[] = {
+    0xA9, 0x00, 0x85, 0x10, 0xA5, 0x10, 0x4A, 0x4A, 0x4A, 0x4A, 0xAA, 0xBD, 0x40, 0x02, 0x85, 0xF9,
+    0x8D, 0x40, 0x17, 0xA5, 0x10, 0x29, 0x0F, 0xAA, 0xBD, 0x40, 0x02, 0x85, 0xFA, 0x8D, 0x40, 0x17,
+    0xE6, 0x10, 0x4C, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71,
+};
+
+static uint8_t flat_ram[1<<16];
+
+static uint32_t hash(const uint8_t* ptr, size_t num_bytes) {
+    uint32_t h = 0x811C9DC5;
+    for (size_t i = 0; i < num_bytes; i++) {
+        h = (h ^ ptr[i]) * 0x01000193;
+    }
+    return h;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void setup_flat_ram(void) {
+    memset(flat_ram, 0, sizeof(flat_ram));
+    memcpy(&flat_ram[0x0200], prog_copy_loop, sizeof(prog_copy_loop));
+    flat_ram[0xFFFC] = 0x00;
+    flat_ram[0xFFFD] = 0x02;
+}
+
+// raw m6502_tick() loop on a flat 64 KB array
+static uint64_t bench_m6502_tick(bench_t* b, uint32_t* checksum) {
+    setup_flat_ram();
+    m6502_t cpu;
+    uint64_t pins = m6502_init(&cpu, &(m6502_desc_t){0});
+    for (uint64_t i = 0; i < b->cycles; i++) {
+        pins = m6502_tick(&cpu, pins);
+        const uint16_t addr = M6502_GET_ADDR(pins);
+        if (pins & M6502_RW) {
+            M6502_SET_DATA(pins, flat_ram[addr]);
+        }
+        else {
+            flat_ram[addr] = M6502_GET_DATA(pins);
+        }
+    }
+    *checksum = hash(&flat_ram[0x0400], 0x100) ^ cpu.PC;
+    return b->cycles;
+}
+
+// m6502_exec_instr() through a flat mem_t
+static uint64_t bench_m6502_exec_instr(bench_t* b, uint32_t* checksum) {
+    setup_flat_ram();
+    mem_t mem;
+    mem_init(&mem);
+    mem_map_ram(&mem, 0, 0x0000, 0x10000, flat_ram);
+    mem_set_flat(&mem, flat_ram, 0x10000);
+    const m6502_bus_t bus = { .mem = &mem };
+    m6502_t cpu;
+    uint64_t pins = m6502_init(&cpu, &(m6502_desc_t){0});
+    uint64_t cycles = 0;
+    while (cycles < b->cycles) {
+        cycles += m6502_exec_instr(&cpu, &bus, &pins);
+    }
+    *checksum = hash(&flat_ram[0x0400], 0x100) ^ cpu.PC;
+    return cycles;
+}
+
+// m6502_exec_block() through a flat mem_t
+static uint64_t bench_m6502_exec_block(bench_t* b, uint32_t* checksum) {
+    setup_flat_ram();
+    mem_t mem;
+    mem_init(&mem);
+    mem_map_ram(&mem, 0, 0x0000, 0x10000, flat_ram);
+    mem_set_flat(&mem, flat_ram, 0x10000);
+    const m6502_bus_t bus = { .mem = &mem };
+    static m6502_block_cache_t cache;
+    m6502_block_cache_init(&cache, 0xFFFF, ~0ULL);
+    m6502_t cpu;
+    uint64_t pins = m6502_init(&cpu, &(m6502_desc_t){0});
+    uint64_t cycles = 0;
+    while (cycles < b->cycles) {
+        m6502_exec_block(&cpu, &cache, &bus, &pins, &cycles, b->cycles);
+    }
+    *checksum = hash(&flat_ram[0x0400], 0x100) ^ cpu.PC;
+    return cycles;
+}
+
+// mem_rd()/mem_wr() with pseudo-random addresses, one access corresponds to one cycle
+static uint64_t bench_mem(bench_t* b, uint32_t* checksum, bool flat) {
+    memset(flat_ram, 0, sizeof(flat_ram));
+    mem_t mem;
+    mem_init(&mem);
+    mem_map_ram(&mem, 0, 0x0000, 0x10000, flat_ram);
+    if (flat) {
+        mem_set_flat(&mem, flat_ram, 0x10000);
+    }
+    uint32_t lcg = 1;
+    uint8_t acc = 0;
+    for (uint64_t i = 0; i < b->cycles; i += 2) {
+        lcg = lcg * 1664525 + 1013904223;
+        const uint16_t addr = (uint16_t)(lcg >> 16);
+        acc += mem_rd(&mem, addr);
+        mem_wr(&mem, addr ^ 0x5555, acc);
+    }
+    *checksum = hash(flat_ram, sizeof(flat_ram));
+    return b->cycles;
+}
+
+#if !defined(MEM_FLAT)
+static uint64_t bench_mem_paged(bench_t* b, uint32_t* checksum) {
+    return bench_mem(b, checksum, false);
+}
+#endif
+
+static uint64_t bench_mem_flat(bench_t* b, uint32_t* checksum) {
+    return bench_mem(b, checksum, true);
+}
+
+// run a KIM-1 program with kim1_exec() in 60 Hz frame slices
+static uint64_t bench_kim1(bench_t* b, uint32_t* checksum, const uint8_t* prog, size_t prog_size, bool instr_stepped, bool block_cache) {
+    static kim1_t sys;
+    kim1_init(&sys, &(kim1_desc_t){
+        .instr_stepped = instr_stepped,
+        .block_cache = block_cache,
+        .roms = {
+            .rom_002 = b->rom_002,
+            .rom_003 = b->rom_003,
+        }
+    });
+    if (prog) {
+        mem_write_range(&sys.mem, 0x0200, prog, (uint32_t)prog_size);
+        sys.rom_002[0x3FC] = 0x00;
+        sys.rom_002[0x3FD] = 0x02;
+    }
+    const uint32_t frame_us = 1000000 / 60;
+    uint64_t cycles = 0;
+    while (cycles < b->cycles) {
+        cycles += kim1_exec(&sys, frame_us);
+    }
+    *checksum = hash(sys.ram, sizeof(sys.ram)) ^ sys.cpu.PC;
+    kim1_discard(&sys);
+    return cycles;
+}
+
+static uint64_t bench_kim1_scan_cycle(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_scan_loop, sizeof(prog_scan_loop), false, false);
+}
+
+static uint64_t bench_kim1_scan_instr(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_scan_loop, sizeof(prog_scan_loop), true, false);
+}
+
+static uint64_t bench_kim1_scan_block(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_scan_loop, sizeof(prog_scan_loop), true, true);
+}
+
+static uint64_t bench_kim1_hex_cycle(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_hex_display, sizeof(prog_hex_display), false, false);
+}
+
+static uint64_t bench_kim1_hex_instr(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_hex_display, sizeof(prog_hex_display), true, false);
+}
+
+static uint64_t bench_kim1_hex_block(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, prog_hex_display, sizeof(prog_hex_display), true, true);
+}
+
+static uint64_t bench_kim1_monitor_cycle(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, 0, 0, false, false);
+}
+
+static uint64_t bench_kim1_monitor_instr(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, 0, 0, true, false);
+}
+
+static uint64_t bench_kim1_monitor_block(bench_t* b, uint32_t* checksum) {
+    return bench_kim1(b, checksum, 0, 0, true, true);
+}
+
+/*
+    The same program in BENCH_NUM_LANES instances, each with a different
+    start value: with kim1_exec() one instance after the other, and with
+    the lockstep runner. The cycles are the sum over all instances.
+*/
+static kim1_t lanes[BENCH_NUM_LANES];
+
+static void init_lanes(bench_t* b, const uint8_t* prog, size_t prog_size) {
+    for (int i = 0; i < BENCH_NUM_LANES; i++) {
+        kim1_init(&lanes[i], &(kim1_desc_t){
+            .instr_stepped = true,
+            .roms = {
+                .rom_002 = b->rom_002,
+                .rom_003 = b->rom_003,
+            }
+        });
+        mem_write_range(&lanes[i].mem, 0x0200, prog, (uint32_t)prog_size);
+        mem_wr(&lanes[i].mem, 0x0201, (uint8_t)(i * 16));     // LDA #$00 at 0200
+        lanes[i].rom_002[0x3FC] = 0x00;
+        lanes[i].rom_002[0x3FD] = 0x02;
+    }
+}
+
+static uint32_t discard_lanes(void) {
+    uint32_t checksum = 0;
+    for (int i = 0; i < BENCH_NUM_LANES; i++) {
+        checksum ^= hash(lanes[i].ram, sizeof(lanes[i].ram)) ^ lanes[i].cpu.PC;
+        kim1_discard(&lanes[i]);
+    }
+    return checksum;
+}
+
+static uint64_t bench_kim1_hex_lanes_exec(bench_t* b, uint32_t* checksum) {
+    init_lanes(b, prog_hex_display, sizeof(prog_hex_display));
+    const uint32_t frame_us = 1000000 / 60;
+    uint64_t cycles = 0;
+    for (int i = 0; i < BENCH_NUM_LANES; i++) {
+        uint64_t lane_cycles = 0;
+        while (lane_cycles < (b->cycles / BENCH_NUM_LANES)) {
+            lane_cycles += kim1_exec(&lanes[i], frame_us);
+        }
+        cycles += lane_cycles;
+    }
+    *checksum = discard_lanes();
+    return cycles;
+}
+
+static uint64_t bench_kim1_hex_lanes_lockstep(bench_t* b, uint32_t* checksum) {
+    static kim1_lockstep_t ls;
+    init_lanes(b, prog_hex_display, sizeof(prog_hex_display));
+    kim1_lockstep_desc_t desc = { .num_lanes = BENCH_NUM_LANES };
+    for (int i = 0; i < BENCH_NUM_LANES; i++) {
+        desc.lanes[i] = &lanes[i];
+    }
+    kim1_lockstep_init(&ls, &desc);
+    uint64_t cycles = 0;
+    while (cycles < b->cycles) {
+        kim1_lockstep_run(&ls, 10000);
+        cycles = 0;
+        for (int i = 0; i < BENCH_NUM_LANES; i++) {
+            cycles += lanes[i].ticks;
+        }
+    }
+    *checksum = discard_lanes();
+    return cycles;
+}
+
+static void run(bench_t* b, const char* name, bench_func_t func) {
+    CHIPS_ASSERT(b->num_results < BENCH_MAX_RESULTS);
+    bench_result_t* res = &b->results[b->num_results++];
+    res->name = name;
+    res->seconds = 0.0;
+    for (int i = 0; i < b->runs; i++) {
+        uint32_t checksum = 0;
+        const double t0 = now();
+        const uint64_t cycles = func(b, &checksum);
+        const double secs = now() - t0;
+        if ((i == 0) || (secs < res->seconds)) {
+            res->seconds = secs;
+            res->cycles = cycles;
+            res->checksum = checksum;
+        }
+    }
+}
+
+static void print_json(const bench_t* b, FILE* fp) {
+    fprintf(fp, "{\n  \"benchmark\": \"gtkimone_bench\",\n  \"runs\": %d,\n  \"results\": [\n", b->runs);
+    for (int i = 0; i < b->num_results; i++) {
+        const bench_result_t* r = &b->results[i];
+        const double mhz = (r->seconds > 0.0) ? ((double)r->cycles / r->seconds * 1e-6) : 0.0;
+        const double ns = (r->cycles > 0) ? (r->seconds * 1e9 / (double)r->cycles) : 0.0;
+        fprintf(fp, "    { \"name\": \"%s\", \"cycles\": %llu, \"seconds\": %.6f, \"mhz\": %.3f, \"ns_per_cycle\": %.3f, \"checksum\": \"%08X\" }%s\n",
+            r->name, (unsigned long long)r->cycles, r->seconds, mhz, ns, r->checksum,
+            (i + 1 < b->num_results) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static chips_range_t load_file(const char* path) {
+    chips_range_t range = {0};
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        return range;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size > 0) {
+        void* ptr = malloc((size_t)size);
+        if (ptr && (fread(ptr, 1, (size_t)size, fp) == (size_t)size)) {
+            range.ptr = ptr;
+            range.size = (size_t)size;
+        }
+        else {
+            free(ptr);
+        }
+    }
+    fclose(fp);
+    return range;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gtkimone_bench [-c cycles] [-n runs] [-r002 rom] [-r003 rom] [-o file]\n");
+}
+
+int main(int argc, char* argv[]) {
+    static bench_t b;
+    b.cycles = 20000000;
+    b.runs = 3;
+    const char* out_path = 0;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if ((0 == strcmp(arg, "-c")) && (i + 1 < argc)) {
+            b.cycles = strtoull(argv[++i], 0, 10);
+        }
+        else if ((0 == strcmp(arg, "-n")) && (i + 1 < argc)) {
+            b.runs = atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(arg, "-o")) && (i + 1 < argc)) {
+            out_path = argv[++i];
+        }
+        else if ((0 == strcmp(arg, "-r002") || 0 == strcmp(arg, "-r003")) && (i + 1 < argc)) {
+            chips_range_t rom = load_file(argv[i + 1]);
+            if (rom.size != 0x400) {
+                fprintf(stderr, "gtkimone_bench: '%s' is not a 1 KB ROM image\n", argv[i + 1]);
+                return 10;
+            }
+            if (0 == strcmp(arg, "-r002")) {
+                b.rom_002 = rom;
+            }
+            else {
+                b.rom_003 = rom;
+            }
+            i++;
+        }
+        else {
+            usage();
+            return 10;
+        }
+    }
+    if ((b.cycles == 0) || (b.runs < 1)) {
+        usage();
+        return 10;
+    }
+
+    run(&b, "m6502_tick/flat_ram_loop", bench_m6502_tick);
+    run(&b, "m6502_exec_instr/flat_ram_loop", bench_m6502_exec_instr);
+    run(&b, "m6502_exec_block/flat_ram_loop", bench_m6502_exec_block);
+    #if !defined(MEM_FLAT)
+    run(&b, "mem_rd_wr/paged", bench_mem_paged);
+    #endif
+    run(&b, "mem_rd_wr/flat", bench_mem_flat);
+    run(&b, "kim1_exec/scan_loop/cycle", bench_kim1_scan_cycle);
+    run(&b, "kim1_exec/scan_loop/instr", bench_kim1_scan_instr);
+    run(&b, "kim1_exec/scan_loop/block", bench_kim1_scan_block);
+    run(&b, "kim1_exec/hex_display/cycle", bench_kim1_hex_cycle);
+    run(&b, "kim1_exec/hex_display/instr", bench_kim1_hex_instr);
+    run(&b, "kim1_exec/hex_display/block", bench_kim1_hex_block);
+    run(&b, "kim1_exec/hex_display/16_lanes", bench_kim1_hex_lanes_exec);
+    run(&b, "kim1_lockstep/hex_display/16_lanes", bench_kim1_hex_lanes_lockstep);
+    if (b.rom_002.ptr && b.rom_003.ptr) {
+        run(&b, "kim1_exec/monitor_idle/cycle", bench_kim1_monitor_cycle);
+        run(&b, "kim1_exec/monitor_idle/instr", bench_kim1_monitor_instr);
+        run(&b, "kim1_exec/monitor_idle/block", bench_kim1_monitor_block);
+    }
+
+    FILE* fp = stdout;
+    if (out_path) {
+        fp = fopen(out_path, "w");
+        if (!fp) {
+            fprintf(stderr, "gtkimone_bench: failed to open '%s'\n", out_path);
+            return 10;
+        }
+    }
+    print_json(&b, fp);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    free((void*)b.rom_002.ptr);
+    free((void*)b.rom_003.ptr);
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+    gtkimone_headless: run a single KIM-1 program without a display, and
+    stream its teletype output to stdout
+
+    Usage:
+
+        gtkimone_headless [options] [program.bin[@load[,start]]]
+
+    The load and start addresses are hex, the default load address is
+    0200, and the start address defaults to the load address. Programs
+    ending in .ptp are KIM-1 paper tapes, which have their own load
+    addresses (the start address still defaults to 0200). The program is
+    started by patching the reset vector, without a program (or with -m)
+    the KIM-1 starts through the reset vector of the 6530-002 ROM.
+
+    Options:
+
+        -t TICKS        cycle budget, 0 for no limit (default: 10000000)
+        -b ADDR         stop before the instruction at ADDR (hex, can be repeated)
+        -r002 FILE      6530-002 ROM image
+        -r003 FILE      6530-003 ROM image
+        -m              start the monitor, not the program (needs the ROM images)
+        -tty            close the TTY jumper, GETCH/OUTCH move whole bytes
+        -i FILE         send FILE ('-' for stdin) to the TTY input
+        -d ADDR[,LEN]   dump LEN bytes (hex, default: 100) of memory at ADDR at the end (can be repeated)
+        -x              run cycle-stepped, instead of instruction-stepped with block cache and idle skip
+        -s SPEED        0: run unthrottled (default), 1: run in real time, N: run at N times real time
+
+    The TTY output is collected after each time slice, and written in
+    large blocks through a fully buffered stdout (when running throttled
+    with -s, stdout is flushed after each slice with output). At the end, a report
+    with the stop reason and the CPU registers, and the memory dumps are
+    printed (lines starting with '#' are comments).
+
+    The run ends at a breakpoint, when the CPU is caught in a 'JMP *',
+    or when the cycle budget is used up. The exit code is 0 for a
+    breakpoint or 'JMP *', 1 if the budget was used up.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/m6530.h"
+#include "chips/sched.h"
+#include "chips/clk.h"
+#include "systems/kim1_tape.h"
+#include "systems/kim1.h"
+#include "systems/kim1_image.h"
+
+#define HEADLESS_MAX_DUMPS (16)
+// OUTCH is trapped in a few cycles, so with the TTY, the slices must be short enough to not overflow the TTY FIFO
+#define HEADLESS_SLICE_TICKS (100000)
+#define HEADLESS_TTY_SLICE_TICKS (1000)
+
+static kim1_images_t images;
+static kim1_t sys;
+static kim1_breakpoints_t bp;
+static char stdout_buf[1 << 16];
+
+typedef struct {
+    uint16_t addr;
+    uint32_t size;
+} dump_t;
+
+static bool is_ptp(const char* path) {
+    const size_t len = strlen(path);
+    return (len > 4) && ((0 == strcmp(path + len - 4, ".ptp")) || (0 == strcmp(path + len - 4, ".PTP")));
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gtkimone_headless [-t ticks] [-b addr] [-r002 rom] [-r003 rom] [-m] [-tty] [-i file] [-d addr[,len]] [-x] [-s speed] [program.bin[@load[,start]]]\n");
+}
+
+// read a whole file (or stdin) into allocated memory
+static bool read_file(const char* path, chips_range_t* out) {
+    FILE* fp = (0 == strcmp(path, "-")) ? stdin : fopen(path, "rb");
+    if (0 == fp) {
+        return false;
+    }
+    size_t size = 0;
+    size_t cap = 1 << 12;
+    uint8_t* ptr = malloc(cap);
+    size_t n;
+    while ((n = fread(ptr + size, 1, cap - size, fp)) > 0) {
+        size += n;
+        if (size == cap) {
+            cap *= 2;
+            ptr = realloc(ptr, cap);
+        }
+    }
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    *out = (chips_range_t){ .ptr = ptr, .size = size };
+    return true;
+}
+
+// check if the CPU is at the start of a 'JMP *' instruction
+static bool is_trapped(kim1_t* sys) {
+    if (0 == (sys->pins & M6502_SYNC)) {
+        return false;
+    }
+    const uint16_t pc = M6502_GET_ADDR(sys->pins);
+    return (mem_rd(&sys->mem, pc) == 0x4C) && (mem_rd16(&sys->mem, pc + 1) == pc);
+}
+
+// move the TTY output into stdout, returns the number of bytes, and keeps track of the last byte
+static uint32_t drain_tty(kim1_t* sys, int* last) {
+    uint8_t buf[KIM1_TTY_FIFO_SIZE];
+    uint32_t total = 0;
+    uint32_t n;
+    while ((n = kim1_tty_get(sys, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, n, stdout);
+        *last = buf[n - 1];
+        total += n;
+    }
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t max_ticks = 10000000;
+    bool monitor = false;
+    bool tty = false;
+    bool cycle_stepped = false;
+    bool use_breakpoints = false;
+    uint32_t speed = 0;
+    const char* input_path = 0;
+    const char* prog_arg = 0;
+    const kim1_image_t* roms[2] = {0};
+    dump_t dumps[HEADLESS_MAX_DUMPS];
+    int num_dumps = 0;
+    kim1_images_init(&images);
+    kim1_breakpoints_init(&bp);
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if ((0 == strcmp(arg, "-t")) && (i + 1 < argc)) {
+            max_ticks = strtoull(argv[++i], 0, 10);
+        }
+        else if ((0 == strcmp(arg, "-b")) && (i + 1 < argc)) {
+            kim1_add_breakpoint(&bp, (uint16_t) strtoul(argv[++i], 0, 16));
+            use_breakpoints = true;
+        }
+        else if ((0 == strcmp(arg, "-r002") || 0 == strcmp(arg, "-r003")) && (i + 1 < argc)) {
+            const int r = (0 == strcmp(arg, "-r002")) ? 0 : 1;
+            if (roms[r]) {
+                kim1_image_release(&images, roms[r]);
+            }
+            roms[r] = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = argv[i + 1] });
+            if (!roms[r] || (roms[r]->data.size != 0x400)) {
+                fprintf(stderr, "gtkimone_headless: '%s' is not a 1 KB ROM image\n", argv[i + 1]);
+                return 10;
+            }
+            i++;
+        }
+        else if (0 == strcmp(arg, "-m")) {
+            monitor = true;
+        }
+        else if (0 == strcmp(arg, "-tty")) {
+            tty = true;
+        }
+        else if ((0 == strcmp(arg, "-i")) && (i + 1 < argc)) {
+            input_path = argv[++i];
+        }
+        else if ((0 == strcmp(arg, "-d")) && (i + 1 < argc)) {
+            if (num_dumps == HEADLESS_MAX_DUMPS) {
+                fprintf(stderr, "gtkimone_headless: too many memory dumps\n");
+                return 10;
+            }
+            char* end;
+            const unsigned long addr = strtoul(argv[++i], &end, 16);
+            const unsigned long size = (*end == ',') ? strtoul(end + 1, 0, 16) : 0x100;
+            dumps[num_dumps++] = (dump_t){ .addr = (uint16_t)addr, .size = (uint32_t)((size <= 0x10000) ? size : 0x10000) };
+        }
+        else if (0 == strcmp(arg, "-x")) {
+            cycle_stepped = true;
+        }
+        else if ((0 == strcmp(arg, "-s")) && (i + 1 < argc)) {
+            speed = (uint32_t) strtoul(argv[++i], 0, 10);
+        }
+        else if ((arg[0] == '-') || prog_arg) {
+            usage();
+            return 10;
+        }
+        else {
+            prog_arg = arg;
+        }
+    }
+    if (!prog_arg && !(roms[0] && roms[1])) {
+        usage();
+        return 10;
+    }
+
+    kim1_init(&sys, &(kim1_desc_t){
+        .instr_stepped = !cycle_stepped,
+        .idle_skip = !cycle_stepped,
+        .block_cache = !cycle_stepped,
+        .tty = { .enabled = tty, .trap = tty },
+        .roms = {
+            .rom_002 = roms[0] ? roms[0]->data : (chips_range_t){0},
+            .rom_003 = roms[1] ? roms[1]->data : (chips_range_t){0},
+        },
+    });
+
+    const kim1_image_t* prog = 0;
+    if (prog_arg) {
+        // program.bin[@load[,start]]
+        char* name = strdup(prog_arg);
+        unsigned int load_addr = 0x0200;
+        unsigned int start_addr = 0;
+        char* at = strrchr(name, '@');
+        if (at) {
+            *at++ = 0;
+            char* comma = strchr(at, ',');
+            if (comma) {
+                *comma++ = 0;
+                start_addr = (unsigned int) strtoul(comma, 0, 16);
+            }
+            load_addr = (unsigned int) strtoul(at, 0, 16);
+        }
+        if (0 == start_addr) {
+            start_addr = load_addr;
+        }
+        const bool ptp = is_ptp(name);
+        prog = kim1_image_acquire(&images, &(kim1_image_desc_t){
+            .path = name,
+            .type = ptp ? KIM1_IMAGE_PTP : KIM1_IMAGE_FILE,
+        });
+        if (0 == prog) {
+            fprintf(stderr, "gtkimone_headless: failed to load '%s'\n", name);
+            return 10;
+        }
+        // a paper tape is loaded as the RAM range it was decoded into
+        if (ptp) {
+            mem_write_range(&sys.mem, prog->first_addr, (const uint8_t*)prog->ram.ptr + prog->first_addr, (uint32_t)(prog->end_addr - prog->first_addr));
+        }
+        else {
+            mem_write_range(&sys.mem, (uint16_t)load_addr, (const uint8_t*)prog->data.ptr, (uint32_t)prog->data.size);
+        }
+        if (!monitor) {
+            // patch the reset vector in the private ROM copy
+            sys.rom_002[0x3FC] = (uint8_t)start_addr;
+            sys.rom_002[0x3FD] = (uint8_t)(start_addr >> 8);
+        }
+        free(name);
+    }
+    chips_range_t input = {0};
+    if (input_path && !read_file(input_path, &input)) {
+        fprintf(stderr, "gtkimone_headless: failed to read '%s'\n", input_path);
+        return 10;
+    }
+    size_t input_pos = 0;
+
+    setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+    // NOTE: KIM1_FREQUENCY is 1 MHz, so ticks are microseconds
+    clk_pacer_t pacer;
+    clk_pacer_init(&pacer, &(clk_pacer_desc_t){
+        .freq_hz = KIM1_FREQUENCY,
+        .mode = (0 == speed) ? CLK_PACE_TURBO : ((1 == speed) ? CLK_PACE_REALTIME : CLK_PACE_MULTIPLE),
+        .multiple = speed,
+        .slice_us = tty ? HEADLESS_TTY_SLICE_TICKS : HEADLESS_SLICE_TICKS,
+    });
+    const char* status = "timeout";
+    int last = '\n';
+    while ((0 == max_ticks) || (sys.ticks < max_ticks)) {
+        if (input_pos < input.size) {
+            input_pos += kim1_tty_put(&sys, (const uint8_t*)input.ptr + input_pos, (uint32_t)(input.size - input_pos));
+        }
+        uint64_t slice = clk_pacer_next(&pacer);
+        if ((0 != max_ticks) && (slice > (max_ticks - sys.ticks))) {
+            slice = max_ticks - sys.ticks;
+        }
+        const uint64_t start_tick = sys.ticks;
+        bool stopped = false;
+        if (use_breakpoints) {
+            stopped = KIM1_STOP_BREAKPOINT == kim1_run_until(&sys, &bp, slice).reason;
+        }
+        else {
+            kim1_exec(&sys, (uint32_t)slice);
+        }
+        clk_pacer_done(&pacer, (uint32_t)(sys.ticks - start_tick));
+        if ((drain_tty(&sys, &last) > 0) && (0 != speed)) {
+            fflush(stdout);
+        }
+        if (stopped) {
+            status = "break";
+            break;
+        }
+        if (is_trapped(&sys)) {
+            status = "trapped";
+            break;
+        }
+    }
+    drain_tty(&sys, &last);
+    if (last != '\n') {
+        fputc('\n', stdout);
+    }
+
+    const uint16_t pc = (sys.pins & M6502_SYNC) ? M6502_GET_ADDR(sys.pins) : sys.cpu.PC;
+    printf("# %-8s %12s %4s %2s %2s %2s %2s %2s\n", "status", "ticks", "pc", "a", "x", "y", "s", "p");
+    printf("%-10s %12llu %04X %02X %02X %02X %02X %02X\n",
+        status, (unsigned long long)sys.ticks, pc, sys.cpu.A, sys.cpu.X, sys.cpu.Y, sys.cpu.S, sys.cpu.P);
+    for (int i = 0; i < num_dumps; i++) {
+        printf("# memory %04X..%04X\n", dumps[i].addr, (dumps[i].addr + dumps[i].size - 1) & 0xFFFF);
+        for (uint32_t offset = 0; offset < dumps[i].size; offset += 16) {
+            const uint16_t addr = (uint16_t)(dumps[i].addr + offset);
+            printf("%04X:", addr);
+            for (uint32_t j = offset; (j < offset + 16) && (j < dumps[i].size); j++) {
+                printf(" %02X", mem_rd(&sys.mem, (uint16_t)(dumps[i].addr + j)));
+            }
+            putchar('\n');
+        }
+    }
+    fflush(stdout);
+
+    kim1_discard(&sys);
+    if (prog) {
+        kim1_image_release(&images, prog);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (roms[i]) {
+            kim1_image_release(&images, roms[i]);
+        }
+    }
+    kim1_images_discard(&images);
+    free(input.ptr);
+    return (0 == strcmp(status, "timeout")) ? 1 : 0;
+}
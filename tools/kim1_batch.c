@@ -0,0 +1,189 @@
+/*
+    kim1_batch: run many KIM-1 programs in parallel and print a report
+
+    Usage:
+
+        kim1_batch [options] program.bin[@load[,start]] ...
+
+    The load and start addresses are hex, the default load address is
+    0200, and the start address defaults to the load address. Programs
+    ending in .ptp are KIM-1 paper tapes, which have their own load
+    addresses (the start address still defaults to 0200). All files are
+    memory-mapped once, no matter how often they appear.
+
+    Options:
+
+        -j N            number of worker threads (default: number of CPU cores)
+        -t TICKS        maximum number of ticks per program (default: 10000000)
+        -r002 FILE      6530-002 ROM image for all programs
+        -r003 FILE      6530-003 ROM image for all programs
+
+    The exit code is 0 if all programs ended in a 'JMP *' trap, and 1 if
+    any program ran into the tick limit.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/mem.h"
+#include "chips/m6502.h"
+#include "chips/m6530.h"
+#include "chips/sched.h"
+#include "chips/clk.h"
+#include "systems/kim1_tape.h"
+#include "systems/kim1.h"
+#include "systems/kim1_batch.h"
+#include "systems/kim1_image.h"
+
+static kim1_images_t images;
+
+static bool is_ptp(const char* path) {
+    const size_t len = strlen(path);
+    return (len > 4) && ((0 == strcmp(path + len - 4, ".ptp")) || (0 == strcmp(path + len - 4, ".PTP")));
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: kim1_batch [-j threads] [-t max_ticks] [-r002 rom] [-r003 rom] program.bin[@load[,start]] ...\n");
+}
+
+int main(int argc, char* argv[]) {
+    int num_threads = 0;
+    uint64_t max_ticks = 10000000;
+    chips_range_t rom_002 = {0};
+    chips_range_t rom_003 = {0};
+    kim1_batch_job_t* jobs = calloc((size_t)argc, sizeof(kim1_batch_job_t));
+    char** names = calloc((size_t)argc, sizeof(char*));
+    const kim1_image_t** progs = calloc((size_t)argc, sizeof(kim1_image_t*));
+    const kim1_image_t* roms[2] = {0};
+    int num_jobs = 0;
+    kim1_images_init(&images);
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if ((0 == strcmp(arg, "-j")) && (i + 1 < argc)) {
+            num_threads = atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(arg, "-t")) && (i + 1 < argc)) {
+            max_ticks = strtoull(argv[++i], 0, 10);
+        }
+        else if ((0 == strcmp(arg, "-r002") || 0 == strcmp(arg, "-r003")) && (i + 1 < argc)) {
+            const int r = (0 == strcmp(arg, "-r002")) ? 0 : 1;
+            if (roms[r]) {
+                kim1_image_release(&images, roms[r]);
+            }
+            roms[r] = kim1_image_acquire(&images, &(kim1_image_desc_t){ .path = argv[i + 1] });
+            if (!roms[r] || (roms[r]->data.size != 0x400)) {
+                fprintf(stderr, "kim1_batch: '%s' is not a 1 KB ROM image\n", argv[i + 1]);
+                return 10;
+            }
+            if (r == 0) {
+                rom_002 = roms[r]->data;
+            }
+            else {
+                rom_003 = roms[r]->data;
+            }
+            i++;
+        }
+        else if (arg[0] == '-') {
+            usage();
+            return 10;
+        }
+        else {
+            // program.bin[@load[,start]]
+            char* name = strdup(arg);
+            unsigned int load_addr = 0x0200;
+            unsigned int start_addr = 0;
+            char* at = strrchr(name, '@');
+            if (at) {
+                *at++ = 0;
+                char* comma = strchr(at, ',');
+                if (comma) {
+                    *comma++ = 0;
+                    start_addr = (unsigned int) strtoul(comma, 0, 16);
+                }
+                load_addr = (unsigned int) strtoul(at, 0, 16);
+            }
+            if (0 == start_addr) {
+                start_addr = load_addr;
+            }
+            const bool ptp = is_ptp(name);
+            const kim1_image_t* prog = kim1_image_acquire(&images, &(kim1_image_desc_t){
+                .path = name,
+                .type = ptp ? KIM1_IMAGE_PTP : KIM1_IMAGE_FILE,
+            });
+            if (0 == prog) {
+                fprintf(stderr, "kim1_batch: failed to load '%s'\n", name);
+                return 10;
+            }
+            names[num_jobs] = name;
+            progs[num_jobs] = prog;
+            // a paper tape is loaded as the RAM range it was decoded into
+            jobs[num_jobs++] = (kim1_batch_job_t){
+                .name = name,
+                .program = ptp ? (chips_range_t){
+                    .ptr = (uint8_t*)prog->ram.ptr + prog->first_addr,
+                    .size = (size_t)(prog->end_addr - prog->first_addr),
+                } : prog->data,
+                .load_addr = ptp ? prog->first_addr : (uint16_t)load_addr,
+                .start_addr = (uint16_t)start_addr,
+                .max_ticks = max_ticks,
+            };
+        }
+    }
+    if (0 == num_jobs) {
+        usage();
+        return 10;
+    }
+    // the ROM and max_ticks options apply to all programs, no matter where they appear
+    for (int i = 0; i < num_jobs; i++) {
+        jobs[i].rom_002 = rom_002;
+        jobs[i].rom_003 = rom_003;
+        jobs[i].max_ticks = max_ticks;
+    }
+
+    kim1_batch_result_t* results = calloc((size_t)num_jobs, sizeof(kim1_batch_result_t));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const kim1_batch_summary_t summary = kim1_batch_run(&(kim1_batch_desc_t){
+        .jobs = jobs,
+        .results = results,
+        .num_jobs = num_jobs,
+        .num_threads = num_threads,
+    });
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    const double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+    printf("# %-30s %-8s %12s %4s %2s %2s %2s %2s %2s %8s\n", "program", "status", "ticks", "pc", "a", "x", "y", "s", "p", "ram");
+    for (int i = 0; i < num_jobs; i++) {
+        const kim1_batch_result_t* r = &results[i];
+        printf("%-32s %-8s %12llu %04X %02X %02X %02X %02X %02X %08X\n",
+            jobs[i].name,
+            (r->status == KIM1_BATCH_TRAPPED) ? "trapped" : "timeout",
+            (unsigned long long)r->ticks,
+            r->pc, r->a, r->x, r->y, r->s, r->p, r->ram_hash);
+    }
+    printf("# %d programs, %d trapped, %d timeout, %d threads, %d stolen, %llu ticks in %.3f s (%.1f MHz)\n",
+        num_jobs, summary.num_trapped, summary.num_timeout, summary.num_threads, summary.num_stolen,
+        (unsigned long long)summary.total_ticks, secs,
+        (secs > 0.0) ? ((double)summary.total_ticks / secs * 1e-6) : 0.0);
+
+    for (int i = 0; i < num_jobs; i++) {
+        kim1_image_release(&images, progs[i]);
+        free(names[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (roms[i]) {
+            kim1_image_release(&images, roms[i]);
+        }
+    }
+    kim1_images_discard(&images);
+    free(results);
+    free(progs);
+    free(names);
+    free(jobs);
+    return (summary.num_timeout == 0) ? 0 : 1;
+}